@@ -0,0 +1,192 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file fanout.c
+ *      @brief Test harness and benchmark of reading a source once for several sinks
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      fanout [ROWS]
+ *          Fan a source of ROWS (by default 1000000) rows out to one sink reading every row, then
+ *          to it alongside a sink which stops early with an error, as one failing would. Fails
+ *          unless the reading sink still reads every row, and each sink is left with its own
+ *          status. Then fans the source out only to sinks which stop early, failing unless it
+ *          stops being read within the rows the sinks' queues hold. Reports the rows per second
+ *          of each.
+ */
+
+#include "barcodeui.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXAMPLE_DEFAULT_ROWS 1000000
+#define EXAMPLE_STOP_ROWS 1000
+#define EXAMPLE_CODE_FORMAT "FAN-%08ld"
+#define EXAMPLE_CODE_LEN 32
+// Rows which may be read after every sink has stopped: those queued, and one block being filled
+#define EXAMPLE_MAX_UNREAD ((BK_FANOUT_QUEUE_BLOCKS + 2) * BK_FANOUT_BLOCK_ROWS)
+
+typedef struct Rows {
+    long rows;
+    long row;
+    char code[EXAMPLE_CODE_LEN];
+} Rows;
+
+static int rows_next(void * ctx, const char ** barcode, int * quantity) {
+    Rows * rows = ctx;
+
+    if (rows->row == rows->rows) {
+        return BK_SOURCE_END;
+    }
+    snprintf(rows->code, sizeof rows->code, EXAMPLE_CODE_FORMAT, rows->row++);
+
+    *barcode  = rows->code;
+    *quantity = 1;
+    return SUCCESS;
+}
+
+/*      @brief A sink counting the rows it reads, stopping with an error after @c stop if not 0 */
+typedef struct Counter {
+    long read;
+    long stop;
+} Counter;
+
+static int counting_generate(void * ctx, BKSource * source) {
+    Counter *    counter = ctx;
+    const char * barcode;
+    int          quantity, status;
+
+    while (SUCCESS == (status = source->next(source->ctx, &barcode, &quantity))) {
+        if (++counter->read == counter->stop) {
+            return ERR_CANCELLED;
+        }
+    }
+
+    return status;
+}
+
+/**
+ *      @brief Fan @c rows rows out to the counters, returning the rows read from the source
+ *      @param stops Whether each counter stops early
+ */
+// clang-format off
+static long run(
+    const char * name,
+    long rows,
+    Counter * counters,
+    const bool * stops,
+    BKFanoutSink * sinks,
+    int num_sinks,
+    int * status
+) {
+    // clang-format on
+    Rows     source_rows = { rows, 0, "" };
+    BKSource source      = { rows_next, &source_rows };
+
+    for (int i = 0; i < num_sinks; i++) {
+        counters[i].read  = 0;
+        counters[i].stop  = stops[i] ? EXAMPLE_STOP_ROWS : 0;
+        sinks[i].generate = counting_generate;
+        sinks[i].ctx      = &counters[i];
+    }
+
+    uint64_t start = bk_clock_ns();
+    *status        = bk_fanout(&source, sinks, num_sinks);
+
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    if (SUCCESS != *status) {
+        fprintf(stderr, "fanout: %s: error %d\n", name, *status);
+        return source_rows.row;
+    }
+    printf("%-22s %ld of %ld rows read in %.1f ms, %.0f rows/s\n",
+           name,
+           source_rows.row,
+           rows,
+           elapsed_ms,
+           source_rows.row / (elapsed_ms / 1e3));
+    return source_rows.row;
+}
+
+/*      @brief Whether each sink read what it should, and was left with the status it should be */
+// clang-format off
+static int check_sinks(
+    const char * name,
+    long rows,
+    const Counter * counters,
+    const BKFanoutSink * sinks,
+    int num_sinks
+) {
+    // clang-format on
+    for (int i = 0; i < num_sinks; i++) {
+        bool stops    = 0 != counters[i].stop;
+        long expected = stops ? EXAMPLE_STOP_ROWS : rows;
+        int  status   = stops ? ERR_CANCELLED : BK_SOURCE_END;
+
+        if (counters[i].read != expected || sinks[i].status != status) {
+            fprintf(stderr,
+                    "fanout: %s: sink %d read %ld rows with status %d, expected %ld with %d\n",
+                    name,
+                    i,
+                    counters[i].read,
+                    sinks[i].status,
+                    expected,
+                    status);
+            return ERR_GENERIC;
+        }
+    }
+
+    return SUCCESS;
+}
+
+int main(int argc, char ** argv) {
+    long         rows = argc > 1 ? atol(argv[1]) : EXAMPLE_DEFAULT_ROWS;
+    Counter      counters[2];
+    BKFanoutSink sinks[2];
+    int          status;
+
+    if (rows <= EXAMPLE_STOP_ROWS + EXAMPLE_MAX_UNREAD) {
+        fprintf(stderr,
+                "Usage: %s [ROWS], of more than %d\n",
+                argv[0],
+                EXAMPLE_STOP_ROWS + EXAMPLE_MAX_UNREAD);
+        return EXIT_FAILURE;
+    }
+
+    const bool reading[] = { false }, one_stopping[] = { false, true }, stopping[] = { true, true };
+    long       read;
+
+    run("One sink", rows, counters, reading, sinks, 1, &status);
+    if (SUCCESS == status) {
+        status = check_sinks("One sink", rows, counters, sinks, 1);
+    }
+
+    // The sink which stops is handed no more blocks, and does not hold up the other
+    if (SUCCESS == status) {
+        run("One sink stopping", rows, counters, one_stopping, sinks, 2, &status);
+        if (SUCCESS == status) {
+            status = check_sinks("One sink stopping", rows, counters, sinks, 2);
+        }
+    }
+
+    // Once every sink has stopped, the rest of the source is left unread
+    if (SUCCESS == status) {
+        read = run("Every sink stopping", rows, counters, stopping, sinks, 2, &status);
+        if (SUCCESS == status) {
+            status = check_sinks("Every sink stopping", rows, counters, sinks, 2);
+        }
+        if (SUCCESS == status && read > EXAMPLE_STOP_ROWS + EXAMPLE_MAX_UNREAD) {
+            fprintf(stderr, "fanout: %ld rows read after every sink had stopped\n", read);
+            status = ERR_GENERIC;
+        }
+    }
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
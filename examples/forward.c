@@ -0,0 +1,266 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file forward.c
+ *      @brief Measurement of forwarding --print-job to a running instance against a cold start
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      forward [RUNS [BINARY]]
+ *          Print a small job with BINARY (by default ./main) --print-job RUNS times (by default
+ *          20) with no instance running, so that each is printed by a new process, then start
+ *          BINARY's user interface and print it RUNS times more, each handed to that instance
+ *          over D-Bus. Reports the median and 90th percentile time of each invocation, from
+ *          starting the process to its exit. lp is replaced on PATH by a stub which only replies
+ *          with a job ID, so that the printing system's own time is left out. Needs a display
+ *          (e.g. under xvfb-run) and a session bus, and fails if an instance is already running
+ *          or any invocation fails.
+ */
+
+#include "barcodeui.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXAMPLE_DEFAULT_RUNS 20
+#define EXAMPLE_DEFAULT_BINARY "./main"
+#define EXAMPLE_JOB_ROWS 10
+#define EXAMPLE_TEMPLATE "/tmp/bk-forward-XXXXXX"
+#define EXAMPLE_PRINTER "stub"
+// Reported by an invocation whose job was handed to the running instance (see main.c)
+#define EXAMPLE_FORWARDED "Handled by the running instance"
+// Time allowed for the user interface to start and own its name on the session bus
+#define EXAMPLE_STARTUP_MS 10000
+#define EXAMPLE_OUTPUT_LEN 4096
+
+#define EXAMPLE_STUB_LP                                                                            \
+    "#!/bin/sh\n"                                                                                  \
+    "echo \"request id is " EXAMPLE_PRINTER "-$$ (1 file(s))\"\n"
+
+/**
+ *      @brief Run a command to completion, capturing its standard output
+ *      @return The command's exit status, or -1 if it could not be run or was killed
+ */
+static int run(char * const * argv, char * output, size_t output_len, double * elapsed_ms) {
+    uint64_t start = bk_clock_ns();
+    int      fds[2];
+    size_t   len = 0;
+    ssize_t  n;
+    int      wstatus;
+
+    if (-1 == pipe(fds)) {
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (0 == pid) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(argv[0], argv);
+        _exit(EXIT_FAILURE);
+    } else if (-1 == pid) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    close(fds[1]);
+    while (len < output_len - 1 && (n = read(fds[0], output + len, output_len - 1 - len)) > 0) {
+        len += n;
+    }
+    output[len] = '\0';
+    close(fds[0]);
+
+    while (-1 == waitpid(pid, &wstatus, 0)) {
+        if (EINTR != errno) {
+            return -1;
+        }
+    }
+    *elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    return WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : -1;
+}
+
+/**
+ *      @brief Time @c runs invocations, each of which must succeed and be forwarded or not
+ *      @return SUCCESS, or ERR_GENERIC if an invocation failed or was handled in the wrong place
+ */
+static int time_runs(char * const * argv, int runs, bool forwarded, double * times) {
+    char output[EXAMPLE_OUTPUT_LEN];
+
+    for (int i = 0; i < runs; i++) {
+        int status = run(argv, output, sizeof output, &times[i]);
+
+        if (EXIT_SUCCESS != status) {
+            fprintf(stderr, "forward: %s exited with status %d:\n%s", argv[0], status, output);
+            return ERR_GENERIC;
+        } else if (forwarded != (NULL != strstr(output, EXAMPLE_FORWARDED))) {
+            fprintf(stderr,
+                    "forward: the job was %s by the running instance\n",
+                    forwarded ? "not handled" : "unexpectedly handled");
+            return ERR_GENERIC;
+        }
+    }
+
+    return SUCCESS;
+}
+
+static int compare_time(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*      @brief Sort a run's times, reporting their median and 90th percentile */
+static double report(const char * name, double * times, int runs) {
+    qsort(times, runs, sizeof *times, compare_time);
+    printf("%-10s median %.1f ms, p90 %.1f ms, fastest %.1f ms over %d runs\n",
+           name,
+           times[runs / 2],
+           times[runs * 9 / 10],
+           times[0],
+           runs);
+    return times[runs / 2];
+}
+
+/*      @brief Start the user interface as the primary instance, without waiting for it */
+static pid_t start_primary(const char * binary) {
+    pid_t pid = fork();
+
+    if (0 == pid) {
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        execlp(binary, binary, "--quiet", NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    return pid;
+}
+
+/*      @brief Wait until an invocation is handled by the primary instance */
+static int wait_primary(char * const * argv, pid_t primary) {
+    uint64_t deadline = bk_clock_ns() + (uint64_t) EXAMPLE_STARTUP_MS * 1000000;
+    char     output[EXAMPLE_OUTPUT_LEN];
+    double   elapsed_ms;
+
+    while (bk_clock_ns() < deadline) {
+        struct timespec retry = { 0, 100000000L };
+
+        if (0 != waitpid(primary, NULL, WNOHANG)) {
+            fprintf(stderr, "forward: the user interface exited - is there a display?\n");
+            return ERR_GENERIC;
+        }
+        if (EXIT_SUCCESS == run(argv, output, sizeof output, &elapsed_ms)
+            && NULL != strstr(output, EXAMPLE_FORWARDED)) {
+            return SUCCESS;
+        }
+        nanosleep(&retry, NULL);
+    }
+
+    fprintf(stderr, "forward: the user interface did not start within %d ms\n", EXAMPLE_STARTUP_MS);
+    return ERR_GENERIC;
+}
+
+int main(int argc, char ** argv) {
+    int    runs   = argc > 1 ? atoi(argv[1]) : EXAMPLE_DEFAULT_RUNS;
+    char * binary = argc > 2 ? argv[2] : EXAMPLE_DEFAULT_BINARY;
+    char   root[] = EXAMPLE_TEMPLATE;
+    char   bin[PATH_MAX], lp[PATH_MAX], job[PATH_MAX], path[PATH_MAX];
+    FILE * file;
+    int    status;
+
+    if (runs <= 0) {
+        fprintf(stderr, "Usage: %s [RUNS [BINARY]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL == mkdtemp(root)) {
+        perror("forward: could not create a temporary directory");
+        return EXIT_FAILURE;
+    }
+    snprintf(bin, sizeof bin, "%s/bin", root);
+    snprintf(lp, sizeof lp, "%s/" BK_PRINT_CMD, bin);
+    snprintf(job, sizeof job, "%s/job.csv", root);
+
+    // The job file, and the stub lp first on PATH for both the new processes and the instance
+    if (-1 == mkdir(bin, 0755) || NULL == (file = fopen(lp, "w"))) {
+        perror("forward: could not create the stub lp");
+        return EXIT_FAILURE;
+    }
+    fputs(EXAMPLE_STUB_LP, file);
+    fclose(file);
+    chmod(lp, 0755);
+    snprintf(path, sizeof path, "%s:%s", bin, getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", path, 1);
+
+    if (NULL == (file = fopen(job, "w"))) {
+        perror("forward: could not create the job file");
+        return EXIT_FAILURE;
+    }
+    fputs("barcode,quantity\n", file);
+    for (int i = 0; i < EXAMPLE_JOB_ROWS; i++) {
+        fprintf(file, "FORWARD-%d,1\n", i);
+    }
+    fclose(file);
+
+    // Not --quiet, so that each invocation reports whether it was forwarded
+    char *   print_argv[] = { binary, "--print-job", job, "--printer", EXAMPLE_PRINTER, NULL };
+    double * cold         = calloc(runs, sizeof *cold);
+    double * forwarded    = calloc(runs, sizeof *forwarded);
+    if (NULL == cold || NULL == forwarded) {
+        fprintf(stderr, "forward: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    status = time_runs(print_argv, runs, false, cold);
+
+    pid_t primary = -1;
+    if (SUCCESS == status) {
+        primary = start_primary(binary);
+        status  = -1 == primary ? ERR_FORK : wait_primary(print_argv, primary);
+    }
+    if (SUCCESS == status) {
+        status = time_runs(print_argv, runs, true, forwarded);
+    }
+    if (primary > 0) {
+        kill(primary, SIGTERM);
+        waitpid(primary, NULL, 0);
+    }
+
+    if (SUCCESS == status) {
+        double cold_ms      = report("Cold start", cold, runs);
+        double forwarded_ms = report("Forwarded", forwarded, runs);
+        printf("Forwarding takes %.2f times as long as a cold start\n", forwarded_ms / cold_ms);
+    }
+
+    free(forwarded);
+    free(cold);
+    remove(job);
+    remove(lp);
+    rmdir(bin);
+    rmdir(root);
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main(void) {
+    fprintf(stderr, "forward: forwarding to a running instance is only measured on Unix\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,211 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file generate.c
+ *      @brief Example of generating labels in-process with libbarcodeui-core
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      generate - < codes.txt > labels.ps
+ *          Generate one label for each line of standard input, writing PostScript to standard
+ *          output.
+ *      generate [N]
+ *          Generate N (by default 100000) labels, discarding the output, and report the
+ *          throughput with and without a generation context. The job is then generated again
+ *          through the same context, counting every heap allocation in the process (see
+ *          malloc_count.h). This fails if any allocation is left live, or if the backend
+ *          allocates anything but a copy of each barcode it encodes again. This is done first
+ *          for a job of fewer distinct barcodes than the encoding cache holds, which must not
+ *          allocate in the backend at all, then for one of four times as many, which the cache
+ *          is trimmed and refilled for. libbarcode still allocates the PostScript of each page,
+ *          and each encoding, and these are reported.
+ */
+
+#include "barcodeui.h"
+#include "malloc_count.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXAMPLE_DEFAULT_LABELS 100000
+// Distinct barcodes of a job the encoding cache holds in full, and of one it must keep trimming
+#define EXAMPLE_FEW_CODES 1000
+#define EXAMPLE_MANY_CODES (4 * BK_CACHE_MAX_ENTRIES)
+#define EXAMPLE_REPEATS 10
+
+/*      @brief An allocator counting the allocations and reallocations made through it */
+static void * counting_realloc(void * ctx, void * ptr, size_t size) {
+    (*(unsigned long *) ctx)++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void * ctx, void * ptr) {
+    (void) ctx;
+    free(ptr);
+}
+
+/*      @brief A sink counting the bytes written to it */
+static int counting_write(void * ctx, const char * data, size_t len) {
+    (void) data;
+    *(size_t *) ctx += len;
+    return SUCCESS;
+}
+
+static int generate_stdin(void) {
+    char         line[BK_BARCODE_LENGTH + 2];
+    PSProperties props = PS_DEFAULT_PROPS;
+    Layout       layout;
+    BKJob *      job  = bk_job_new();
+    BKSink       sink = { bk_file_write, stdout };
+
+    layout.rows = BK_DEFAULT_ROWS;
+    layout.cols = BK_DEFAULT_COLS;
+
+    while (NULL != fgets(line, sizeof line, stdin)) {
+        size_t len = strcspn(line, "\r\n");
+        if (len > 0) {
+            bk_job_add(job, line, len, 1);
+        }
+    }
+
+    int status = bk_job_generate(job, &props, &layout, &sink, NULL, NULL);
+    if (SUCCESS != status) {
+        fprintf(stderr, "generate: error %d\n", status);
+    }
+
+    bk_job_delete(job);
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *      @brief Benchmark a job of @c distinct barcodes, then regenerate it through the same context
+ *      @details Regenerating must leave no allocation live, and the backend itself may only
+ *               allocate a copy of each barcode it encodes again - none at all once the cache
+ *               holds every barcode of the job.
+ */
+static int generate_benchmark(int num_labels, int distinct) {
+    unsigned long     allocations = 0;
+    BKAllocator       allocator   = { counting_realloc, counting_free, &allocations };
+    PSProperties      props       = PS_DEFAULT_PROPS;
+    Layout            layout;
+    BKGenerateContext context;
+    BKGenerateStats   stats;
+    size_t            bytes = 0;
+    BKSink            sink  = { counting_write, &bytes };
+    char              code[BK_BARCODE_LENGTH];
+    int               status;
+
+    bk_set_allocator(&allocator);
+
+    layout.rows = BK_DEFAULT_ROWS;
+    layout.cols = BK_DEFAULT_COLS;
+
+    uint64_t start = bk_clock_ns();
+    BKJob *  job   = bk_job_new();
+    for (int i = 0; i < num_labels; i++) {
+        int len = snprintf(code, sizeof code, "ITEM-%06d", i % distinct);
+        bk_job_add(job, code, len, 1);
+    }
+    printf("Built a job of %d labels, %d distinct, in %.1f ms with %lu allocations\n",
+           num_labels,
+           distinct,
+           (bk_clock_ns() - start) / 1e6,
+           allocations);
+
+    start  = bk_clock_ns();
+    status = bk_job_generate(job, &props, &layout, &sink, NULL, &stats);
+    double uncached_ms = (bk_clock_ns() - start) / 1e6;
+
+    bk_context_init(&context);
+    start = bk_clock_ns();
+    if (SUCCESS == status) {
+        status = bk_job_generate(job, &props, &layout, &sink, &context, &stats);
+    }
+    double cached_ms = (bk_clock_ns() - start) / 1e6;
+
+    // The context has grown to fit the job, so only libbarcode and re-encoding should allocate
+    unsigned long backend_allocations = allocations;
+    unsigned long encodings           = context.cache.misses;
+    long          mallocs             = malloc_count_calls();
+    long          live                = malloc_count_live();
+    for (int i = 0; i < EXAMPLE_REPEATS && SUCCESS == status; i++) {
+        status = bk_job_generate(job, &props, &layout, &sink, &context, &stats);
+    }
+    backend_allocations = allocations - backend_allocations;
+    encodings           = context.cache.misses - encodings;
+    mallocs             = malloc_count_calls() - mallocs;
+    live                = malloc_count_live() - live;
+
+    if (SUCCESS == status) {
+        printf("Generated %ld pages (%lu bytes) without a context in %.1f ms (%.0f labels/s)\n",
+               stats.pages,
+               (unsigned long) stats.bytes,
+               uncached_ms,
+               num_labels / (uncached_ms / 1e3));
+        printf("Generated %ld pages (%lu bytes) with a context in %.1f ms (%.0f labels/s)\n",
+               stats.pages,
+               (unsigned long) stats.bytes,
+               cached_ms,
+               num_labels / (cached_ms / 1e3));
+        printf("Regenerated %d times through the context, encoding %lu barcodes again: %lu "
+               "backend allocations",
+               EXAMPLE_REPEATS,
+               encodings,
+               backend_allocations);
+        if (MALLOC_COUNTED) {
+            printf(", %ld mallocs in all (%.2f per page), %ld left live",
+                   mallocs,
+                   (double) mallocs / (stats.pages * EXAMPLE_REPEATS),
+                   live);
+        }
+        printf("\n");
+    } else {
+        fprintf(stderr, "generate: error %d\n", status);
+    }
+
+    if (SUCCESS == status && distinct > BK_CACHE_MAX_ENTRIES && 0 == encodings) {
+        fprintf(stderr, "generate: %d distinct barcodes should not all stay cached\n", distinct);
+        status = ERR_GENERIC;
+    } else if (SUCCESS == status && distinct <= BK_CACHE_MAX_ENTRIES && encodings > 0) {
+        fprintf(stderr, "generate: %d distinct barcodes should all stay cached\n", distinct);
+        status = ERR_GENERIC;
+    } else if (SUCCESS == status && backend_allocations != encodings) {
+        fprintf(stderr, "generate: regenerating should only allocate for barcodes encoded again\n");
+        status = ERR_GENERIC;
+    } else if (SUCCESS == status && 0 != live) {
+        fprintf(stderr, "generate: regenerating should not leave allocations live\n");
+        status = ERR_GENERIC;
+    }
+
+    bk_context_free(&context);
+    bk_job_delete(job);
+    bk_set_allocator(NULL);
+
+    return status;
+}
+
+int main(int argc, char ** argv) {
+    if (argc > 1 && strcmp(argv[1], "-") == 0) {
+        return generate_stdin();
+    }
+
+    int num_labels = argc > 1 ? atoi(argv[1]) : EXAMPLE_DEFAULT_LABELS;
+    if (num_labels <= 0) {
+        fprintf(stderr, "Usage: %s [ - | N ]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int status = generate_benchmark(num_labels, EXAMPLE_FEW_CODES);
+    if (SUCCESS == status) {
+        printf("\n");
+        status = generate_benchmark(num_labels, EXAMPLE_MANY_CODES);
+    }
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
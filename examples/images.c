@@ -0,0 +1,200 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file images.c
+ *      @brief Test harness and benchmark of exporting one image per barcode
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      images [BARCODES [WORKERS]]
+ *          Export BARCODES (by default 10000) distinct barcodes, each on EXAMPLE_REPEATS rows, as
+ *          PNG and SVG images into a new directory with WORKERS (by default 4) workers, as
+ *          --images does. Then export the same job again, and again after spoiling one
+ *          image. Fails unless the first export writes every image, the second none - leaving
+ *          each unchanged - and the third only the spoiled one, or if a temporary file is left
+ *          behind. Reports the images per second of each export.
+ */
+
+#include "barcodeui.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+
+#define EXAMPLE_DEFAULT_BARCODES 10000
+#define EXAMPLE_REPEATS 3
+#define EXAMPLE_CODE_FORMAT "IMG-%08ld"
+#define EXAMPLE_CODE_LEN 32
+#define EXAMPLE_TEMPLATE "/tmp/bk-images-XXXXXX"
+
+/*      @brief A source of each barcode repeated, as a job listing an item once per order would */
+typedef struct Codes {
+    long barcodes;
+    long row;
+    char code[EXAMPLE_CODE_LEN];
+} Codes;
+
+static int codes_next(void * ctx, const char ** barcode, int * quantity) {
+    Codes * codes = ctx;
+
+    if (codes->row == codes->barcodes * EXAMPLE_REPEATS) {
+        return BK_SOURCE_END;
+    }
+    snprintf(codes->code, sizeof codes->code, EXAMPLE_CODE_FORMAT, codes->row % codes->barcodes);
+    codes->row++;
+
+    *barcode  = codes->code;
+    *quantity = 1;
+    return SUCCESS;
+}
+
+/*      @brief Count the files in a directory whose names end in @c ext */
+static int count_files(const char * dir, const char * ext) {
+    DIR *           d = opendir(dir);
+    struct dirent * entry;
+    int             count = 0;
+
+    if (NULL == d) {
+        return 0;
+    }
+    while (NULL != (entry = readdir(d))) {
+        size_t len = strlen(entry->d_name);
+        if ('.' != entry->d_name[0] && len >= strlen(ext)
+            && 0 == strcmp(entry->d_name + len - strlen(ext), ext)) {
+            count++;
+        }
+    }
+    closedir(d);
+
+    return count;
+}
+
+/*      @brief Remove a directory of files */
+static void remove_dir(const char * dir) {
+    DIR *           d = opendir(dir);
+    struct dirent * entry;
+    char            path[PATH_MAX];
+
+    while (NULL != d && NULL != (entry = readdir(d))) {
+        if ('.' != entry->d_name[0]) {
+            snprintf(path, sizeof path, "%s/%s", dir, entry->d_name);
+            remove(path);
+        }
+    }
+    if (NULL != d) {
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/**
+ *      @brief Export every barcode, failing unless as many images were written as expected
+ *      @param written The images expected to be written, the rest being left unchanged
+ */
+// clang-format off
+static int export_codes(
+    const char * name,
+    const BKImageOptions * options,
+    long barcodes,
+    long written
+) {
+    // clang-format on
+    Codes        codes  = { barcodes, 0, "" };
+    BKSource     source = { codes_next, &codes };
+    BKImageStats stats;
+    long         images = barcodes * 2;
+    uint64_t     start  = bk_clock_ns();
+
+    int    status     = bk_images_generate(&source, options, &stats);
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "images: %s: error %d\n", name, status);
+        return status;
+    } else if (stats.barcodes != barcodes || stats.labels != barcodes * EXAMPLE_REPEATS
+               || stats.failed != 0 || stats.written != written
+               || stats.unchanged != images - written) {
+        fprintf(stderr,
+                "images: %s: %ld barcodes of %ld labels gave %ld images written, %ld unchanged "
+                "and %ld failed, expected %ld written and %ld unchanged\n",
+                name,
+                stats.barcodes,
+                stats.labels,
+                stats.written,
+                stats.unchanged,
+                stats.failed,
+                written,
+                images - written);
+        return ERR_GENERIC;
+    } else if (0 != count_files(options->dir, BK_IMAGE_TMP_SUFFIX)) {
+        fprintf(stderr, "images: %s: temporary files were left behind\n", name);
+        return ERR_GENERIC;
+    }
+
+    printf("%-16s %ld images (%ld written) with %d workers in %.1f ms, %.0f images/s\n",
+           name,
+           images,
+           stats.written,
+           stats.workers,
+           elapsed_ms,
+           images / (elapsed_ms / 1e3));
+    return SUCCESS;
+}
+
+int main(int argc, char ** argv) {
+    long           barcodes = argc > 1 ? atol(argv[1]) : EXAMPLE_DEFAULT_BARCODES;
+    BKImageOptions options  = { NULL, NULL, NULL, BK_IMAGE_PNG | BK_IMAGE_SVG, 0, 0 };
+    char           dir[]    = EXAMPLE_TEMPLATE;
+    char           path[PATH_MAX];
+    int            status;
+
+    options.workers = argc > 2 ? atoi(argv[2]) : 0;
+    if (barcodes <= 0 || options.workers < 0) {
+        fprintf(stderr, "Usage: %s [BARCODES [WORKERS]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL == mkdtemp(dir)) {
+        perror("images: could not create a temporary directory");
+        return EXIT_FAILURE;
+    }
+    options.dir = dir;
+
+    status = export_codes("Export", &options, barcodes, barcodes * 2);
+    if (SUCCESS == status) {
+        status = export_codes("Re-export", &options, barcodes, 0);
+    }
+
+    // An image whose file no longer holds it is written again, and only that image
+    if (SUCCESS == status) {
+        snprintf(path, sizeof path, "%s/" EXAMPLE_CODE_FORMAT ".png", dir, barcodes / 2);
+        FILE * file = fopen(path, "wb");
+        if (NULL == file) {
+            perror("images: could not spoil an image");
+            status = ERR_FILE_OPEN_FAILED;
+        } else {
+            fputs("not a PNG", file);
+            fclose(file);
+            status = export_codes("Spoilt re-export", &options, barcodes, 1);
+        }
+    }
+
+    remove_dir(dir);
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main(void) {
+    fprintf(stderr, "images: this harness is not supported on Windows\n");
+    return EXIT_FAILURE;
+}
+#endif
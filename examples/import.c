@@ -0,0 +1,124 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file import.c
+ *      @brief Benchmark of importing a large CSV job file with libbarcodeui-core
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      import [ROWS [BUDGET_MB]]
+ *          Write a CSV job file of ROWS (by default 1000000) rows to a temporary file, import it
+ *          as the user interface does a .csv file - into a job limited to BUDGET_MB megabytes if
+ *          given (see bk_job_set_budget()) - and report the rows imported per second and the
+ *          peak resident memory of the import. The job is then read back, failing unless every
+ *          row is as written.
+ */
+
+#include "barcodeui.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXAMPLE_DEFAULT_ROWS 1000000
+#define EXAMPLE_MAX_QUANTITY 5
+
+/*      @brief The quantity written for a row, so that rows can be checked when read back */
+static int row_quantity(long row) {
+    return 1 + row % EXAMPLE_MAX_QUANTITY;
+}
+
+static int write_csv(FILE * file, long rows) {
+    fputs("barcode,quantity\n", file);
+    for (long i = 0; i < rows; i++) {
+        fprintf(file, "ITEM-%08ld,%d\n", i, row_quantity(i));
+    }
+    return EOF == fclose(file) ? ERR_FILE_CLOSE_FAILED : SUCCESS;
+}
+
+/*      @brief Read every row of a job back, returning the number which differ from those written */
+static long check_job(BKJob * job, long rows) {
+    BKJobReader  reader;
+    char         expected[BK_BARCODE_LENGTH];
+    const char * barcode;
+    int          quantity;
+    long         row = 0, mismatches = 0;
+
+    bk_job_read(job, &reader);
+    while (SUCCESS == bk_job_next(&reader, &barcode, &quantity)) {
+        snprintf(expected, sizeof expected, "ITEM-%08ld", row);
+        if (0 != strcmp(barcode, expected) || quantity != row_quantity(row)) {
+            mismatches++;
+        }
+        row++;
+    }
+    bk_job_reader_free(&reader);
+
+    return mismatches + labs(rows - row);
+}
+
+int main(int argc, char ** argv) {
+    long            rows   = argc > 1 ? atol(argv[1]) : EXAMPLE_DEFAULT_ROWS;
+    size_t          budget = argc > 2 ? (size_t) atol(argv[2]) * 1024 * 1024 : 0;
+    BKImportOptions options = BK_IMPORT_DEFAULT_OPTIONS;
+    BKImportStats   stats;
+    char            path[BK_TEMPFILE_TEMPLATE_SIZE];
+    FILE *          file;
+    BKJob           job;
+
+    if (rows <= 0) {
+        fprintf(stderr, "Usage: %s [ROWS [BUDGET_MB]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The temporary file has no extension to choose the delimiter from
+    options.delimiter = BK_IMPORT_CSV_DELIM;
+
+    int status = bk_tempfile_open(path, &file);
+    if (SUCCESS == status) {
+        status = write_csv(file, rows);
+    }
+    if (SUCCESS != status) {
+        fprintf(stderr, "import: could not write the job file: error %d\n", status);
+        return EXIT_FAILURE;
+    }
+
+    bk_job_init(&job);
+    bk_job_set_budget(&job, budget);
+    bk_peak_rss_reset();
+
+    status        = bk_import_csv(path, &options, &job, &stats);
+    size_t peak   = bk_peak_rss();
+    long   errors = SUCCESS == status ? check_job(&job, rows) : 0;
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "import: error %d\n", status);
+    } else if (errors > 0) {
+        fprintf(stderr, "import: %ld of %ld rows differ from those written\n", errors, rows);
+        status = ERR_GENERIC;
+    } else {
+        printf("Imported %ld rows (%ld labels, %.1f MiB) in %.1f ms: %.0f rows/s, %.1f MiB/s\n",
+               stats.rows,
+               stats.labels,
+               stats.bytes / 1048576.0,
+               stats.elapsed_ms,
+               stats.rows / (stats.elapsed_ms / 1e3),
+               stats.bytes / 1048576.0 / (stats.elapsed_ms / 1e3));
+        printf("Peak memory %.1f MiB, job %.1f MiB in memory",
+               peak / 1048576.0,
+               bk_job_size(&job) / 1048576.0);
+        if (budget > 0) {
+            printf(" of a %.0f MiB budget, %ld rows spilled", budget / 1048576.0, job.spilled_rows);
+        }
+        printf("\n");
+    }
+
+    bk_job_free(&job);
+    remove(path);
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
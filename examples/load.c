@@ -0,0 +1,235 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file load.c
+ *      @brief Load generator for the job daemon
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      load [JOBS [CONNECTIONS [SOCKET [PRINTER]]]]
+ *          Send JOBS (by default 10000) small jobs of EXAMPLE_LABELS labels each to the job
+ *          daemon over CONNECTIONS (by default 4) connections at once, each sending its next job
+ *          as soon as the last is answered, and report the jobs completed per second and the
+ *          50th and 99th percentile of the time from sending a job's first label to its "ok"
+ *          reply. Without SOCKET, or given "-", a daemon is started within this process on a
+ *          temporary socket, as --daemon does; otherwise the daemon listening on SOCKET is used.
+ *          Jobs are only generated unless PRINTER is given. Fails if any job is answered with an
+ *          error.
+ */
+
+#include "barcodeui.h"
+#include "daemon.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXAMPLE_DEFAULT_JOBS 10000
+#define EXAMPLE_DEFAULT_CONNECTIONS 4
+#define EXAMPLE_LABELS 10
+#define EXAMPLE_DISTINCT_CODES 1000
+#define EXAMPLE_SOCKET_TEMPLATE "/tmp/bk-load-%ld.sock"
+// Time allowed for a daemon started within this process to begin listening
+#define EXAMPLE_CONNECT_MS 5000
+#define EXAMPLE_LINE_LEN 256
+
+/*      @brief One connection's share of the jobs, and the latency of each in nanoseconds */
+typedef struct LoadClient {
+    const char * socket_path;
+    const char * printer;
+    int          first_job;
+    int          num_jobs;
+    uint64_t *   latencies;
+    int          status;
+} LoadClient;
+
+/*      @brief Connect to the daemon, retrying while a daemon started alongside is not yet up */
+static int load_connect(const char * path) {
+    struct sockaddr_un addr;
+    uint64_t           deadline = bk_clock_ns() + (uint64_t) EXAMPLE_CONNECT_MS * 1000000;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+
+    for (;;) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (-1 == fd) {
+            return -1;
+        }
+        if (0 == connect(fd, (struct sockaddr *) &addr, sizeof addr)) {
+            return fd;
+        }
+        close(fd);
+
+        if (bk_clock_ns() > deadline) {
+            return -1;
+        }
+        struct timespec retry = { 0, 1000000L };
+        nanosleep(&retry, NULL);
+    }
+}
+
+/*      @brief Read replies until one starting with "ok" or "error", returning SUCCESS for "ok" */
+static int load_reply(FILE * in, char * line) {
+    while (NULL != fgets(line, EXAMPLE_LINE_LEN, in)) {
+        if (0 == strncmp(line, "ok", 2)) {
+            return SUCCESS;
+        } else if (0 == strncmp(line, "error", 5)) {
+            return ERR_GENERIC;
+        }
+    }
+    return ERR_SOCKET;
+}
+
+static void * load_client(void * arg) {
+    LoadClient * client = arg;
+    char         line[EXAMPLE_LINE_LEN];
+    FILE *       in, *out;
+    int          fd = load_connect(client->socket_path);
+
+    if (-1 == fd) {
+        client->status = ERR_SOCKET;
+        return NULL;
+    }
+    in  = fdopen(fd, "r");
+    out = fdopen(dup(fd), "w");
+
+    client->status = SUCCESS;
+    if (NULL != client->printer) {
+        fprintf(out, "printer %s\n", client->printer);
+        fflush(out);
+        client->status = load_reply(in, line);
+    }
+
+    for (int i = 0; i < client->num_jobs && SUCCESS == client->status; i++) {
+        int      job   = client->first_job + i;
+        uint64_t start = bk_clock_ns();
+
+        for (int j = 0; j < EXAMPLE_LABELS; j++) {
+            int code = (job * EXAMPLE_LABELS + j) % EXAMPLE_DISTINCT_CODES;
+            fprintf(out, "label %d LOAD-%05d\n", 1 + j % 2, code);
+        }
+        fputs("print\n", out);
+        fflush(out);
+
+        client->status       = load_reply(in, line);
+        client->latencies[i] = bk_clock_ns() - start;
+        if (SUCCESS != client->status) {
+            fprintf(stderr, "load: job %d: %s", job, line);
+        }
+    }
+
+    fputs("quit\n", out);
+    fclose(out);
+    fclose(in);
+
+    return NULL;
+}
+
+static int compare_latency(const void * a, const void * b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void * run_daemon(void * arg) {
+    bk_daemon_run(arg);
+    return NULL;
+}
+
+int main(int argc, char ** argv) {
+    int             jobs        = argc > 1 ? atoi(argv[1]) : EXAMPLE_DEFAULT_JOBS;
+    int             connections = argc > 2 ? atoi(argv[2]) : EXAMPLE_DEFAULT_CONNECTIONS;
+    char            socket_path[EXAMPLE_LINE_LEN];
+    BKDaemonOptions options = { socket_path, 0, { NULL, NULL, 0, 0 } };
+    pthread_t       daemon_thread;
+    bool            own_daemon = argc <= 3 || 0 == strcmp(argv[3], "-");
+    int             status     = SUCCESS;
+
+    if (jobs <= 0 || connections <= 0 || connections > jobs) {
+        fprintf(stderr, "Usage: %s [JOBS [CONNECTIONS [SOCKET [PRINTER]]]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // The daemon started within this process has a worker for every connection
+    if (own_daemon) {
+        snprintf(socket_path, sizeof socket_path, EXAMPLE_SOCKET_TEMPLATE, (long) getpid());
+        options.workers = connections;
+        pthread_create(&daemon_thread, NULL, run_daemon, &options);
+    } else {
+        snprintf(socket_path, sizeof socket_path, "%s", argv[3]);
+    }
+
+    LoadClient * clients   = calloc(connections, sizeof *clients);
+    uint64_t *   latencies = calloc(jobs, sizeof *latencies);
+    pthread_t *  threads   = calloc(connections, sizeof *threads);
+    if (NULL == clients || NULL == latencies || NULL == threads) {
+        fprintf(stderr, "load: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    uint64_t start = bk_clock_ns();
+    for (int i = 0, first = 0; i < connections; i++) {
+        clients[i].socket_path = socket_path;
+        clients[i].printer     = argc > 4 ? argv[4] : NULL;
+        clients[i].first_job   = first;
+        clients[i].num_jobs    = jobs / connections + (i < jobs % connections);
+        clients[i].latencies   = latencies + first;
+        first += clients[i].num_jobs;
+        pthread_create(&threads[i], NULL, load_client, &clients[i]);
+    }
+    for (int i = 0; i < connections; i++) {
+        pthread_join(threads[i], NULL);
+        if (SUCCESS == status) {
+            status = clients[i].status;
+        }
+    }
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    // The daemon is stopped as it would be by a service manager
+    if (own_daemon) {
+        kill(getpid(), SIGTERM);
+        pthread_join(daemon_thread, NULL);
+    }
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "load: error %d\n", status);
+    } else {
+        qsort(latencies, jobs, sizeof *latencies, compare_latency);
+        printf("%d jobs of %d labels over %d connections in %.1f ms: %.0f jobs/s, "
+               "latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+               jobs,
+               EXAMPLE_LABELS,
+               connections,
+               elapsed_ms,
+               jobs / (elapsed_ms / 1e3),
+               latencies[jobs / 2] / 1e6,
+               latencies[(long) jobs * 99 / 100] / 1e6,
+               latencies[jobs - 1] / 1e6);
+    }
+
+    free(threads);
+    free(latencies);
+    free(clients);
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main(void) {
+    fprintf(stderr, "load: the job daemon is not supported on Windows\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,118 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file malloc_count.h
+ *      @brief Counting of every heap allocation made by an example program
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Included by exactly one file of an example, this replaces malloc() and its relatives for
+ *      the whole process - the example, libbarcodeui-core, libbarcode and the C library alike -
+ *      with versions which count each call before passing it on to the C library's own. An
+ *      allocator set with bk_set_allocator() only sees the backend's own allocations; these
+ *      counts also see those libbarcode makes for each encoding and page.
+ *
+ *      Only glibc, which exports its allocator as __libc_malloc() and so on, is supported.
+ *      Elsewhere MALLOC_COUNTED is 0 and the counts are always 0. Address sanitizer builds
+ *      replace malloc() themselves, and must not include this file.
+ */
+
+#ifndef MALLOC_COUNT_H
+#define MALLOC_COUNT_H
+
+#include <stddef.h>
+
+#ifdef __GLIBC__
+#define MALLOC_COUNTED 1
+
+#include <errno.h>
+
+void * __libc_malloc(size_t);
+void * __libc_calloc(size_t, size_t);
+void * __libc_realloc(void *, size_t);
+void * __libc_memalign(size_t, size_t);
+void   __libc_free(void *);
+
+// Calls which allocated or moved a block, and blocks allocated but not yet freed
+static long malloc_calls, malloc_live;
+
+static void malloc_counted(long calls, long live) {
+    __atomic_add_fetch(&malloc_calls, calls, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&malloc_live, live, __ATOMIC_RELAXED);
+}
+
+void * malloc(size_t size) {
+    void * ptr = __libc_malloc(size);
+    if (NULL != ptr) {
+        malloc_counted(1, 1);
+    }
+    return ptr;
+}
+
+void * calloc(size_t num, size_t size) {
+    void * ptr = __libc_calloc(num, size);
+    if (NULL != ptr) {
+        malloc_counted(1, 1);
+    }
+    return ptr;
+}
+
+void * realloc(void * ptr, size_t size) {
+    void * new_ptr = __libc_realloc(ptr, size);
+    if (NULL == ptr) {
+        malloc_counted(NULL != new_ptr, NULL != new_ptr);
+    } else if (0 == size) {
+        // glibc frees the block
+        malloc_counted(0, -1);
+    } else if (NULL != new_ptr) {
+        malloc_counted(1, 0);
+    }
+    return new_ptr;
+}
+
+void free(void * ptr) {
+    if (NULL != ptr) {
+        malloc_counted(0, -1);
+    }
+    __libc_free(ptr);
+}
+
+void * aligned_alloc(size_t alignment, size_t size) {
+    void * ptr = __libc_memalign(alignment, size);
+    if (NULL != ptr) {
+        malloc_counted(1, 1);
+    }
+    return ptr;
+}
+
+void * memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+int posix_memalign(void ** ptr, size_t alignment, size_t size) {
+    if (NULL == (*ptr = aligned_alloc(alignment, size))) {
+        return ENOMEM;
+    }
+    return 0;
+}
+#else
+#define MALLOC_COUNTED 0
+
+static long malloc_calls, malloc_live;
+#endif
+
+/*      @brief The number of calls so far which allocated or moved a block */
+static inline long malloc_count_calls(void) {
+    return __atomic_load_n(&malloc_calls, __ATOMIC_RELAXED);
+}
+
+/*      @brief The number of blocks allocated and not yet freed */
+static inline long malloc_count_live(void) {
+    return __atomic_load_n(&malloc_live, __ATOMIC_RELAXED);
+}
+
+#endif
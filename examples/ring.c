@@ -0,0 +1,292 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file ring.c
+ *      @brief Benchmark of ingesting jobs through a shared memory ring against job files
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      ring [LABELS [JOBS]]
+ *          Hand LABELS labels (by default 1000000), split into JOBS jobs (by default 100), from a
+ *          producer thread to a consumer, first as CSV job files - each written to a temporary
+ *          file, then imported - and then through a shared memory ring, as --ring reads them.
+ *          Each is timed twice: once only reading every label, and once generating PostScript
+ *          from them into a sink which discards it. Reports the labels per second of each, from
+ *          the producer starting to the consumer finishing the last job. Linux only.
+ */
+
+#include "barcodeui.h"
+#include "ring.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <unistd.h>
+
+#define EXAMPLE_DEFAULT_LABELS 1000000
+#define EXAMPLE_DEFAULT_JOBS 100
+#define EXAMPLE_RING_NAME "/bk-ring-example-%ld"
+#define EXAMPLE_CODE_FORMAT "RING-%08ld"
+#define EXAMPLE_CODE_LEN 32
+#define EXAMPLE_NAME_LEN 64
+
+/*      @brief How jobs are handed from the producer to the consumer */
+typedef struct Bench {
+    long   labels_per_job;
+    int    jobs;
+    bool   generate;
+    // Job files: the path of each complete file is written to this pipe
+    int    paths[2];
+    // Ring: the name of the ring, created by the consumer
+    char   ring_name[EXAMPLE_NAME_LEN];
+    int    producer_status;
+} Bench;
+
+/*      @brief A sink counting the bytes written to it */
+static int counting_write(void * ctx, const char * data, size_t len) {
+    (void) data;
+    *(size_t *) ctx += len;
+    return SUCCESS;
+}
+
+static int code_of(char * code, int job, long label, long labels_per_job) {
+    return snprintf(code, EXAMPLE_CODE_LEN, EXAMPLE_CODE_FORMAT, job * labels_per_job + label);
+}
+
+static void * file_producer(void * arg) {
+    Bench * bench = arg;
+    char    path[BK_TEMPFILE_TEMPLATE_SIZE];
+    char    code[EXAMPLE_CODE_LEN];
+    FILE *  file;
+
+    bench->producer_status = SUCCESS;
+    for (int job = 0; job < bench->jobs && SUCCESS == bench->producer_status; job++) {
+        bench->producer_status = bk_tempfile_open(path, &file);
+        if (SUCCESS != bench->producer_status) {
+            break;
+        }
+
+        fputs("barcode,quantity\n", file);
+        for (long i = 0; i < bench->labels_per_job; i++) {
+            code_of(code, job, i, bench->labels_per_job);
+            fprintf(file, "%s,1\n", code);
+        }
+        if (EOF == fclose(file)) {
+            bench->producer_status = ERR_FILE_CLOSE_FAILED;
+        } else if (sizeof path != (size_t) write(bench->paths[1], path, sizeof path)) {
+            bench->producer_status = ERR_GENERIC;
+        }
+    }
+    close(bench->paths[1]);
+
+    return NULL;
+}
+
+static void * ring_producer(void * arg) {
+    Bench * bench = arg;
+    BKRing  ring;
+    char    code[EXAMPLE_CODE_LEN];
+
+    bench->producer_status = bk_ring_attach(&ring, bench->ring_name);
+    if (SUCCESS != bench->producer_status) {
+        return NULL;
+    }
+
+    for (int job = 0; job < bench->jobs && SUCCESS == bench->producer_status; job++) {
+        for (long i = 0; i < bench->labels_per_job && SUCCESS == bench->producer_status; i++) {
+            int len                = code_of(code, job, i, bench->labels_per_job);
+            bench->producer_status = bk_ring_push(&ring, code, len, 1);
+        }
+        if (SUCCESS == bench->producer_status) {
+            bench->producer_status = bk_ring_end_job(&ring);
+        }
+    }
+    bk_ring_close(&ring);
+
+    return NULL;
+}
+
+/**
+ *      @brief Read every label of one job, generating from them if the benchmark does
+ *      @return As bk_generate_context(), with the labels read added to @c labels
+ */
+// clang-format off
+static int consume(
+    Bench * bench,
+    BKSource * source,
+    BKGenerateContext * context,
+    long * labels
+) {
+    // clang-format on
+    if (bench->generate) {
+        PSProperties    props = PS_DEFAULT_PROPS;
+        Layout          layout;
+        BKGenerateStats stats;
+        size_t          bytes = 0;
+        BKSink          sink  = { counting_write, &bytes };
+
+        layout.cols = BK_DEFAULT_COLS;
+        layout.rows = BK_DEFAULT_ROWS;
+
+        int status = bk_generate_context(source, &props, &layout, &sink, context, &stats);
+        *labels += stats.labels;
+        return status;
+    }
+
+    const char * barcode;
+    int          quantity, status;
+    while (SUCCESS == (status = source->next(source->ctx, &barcode, &quantity))) {
+        *labels += quantity;
+    }
+    return BK_SOURCE_END == status ? SUCCESS : status;
+}
+
+static int run_files(Bench * bench, BKGenerateContext * context, long * labels) {
+    BKImportOptions options = BK_IMPORT_DEFAULT_OPTIONS;
+    char            path[BK_TEMPFILE_TEMPLATE_SIZE];
+    pthread_t       producer;
+    int             status = SUCCESS;
+
+    // Temporary files have no extension to choose the delimiter from
+    options.delimiter = BK_IMPORT_CSV_DELIM;
+
+    if (-1 == pipe(bench->paths)) {
+        return ERR_GENERIC;
+    }
+    pthread_create(&producer, NULL, file_producer, bench);
+
+    while (sizeof path == (size_t) read(bench->paths[0], path, sizeof path)) {
+        BKJob       job;
+        BKJobReader reader;
+
+        bk_job_init(&job);
+        if (SUCCESS == status) {
+            status = bk_import_csv(path, &options, &job, NULL);
+        }
+        if (SUCCESS == status) {
+            bk_job_read(&job, &reader);
+            BKSource source = { bk_job_next, &reader };
+            status          = consume(bench, &source, context, labels);
+            bk_job_reader_free(&reader);
+        }
+        bk_job_free(&job);
+        remove(path);
+    }
+
+    pthread_join(producer, NULL);
+    close(bench->paths[0]);
+
+    return SUCCESS == status ? bench->producer_status : status;
+}
+
+static int run_ring(Bench * bench, BKGenerateContext * context, long * labels) {
+    BKRing    ring;
+    pthread_t producer;
+    int       status;
+
+    snprintf(bench->ring_name, sizeof bench->ring_name, EXAMPLE_RING_NAME, (long) getpid());
+    if (SUCCESS != (status = bk_ring_create(&ring, bench->ring_name, BK_RING_DEFAULT_SIZE))) {
+        return status;
+    }
+    pthread_create(&producer, NULL, ring_producer, bench);
+
+    for (int job = 0; job < bench->jobs && SUCCESS == status; job++) {
+        BKSource source = { bk_ring_next, &ring };
+
+        status = bk_ring_wait(&ring);
+        if (SUCCESS == status) {
+            status = consume(bench, &source, context, labels);
+        }
+    }
+
+    pthread_join(producer, NULL);
+    bk_ring_close(&ring);
+
+    return SUCCESS == status ? bench->producer_status : status;
+}
+
+/*      @brief Time one way of handing jobs over, returning the labels per second */
+// clang-format off
+static double time_run(
+    const char * name,
+    int (*run)(Bench *, BKGenerateContext *, long *),
+    Bench * bench,
+    int * status
+) {
+    // clang-format on
+    BKGenerateContext context;
+    long              labels = 0;
+    uint64_t          start  = bk_clock_ns();
+
+    bk_context_init(&context);
+    *status           = run(bench, &context, &labels);
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    bk_context_free(&context);
+
+    if (SUCCESS != *status) {
+        fprintf(stderr, "ring: %s: error %d\n", name, *status);
+        return 0;
+    } else if (labels != bench->jobs * bench->labels_per_job) {
+        fprintf(stderr,
+                "ring: %s: %ld labels read of %ld\n",
+                name,
+                labels,
+                bench->jobs * bench->labels_per_job);
+        *status = ERR_GENERIC;
+        return 0;
+    }
+
+    double rate = labels / (elapsed_ms / 1e3);
+    printf("%-20s %s: %ld labels in %.1f ms, %.0f labels/s\n",
+           name,
+           bench->generate ? "generating" : "reading   ",
+           labels,
+           elapsed_ms,
+           rate);
+    return rate;
+}
+
+int main(int argc, char ** argv) {
+    long  labels = argc > 1 ? atol(argv[1]) : EXAMPLE_DEFAULT_LABELS;
+    int   jobs   = argc > 2 ? atoi(argv[2]) : EXAMPLE_DEFAULT_JOBS;
+    Bench bench;
+    int   status = SUCCESS;
+
+    if (labels <= 0 || jobs <= 0 || labels < jobs) {
+        fprintf(stderr, "Usage: %s [LABELS [JOBS]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    memset(&bench, 0, sizeof bench);
+    bench.jobs           = jobs;
+    bench.labels_per_job = labels / jobs;
+
+    for (int generate = 0; generate < 2 && SUCCESS == status; generate++) {
+        bench.generate = generate;
+
+        double files = time_run("Job files", run_files, &bench, &status);
+        double ring  = SUCCESS == status ? time_run("Shared memory ring", run_ring, &bench, &status)
+                                         : 0;
+        if (SUCCESS == status) {
+            printf("The ring is %.1f times as fast %s\n",
+                   ring / files,
+                   generate ? "generating" : "reading");
+        }
+    }
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main(void) {
+    fprintf(stderr, "ring: shared memory rings are only supported on Linux\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -0,0 +1,209 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file scanline.c
+ *      @brief Check and benchmark of the scanline kernels of libbarcodeui-core
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      scanline [N]
+ *          Draw N (by default 20000) random barcodes with the kernels of every instruction set the
+ *          processor supports, failing unless each matches a pixel at a time reference - at both
+ *          depths, and without writing past the padding of its buffer. Then report the rate at
+ *          which each draws scanlines, and whole barcodes - a scanline repeated over the height
+ *          of the bars - in megapixels per second.
+ */
+
+#include "barcodeui.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXAMPLE_DEFAULT_BARCODES 20000
+#define EXAMPLE_MAX_LENGTH 40
+#define EXAMPLE_MAX_MODULE 12
+#define EXAMPLE_BAR_HEIGHT 200
+#define EXAMPLE_MODULE 4
+// Written after each buffer, to catch kernels writing past it
+#define EXAMPLE_GUARD 0xA5
+#define EXAMPLE_GUARD_LEN 64
+#define EXAMPLE_MAX_PIXELS (BK_MODULES_MAX_ELEMENTS * 4 * EXAMPLE_MAX_MODULE)
+
+/*      @brief Encode a random barcode of printable characters */
+static void random_modules(BKModules * modules) {
+    char code[EXAMPLE_MAX_LENGTH];
+    int  len = 1 + rand() % EXAMPLE_MAX_LENGTH;
+
+    for (int i = 0; i < len; i++) {
+        // Runs of digits exercise code set C
+        code[i] = rand() % 2 ? '0' + rand() % 10 : ' ' + rand() % 95;
+    }
+    bk_modules_encode(code, len, modules);
+}
+
+/*      @brief Draw a scanline a pixel at a time, one byte per pixel */
+// clang-format off
+static int reference_8bpp(
+    const BKModules * modules,
+    int module,
+    unsigned char ink,
+    unsigned char paper,
+    unsigned char * row
+) {
+    // clang-format on
+    int x = 0;
+
+    for (int e = 0; e < modules->num_elements; e++) {
+        for (int i = 0; i < modules->widths[e] * module; i++) {
+            row[x++] = 0 == e % 2 ? ink : paper;
+        }
+    }
+
+    return x;
+}
+
+/*      @brief Draw a scanline a pixel at a time, one bit per pixel */
+static int reference_1bpp(const BKModules * modules, int module, unsigned char * row) {
+    int x = 0;
+
+    memset(row, 0, (modules->num_modules * module + 7) / 8);
+    for (int e = 0; e < modules->num_elements; e++) {
+        for (int i = 0; i < modules->widths[e] * module; i++, x++) {
+            if (0 == e % 2) {
+                row[x / 8] |= 0x80 >> (x % 8);
+            }
+        }
+    }
+
+    return (x + 7) / 8;
+}
+
+static int guard_intact(const unsigned char * guard) {
+    for (int i = 0; i < EXAMPLE_GUARD_LEN; i++) {
+        if (EXAMPLE_GUARD != guard[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*      @brief Compare the kernels in use with the reference, returning the number of mismatches */
+static int check_kernels(int num_barcodes, unsigned char * row, unsigned char * expected) {
+    size_t    size     = BK_SCANLINE_SIZE(EXAMPLE_MAX_PIXELS);
+    int       failures = 0;
+    BKModules modules;
+
+    for (int n = 0; n < num_barcodes; n++) {
+        int           module = 1 + rand() % EXAMPLE_MAX_MODULE;
+        unsigned char ink = rand(), paper = rand();
+        random_modules(&modules);
+
+        // Only the pixels drawn and their padding may be written
+        int pixels = modules.num_modules * module;
+        memset(row, EXAMPLE_GUARD, size + EXAMPLE_GUARD_LEN);
+        int drawn = bk_scanline_8bpp(&modules, module, ink, paper, row);
+        reference_8bpp(&modules, module, ink, paper, expected);
+        if (drawn != pixels || 0 != memcmp(row, expected, pixels)
+            || !guard_intact(row + BK_SCANLINE_SIZE(pixels))) {
+            failures++;
+        }
+
+        memset(row, EXAMPLE_GUARD, size + EXAMPLE_GUARD_LEN);
+        int bytes = bk_scanline_1bpp(&modules, module, row);
+        reference_1bpp(&modules, module, expected);
+        if (bytes != (pixels + 7) / 8 || 0 != memcmp(row, expected, bytes)
+            || !guard_intact(row + BK_SCANLINE_SIZE(pixels))) {
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+/**
+ *      @brief Draw barcodes @c rows high with the kernels in use, returning megapixels per second
+ *      @details As many pixels are drawn whatever the height, so a single row times the kernels
+ *               alone.
+ */
+static double benchmark_kernels(int num_barcodes, int depth, int rows, unsigned char * image) {
+    BKModules modules;
+    double    pixels = 0;
+
+    random_modules(&modules);
+    uint64_t start = bk_clock_ns();
+    for (long n = 0; n < (long) num_barcodes * EXAMPLE_BAR_HEIGHT / rows; n++) {
+        int width = modules.num_modules * EXAMPLE_MODULE;
+        int len;
+        if (8 == depth) {
+            len = bk_scanline_8bpp(&modules, EXAMPLE_MODULE, 0x00, 0xFF, image);
+        } else {
+            len = bk_scanline_1bpp(&modules, EXAMPLE_MODULE, image);
+        }
+        bk_scanline_replicate(image, len, len, rows);
+        pixels += (double) width * rows;
+    }
+    double seconds = (bk_clock_ns() - start) / 1e9;
+
+    return pixels / 1e6 / seconds;
+}
+
+int main(int argc, char ** argv) {
+    int num_barcodes = argc > 1 ? atoi(argv[1]) : EXAMPLE_DEFAULT_BARCODES;
+    if (num_barcodes <= 0) {
+        fprintf(stderr, "Usage: %s [N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    size_t          size     = BK_SCANLINE_SIZE(EXAMPLE_MAX_PIXELS) + EXAMPLE_GUARD_LEN;
+    unsigned char * row      = malloc(size);
+    unsigned char * expected = malloc(size);
+    // Tall enough for any barcode drawn by the benchmark, and the padding of its first row
+    size_t          image_size =
+        BK_SCANLINE_SIZE((size_t) EXAMPLE_MAX_PIXELS * EXAMPLE_BAR_HEIGHT);
+    unsigned char * image  = malloc(image_size);
+    int             status = EXIT_SUCCESS;
+
+    if (NULL == row || NULL == expected || NULL == image) {
+        fprintf(stderr, "scanline: out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (int isa = BK_SCANLINE_SCALAR; isa <= BK_SCANLINE_AVX2; isa++) {
+        if (SUCCESS != bk_scanline_use(isa)) {
+            printf("%-8s unsupported\n", bk_scanline_name(isa));
+            continue;
+        }
+
+        srand(1);
+        int failures = check_kernels(num_barcodes, row, expected);
+        if (failures > 0) {
+            fprintf(stderr,
+                    "scanline: %s kernels differ from the reference for %d of %d scanlines\n",
+                    bk_scanline_name(isa),
+                    failures,
+                    2 * num_barcodes);
+            status = EXIT_FAILURE;
+            continue;
+        }
+
+        printf("%-8s scanlines 8bpp %6.0f MP/s, 1bpp %6.0f MP/s;"
+               " barcodes 8bpp %6.0f MP/s, 1bpp %6.0f MP/s\n",
+               bk_scanline_name(isa),
+               benchmark_kernels(num_barcodes, 8, 1, image),
+               benchmark_kernels(num_barcodes, 1, 1, image),
+               benchmark_kernels(num_barcodes, 8, EXAMPLE_BAR_HEIGHT, image),
+               benchmark_kernels(num_barcodes, 1, EXAMPLE_BAR_HEIGHT, image));
+    }
+    printf("Best supported: %s\n", bk_scanline_name(bk_scanline_best()));
+
+    free(row);
+    free(expected);
+    free(image);
+
+    return status;
+}
@@ -0,0 +1,189 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file soak.c
+ *      @brief Soak test of the generate and print cycle run by the user interface
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      soak [CYCLES [PRINTER]]
+ *          Generate (and, given a printer, print) a small job CYCLES times (by default 5000),
+ *          as the user interface does each time Print is clicked - alternately regenerating the
+ *          job, and taking the output prepared in the background through a reused context. Fails
+ *          unless the number of live allocations and the peak resident memory stop growing once
+ *          warmed up. On glibc every malloc() in the process is counted (see malloc_count.h), so
+ *          that leaks in libbarcode and the C library are caught as well as the backend's own.
+ *          Put a stub lp, e.g. a script printing "request id is stub-1 (1 file(s))", first on
+ *          PATH to soak printing without a printer.
+ */
+
+#include "barcodeui.h"
+#include "malloc_count.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOAK_DEFAULT_CYCLES 5000
+#define SOAK_BARCODES 8
+#define SOAK_DISTINCT_CODES 100
+// Cycles run before the baseline is taken, as a percentage of all cycles
+#define SOAK_WARMUP_PERCENT 10
+// Growth in peak resident memory after warming up which is not counted as a leak
+#define SOAK_RSS_SLACK (1024 * 1024)
+
+/*      @brief An allocator counting the allocations made through it which are still live */
+static void * counting_realloc(void * ctx, void * ptr, size_t size) {
+    if (NULL == ptr) {
+        (*(long *) ctx)++;
+    }
+    return realloc(ptr, size);
+}
+
+static void counting_free(void * ctx, void * ptr) {
+    (*(long *) ctx)--;
+    free(ptr);
+}
+
+/*      @brief Generate into a temporary file of its own, as the user interface does in advance */
+// clang-format off
+static int soak_prepare(
+    char ** barcodes,
+    int * quantities,
+    PSProperties * props,
+    Layout * layout,
+    BKGenerateContext * context,
+    char * path
+) {
+    // clang-format on
+    BKArraySource array = { barcodes, quantities, SOAK_BARCODES, 0 };
+    BKSource      rows  = { bk_array_next, &array };
+    FILE *        file;
+
+    int status = bk_tempfile_open(path, &file);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    BKSink sink = { bk_file_write, file };
+    status      = bk_generate_context(&rows, props, layout, &sink, context, NULL);
+    if (EOF == fclose(file) && SUCCESS == status) {
+        status = ERR_FILE_CLOSE_FAILED;
+    }
+
+    return status;
+}
+
+static int soak_cycle(int cycle, const char * printer, BKGenerateContext * context) {
+    char         codes[SOAK_BARCODES][BK_BARCODE_LENGTH];
+    char *       barcodes[SOAK_BARCODES];
+    int          quantities[SOAK_BARCODES];
+    PSProperties props = PS_DEFAULT_PROPS;
+    Layout       layout;
+    char         prepared_path[BK_TEMPFILE_TEMPLATE_SIZE];
+    char *       ps_path = NULL;
+    int          status;
+
+    layout.rows = BK_DEFAULT_ROWS;
+    layout.cols = BK_DEFAULT_COLS;
+
+    for (int i = 0; i < SOAK_BARCODES; i++) {
+        snprintf(codes[i], BK_BARCODE_LENGTH, "SOAK-%06d", (cycle + i) % SOAK_DISTINCT_CODES);
+        barcodes[i]   = codes[i];
+        quantities[i] = 1 + i % 3;
+    }
+
+    if (cycle % 2) {
+        status = soak_prepare(barcodes, quantities, &props, &layout, context, prepared_path);
+        if (SUCCESS != status) {
+            return status;
+        }
+        // The prepared file is removed once printed, so lp must have read it first
+        if (NULL != printer) {
+            status = bk_print_sync(prepared_path, (char *) printer, NULL, 0);
+        }
+        remove(prepared_path);
+        return status;
+    }
+
+    status = bk_generate(barcodes, quantities, SOAK_BARCODES, &props, &layout, &ps_path);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    if (NULL != printer) {
+        status = bk_print(ps_path, (char *) printer);
+    }
+    free(ps_path);
+
+    return status;
+}
+
+int main(int argc, char ** argv) {
+    long         live      = 0;
+    BKAllocator  allocator = { counting_realloc, counting_free, &live };
+    int          cycles    = argc > 1 ? atoi(argv[1]) : SOAK_DEFAULT_CYCLES;
+    const char * printer   = argc > 2 ? argv[2] : NULL;
+    int          warmup    = cycles * SOAK_WARMUP_PERCENT / 100;
+    long         base_live = 0, base_mallocs = 0;
+    size_t       base_rss  = 0;
+    int          status    = SUCCESS;
+
+    BKGenerateContext context;
+
+    if (cycles <= 0) {
+        fprintf(stderr, "Usage: %s [CYCLES [PRINTER]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bk_set_allocator(&allocator);
+    if (SUCCESS != (status = bk_init())) {
+        fprintf(stderr, "soak: could not initialise the backend: error %d\n", status);
+        return EXIT_FAILURE;
+    }
+
+    bk_context_init(&context);
+    uint64_t start = bk_clock_ns();
+    for (int i = 0; i < cycles && SUCCESS == status; i++) {
+        if (i == warmup) {
+            base_live    = live;
+            base_mallocs = malloc_count_live();
+            base_rss     = bk_peak_rss();
+        }
+        status = soak_cycle(i, printer, &context);
+    }
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    size_t rss         = bk_peak_rss();
+    long   end_live    = live;
+    long   end_mallocs = malloc_count_live();
+    bk_context_free(&context);
+    bk_exit();
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "soak: cycle failed: error %d\n", status);
+        return EXIT_FAILURE;
+    }
+
+    printf("Ran %d cycles in %.1f ms (%.3f ms each)\n", cycles, elapsed_ms, elapsed_ms / cycles);
+    printf("Live allocations: %ld after warming up, %ld at the end\n", base_live, end_live);
+    if (MALLOC_COUNTED) {
+        printf("Live allocations in the whole process: %ld after warming up, %ld at the end\n",
+               base_mallocs,
+               end_mallocs);
+    }
+    printf("Peak memory: %.1f MiB after warming up, %.1f MiB at the end\n",
+           base_rss / 1048576.0,
+           rss / 1048576.0);
+
+    if (end_live > base_live || end_mallocs > base_mallocs || rss > base_rss + SOAK_RSS_SLACK) {
+        fprintf(stderr, "soak: memory grew after warming up\n");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,265 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file spool.c
+ *      @brief Test harness of a spool directory printing to a stub lp
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      spool [JOBS [WORKERS]]
+ *          Watch a new spool directory with WORKERS (by default 4) workers, as --watch does, and
+ *          drop JOBS (by default 200) small job files into it the way a producer should - written
+ *          to a hidden file, then renamed into place - one in every EXAMPLE_BAD_EVERY of which
+ *          cannot be imported. lp is replaced on PATH by a stub which logs each request. Fails
+ *          unless every good job is moved to done and every bad one to failed with an error file,
+ *          and reports the jobs printed per second and how many were coalesced into each lp
+ *          request. Linux only.
+ */
+
+#include "barcodeui.h"
+#include "spool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EXAMPLE_DEFAULT_JOBS 200
+#define EXAMPLE_JOB_ROWS 5
+// Every this many jobs, one is dropped with an extension that cannot be imported
+#define EXAMPLE_BAD_EVERY 25
+#define EXAMPLE_TIMEOUT_MS 60000
+#define EXAMPLE_POLL_MS 5
+#define EXAMPLE_TEMPLATE "/tmp/bk-spool-XXXXXX"
+#define EXAMPLE_PRINTER "stub"
+
+/*      @brief The stub lp, logging its arguments to the file given by its first format argument */
+#define EXAMPLE_STUB_LP                                                                            \
+    "#!/bin/sh\n"                                                                                  \
+    "echo \"$@\" >> '%s'\n"                                                                        \
+    "echo \"request id is " EXAMPLE_PRINTER "-$$ (1 file(s))\"\n"
+
+static void * run_spool(void * arg) {
+    bk_spool_run(arg);
+    return NULL;
+}
+
+static int is_bad_job(int job) {
+    return EXAMPLE_BAD_EVERY - 1 == job % EXAMPLE_BAD_EVERY;
+}
+
+/*      @brief Write a job file to a hidden name, then rename it into the spool directory */
+static int drop_job(const char * spool, int job) {
+    char   hidden[PATH_MAX], path[PATH_MAX];
+    FILE * file;
+
+    snprintf(hidden, sizeof hidden, "%s/.job-%05d", spool, job);
+    snprintf(path, sizeof path, "%s/job-%05d.%s", spool, job, is_bad_job(job) ? "xyz" : "csv");
+
+    if (NULL == (file = fopen(hidden, "w"))) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+    fputs("barcode,quantity\n", file);
+    for (int i = 0; i < EXAMPLE_JOB_ROWS; i++) {
+        fprintf(file, "JOB%05d-%d,%d\n", job, i, 1 + i % 2);
+    }
+    if (EOF == fclose(file)) {
+        return ERR_FILE_CLOSE_FAILED;
+    }
+
+    return 0 == rename(hidden, path) ? SUCCESS : ERR_GENERIC;
+}
+
+/*      @brief Count the files in a directory whose names end in @c ext */
+static int count_files(const char * dir, const char * ext) {
+    DIR *           d = opendir(dir);
+    struct dirent * entry;
+    int             count = 0;
+
+    if (NULL == d) {
+        return 0;
+    }
+    while (NULL != (entry = readdir(d))) {
+        size_t len = strlen(entry->d_name);
+        if ('.' != entry->d_name[0] && len >= strlen(ext)
+            && 0 == strcmp(entry->d_name + len - strlen(ext), ext)) {
+            count++;
+        }
+    }
+    closedir(d);
+
+    return count;
+}
+
+/*      @brief Count the lines of a file, or 0 if it does not exist */
+static int count_lines(const char * path) {
+    FILE * file = fopen(path, "r");
+    int    lines = 0, c;
+
+    if (NULL == file) {
+        return 0;
+    }
+    while (EOF != (c = fgetc(file))) {
+        lines += '\n' == c;
+    }
+    fclose(file);
+
+    return lines;
+}
+
+/*      @brief Remove a directory and everything in it */
+static void remove_tree(const char * dir) {
+    DIR *           d = opendir(dir);
+    struct dirent * entry;
+    struct stat     st;
+    char            path[PATH_MAX];
+
+    while (NULL != d && NULL != (entry = readdir(d))) {
+        if (0 == strcmp(entry->d_name, ".") || 0 == strcmp(entry->d_name, "..")) {
+            continue;
+        }
+        snprintf(path, sizeof path, "%s/%s", dir, entry->d_name);
+        if (0 == lstat(path, &st) && S_ISDIR(st.st_mode)) {
+            remove_tree(path);
+        } else {
+            remove(path);
+        }
+    }
+    if (NULL != d) {
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char ** argv) {
+    int            jobs    = argc > 1 ? atoi(argv[1]) : EXAMPLE_DEFAULT_JOBS;
+    BKSpoolOptions options = { NULL, EXAMPLE_PRINTER, argc > 2 ? atoi(argv[2]) : 0, 0 };
+    char           root[] = EXAMPLE_TEMPLATE;
+    char           spool[PATH_MAX], bin[PATH_MAX], lp[PATH_MAX], log[PATH_MAX], path[PATH_MAX];
+    char           done[PATH_MAX], failed[PATH_MAX];
+    pthread_t      thread;
+    int            status = SUCCESS;
+
+    if (jobs <= 0 || options.workers < 0) {
+        fprintf(stderr, "Usage: %s [JOBS [WORKERS]]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL == mkdtemp(root)) {
+        perror("spool: could not create a temporary directory");
+        return EXIT_FAILURE;
+    }
+    snprintf(spool, sizeof spool, "%s/spool", root);
+    snprintf(bin, sizeof bin, "%s/bin", root);
+    snprintf(lp, sizeof lp, "%s/" BK_PRINT_CMD, bin);
+    snprintf(log, sizeof log, "%s/lp.log", root);
+    snprintf(done, sizeof done, "%s/" BK_SPOOL_DONE_DIR, spool);
+    snprintf(failed, sizeof failed, "%s/" BK_SPOOL_FAILED_DIR, spool);
+    options.dir = spool;
+
+    // The stub lp is found first on PATH by the spool's print subprocesses
+    FILE * stub = NULL;
+    if (-1 == mkdir(spool, 0755) || -1 == mkdir(bin, 0755) || NULL == (stub = fopen(lp, "w"))) {
+        perror("spool: could not create the spool directory and stub lp");
+        return EXIT_FAILURE;
+    }
+    fprintf(stub, EXAMPLE_STUB_LP, log);
+    fclose(stub);
+    chmod(lp, 0755);
+    snprintf(path, sizeof path, "%s:%s", bin, getenv("PATH") ? getenv("PATH") : "/usr/bin:/bin");
+    setenv("PATH", path, 1);
+
+    pthread_create(&thread, NULL, run_spool, &options);
+
+    // The queue depth is sampled after each job is dropped, and while waiting for the rest
+    int      bad = 0, max_depth = 0;
+    uint64_t start = bk_clock_ns();
+    for (int i = 0; i < jobs && SUCCESS == status; i++) {
+        int depth = bk_spool_queue_depth();
+
+        max_depth = depth > max_depth ? depth : max_depth;
+        bad += is_bad_job(i);
+        status = drop_job(spool, i);
+    }
+
+    // Wait for every job to be moved out of the work directory
+    int      printed = 0, rejected = 0;
+    uint64_t timeout = start + (uint64_t) EXAMPLE_TIMEOUT_MS * 1000000;
+    while (SUCCESS == status && printed + rejected < jobs) {
+        struct timespec poll = { 0, EXAMPLE_POLL_MS * 1000000L };
+        int             depth = bk_spool_queue_depth();
+
+        max_depth = depth > max_depth ? depth : max_depth;
+        if (bk_clock_ns() > timeout) {
+            fprintf(stderr, "spool: timed out with %d of %d jobs done\n", printed + rejected, jobs);
+            status = ERR_GENERIC;
+            break;
+        }
+        nanosleep(&poll, NULL);
+        printed  = count_files(done, ".csv");
+        rejected = count_files(failed, ".xyz");
+    }
+    double elapsed_ms = (bk_clock_ns() - start) / 1e6;
+
+    // The spool is stopped as it would be by a service manager, once its queue has drained
+    if (printed + rejected == jobs) {
+        kill(getpid(), SIGTERM);
+        pthread_join(thread, NULL);
+    }
+
+    int requests = count_lines(log);
+    int outputs  = count_files(done, BK_SPOOL_OUT_EXT);
+    int errors   = count_files(failed, BK_SPOOL_ERR_EXT);
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "spool: error %d\n", status);
+    } else if (printed != jobs - bad || rejected != bad || errors != bad) {
+        fprintf(stderr,
+                "spool: %d printed and %d failed (%d error files), expected %d and %d\n",
+                printed,
+                rejected,
+                errors,
+                jobs - bad,
+                bad);
+        status = ERR_GENERIC;
+    } else if (requests != outputs || requests < 1) {
+        fprintf(stderr, "spool: %d lp requests for %d PostScript files\n", requests, outputs);
+        status = ERR_GENERIC;
+    } else {
+        printf("Printed %d jobs in %d lp requests (%.1f jobs per request) and rejected %d in "
+               "%.1f ms: %.0f jobs/s, at most %d queued\n",
+               printed,
+               requests,
+               (double) printed / requests,
+               rejected,
+               elapsed_ms,
+               jobs / (elapsed_ms / 1e3),
+               max_depth);
+    }
+
+    if (printed + rejected == jobs) {
+        remove_tree(root);
+    } else {
+        fprintf(stderr, "spool: left %s for inspection\n", root);
+    }
+
+    return SUCCESS == status ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#else
+int main(void) {
+    fprintf(stderr, "spool: spool directories are only supported on Linux\n");
+    return EXIT_FAILURE;
+}
+#endif
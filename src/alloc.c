@@ -0,0 +1,57 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file alloc.c
+ *      @brief Replaceable memory allocator implementations as defined in alloc.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "alloc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void * libc_realloc(void * ctx, void * ptr, size_t size) {
+    (void) ctx;
+    return realloc(ptr, size);
+}
+
+static void libc_free(void * ctx, void * ptr) {
+    (void) ctx;
+    free(ptr);
+}
+
+static BKAllocator bk_allocator = { libc_realloc, libc_free, NULL };
+
+void bk_set_allocator(const BKAllocator * allocator) {
+    if (NULL == allocator) {
+        bk_allocator.realloc = libc_realloc;
+        bk_allocator.free    = libc_free;
+        bk_allocator.ctx     = NULL;
+    } else {
+        bk_allocator = *allocator;
+    }
+}
+
+void * bk_realloc(void * ptr, size_t size) {
+    return bk_allocator.realloc(bk_allocator.ctx, ptr, size);
+}
+
+void * bk_calloc(size_t size) {
+    void * ptr = bk_allocator.realloc(bk_allocator.ctx, NULL, size);
+    if (NULL != ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void bk_free(void * ptr) {
+    if (NULL != ptr) {
+        bk_allocator.free(bk_allocator.ctx, ptr);
+    }
+}
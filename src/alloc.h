@@ -0,0 +1,48 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file alloc.h
+ *      @brief Replaceable memory allocator declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+/**
+ *      @brief A set of allocation functions to use in place of the C library's
+ *      @details @c realloc behaves as realloc(3) - it is called with a NULL pointer to allocate.
+ *               @c ctx is passed to both functions unchanged.
+ */
+typedef struct BKAllocator {
+    void * (*realloc)(void *, void *, size_t);
+    void (*free)(void *, void *);
+    void * ctx;
+} BKAllocator;
+
+/**
+ *      @brief Set the allocator used for jobs, encoding caches and other backend storage
+ *      @details Must be called before anything is allocated, and not changed while any storage
+ *               allocated through it remains in use. Encodings and PostScript allocated within
+ *               libbarcode are not affected.
+ *      @param allocator The allocator to use, or NULL for the C library's
+ */
+void bk_set_allocator(const BKAllocator *);
+
+/*      @brief Allocate or resize through the current allocator, as realloc(3) */
+void * bk_realloc(void *, size_t);
+
+/*      @brief Allocate zeroed storage through the current allocator */
+void * bk_calloc(size_t);
+
+/*      @brief Release storage allocated through the current allocator */
+void bk_free(void *);
+
+#endif
@@ -0,0 +1,98 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file arena.c
+ *      @brief Job-scoped arena allocator implementations as defined in arena.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "arena.h"
+
+#include "alloc.h"
+
+#include <string.h>
+
+#define ARENA_ROUND(size) (((size) + BK_ARENA_ALIGN - 1) & ~(size_t)(BK_ARENA_ALIGN - 1))
+// Block headers are padded so that block data is aligned
+#define ARENA_HEADER_SIZE ARENA_ROUND(sizeof(BKArenaBlock))
+
+static BKArenaBlock * arena_block_new(size_t size) {
+    BKArenaBlock * block = bk_realloc(NULL, ARENA_HEADER_SIZE + size);
+    if (NULL != block) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
+
+void bk_arena_init(BKArena * arena) {
+    memset(arena, 0, sizeof *arena);
+}
+
+void * bk_arena_alloc(BKArena * arena, size_t size) {
+    BKArenaBlock * block = arena->blocks;
+
+    size = ARENA_ROUND(size);
+
+    if (NULL == block || block->size - block->used < size) {
+        // Each block is at least double the last, so a growing job needs few of them
+        size_t block_size = NULL == block ? BK_ARENA_BLOCK_SIZE : block->size * 2;
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        BKArenaBlock * next = arena_block_new(block_size);
+        if (NULL == next) {
+            return NULL;
+        }
+        next->next    = block;
+        arena->blocks = next;
+        block         = next;
+    }
+
+    void * ptr = (char *) block + ARENA_HEADER_SIZE + block->used;
+    block->used += size;
+
+    return ptr;
+}
+
+void bk_arena_reset(BKArena * arena) {
+    BKArenaBlock * block = arena->blocks;
+
+    if (NULL == block) {
+        return;
+    }
+
+    if (NULL == block->next) {
+        block->used = 0;
+        return;
+    }
+
+    size_t total = 0;
+    while (NULL != block) {
+        BKArenaBlock * next = block->next;
+        total += block->size;
+        bk_free(block);
+        block = next;
+    }
+
+    // Should this fail, the arena starts again from nothing
+    arena->blocks = arena_block_new(total);
+}
+
+void bk_arena_free(BKArena * arena) {
+    BKArenaBlock * block = arena->blocks;
+
+    while (NULL != block) {
+        BKArenaBlock * next = block->next;
+        bk_free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
@@ -0,0 +1,67 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file arena.h
+ *      @brief Job-scoped arena allocator declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/**
+ *      @defgroup ArenaProperties Arena properties
+ */
+/*@{*/
+// clang-format off
+// Smallest block allocated by an arena
+#define BK_ARENA_BLOCK_SIZE     (16 * 1024)
+// Alignment of every allocation from an arena
+#define BK_ARENA_ALIGN          16
+// clang-format on
+/*@}*/
+
+/*      @brief A block of arena storage, followed by its data */
+typedef struct BKArenaBlock {
+    struct BKArenaBlock * next;
+    size_t                size;
+    size_t                used;
+} BKArenaBlock;
+
+/**
+ *      @brief Storage for the duration of one job, released all at once
+ *      @details Allocations are carved from a chain of blocks, newest first, and are only released
+ *               by bk_arena_reset() or bk_arena_free(). An arena is zeroed to initialise it and is
+ *               not thread-safe.
+ */
+typedef struct BKArena {
+    BKArenaBlock * blocks;
+} BKArena;
+
+void bk_arena_init(BKArena *);
+
+/**
+ *      @brief Allocate uninitialised storage from an arena
+ *      @return The storage, aligned to BK_ARENA_ALIGN, or NULL if a new block could not be allocated
+ */
+void * bk_arena_alloc(BKArena *, size_t);
+
+/**
+ *      @brief Release every allocation from an arena, keeping its storage for reuse
+ *      @details If the last job needed more than one block, they are replaced by a single block
+ *               as large as all of them together, so that a job of the same size runs without
+ *               allocating.
+ */
+void bk_arena_reset(BKArena *);
+
+/*      @brief Release an arena's storage */
+void bk_arena_free(BKArena *);
+
+#endif
@@ -11,34 +11,52 @@
  *      @date 21/4/19
  */
 
+#ifdef __linux__
+// For pipe2()
+#define _GNU_SOURCE
+#endif
+
 #include "backend.h"
 
+#include "alloc.h"
 #include "barcode.h"
 #include "error.h"
-#include "gtk/gtk.h"
+#include "metrics.h"
+#include "probes.h"
+#include "str.h"
+#include "trace.h"
 
 #include <setjmp.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #ifdef _WIN32
-#include "util.h"
-
 #include <errno.h>
 #else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 #endif
 
 static FILE * bk_tempfile;
 static char * bk_tempfile_path;
 
+/*      @brief Generation context for jobs generated into the backend's temporary file */
+static BKGenerateContext bk_context;
+
 int bk_init(void) {
 
     jmp_buf env;
     int     status = SUCCESS;
 
+    bk_context_init(&bk_context);
+
     if (!setjmp(env)) {
         bk_tempfile_path = calloc(1, BK_TEMPFILE_TEMPLATE_SIZE);
         VERIFY_NULL_BC(bk_tempfile_path, BK_TEMPFILE_TEMPLATE_SIZE);
@@ -93,136 +111,446 @@ int bk_exit(void) {
     }
 
     free(bk_tempfile_path);
+    bk_context_free(&bk_context);
 
     return status;
 }
 
+// clang-format off
+int bk_generate_stream(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    return bk_generate_cached(source, props, layout, sink, NULL, stats);
+}
+
 /**
- *      @detail bk_generate_png() generates a temporary po file from a list of barcodes and
- *              property structures and fills the destination pointer with the image path.
+ *      @details Rows and columns are each checked before their product, so that it cannot
+ *              overflow.
  */
+int bk_layout_check(const Layout * layout) {
+    if (layout->rows <= 0 || layout->cols <= 0 || layout->rows > BK_MAX_LABELS_PER_PAGE
+        || layout->cols > BK_MAX_LABELS_PER_PAGE
+        || layout->rows * layout->cols > BK_MAX_LABELS_PER_PAGE) {
+        return ERR_INVALID_LAYOUT;
+    }
+    return SUCCESS;
+}
 
+/**
+ *      @details Unlike the backend's own temporary file, files created here belong to the caller,
+ *              so generation into them may run alongside the user interface.
+ */
+int bk_tempfile_open(char * path, FILE ** file) {
+#ifdef _WIN32
+    if (SUCCESS != tmpnam_s(path, BK_TEMPFILE_TEMPLATE_SIZE)
+        || NULL == (*file = fopen(path, "w"))) {
+        return ERR_TEMPORARY_FILE_CREATION_FAILED;
+    }
+#else
+    strncpy(path, BK_TEMPFILE_TEMPLATE, BK_TEMPFILE_TEMPLATE_SIZE - 1);
+
+    int fd = mkstemp(path);
+    if (-1 == fd) {
+        return ERR_TEMPORARY_FILE_CREATION_FAILED;
+    }
+    if (NULL == (*file = fdopen(fd, "w"))) {
+        close(fd);
+        remove(path);
+        return ERR_TEMPORARY_FILE_CREATION_FAILED;
+    }
+#endif
+
+    return SUCCESS;
+}
+
+/**
+ *      @brief Lay out a page of labels and write it to the sink
+ *      @param len Destination for the number of bytes written
+ */
 // clang-format off
-int bk_generate(
-    char **barcodes,
-    int *quantities,
-    int num_barcodes,
+static int emit_page(
+    Code128 ** page,
+    int num_labels,
     PSProperties * props,
     Layout * layout,
-    char ** ps_name_ptr
+    BKSink * sink,
+    uint64_t job,
+    long page_num,
+    size_t * len
 ) {
+    // clang-format on
+
+    char *   postscript;
+    uint64_t span  = bk_trace_begin();
+    uint64_t probe = BK_PROBE_CLOCK(page);
+
+    int status = c128_ps_layout(page, num_labels, &postscript, props, layout);
+    if (status != SUCCESS) {
+        return status;
+    }
+    *len = strlen(postscript);
+    bk_metrics_observe(BK_METRIC_LAYOUT_SECONDS, bk_trace_end(BK_TRACE_LAYOUT, span));
+    BK_PROBE5(page, job, page_num, num_labels, *len, bk_clock_ns() - probe);
+
+    span   = bk_trace_begin();
+    probe  = BK_PROBE_CLOCK(write);
+    status = sink->write(sink->ctx, postscript, *len);
+    if (status == SUCCESS) {
+        bk_metrics_observe(BK_METRIC_WRITE_SECONDS, bk_trace_end(BK_TRACE_WRITE, span));
+        BK_PROBE4(write, job, page_num, *len, bk_clock_ns() - probe);
+    }
 
+    free(postscript);
+
+    return status;
+}
+
+/**
+ *      @details Rows are pulled from the source one at a time and encoded immediately, so the
+ *              source need only keep a row valid until it is next called. Labels are gathered into
+ *              pages of @c layout->rows x @c layout->cols; each page is laid out and written to
+ *              the sink as soon as it is full, so memory use is bounded by the size of one page
+ *              regardless of the number of labels. Without a cache, each row is encoded once per
+ *              page it appears on, however many copies of it are printed; with one, each distinct
+ *              barcode is encoded once for as long as the cache keeps it. The cache is trimmed
+ *              between pages, so it too is bounded however many distinct barcodes a job has.
+ *              Working storage comes from @c arena, and is released when it is next reset.
+ */
+// clang-format off
+static int generate(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKArena * arena,
+    BKEncodeCache * cache,
+    BKGenerateStats * stats
+) {
     // clang-format on
 
-    char *     postscript_dest;
-    Code128 ** barcode_structs;
-    // There are multiple failure points so we define some memory allocation flags
-    // Safe error handling is provided by setjmp() and longjmp()
-    bool postscript_allocated = false;
-    int  num_allocated        = 0;
+    int                 per_page;
+    Code128 **          page;
+    Code128 **          encoded;
+    // Counters are modified after setjmp(), so must be volatile to be reliable after longjmp()
+    volatile int        on_page     = 0;
+    volatile int        num_encoded = 0;
+    volatile long       labels = 0, pages = 0;
+    volatile size_t     bytes  = 0;
+    // Start of the span reading and encoding the labels of the page in progress
+    volatile uint64_t   encode_start;
+
+    jmp_buf      env;
+    volatile int status = SUCCESS;
+
+    if (SUCCESS != bk_layout_check(layout)) {
+        return ERR_INVALID_LAYOUT;
+    }
+    per_page = layout->rows * layout->cols;
 
-    jmp_buf env;
-    int     status = SUCCESS;
+    uint64_t      job_start    = bk_trace_begin();
+    unsigned long cache_hits   = NULL != cache ? cache->hits : 0;
+    unsigned long cache_misses = NULL != cache ? cache->misses : 0;
+    uint64_t      job          = BK_PROBE_JOB_ID();
+    uint64_t      job_probe    = BK_PROBE_CLOCK(job_end);
+    encode_start               = job_start;
+
+    BK_PROBE2(job_start, job, per_page);
+
+    size_t page_size = sizeof *page * per_page;
+    page             = bk_arena_alloc(arena, page_size);
+    VERIFY_NULL_BC(page, page_size);
+    // At most one distinct encoding per label, plus a row continued from the previous page
+    size_t encoded_size = sizeof *encoded * (per_page + 1);
+    encoded             = bk_arena_alloc(arena, encoded_size);
+    VERIFY_NULL_BC(encoded, encoded_size);
 
     if (!setjmp(env)) {
-        /* Calculate total number of barcodes that will be generated, which is used to calculate the
-           size of the barcode buffer */
-        int    total_barcodes       = 0;
-        size_t barcode_structs_size = 0;
-        for (int barcode_no = 0; barcode_no < num_barcodes; barcode_no++) {
-            for (int barcode_idx = 0; barcode_idx < quantities[barcode_no]; barcode_idx++) {
-                total_barcodes++;
+        const char * barcode;
+        int          quantity;
+
+        for (;;) {
+            status = source->next(source->ctx, &barcode, &quantity);
+            if (BK_SOURCE_END == status) {
+                status = SUCCESS;
+                break;
+            } else if (SUCCESS != status) {
+                longjmp(env, status);
             }
-        }
 
-        barcode_structs_size = sizeof *barcode_structs * total_barcodes;
-
-        barcode_structs = calloc(1, barcode_structs_size);
-        VERIFY_NULL_BC(barcode_structs, barcode_structs_size);
-
-        /** Algorithm:
-         (i) Generate barcodes from input text
-         (ii) Generate PostScript from the given barcodes and properties and store in a supplied
-              string buffer
-        */
-
-        /* (i) */
-        /* Loop over each barcode, then encode that barcode the corresponding number of times
-           specified in quantities[]. This creates an array of internal barcode representations
-           which we later use to generate PostScript */
-        for (int barcode_no = 0; barcode_no < num_barcodes; barcode_no++) {
-            for (int barcode_idx = 0; barcode_idx < quantities[barcode_no]; barcode_idx++) {
-                status = c128_encode((uchar *) barcodes[barcode_no],
-                                     strlen(barcodes[barcode_no]),
-                                     &barcode_structs[num_allocated]);
-
-                // __LINE__, __func__, barcode_no, barcode_idx);
-                if (status != SUCCESS) {
-                    longjmp(env, status);
-                }
-                num_allocated++;
+            if (quantity <= 0) {
+                continue;
             }
-        }
 
+            // No page is in progress, so no cached encodings are in use
+            if (NULL != cache && 0 == on_page) {
+                bk_cache_trim(cache);
+            }
 
-        /* (iii) */
-        status = c128_ps_layout(barcode_structs, total_barcodes, &postscript_dest, props, layout);
+            Code128 *     current;
+            uint64_t      encode_probe  = BK_PROBE_CLOCK(encode);
+            unsigned long probe_misses  = BK_PROBE_ENABLED(encode) && cache ? cache->misses : 0;
+            if (NULL == cache) {
+                status = c128_encode((uchar *) barcode, strlen(barcode), &current);
+            } else {
+                status = bk_cache_encode(cache, barcode, &current);
+            }
+            if (status != SUCCESS) {
+                longjmp(env, status);
+            }
+            BK_PROBE6(encode,
+                      job,
+                      barcode,
+                      strlen(barcode),
+                      quantity,
+                      bk_clock_ns() - encode_probe,
+                      NULL != cache && cache->misses == probe_misses);
+            // Cached encodings are owned by the cache
+            if (NULL == cache) {
+                encoded[num_encoded++] = current;
+            }
 
-        if (status != SUCCESS) {
-            longjmp(env, status);
+            for (int copy = 0; copy < quantity; copy++) {
+                page[on_page++] = current;
+                labels++;
+
+                if (on_page == per_page) {
+                    /* Flush the full page. Every encoding but the current row's belongs only to
+                       this page. */
+                    bk_metrics_observe(BK_METRIC_ENCODE_SECONDS,
+                                       bk_trace_end(BK_TRACE_ENCODE, encode_start));
+                    size_t len;
+                    status = emit_page(page, on_page, props, layout, sink, job, pages, &len);
+                    if (status != SUCCESS) {
+                        longjmp(env, status);
+                    }
+
+                    if (NULL == cache) {
+                        for (int i = 0; i < num_encoded - 1; i++) {
+                            free(encoded[i]);
+                        }
+                        encoded[0]  = current;
+                        num_encoded = 1;
+                    }
+
+                    bytes += len;
+                    pages++;
+                    on_page      = 0;
+                    encode_start = bk_trace_begin();
+                }
+            }
         }
 
-        postscript_allocated = true;
+        // Final, partially filled page
+        if (on_page > 0) {
+            bk_metrics_observe(BK_METRIC_ENCODE_SECONDS,
+                               bk_trace_end(BK_TRACE_ENCODE, encode_start));
+            size_t len;
+            status = emit_page(page, on_page, props, layout, sink, job, pages, &len);
+            if (status != SUCCESS) {
+                longjmp(env, status);
+            }
 
-        // wipe file completely
-        if (NULL == freopen(bk_tempfile_path, "w", bk_tempfile)) {
-            status = ERR_FILE_RESET_FAILED;
-            longjmp(env, status);
+            bytes += len;
+            pages++;
         }
+    }
 
-        // fprintf returns negative when an error occurs
-        if (fprintf(bk_tempfile, "%s", postscript_dest) < 0) {
-            status = ERR_FILE_WRITE_FAILED;
-            longjmp(env, status);
-        }
+    for (int i = 0; i < num_encoded; i++) {
+        free(encoded[i]);
+    }
 
-        // ensure everything is written to file since we're keeping it open
-        if (fflush(bk_tempfile) != SUCCESS) {
-            status = ERR_FLUSH;
-            longjmp(env, status);
-        }
+    if (NULL != stats) {
+        stats->labels = labels;
+        stats->pages  = pages;
+        stats->bytes  = bytes;
+    }
 
-        // allocate and copy file destination to the given pointer
-        *ps_name_ptr = calloc(1, BK_TEMPFILE_TEMPLATE_SIZE);
-        VERIFY_NULL_BC(*ps_name_ptr, BK_TEMPFILE_TEMPLATE_SIZE);
+    bk_metrics_observe(BK_METRIC_JOB_SECONDS, bk_trace_end(BK_TRACE_JOB, job_start));
+    BK_PROBE6(job_end, job, labels, pages, bytes, bk_clock_ns() - job_probe, status);
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_JOBS : BK_METRIC_JOB_FAILURES, 1);
+    bk_metrics_add(BK_METRIC_LABELS, labels);
+    bk_metrics_add(BK_METRIC_PAGES, pages);
+    bk_metrics_add(BK_METRIC_BYTES, bytes);
+    if (NULL != cache) {
+        bk_metrics_add(BK_METRIC_CACHE_HITS, cache->hits - cache_hits);
+        bk_metrics_add(BK_METRIC_CACHE_MISSES, cache->misses - cache_misses);
+    }
 
-        strncpy(*ps_name_ptr, bk_tempfile_path, BK_TEMPFILE_TEMPLATE_SIZE);
+    return status;
+}
 
+// clang-format off
+int bk_generate_cached(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKEncodeCache * cache,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    BKArena arena;
+    bk_arena_init(&arena);
+
+    int status = generate(source, props, layout, sink, &arena, cache, stats);
+
+    bk_arena_free(&arena);
+
+    return status;
+}
+
+/**
+ *      @details The context's arena is reset as each job starts, and its cache trimmed once the
+ *              job's encodings are no longer in use.
+ */
+// clang-format off
+int bk_generate_context(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKGenerateContext * context,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    bk_arena_reset(&context->arena);
+
+    int status = generate(source, props, layout, sink, &context->arena, &context->cache, stats);
+
+    bk_cache_trim(&context->cache);
+
+    return status;
+}
+
+void bk_context_init(BKGenerateContext * context) {
+    bk_arena_init(&context->arena);
+    bk_cache_init(&context->cache);
+}
+
+void bk_context_free(BKGenerateContext * context) {
+    bk_arena_free(&context->arena);
+    bk_cache_free(&context->cache);
+}
+
+/**
+ *      @details Generation is streamed into the backend's temporary file, which is truncated
+ *              first. The file is kept open between calls.
+ */
+// clang-format off
+int bk_generate_source(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    char ** ps_name_ptr,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    int    status = SUCCESS;
+    BKSink sink   = { bk_file_write, NULL };
+
+    // wipe file completely
+    if (NULL == freopen(bk_tempfile_path, "w", bk_tempfile)) {
+        return ERR_FILE_RESET_FAILED;
     }
+    sink.ctx = bk_tempfile;
 
-    if (postscript_allocated) {
-        free(postscript_dest);
+    status = bk_generate_context(source, props, layout, &sink, &bk_context, stats);
+    if (SUCCESS != status) {
+        return status;
     }
 
-    // Clean up barcode_structs
-    for (int i = 0; i < num_allocated; i++) {
-        free(barcode_structs[i]);
+    // ensure everything is written to file since we're keeping it open
+    uint64_t span = bk_trace_begin();
+    if (fflush(bk_tempfile) != SUCCESS) {
+        return ERR_FLUSH;
     }
-    free(barcode_structs);
+    bk_trace_end(BK_TRACE_FLUSH, span);
 
+    // allocate and copy file destination to the given pointer
+    *ps_name_ptr = calloc(1, BK_TEMPFILE_TEMPLATE_SIZE);
+    VERIFY_NULL_BC(*ps_name_ptr, BK_TEMPFILE_TEMPLATE_SIZE);
+
+    strncpy(*ps_name_ptr, bk_tempfile_path, BK_TEMPFILE_TEMPLATE_SIZE);
 
     return status;
 }
 
+/**
+ *      @details bk_generate() generates a temporary PostScript file from a list of barcodes and
+ *              property structures and fills the destination pointer with the file path.
+ */
+// clang-format off
+int bk_generate(
+    char **barcodes,
+    int *quantities,
+    int num_barcodes,
+    PSProperties * props,
+    Layout * layout,
+    char ** ps_name_ptr
+) {
+    // clang-format on
+
+    BKArraySource array  = { barcodes, quantities, num_barcodes, 0 };
+    BKSource      source = { bk_array_next, &array };
+
+    return bk_generate_source(&source, props, layout, ps_name_ptr, NULL);
+}
+
+int bk_array_next(void * ctx, const char ** barcode, int * quantity) {
+    BKArraySource * array = ctx;
+
+    if (array->next >= array->num_barcodes) {
+        return BK_SOURCE_END;
+    }
+
+    *barcode  = array->barcodes[array->next];
+    *quantity = array->quantities[array->next];
+    array->next++;
+
+    return SUCCESS;
+}
+
+int bk_chain_next(void * ctx, const char ** barcode, int * quantity) {
+    BKChainSource * chain = ctx;
+
+    while (chain->next < chain->num_sources) {
+        BKSource * source = &chain->sources[chain->next];
+        int        status = source->next(source->ctx, barcode, quantity);
+        if (BK_SOURCE_END != status) {
+            return status;
+        }
+        chain->next++;
+    }
+
+    return BK_SOURCE_END;
+}
+
+int bk_file_write(void * ctx, const char * data, size_t len) {
+    if (fwrite(data, 1, len, (FILE *) ctx) != len) {
+        return ERR_FILE_WRITE_FAILED;
+    }
+    return SUCCESS;
+}
+
 /**
  *      @brief Print a file to a specific printer - abstraction from platform-specific APIs
  *      @param file File to print
  *      @param printer Destination printer
  *      @return SUCCESS, TODO: fill out other return values
  */
-int bk_print(char * filename, char * printer) {
+static int print_file(char * filename, char * printer) {
 
-    int status = SUCCESS;
+    int      status = SUCCESS;
+    uint64_t span   = bk_trace_begin();
 
 #ifdef _WIN32
     // 1 for null terminator
@@ -266,15 +594,207 @@ int bk_print(char * filename, char * printer) {
     }
     free(print_cmd);
 #else
-    int pid = fork();
+    /* BK_PRINT_CMD runs in a grandchild, which is reaped by init once its parent exits - so that
+       printing does not wait for it, nor leave a zombie process behind after every print */
+    uint64_t probe = BK_PROBE_CLOCK(print_reap);
+    pid_t    pid   = fork();
     if (pid == 0) {
-        execlp("lp", "lp", "-d", printer, "-t", filename, filename, NULL);
+        if (fork() == 0) {
+            execlp(BK_PRINT_CMD, BK_PRINT_CMD, "-d", printer, "-t", filename, filename, NULL);
+        }
+        _exit(EXIT_SUCCESS);
     } else if (pid == -1) {
         fprintf(stderr, "ERROR: could not start printing subprocess\n");
         status = ERR_FORK;
+    } else {
+        int wstatus = 0;
+        BK_PROBE3(print_spawn, pid, printer, filename);
+        while (-1 == waitpid(pid, &wstatus, 0) && EINTR == errno)
+            ;
+        BK_PROBE3(print_reap, pid, wstatus, bk_clock_ns() - probe);
     }
 #endif
 
+    bk_trace_end(BK_TRACE_SPAWN_LP, span);
+
+    return status;
+}
+
+#ifndef _WIN32
+/**
+ *      @details Neither end then leaks into a subprocess started by another thread while this one
+ *              is still being set up.
+ */
+int bk_cloexec_pipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    // Elsewhere the pipe is briefly inheritable, between its creation and marking its ends
+    if (-1 == pipe(fds)) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+#endif
+
+/**
+ *      @details On Unix-compatible systems the output of @c lp is read back for the job ID it
+ *              assigned ("request id is <printer>-<n> (1 file(s))"). On Windows printing is already
+ *              synchronous, and no job ID is available.
+ */
+// clang-format off
+static int print_sync(
+    char * filename,
+    char * printer,
+    bool raw,
+    char * job_id,
+    size_t job_id_len
+) {
+    // clang-format on
+    int status = SUCCESS;
+
+    if (NULL != job_id && job_id_len > 0) {
+        job_id[0] = '\0';
+    }
+
+#ifdef _WIN32
+    if (raw) {
+        fprintf(stderr, "ERROR: printing without a driver is not supported on Windows\n");
+        return ERR_UNSUPPORTED_PLATFORM;
+    }
+    status = print_file(filename, printer);
+#else
+    uint64_t span  = bk_trace_begin();
+    uint64_t probe = BK_PROBE_CLOCK(print_reap);
+    int      fds[2];
+    if (-1 == bk_cloexec_pipe(fds)) {
+        return ERR_FORK;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Only the child's standard output is inherited by lp: dup2() clears close-on-exec on the
+        // copy, unless the write end already is standard output, and the pipe's own ends close on
+        // exec
+        if (STDOUT_FILENO == fds[1]) {
+            fcntl(STDOUT_FILENO, F_SETFD, 0);
+        } else {
+            dup2(fds[1], STDOUT_FILENO);
+        }
+        if (raw) {
+            execlp(BK_PRINT_CMD,
+                   BK_PRINT_CMD,
+                   "-d",
+                   printer,
+                   "-o",
+                   BK_PRINT_RAW_OPTION,
+                   "-t",
+                   filename,
+                   filename,
+                   NULL);
+        } else {
+            execlp(BK_PRINT_CMD, BK_PRINT_CMD, "-d", printer, "-t", filename, filename, NULL);
+        }
+        _exit(EXIT_FAILURE);
+    } else if (pid == -1) {
+        fprintf(stderr, "ERROR: could not start printing subprocess\n");
+        close(fds[0]);
+        close(fds[1]);
+        return ERR_FORK;
+    }
+
+    close(fds[1]);
+    bk_trace_end(BK_TRACE_SPAWN_LP, span);
+    BK_PROBE3(print_spawn, pid, printer, filename);
+    span = bk_trace_begin();
+
+    char    output[BK_EXEC_BUFSIZE];
+    size_t  outputlen = 0;
+    ssize_t n;
+    while (outputlen < sizeof output - 1
+           && (n = read(fds[0], output + outputlen, sizeof output - 1 - outputlen)) != 0) {
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        outputlen += n;
+    }
+    output[outputlen] = '\0';
+    close(fds[0]);
+
+    int wstatus;
+    while (-1 == waitpid(pid, &wstatus, 0)) {
+        if (EINTR != errno) {
+            return ERR_PRINT_FAILED;
+        }
+    }
+    bk_trace_end(BK_TRACE_WAIT_LP, span);
+    BK_PROBE3(print_reap, pid, wstatus, bk_clock_ns() - probe);
+
+    if (!WIFEXITED(wstatus) || EXIT_SUCCESS != WEXITSTATUS(wstatus)) {
+        fprintf(stderr, "ERROR: %s exited unsuccessfully: %s", BK_PRINT_CMD, output);
+        return ERR_PRINT_FAILED;
+    }
+
+    char * request = strstr(output, BK_PRINT_REQUEST_ID);
+    if (NULL != request && NULL != job_id && job_id_len > 0) {
+        request += strlen(BK_PRINT_REQUEST_ID);
+        size_t len = strcspn(request, " \n");
+        if (len >= job_id_len) {
+            len = job_id_len - 1;
+        }
+        memcpy(job_id, request, len);
+        job_id[len] = '\0';
+    }
+#endif
+
+    return status;
+}
+
+/*      @brief Count a print request, started at @c start, in the metrics */
+static void print_metrics(const char * filename, int status, uint64_t start) {
+    struct stat file_stat;
+
+    if (!bk_metrics_enabled) {
+        return;
+    }
+
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_PRINTS : BK_METRIC_PRINT_FAILURES, 1);
+    if (SUCCESS == status && 0 == stat(filename, &file_stat)) {
+        bk_metrics_add(BK_METRIC_BYTES_SPOOLED, file_stat.st_size);
+    }
+    bk_metrics_observe(BK_METRIC_PRINT_SECONDS, bk_clock_ns() - start);
+}
+
+int bk_print(char * filename, char * printer) {
+    uint64_t start  = bk_trace_begin();
+    int      status = print_file(filename, printer);
+
+    print_metrics(filename, status, start);
+
+    return status;
+}
+
+int bk_print_sync(char * filename, char * printer, char * job_id, size_t job_id_len) {
+    uint64_t start  = bk_trace_begin();
+    int      status = print_sync(filename, printer, false, job_id, job_id_len);
+
+    print_metrics(filename, status, start);
+
+    return status;
+}
+
+int bk_print_raw_sync(char * filename, char * printer, char * job_id, size_t job_id_len) {
+    uint64_t start  = bk_trace_begin();
+    int      status = print_sync(filename, printer, true, job_id, job_id_len);
+
+    print_metrics(filename, status, start);
+
     return status;
 }
 
@@ -290,6 +810,8 @@ int bk_get_printers(char *** printers, int * num_printers) {
     char *  output = calloc(1, BK_EXEC_BUFSIZE);
     VERIFY_NULL_BC(output, BK_EXEC_BUFSIZE);
 
+    uint64_t span = bk_trace_begin();
+
 
     /*
      * Utilising popen() to grab output from lpstat -e or wmic
@@ -300,9 +822,10 @@ int bk_get_printers(char *** printers, int * num_printers) {
         if ((output_stream = popen(BK_GET_PRINTER_CMD, BK_POPEN_MODE)) != NULL) {
             if ((outputlen = fread(output, sizeof *output, BK_EXEC_BUFSIZE - 1, output_stream)) >
                 0) {
-                output[outputlen + 1] = '\0';
+                output[outputlen] = '\0';
             } else {
                 fprintf(stderr, "ERROR: could not read from stream\n");
+                pclose(output_stream);
                 status = ERR_FREAD;
                 longjmp(env, status);
             }
@@ -330,10 +853,12 @@ int bk_get_printers(char *** printers, int * num_printers) {
         // Run again to remove 'Name' heading on Windows wmic output
         while (NULL != (sep_output = strtok_s(NULL, "\r\n", &context))) {
             current_printer = strstrip(sep_output); // This must be freed later
-            if (0 != strcmp(sep_output, "")) {
+            if (0 != strcmp(current_printer, "") && *num_printers < BK_MAX_PRINTERS) {
                 // Output is modified in-place to point to the next line
                 printer_addrs[*num_printers] = current_printer;
                 (*num_printers)++;
+            } else {
+                free(current_printer);
             }
         }
     } else {
@@ -346,7 +871,8 @@ int bk_get_printers(char *** printers, int * num_printers) {
     }
 #else
     char * old_addr = sep_output;
-    while (strcmp(sep_output, "") != 0 && strsep(&sep_output, "\n") != NULL) {
+    while (NULL != sep_output && strcmp(sep_output, "") != 0 && *num_printers < BK_MAX_PRINTERS
+           && strsep(&sep_output, "\n") != NULL) {
         printer_addrs[*num_printers] = old_addr;
         old_addr = sep_output; // Output is modified in-place to point to the next line
         (*num_printers)++;
@@ -368,8 +894,10 @@ int bk_get_printers(char *** printers, int * num_printers) {
             VERIFY_NULL_BC((*printers)[i], str_size);
 
             strncpy((*printers)[i], printer_addrs[i], len);
-            
+
+#ifdef _WIN32
             free(printer_addrs[i]); // Allocated from current_printer above
+#endif
         }
     } else {
         status = ERR_NO_PRINTERS;
@@ -377,6 +905,69 @@ int bk_get_printers(char *** printers, int * num_printers) {
 
     free(output);
 
+    bk_trace_end(BK_TRACE_PRINTERS, span);
 
     return status;
 }
+
+uint64_t bk_clock_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER count, frequency;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&frequency);
+    return (uint64_t)((double) count.QuadPart * 1e9 / frequency.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/**
+ *      @details Linux reports the peak as @c VmHWM in /proc/self/status; other Unix-compatible
+ *              systems only through getrusage(), in kilobytes (bytes on macOS).
+ */
+size_t bk_peak_rss(void) {
+#ifdef _WIN32
+    return 0;
+#else
+#ifdef __linux__
+    FILE * status = fopen(BK_PROC_STATUS, "r");
+    if (NULL != status) {
+        char          line[BK_EXEC_BUFSIZE];
+        unsigned long kb = 0;
+
+        while (NULL != fgets(line, sizeof line, status)) {
+            if (1 == sscanf(line, BK_PROC_PEAK_RSS " %lu", &kb)) {
+                break;
+            }
+        }
+        fclose(status);
+
+        if (kb > 0) {
+            return (size_t) kb * 1024;
+        }
+    }
+#endif
+    struct rusage usage;
+    if (-1 == getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (size_t) usage.ru_maxrss;
+#else
+    return (size_t) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+void bk_peak_rss_reset(void) {
+#ifdef __linux__
+    // Writing 5 resets VmHWM to the current resident set size
+    FILE * clear_refs = fopen(BK_PROC_CLEAR_REFS, "w");
+    if (NULL != clear_refs) {
+        fputs("5", clear_refs);
+        fclose(clear_refs);
+    }
+#endif
+}
@@ -14,8 +14,11 @@
 #ifndef BACKEND_H
 #define BACKEND_H
 
+#include "arena.h"
 #include "barcode.h"
+#include "cache.h"
 
+#include <stdint.h>
 #include <stdio.h>
 
 #ifdef _WIN32
@@ -39,17 +42,112 @@
 #define BK_GET_PRINTER_CMD "lpstat -e"
 #define BK_POPEN_MODE "r"
 #define BK_TEMPFILE_TEMPLATE_SIZE sizeof(BK_TEMPFILE_TEMPLATE) + 1
+#define BK_PROC_STATUS "/proc/self/status"
+#define BK_PROC_CLEAR_REFS "/proc/self/clear_refs"
+#define BK_PROC_PEAK_RSS "VmHWM:"
 #endif
 #define BK_EXEC_BUFSIZE 1024 // Hopefully 1 KB is enough to hold printer info
 /* #define BK_PRINTER_LENGTH                   127  // Enough for 8 printers, allowing for newlines
  */
 #define BK_MAX_PRINTERS 8
+#define BK_PRINT_CMD "lp"
+// Passes a file to the printer without filtering it, for printers' own command languages
+#define BK_PRINT_RAW_OPTION "raw"
+// Prefix of the job ID in the output of BK_PRINT_CMD
+#define BK_PRINT_REQUEST_ID "request id is "
+#define BK_JOB_ID_LEN 64
+#define BK_DEFAULT_COLS 2
+#define BK_DEFAULT_ROWS 1
+// Most labels on one page, bounding the storage generating a page takes
+#define BK_MAX_LABELS_PER_PAGE 10000
 /*@}*/
 
+/*      @brief Returned by a BKSource once every row has been read */
+#define BK_SOURCE_END -1
+
+/**
+ *      @brief A stream of barcodes and quantities, read once from start to end
+ *      @details @c next fills its barcode and quantity arguments with the next row and returns
+ *               SUCCESS, or returns BK_SOURCE_END when there are no more rows, or an error code.
+ *               The barcode string need only remain valid until @c next is called again.
+ */
+typedef struct BKSource {
+    int (*next)(void *, const char **, int *);
+    void * ctx;
+} BKSource;
+
+/**
+ *      @brief A destination for generated output
+ *      @details @c write returns SUCCESS once all @c len bytes are written, or an error code.
+ */
+typedef struct BKSink {
+    int (*write)(void *, const char *, size_t);
+    void * ctx;
+} BKSink;
+
+/*      @brief Source state for reading parallel barcode and quantity arrays (see bk_array_next) */
+typedef struct BKArraySource {
+    char ** barcodes;
+    int *   quantities;
+    int     num_barcodes;
+    int     next;
+} BKArraySource;
+
+/*      @brief Source state for reading several sources one after another (see bk_chain_next) */
+typedef struct BKChainSource {
+    BKSource * sources;
+    int        num_sources;
+    int        next;
+} BKChainSource;
+
+/*      @brief Summary of a completed generation */
+typedef struct BKGenerateStats {
+    long   labels;
+    long   pages;
+    size_t bytes;
+} BKGenerateStats;
+
+/**
+ *      @brief State reused by every job generated through it
+ *      @details Working storage for each job comes from @c arena, which is reset rather than freed
+ *               between jobs, and encodings from @c cache, so that repeated jobs of a similar size
+ *               generate without allocating. A context is not thread-safe - each thread
+ *               generating should own its own.
+ */
+typedef struct BKGenerateContext {
+    BKArena       arena;
+    BKEncodeCache cache;
+} BKGenerateContext;
+
 int bk_init(void);
 
 int bk_exit(void);
 
+/**
+ *      @brief Check that labels can be generated with a layout
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @return SUCCESS, or ERR_INVALID_LAYOUT if a page has no labels or more than
+ *              BK_MAX_LABELS_PER_PAGE
+ */
+int bk_layout_check(const Layout *);
+
+/**
+ *      @brief Create and open a new temporary file for writing
+ *      @param path Destination buffer of BK_TEMPFILE_TEMPLATE_SIZE bytes for the file's path
+ *      @param file Destination for the open file
+ *      @return SUCCESS, ERR_TEMPORARY_FILE_CREATION_FAILED
+ */
+int bk_tempfile_open(char *, FILE **);
+
+#ifndef _WIN32
+/**
+ *      @brief Create a pipe whose ends are both closed on exec
+ *      @param fds Destination for the read and write ends, as pipe()
+ *      @return 0, or -1 as pipe()
+ */
+int bk_cloexec_pipe(int[2]);
+#endif
+
 /**
  *      @brief Generates PostScript the given barcodes and properties
  *      @param barcodes A list of barcode strings to be encoded
@@ -72,6 +170,57 @@ int bk_exit(void);
  */
 int bk_generate(char **, int *, int, PSProperties *, Layout *, char **);
 
+/**
+ *      @brief Generates PostScript from a stream of barcodes, one page at a time
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties to be used when generating the PostScript
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param sink The destination for the generated PostScript, written a page at a time
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return As bk_generate(), or any error returned by @c source or @c sink
+ */
+int bk_generate_stream(BKSource *, PSProperties *, Layout *, BKSink *, BKGenerateStats *);
+
+/**
+ *      @brief As bk_generate_stream(), taking encodings from a cache
+ *      @param cache The cache to encode barcodes through, or NULL to encode without one
+ *      @return As bk_generate_stream()
+ */
+int bk_generate_cached(
+    BKSource *, PSProperties *, Layout *, BKSink *, BKEncodeCache *, BKGenerateStats *);
+
+/**
+ *      @brief As bk_generate_stream(), reusing a generation context's storage and encoding cache
+ *      @param context The context to generate with, initialised with bk_context_init()
+ *      @return As bk_generate_stream()
+ */
+int bk_generate_context(
+    BKSource *, PSProperties *, Layout *, BKSink *, BKGenerateContext *, BKGenerateStats *);
+
+void bk_context_init(BKGenerateContext *);
+
+void bk_context_free(BKGenerateContext *);
+
+/**
+ *      @brief As bk_generate(), reading barcodes from a source
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties to be used when generating the PostScript
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param ps_name_ptr The destination pointer for the name of the generated file
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return As bk_generate_stream()
+ */
+int bk_generate_source(BKSource *, PSProperties *, Layout *, char **, BKGenerateStats *);
+
+/*      @brief BKSource callback reading a BKArraySource */
+int bk_array_next(void *, const char **, int *);
+
+/*      @brief BKSource callback reading a BKChainSource */
+int bk_chain_next(void *, const char **, int *);
+
+/*      @brief BKSink callback writing to a (FILE *) */
+int bk_file_write(void *, const char *, size_t);
+
 /**
  *      @brief Print a file to a specific printer - abstraction from platform-specific APIs
  *      @param filename File to print
@@ -80,6 +229,23 @@ int bk_generate(char **, int *, int, PSProperties *, Layout *, char **);
  */
 int bk_print(char *, char *);
 
+/**
+ *      @brief Print a file and wait until it has been accepted by the print system
+ *      @param filename File to print
+ *      @param printer Destination printer
+ *      @param job_id Destination buffer for the job ID assigned to the print, or NULL
+ *      @param job_id_len Length of @c job_id
+ *      @return SUCCESS, ERR_FORK, ERR_PRINT_FAILED, ERR_SYSTEM (Windows only)
+ */
+int bk_print_sync(char *, char *, char *, size_t);
+
+/**
+ *      @brief As bk_print_sync(), passing the file to the printer as it is, unfiltered
+ *      @details For files in a printer's own command language, such as ZPL (see thermal.h).
+ *      @return As bk_print_sync(), or ERR_UNSUPPORTED_PLATFORM on Windows
+ */
+int bk_print_raw_sync(char *, char *, char *, size_t);
+
 /**
  *      @brief Get a list of available printing destinations for use in bk_print()
  *      @param printers Unallocated triple pointer to char - is allocated within the function
@@ -89,4 +255,23 @@ int bk_print(char *, char *);
  */
 int bk_get_printers(char ***, int *);
 
+/**
+ *      @brief Peak resident memory of the process since it started or bk_peak_rss_reset()
+ *      @return The peak in bytes, or 0 where it is not available
+ */
+size_t bk_peak_rss(void);
+
+/**
+ *      @brief Start measuring peak resident memory afresh, where the platform allows it
+ *      @details Only Linux allows the peak to be reset; elsewhere bk_peak_rss() continues to report
+ *               the peak since the process started.
+ */
+void bk_peak_rss_reset(void);
+
+/**
+ *      @brief Read a monotonic clock, for timing backend operations
+ *      @return Nanoseconds since an arbitrary fixed point
+ */
+uint64_t bk_clock_ns(void);
+
 #endif
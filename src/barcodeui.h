@@ -0,0 +1,91 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file barcodeui.h
+ *      @brief Public interface of the libbarcodeui-core library
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      libbarcodeui-core is the backend of this program without its user interface, for generating
+ *      labels within another process. It has no GTK dependency, and generation needs no temporary
+ *      files - output is written to a caller-supplied BKSink. bk_init() need not be called.
+ *
+ *      A job is built with bk_job_new() and bk_job_add() or bk_job_add_batch(), then generated
+ *      with bk_job_generate() or printed with bk_job_print(); bk_generate_pdf() writes PDF from
+ *      any BKSource instead. Storage may be taken from the
+ *      caller's own allocator with bk_set_allocator(). See examples/generate.c.
+ */
+
+#ifndef BARCODEUI_H
+#define BARCODEUI_H
+
+#include "alloc.h"
+#include "arena.h"
+#include "backend.h"
+#include "cache.h"
+#include "error.h"
+#include "fanout.h"
+#include "images.h"
+#include "import.h"
+#include "job.h"
+#include "metrics.h"
+#include "modules.h"
+#include "pdf.h"
+#include "raster.h"
+#include "scanline.h"
+#include "thermal.h"
+#include "trace.h"
+
+#include <stddef.h>
+
+/**
+ *      @brief Allocate an empty job through the current allocator
+ *      @return The new job, to be released with bk_job_delete()
+ */
+BKJob * bk_job_new(void);
+
+/**
+ *      @brief Release a job allocated by bk_job_new(), along with its storage
+ */
+void bk_job_delete(BKJob *);
+
+/**
+ *      @brief Append several null-terminated barcodes to a job, reserving storage for all at once
+ *      @param job The job to append to
+ *      @param barcodes The barcode strings
+ *      @param quantities The number of times each barcode is to be printed, or NULL for once each
+ *      @param num_barcodes The length of @c barcodes
+ */
+void bk_job_add_batch(BKJob *, const char * const *, const int *, int);
+
+/**
+ *      @brief Generate PostScript for a job, writing it to a sink a page at a time
+ *      @param job The job to generate
+ *      @param props The PostScript properties to use
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param sink The destination for the PostScript
+ *      @param context A generation context to reuse across calls, or NULL. Reprinting jobs
+ *                     through one context allocates nothing once it has grown to fit them.
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return As bk_generate_stream()
+ */
+int bk_job_generate(
+    BKJob *, PSProperties *, Layout *, BKSink *, BKGenerateContext *, BKGenerateStats *);
+
+/**
+ *      @brief Generate a job and print it, waiting until the print system has accepted it
+ *      @param job The job to print
+ *      @param props The PostScript properties to use
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param printer Destination printer
+ *      @param job_id Destination buffer for the print system's job ID, or NULL
+ *      @param job_id_len Length of @c job_id
+ *      @return As bk_job_generate(), bk_print_sync(), or ERR_TEMPORARY_FILE_CREATION_FAILED
+ */
+int bk_job_print(BKJob *, PSProperties *, Layout *, const char *, char *, size_t);
+
+#endif
@@ -0,0 +1,304 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file batch.c
+ *      @brief Batch (headless) printing implementations as defined in batch.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "batch.h"
+
+#include "backend.h"
+#include "dbsource.h"
+#include "error.h"
+#include "fanout.h"
+#include "images.h"
+#include "import.h"
+#include "job.h"
+#include "pdf.h"
+#include "raster.h"
+#include "thermal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *      @brief Generate a source into a new temporary file, leaving its path in @c ps_path
+ *      @param options The printer's command language, and whether PostScript is rasterised
+ */
+// clang-format off
+static int batch_generate(
+    BKSource * source,
+    const BKBatchOptions * options,
+    char * ps_path,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+    PSProperties props = PS_DEFAULT_PROPS;
+    Layout       layout;
+    FILE *       ps_file;
+
+    layout.cols = BK_DEFAULT_COLS;
+    layout.rows = BK_DEFAULT_ROWS;
+
+    int status = bk_tempfile_open(ps_path, &ps_file);
+    if (SUCCESS != status) {
+        ps_path[0] = '\0';
+        return status;
+    }
+
+    BKSink sink = { bk_file_write, ps_file };
+    if (BK_THERMAL_NONE != options->thermal.language) {
+        status = bk_generate_thermal(source, &props, &options->thermal, &sink, stats);
+    } else if (options->raster_dpi > 0) {
+        status = bk_generate_raster(source, &props, &layout, options->raster_dpi, &sink, stats);
+    } else {
+        status = bk_generate_stream(source, &props, &layout, &sink, stats);
+    }
+
+    if (EOF == fclose(ps_file) && SUCCESS == status) {
+        status = ERR_FILE_CLOSE_FAILED;
+    }
+
+    return status;
+}
+
+/*      @brief The outputs of a job, each generated from the one read of it as a BKFanoutSink */
+typedef struct BatchOutputs {
+    const BKBatchOptions * options;
+    BKBatchResult *        result;
+    char *                 ps_path;
+} BatchOutputs;
+
+static int batch_print_output(void * ctx, BKSource * source) {
+    BatchOutputs * outputs = ctx;
+    return batch_generate(source, outputs->options, outputs->ps_path, &outputs->result->stats);
+}
+
+static int batch_archive_output(void * ctx, BKSource * source) {
+    BatchOutputs * outputs = ctx;
+    PSProperties   props   = PS_DEFAULT_PROPS;
+    Layout         layout;
+
+    layout.cols = BK_DEFAULT_COLS;
+    layout.rows = BK_DEFAULT_ROWS;
+
+    FILE * file = fopen(outputs->options->archive, "wb");
+    if (NULL == file) {
+        fprintf(stderr, "ERROR: could not open \"%s\" for writing\n", outputs->options->archive);
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    BKSink sink   = { bk_file_write, file };
+    int    status = bk_generate_pdf(source, &props, &layout, &sink, &outputs->result->archive);
+
+    if (EOF == fclose(file) && SUCCESS == status) {
+        status = ERR_FILE_CLOSE_FAILED;
+    }
+
+    return status;
+}
+
+static int batch_images_output(void * ctx, BKSource * source) {
+    BatchOutputs * outputs = ctx;
+    return bk_images_generate(source, &outputs->options->images, &outputs->result->images);
+}
+
+/**
+ *      @brief Generate a source into a new temporary file as batch_generate(), and into the
+ *             archive and images of the job if it has them
+ *      @details Without an archive or images the file is generated on the calling thread.
+ *      @param others Destination for the first error of the archive and images
+ *      @return SUCCESS, or any error from @c source or generating the file
+ */
+// clang-format off
+static int batch_outputs(
+    BKSource * source,
+    const BKBatchOptions * options,
+    char * ps_path,
+    BKBatchResult * result,
+    int * others
+) {
+    // clang-format on
+    BatchOutputs outputs = { options, result, ps_path };
+    BKFanoutSink sinks[3];
+    int          num_sinks = 0;
+
+    *others = SUCCESS;
+    if (NULL == options->archive && NULL == options->images.dir) {
+        return batch_generate(source, options, ps_path, &result->stats);
+    }
+
+    memset(sinks, 0, sizeof sinks);
+    sinks[num_sinks].generate = batch_print_output;
+    sinks[num_sinks++].ctx    = &outputs;
+    if (NULL != options->archive) {
+        sinks[num_sinks].generate = batch_archive_output;
+        sinks[num_sinks++].ctx    = &outputs;
+    }
+    if (NULL != options->images.dir) {
+        sinks[num_sinks].generate = batch_images_output;
+        sinks[num_sinks++].ctx    = &outputs;
+    }
+
+    int status = bk_fanout(source, sinks, num_sinks);
+    for (int i = 1; i < num_sinks && SUCCESS == *others; i++) {
+        *others = sinks[i].status;
+    }
+
+    return SUCCESS == status ? sinks[0].status : status;
+}
+
+/*      @brief Print a generated file, unfiltered if it is in the printer's own language */
+static int batch_print_file(const BKBatchOptions * options, char * path, BKBatchResult * result) {
+    if (BK_THERMAL_NONE != options->thermal.language) {
+        return bk_print_raw_sync(path, (char *) options->printer, result->job_id, BK_JOB_ID_LEN);
+    }
+    return bk_print_sync(path, (char *) options->printer, result->job_id, BK_JOB_ID_LEN);
+}
+
+int bk_batch_run(const BKBatchOptions * options, BKBatchResult * result) {
+    BKBatchResult local;
+    char          ps_path[BK_TEMPFILE_TEMPLATE_SIZE] = "";
+    uint64_t      start = bk_clock_ns();
+    int           status;
+    int           others = SUCCESS;
+
+    if (NULL == result) {
+        result = &local;
+    }
+    memset(result, 0, sizeof *result);
+    bk_peak_rss_reset();
+
+    if (BK_FORMAT_SQLITE == bk_import_format(options->path)) {
+        BKDBSource db_source;
+
+        status = bk_db_open(&db_source, options->path, options->query);
+        if (SUCCESS == status) {
+            BKSource source = bk_db_source(&db_source);
+            status          = batch_outputs(&source, options, ps_path, result, &others);
+        }
+
+        // Rows are only marked once the spool has been handed to the print system, so a query
+        // matching no rows leaves nothing printed or marked
+        if (SUCCESS == status && result->stats.labels > 0) {
+            status = batch_print_file(options, ps_path, result);
+            if (SUCCESS == status) {
+                status = bk_db_mark_printed(&db_source, options->mark);
+            }
+        }
+
+        bk_db_close(&db_source);
+    } else {
+        BKJob job;
+
+        bk_job_init(&job);
+        bk_job_set_budget(&job, options->memory_budget);
+        status = bk_import_file(options->path, NULL, &job, NULL);
+        if (SUCCESS == status) {
+            BKJobReader reader;
+            bk_job_read(&job, &reader);
+
+            BKSource source = { bk_job_next, &reader };
+            status          = batch_outputs(&source, options, ps_path, result, &others);
+
+            bk_job_reader_free(&reader);
+        }
+
+        if (SUCCESS == status && result->stats.labels > 0) {
+            status = batch_print_file(options, ps_path, result);
+        }
+
+        bk_job_free(&job);
+    }
+
+    if ('\0' != ps_path[0]) {
+        remove(ps_path);
+    }
+    if (SUCCESS == status) {
+        status = others;
+    }
+
+    result->elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    result->peak_rss   = bk_peak_rss();
+
+    return status;
+}
+
+// clang-format off
+void bk_batch_report(
+    const BKBatchOptions * options,
+    int status,
+    const BKBatchResult * result,
+    char * dest,
+    size_t len
+) {
+    // clang-format on
+
+    if (SUCCESS == status) {
+        char peak[32] = "";
+        if (result->peak_rss > 0) {
+            snprintf(peak, sizeof peak, ", peak memory %.1f MiB", result->peak_rss / 1048576.0);
+        }
+        size_t used = snprintf(dest,
+                               len,
+                               "Printed %ld labels on %ld pages to %s (job %s) in %.1f ms%s",
+                               result->stats.labels,
+                               result->stats.pages,
+                               options->printer,
+                               result->job_id[0] ? result->job_id : "-",
+                               result->elapsed_ms,
+                               peak);
+        // The outputs generated alongside, each appended if there is room
+        if (NULL != options->archive && used < len) {
+            used += snprintf(dest + used,
+                             len - used,
+                             ", archived %ld pages to %s",
+                             result->archive.pages,
+                             options->archive);
+        }
+        if (NULL != options->images.dir && used < len) {
+            used += snprintf(dest + used,
+                             len - used,
+                             ", %ld images written (%ld unchanged) to %s",
+                             result->images.written,
+                             result->images.unchanged,
+                             options->images.dir);
+        }
+        if (used + 1 < len) {
+            strcpy(dest + used, "\n");
+        } else {
+            dest[len - 2] = '\n';
+        }
+    } else if ('\0' != result->job_id[0]) {
+        // Printed, but its archive or images failed
+        snprintf(dest,
+                 len,
+                 "Printed %s to %s (job %s), but could not archive or export it: error %d\n",
+                 options->path,
+                 options->printer,
+                 result->job_id,
+                 status);
+    } else {
+        snprintf(dest, len, "Could not print %s: error %d\n", options->path, status);
+    }
+}
+
+int bk_batch_print(const BKBatchOptions * options, FILE * report) {
+    BKBatchResult result;
+    char          summary[BK_EXEC_BUFSIZE];
+
+    int status = bk_batch_run(options, &result);
+
+    if (NULL != report) {
+        bk_batch_report(options, status, &result, summary, sizeof summary);
+        fputs(summary, report);
+    }
+
+    return status;
+}
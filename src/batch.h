@@ -0,0 +1,93 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file batch.h
+ *      @brief Batch (headless) printing declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "backend.h"
+#include "images.h"
+#include "thermal.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ *      @brief A single job file to be printed without the user interface
+ *      @details @c query and @c mark only apply to SQLite job sources, and may be NULL to use
+ *               BK_DB_DEFAULT_QUERY and BK_DB_DEFAULT_MARK. @c memory_budget limits the memory the
+ *               imported job may hold (see bk_job_set_budget()), or is 0 for no limit. @c thermal
+ *               selects a thermal printer's command language instead of PostScript, and
+ *               @c raster_dpi rasterised PostScript at that resolution (see raster.h), or is 0 for
+ *               vector PostScript. @c archive names a PDF file to write the job to as well, and
+ *               @c images.dir a directory to export an image of each distinct barcode to (see
+ *               images.h); either may be NULL. The job is read once for all of its outputs.
+ */
+typedef struct BKBatchOptions {
+    const char *     path;
+    const char *     printer;
+    const char *     query;
+    const char *     mark;
+    size_t           memory_budget;
+    BKThermalOptions thermal;
+    int              raster_dpi;
+    const char *     archive;
+    BKImageOptions   images;
+} BKBatchOptions;
+
+/**
+ *      @brief Summary of a printed job, and of its archive and images if it has them
+ */
+typedef struct BKBatchResult {
+    BKGenerateStats stats;
+    BKGenerateStats archive;
+    BKImageStats    images;
+    char            job_id[BK_JOB_ID_LEN];
+    double          elapsed_ms;
+    size_t          peak_rss;
+} BKBatchResult;
+
+/**
+ *      @brief Generate and print a job file with the default properties and layout
+ *      @details Job files are imported in full, spilling to disk beyond the memory budget;
+ *               SQLite sources are streamed through a cursor straight into generation, and their
+ *               rows marked printed once the print has been accepted by the print system - a
+ *               query with no rows to print is neither printed nor marked. The job is generated
+ *               into a temporary file of its own, so this may be called from any thread, including
+ *               while the user interface is running. An archive or images are generated alongside
+ *               the printed file, each on a thread of its own (see fanout.h); should they fail,
+ *               the job is still printed and its rows marked, and their error returned.
+ *      @param options The job file and printer
+ *      @param result Destination for a summary of the job, or NULL
+ *      @return SUCCESS, or any error from import, generation, printing, or the archive or images
+ */
+int bk_batch_run(const BKBatchOptions *, BKBatchResult *);
+
+/**
+ *      @brief Format a one-line summary of a job run by bk_batch_run()
+ *      @param options The job file and printer
+ *      @param status The status returned by bk_batch_run()
+ *      @param result The result filled by bk_batch_run()
+ *      @param dest Destination buffer for the summary, ending in a newline
+ *      @param len Length of @c dest
+ */
+void bk_batch_report(const BKBatchOptions *, int, const BKBatchResult *, char *, size_t);
+
+/**
+ *      @brief As bk_batch_run(), writing a one-line summary of the job to a stream
+ *      @param options The job file and printer
+ *      @param report Stream to write the summary to, or NULL
+ *      @return As bk_batch_run()
+ */
+int bk_batch_print(const BKBatchOptions *, FILE *);
+
+#endif
@@ -0,0 +1,207 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file cache.c
+ *      @brief Barcode encoding cache implementations as defined in cache.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "cache.h"
+
+#include "alloc.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*      @brief FNV-1a, which is plenty for short barcode strings */
+static uint64_t cache_hash(const char * key, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (unsigned char) key[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/*      @brief Find the slot holding a key, or the empty slot where it belongs */
+static BKCacheEntry * cache_find(BKCacheEntry * slots, size_t num_slots, const char * key, uint64_t hash) {
+    size_t i = hash & (num_slots - 1);
+
+    while (NULL != slots[i].key && (slots[i].hash != hash || strcmp(slots[i].key, key) != 0)) {
+        i = (i + 1) & (num_slots - 1);
+    }
+
+    return &slots[i];
+}
+
+static void cache_grow(BKEncodeCache * cache) {
+    size_t         num_slots  = cache->num_slots ? cache->num_slots * 2 : BK_CACHE_INITIAL_SLOTS;
+    size_t         slots_size = sizeof *cache->slots * num_slots;
+    BKCacheEntry * slots      = bk_calloc(slots_size);
+    VERIFY_NULL_BC(slots, slots_size);
+
+    for (size_t i = 0; i < cache->num_slots; i++) {
+        if (NULL != cache->slots[i].key) {
+            *cache_find(slots, num_slots, cache->slots[i].key, cache->slots[i].hash) =
+                cache->slots[i];
+        }
+    }
+
+    bk_free(cache->slots);
+    cache->slots     = slots;
+    cache->num_slots = num_slots;
+}
+
+void bk_cache_init(BKEncodeCache * cache) {
+    memset(cache, 0, sizeof *cache);
+}
+
+/**
+ *      @details Open addressing with linear probing, kept at most half full.
+ */
+int bk_cache_encode(BKEncodeCache * cache, const char * barcode, Code128 ** encoding) {
+    size_t   len  = strlen(barcode);
+    uint64_t hash = cache_hash(barcode, len);
+
+    if (2 * (cache->num_entries + 1) > cache->num_slots) {
+        cache_grow(cache);
+    }
+
+    BKCacheEntry * entry = cache_find(cache->slots, cache->num_slots, barcode, hash);
+    if (NULL != entry->key) {
+        cache->hits++;
+        *encoding = entry->encoding;
+        return SUCCESS;
+    }
+
+    int status = c128_encode((uchar *) barcode, len, encoding);
+    if (SUCCESS != status) {
+        return status;
+    }
+    cache->misses++;
+
+    entry->key = bk_realloc(NULL, len + 1);
+    VERIFY_NULL_BC(entry->key, len + 1);
+    memcpy(entry->key, barcode, len + 1);
+    entry->hash     = hash;
+    entry->encoding = *encoding;
+    cache->num_entries++;
+
+    return SUCCESS;
+}
+
+void bk_cache_trim(BKEncodeCache * cache) {
+    if (cache->num_entries <= BK_CACHE_MAX_ENTRIES) {
+        return;
+    }
+
+    for (size_t i = 0; i < cache->num_slots; i++) {
+        if (NULL != cache->slots[i].key) {
+            bk_free(cache->slots[i].key);
+            free(cache->slots[i].encoding);
+        }
+    }
+    memset(cache->slots, 0, sizeof *cache->slots * cache->num_slots);
+    cache->num_entries = 0;
+}
+
+void bk_cache_free(BKEncodeCache * cache) {
+    for (size_t i = 0; i < cache->num_slots; i++) {
+        if (NULL != cache->slots[i].key) {
+            bk_free(cache->slots[i].key);
+            free(cache->slots[i].encoding);
+        }
+    }
+    bk_free(cache->slots);
+    memset(cache, 0, sizeof *cache);
+}
+
+/*      @brief Find the slot holding a symbol, or the empty slot where it belongs */
+static BKSymbol * symbol_find(BKSymbol * slots, size_t num_slots, const char * key, uint64_t hash) {
+    size_t i = hash & (num_slots - 1);
+
+    while (NULL != slots[i].key && (slots[i].hash != hash || strcmp(slots[i].key, key) != 0)) {
+        i = (i + 1) & (num_slots - 1);
+    }
+
+    return &slots[i];
+}
+
+static void symbols_grow(BKSymbolTable * table) {
+    size_t     num_slots  = table->num_slots ? table->num_slots * 2 : BK_CACHE_INITIAL_SLOTS;
+    size_t     slots_size = sizeof *table->slots * num_slots;
+    BKSymbol * slots      = bk_calloc(slots_size);
+    VERIFY_NULL_BC(slots, slots_size);
+
+    for (size_t i = 0; i < table->num_slots; i++) {
+        if (NULL != table->slots[i].key) {
+            *symbol_find(slots, num_slots, table->slots[i].key, table->slots[i].hash) =
+                table->slots[i];
+        }
+    }
+
+    bk_free(table->slots);
+    table->slots     = slots;
+    table->num_slots = num_slots;
+}
+
+void bk_symbols_init(BKSymbolTable * table) {
+    memset(table, 0, sizeof *table);
+}
+
+bool bk_symbols_lookup(BKSymbolTable * table, const char * barcode, long * id) {
+    if (0 == table->num_entries) {
+        return false;
+    }
+
+    BKSymbol * symbol =
+        symbol_find(table->slots, table->num_slots, barcode, cache_hash(barcode, strlen(barcode)));
+    if (NULL == symbol->key) {
+        return false;
+    }
+
+    *id = symbol->id;
+    return true;
+}
+
+/**
+ *      @details Open addressing with linear probing, kept at most half full, as for the cache.
+ */
+void bk_symbols_insert(BKSymbolTable * table, const char * barcode, long id) {
+    size_t   len  = strlen(barcode);
+    uint64_t hash = cache_hash(barcode, len);
+
+    if (2 * (table->num_entries + 1) > table->num_slots) {
+        symbols_grow(table);
+    }
+
+    BKSymbol * symbol = symbol_find(table->slots, table->num_slots, barcode, hash);
+    symbol->key       = bk_realloc(NULL, len + 1);
+    VERIFY_NULL_BC(symbol->key, len + 1);
+    memcpy(symbol->key, barcode, len + 1);
+    symbol->hash = hash;
+    symbol->id   = id;
+    table->num_entries++;
+}
+
+void bk_symbols_clear(BKSymbolTable * table) {
+    for (size_t i = 0; i < table->num_slots; i++) {
+        bk_free(table->slots[i].key);
+    }
+    if (NULL != table->slots) {
+        memset(table->slots, 0, sizeof *table->slots * table->num_slots);
+    }
+    table->num_entries = 0;
+}
+
+void bk_symbols_free(BKSymbolTable * table) {
+    bk_symbols_clear(table);
+    bk_free(table->slots);
+    memset(table, 0, sizeof *table);
+}
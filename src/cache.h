@@ -0,0 +1,116 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file cache.h
+ *      @brief Barcode encoding cache declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "barcode.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *      @defgroup CacheProperties Encoding cache properties
+ */
+/*@{*/
+// clang-format off
+#define BK_CACHE_INITIAL_SLOTS  256
+// Entries kept by bk_cache_trim() - beyond this the cache is emptied
+#define BK_CACHE_MAX_ENTRIES    4096
+// clang-format on
+/*@}*/
+
+/*      @brief A cached encoding, keyed by its barcode text */
+typedef struct BKCacheEntry {
+    char *    key;
+    uint64_t  hash;
+    Code128 * encoding;
+} BKCacheEntry;
+
+/**
+ *      @brief A hash table of barcode encodings, so that repeated barcodes are encoded once
+ *      @details Encodings returned by bk_cache_encode() are owned by the cache and remain valid
+ *              until bk_cache_trim() or bk_cache_free(). A cache is not thread-safe - each thread
+ *              generating should own its own.
+ */
+typedef struct BKEncodeCache {
+    BKCacheEntry * slots;
+    size_t         num_slots;
+    size_t         num_entries;
+    unsigned long  hits;
+    unsigned long  misses;
+} BKEncodeCache;
+
+void bk_cache_init(BKEncodeCache *);
+
+/**
+ *      @brief Get the encoding of a barcode, encoding it only if it is not already cached
+ *      @param cache The cache to look in
+ *      @param barcode The null-terminated barcode text
+ *      @param encoding Destination for the cached encoding
+ *      @return SUCCESS, or any error from c128_encode()
+ */
+int bk_cache_encode(BKEncodeCache *, const char *, Code128 **);
+
+/**
+ *      @brief Empty the cache if it holds more than BK_CACHE_MAX_ENTRIES encodings
+ *      @details Must only be called when no encodings from the cache are in use.
+ */
+void bk_cache_trim(BKEncodeCache *);
+
+void bk_cache_free(BKEncodeCache *);
+
+/*      @brief A barcode remembered by a BKSymbolTable, and the identifier it was given */
+typedef struct BKSymbol {
+    char *   key;
+    uint64_t hash;
+    long     id;
+} BKSymbol;
+
+/**
+ *      @brief A hash table of identifiers by barcode text
+ *      @details For output which defines each distinct barcode once and refers to it by an
+ *               identifier thereafter, such as an object number (see pdf.h). Not thread-safe.
+ */
+typedef struct BKSymbolTable {
+    BKSymbol * slots;
+    size_t     num_slots;
+    size_t     num_entries;
+} BKSymbolTable;
+
+void bk_symbols_init(BKSymbolTable *);
+
+/**
+ *      @brief Look a barcode up
+ *      @param table The table to look in
+ *      @param barcode The null-terminated barcode text
+ *      @param id Destination for the barcode's identifier, if it is in the table
+ *      @return Whether the barcode is in the table
+ */
+bool bk_symbols_lookup(BKSymbolTable *, const char *, long *);
+
+/**
+ *      @brief Remember a barcode which is not already in the table
+ *      @param table The table to add to
+ *      @param barcode The null-terminated barcode text, which is copied
+ *      @param id The barcode's identifier
+ */
+void bk_symbols_insert(BKSymbolTable *, const char *, long);
+
+/*      @brief Forget every barcode in the table */
+void bk_symbols_clear(BKSymbolTable *);
+
+void bk_symbols_free(BKSymbolTable *);
+
+#endif
@@ -0,0 +1,117 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file core.c
+ *      @brief Core library implementations as defined in barcodeui.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "barcodeui.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+BKJob * bk_job_new(void) {
+    size_t  job_size = sizeof(BKJob);
+    BKJob * job      = bk_calloc(job_size);
+    VERIFY_NULL_BC(job, job_size);
+
+    bk_job_init(job);
+
+    return job;
+}
+
+void bk_job_delete(BKJob * job) {
+    if (NULL != job) {
+        bk_job_free(job);
+        bk_free(job);
+    }
+}
+
+// clang-format off
+void bk_job_add_batch(
+    BKJob * job,
+    const char * const * barcodes,
+    const int * quantities,
+    int num_barcodes
+) {
+    // clang-format on
+
+    size_t bytes = job->pool_len;
+    for (int i = 0; i < num_barcodes; i++) {
+        bytes += strlen(barcodes[i]) + 1;
+    }
+    bk_job_reserve(job, job->num_barcodes + num_barcodes, bytes);
+
+    for (int i = 0; i < num_barcodes; i++) {
+        bk_job_add(job, barcodes[i], strlen(barcodes[i]), NULL == quantities ? 1 : quantities[i]);
+    }
+}
+
+// clang-format off
+int bk_job_generate(
+    BKJob * job,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKGenerateContext * context,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    bk_job_index(job);
+
+    BKArraySource array  = { job->barcodes, job->quantities, job->num_barcodes, 0 };
+    BKSource      source = { bk_array_next, &array };
+
+    if (NULL == context) {
+        return bk_generate_stream(&source, props, layout, sink, stats);
+    }
+    return bk_generate_context(&source, props, layout, sink, context, stats);
+}
+
+/**
+ *      @details The print system reads the job from a file, so it is generated into a temporary
+ *              file which is removed once the print has been accepted.
+ */
+// clang-format off
+int bk_job_print(
+    BKJob * job,
+    PSProperties * props,
+    Layout * layout,
+    const char * printer,
+    char * job_id,
+    size_t job_id_len
+) {
+    // clang-format on
+
+    char            ps_path[BK_TEMPFILE_TEMPLATE_SIZE];
+    FILE *          ps_file;
+    BKGenerateStats stats;
+
+    int status = bk_tempfile_open(ps_path, &ps_file);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    BKSink sink = { bk_file_write, ps_file };
+    status      = bk_job_generate(job, props, layout, &sink, NULL, &stats);
+
+    if (EOF == fclose(ps_file) && SUCCESS == status) {
+        status = ERR_FILE_CLOSE_FAILED;
+    }
+
+    if (SUCCESS == status && stats.labels > 0) {
+        status = bk_print_sync(ps_path, (char *) printer, job_id, job_id_len);
+    }
+
+    remove(ps_path);
+
+    return status;
+}
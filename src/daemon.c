@@ -0,0 +1,539 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file daemon.c
+ *      @brief Job daemon implementations as defined in daemon.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "daemon.h"
+
+#include "backend.h"
+#include "error.h"
+#include "job.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ *      @brief An accepted connection waiting for a worker
+ */
+typedef struct DaemonConn {
+    int                 fd;
+    struct DaemonConn * next;
+} DaemonConn;
+
+/**
+ *      @brief Daemon state shared between the accept loop and worker threads
+ *      @details @c active holds the connection each worker is serving (or -1), so that reading
+ *              can be shut down when the daemon stops.
+ */
+typedef struct Daemon {
+    pthread_mutex_t lock;
+    pthread_cond_t  ready;
+    DaemonConn *    head;
+    DaemonConn *    tail;
+    int *           active;
+    bool            stopping;
+    // Shared by every worker, or NULL if the daemon does not render
+    BKGsPool *      render_pool;
+    const char *    render_dir;
+} Daemon;
+
+/**
+ *      @brief State kept by a worker thread across the jobs and connections it serves
+ */
+typedef struct DaemonWorker {
+    Daemon *          daemon;
+    int               index;
+    BKGenerateContext context;
+    BKJob             job;
+    FILE *            ps_file;
+    char              ps_path[sizeof BK_TEMPFILE_TEMPLATE];
+} DaemonWorker;
+
+/**
+ *      @brief Per-connection job settings
+ */
+typedef struct DaemonSession {
+    PSProperties props;
+    Layout       layout;
+    char         printer[BK_EXEC_BUFSIZE];
+} DaemonSession;
+
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal(int sig) {
+    (void) sig;
+    daemon_stop = 1;
+}
+
+static void daemon_reply_error(FILE * out, int status, const char * message) {
+    fprintf(out, "error %d %s\n", status, message);
+}
+
+/**
+ *      @details The job is generated into the worker's PostScript file, which is truncated and
+ *              reused by every job the worker serves.
+ */
+static void daemon_print(DaemonWorker * worker, DaemonSession * session, FILE * out) {
+    BKGenerateStats stats                 = { 0, 0, 0 };
+    char            job_id[BK_JOB_ID_LEN] = "-";
+    uint64_t        start                 = bk_clock_ns();
+    int             status;
+
+    bk_job_index(&worker->job);
+
+    BKArraySource array  = { worker->job.barcodes,
+                             worker->job.quantities,
+                             worker->job.num_barcodes,
+                             0 };
+    BKSource      source = { bk_array_next, &array };
+    BKSink        sink   = { bk_file_write, NULL };
+
+    if (NULL == freopen(worker->ps_path, "w", worker->ps_file)) {
+        status = ERR_FILE_RESET_FAILED;
+    } else {
+        sink.ctx = worker->ps_file;
+        status   = bk_generate_context(
+            &source, &session->props, &session->layout, &sink, &worker->context, &stats);
+        if (SUCCESS == status && 0 != fflush(worker->ps_file)) {
+            status = ERR_FLUSH;
+        }
+    }
+
+    if (SUCCESS == status) {
+        fprintf(out, "generated %ld %ld %lu\n", stats.labels, stats.pages, (unsigned long) stats.bytes);
+        fflush(out);
+
+        if ('\0' != session->printer[0] && stats.labels > 0) {
+            status = bk_print_sync(worker->ps_path, session->printer, job_id, BK_JOB_ID_LEN);
+        }
+    }
+
+    if (SUCCESS == status) {
+        fprintf(out,
+                "ok %s %ld %ld %.3f\n",
+                job_id[0] ? job_id : "-",
+                stats.labels,
+                stats.pages,
+                (bk_clock_ns() - start) / 1e6);
+    } else {
+        daemon_reply_error(out, status, "could not generate or print job");
+    }
+
+    bk_job_clear(&worker->job);
+}
+
+/**
+ *      @details The job is rendered through the daemon's Ghostscript pool, so only its pages are
+ *              rendered per request. Names are confined to the output directory.
+ */
+// clang-format off
+static void daemon_render(
+    DaemonWorker * worker,
+    DaemonSession * session,
+    const char * name,
+    FILE * out
+) {
+    // clang-format on
+    Daemon *        daemon = worker->daemon;
+    BKGenerateStats stats  = { 0, 0, 0 };
+    uint64_t        start  = bk_clock_ns();
+    char            output[BK_EXEC_BUFSIZE];
+
+    if (NULL == daemon->render_pool) {
+        daemon_reply_error(out, ERR_PROTOCOL, "not rendering - start the daemon with --device");
+    } else if ('\0' == name[0] || '.' == name[0] || NULL != strchr(name, '/')) {
+        daemon_reply_error(out, ERR_PROTOCOL, "expected render NAME within the output directory");
+    } else {
+        snprintf(output, sizeof output, "%s/%s", daemon->render_dir, name);
+        bk_job_index(&worker->job);
+
+        BKArraySource array  = { worker->job.barcodes,
+                                 worker->job.quantities,
+                                 worker->job.num_barcodes,
+                                 0 };
+        BKSource      source = { bk_array_next, &array };
+
+        int status = bk_gs_render(
+            daemon->render_pool, &source, &session->props, &session->layout, output, &stats);
+        if (SUCCESS == status) {
+            fprintf(out,
+                    "ok %s %ld %ld %.3f\n",
+                    name,
+                    stats.labels,
+                    stats.pages,
+                    (bk_clock_ns() - start) / 1e6);
+        } else {
+            daemon_reply_error(out, status, "could not render job");
+        }
+    }
+
+    bk_job_clear(&worker->job);
+}
+
+static void daemon_serve(DaemonWorker * worker, int fd) {
+    DaemonSession session;
+    FILE *        in, *out;
+    char *        line     = NULL;
+    size_t        line_cap = 0;
+    ssize_t       len;
+    int           dup_fd = dup(fd);
+
+    if (-1 == dup_fd || NULL == (in = fdopen(fd, "r"))) {
+        close(fd);
+        if (-1 != dup_fd) {
+            close(dup_fd);
+        }
+        return;
+    }
+    if (NULL == (out = fdopen(dup_fd, "w"))) {
+        close(dup_fd);
+        fclose(in);
+        return;
+    }
+
+    memset(&session, 0, sizeof session);
+    session.props       = PS_DEFAULT_PROPS;
+    session.layout.rows = BK_DEFAULT_ROWS;
+    session.layout.cols = BK_DEFAULT_COLS;
+
+    while ((len = getline(&line, &line_cap, in)) > 0) {
+        int value_start = 0;
+
+        // Strip the line ending, accepting CRLF
+        while (len > 0 && ('\n' == line[len - 1] || '\r' == line[len - 1])) {
+            line[--len] = '\0';
+        }
+
+        if (strncmp(line, "label ", 6) == 0) {
+            int quantity;
+            if (1 != sscanf(line + 6, "%d %n", &quantity, &value_start) || 0 == value_start
+                || '\0' == line[6 + value_start]) {
+                daemon_reply_error(out, ERR_PROTOCOL, "expected label QUANTITY CODE");
+            } else {
+                const char * code = line + 6 + value_start;
+                bk_job_add(&worker->job, code, strlen(code), quantity);
+                // Labels are not acknowledged, so that clients can stream them without waiting
+                continue;
+            }
+        } else if (strcmp(line, "print") == 0) {
+            daemon_print(worker, &session, out);
+        } else if (strncmp(line, "render ", 7) == 0) {
+            daemon_render(worker, &session, line + 7, out);
+        } else if (strncmp(line, "printer ", 8) == 0) {
+            strncpy(session.printer, line + 8, sizeof session.printer - 1);
+            fputs("ok\n", out);
+        } else if (strncmp(line, "layout ", 7) == 0) {
+            Layout layout;
+            if (2 != sscanf(line + 7, "%d %d", &layout.rows, &layout.cols)
+                || SUCCESS != bk_layout_check(&layout)) {
+                char message[BK_EXEC_BUFSIZE];
+                snprintf(message,
+                         sizeof message,
+                         "expected layout ROWS COLS of at most %d labels",
+                         BK_MAX_LABELS_PER_PAGE);
+                daemon_reply_error(out, ERR_INVALID_LAYOUT, message);
+            } else {
+                session.layout = layout;
+                fputs("ok\n", out);
+            }
+        } else if (strncmp(line, "props ", 6) == 0) {
+            PSProperties props = session.props;
+            char         units[8];
+            // clang-format off
+            if (10 != sscanf(line + 6, "%7s %lf %lf %lf %lf %lf %lf %lf %lf %lf",
+                             units,
+                             &props.lmargin, &props.rmargin, &props.tmargin, &props.bmargin,
+                             &props.bar_width, &props.bar_height, &props.padding,
+                             &props.column_width, &props.fontsize)) {
+                // clang-format on
+                daemon_reply_error(out, ERR_PROTOCOL, "expected props UNITS and nine numbers");
+            } else {
+                strncpy(props.units, units, sizeof props.units - 1);
+                session.props = props;
+                fputs("ok\n", out);
+            }
+        } else if (strcmp(line, "quit") == 0) {
+            break;
+        } else if (len > 0) {
+            daemon_reply_error(out, ERR_PROTOCOL, "unknown request");
+        }
+
+        if (EOF == fflush(out)) {
+            // The client has gone
+            break;
+        }
+    }
+
+    // A job left unprinted by a closed connection is discarded
+    bk_job_clear(&worker->job);
+
+    free(line);
+    fclose(out);
+    fclose(in);
+}
+
+static void * daemon_worker(void * arg) {
+    DaemonWorker * worker = arg;
+    Daemon *       daemon = worker->daemon;
+
+    bk_trace_thread_name("daemon worker");
+
+    for (;;) {
+        pthread_mutex_lock(&daemon->lock);
+        while (NULL == daemon->head && !daemon->stopping) {
+            pthread_cond_wait(&daemon->ready, &daemon->lock);
+        }
+        if (NULL == daemon->head) {
+            pthread_mutex_unlock(&daemon->lock);
+            break;
+        }
+
+        DaemonConn * conn = daemon->head;
+        daemon->head      = conn->next;
+        if (NULL == daemon->head) {
+            daemon->tail = NULL;
+        }
+        bk_metrics_gauge_add(BK_METRIC_DAEMON_QUEUE, -1);
+        int fd = conn->fd;
+        free(conn);
+
+        daemon->active[worker->index] = fd;
+        pthread_mutex_unlock(&daemon->lock);
+
+        daemon_serve(worker, fd);
+
+        pthread_mutex_lock(&daemon->lock);
+        daemon->active[worker->index] = -1;
+        pthread_mutex_unlock(&daemon->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ *      @details A socket file left behind by a daemon which did not exit cleanly is replaced, but
+ *              one with a daemon still listening on it is not.
+ */
+static int daemon_listen(const char * path) {
+    struct sockaddr_un addr;
+    int                fd;
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "ERROR: socket path too long: %s\n", path);
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+
+    if (-1 == (fd = socket(AF_UNIX, SOCK_STREAM, 0))) {
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if (0 == connect(fd, (struct sockaddr *) &addr, sizeof addr)) {
+        fprintf(stderr, "ERROR: a daemon is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    unlink(path);
+
+    mode_t mask = umask(0077);
+    int    status = bind(fd, (struct sockaddr *) &addr, sizeof addr);
+    umask(mask);
+
+    if (-1 == status || -1 == listen(fd, BK_DAEMON_BACKLOG)) {
+        fprintf(stderr, "ERROR: could not listen on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int bk_daemon_run(const BKDaemonOptions * options) {
+    Daemon         daemon;
+    DaemonWorker * workers;
+    pthread_t *    threads;
+    int            num_workers = options->workers > 0 ? options->workers : BK_DAEMON_DEFAULT_WORKERS;
+    int            status      = SUCCESS;
+
+    int listen_fd = daemon_listen(options->socket_path);
+    if (-1 == listen_fd) {
+        return ERR_SOCKET;
+    }
+
+    memset(&daemon, 0, sizeof daemon);
+
+    // Ghostscript is started once for the life of the daemon, not for each job it renders
+    if (NULL != options->render.device) {
+        status = bk_gs_pool_start(&options->render, &daemon.render_pool);
+        if (SUCCESS != status) {
+            fprintf(stderr, "ERROR: could not start Ghostscript: error %d\n", status);
+            close(listen_fd);
+            unlink(options->socket_path);
+            return status;
+        }
+        daemon.render_dir = options->render.output_dir;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = daemon_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    // A client closing its connection early must not terminate the daemon
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.ready, NULL);
+
+    size_t active_size  = sizeof *daemon.active * num_workers;
+    size_t workers_size = sizeof *workers * num_workers;
+    size_t threads_size = sizeof *threads * num_workers;
+    daemon.active       = calloc(1, active_size);
+    VERIFY_NULL_BC(daemon.active, active_size);
+    workers = calloc(1, workers_size);
+    VERIFY_NULL_BC(workers, workers_size);
+    threads = calloc(1, threads_size);
+    VERIFY_NULL_BC(threads, threads_size);
+
+    for (int i = 0; i < num_workers; i++) {
+        DaemonWorker * worker = &workers[i];
+
+        worker->daemon = &daemon;
+        worker->index  = i;
+        bk_context_init(&worker->context);
+        bk_job_init(&worker->job);
+
+        strncpy(worker->ps_path, BK_TEMPFILE_TEMPLATE, sizeof worker->ps_path - 1);
+        int ps_fd = mkstemp(worker->ps_path);
+        if (-1 == ps_fd || NULL == (worker->ps_file = fdopen(ps_fd, "w"))) {
+            fprintf(stderr, "FATAL: Could not create temporary file, exiting.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        daemon.active[i] = -1;
+        pthread_create(&threads[i], NULL, daemon_worker, worker);
+    }
+
+    printf("Listening on %s with %d workers", options->socket_path, num_workers);
+    if (NULL != daemon.render_pool) {
+        printf(", rendering with %s into %s", options->render.device, daemon.render_dir);
+    }
+    printf("\n");
+    fflush(stdout);
+
+    struct pollfd pfd = { listen_fd, POLLIN, 0 };
+
+    while (!daemon_stop) {
+        if (poll(&pfd, 1, BK_DAEMON_POLL_MS) <= 0) {
+            continue;
+        }
+
+        int fd = accept(listen_fd, NULL, NULL);
+        if (-1 == fd) {
+            if (EINTR != errno && EAGAIN != errno && ECONNABORTED != errno) {
+                fprintf(stderr, "ERROR: could not accept connection: %s\n", strerror(errno));
+                status = ERR_SOCKET;
+                break;
+            }
+            continue;
+        }
+        // Connections must not be inherited by print subprocesses
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+        size_t       conn_size = sizeof(DaemonConn);
+        DaemonConn * conn      = calloc(1, conn_size);
+        VERIFY_NULL_BC(conn, conn_size);
+        conn->fd = fd;
+
+        pthread_mutex_lock(&daemon.lock);
+        if (NULL == daemon.tail) {
+            daemon.head = conn;
+        } else {
+            daemon.tail->next = conn;
+        }
+        daemon.tail = conn;
+        bk_metrics_gauge_add(BK_METRIC_DAEMON_QUEUE, 1);
+        pthread_cond_signal(&daemon.ready);
+        pthread_mutex_unlock(&daemon.lock);
+    }
+
+    close(listen_fd);
+    unlink(options->socket_path);
+
+    /* Stop reading from connections being served, so that each worker returns once its request in
+       progress is complete, and drop connections not yet served */
+    pthread_mutex_lock(&daemon.lock);
+    daemon.stopping = true;
+    for (int i = 0; i < num_workers; i++) {
+        if (-1 != daemon.active[i]) {
+            shutdown(daemon.active[i], SHUT_RD);
+        }
+    }
+    while (NULL != daemon.head) {
+        DaemonConn * conn = daemon.head;
+        daemon.head       = conn->next;
+        close(conn->fd);
+        free(conn);
+    }
+    daemon.tail = NULL;
+    pthread_cond_broadcast(&daemon.ready);
+    pthread_mutex_unlock(&daemon.lock);
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(threads[i], NULL);
+
+        fclose(workers[i].ps_file);
+        remove(workers[i].ps_path);
+        bk_context_free(&workers[i].context);
+        bk_job_free(&workers[i].job);
+    }
+
+    if (NULL != daemon.render_pool) {
+        bk_gs_pool_stop(daemon.render_pool);
+    }
+
+    free(threads);
+    free(workers);
+    free(daemon.active);
+    pthread_cond_destroy(&daemon.ready);
+    pthread_mutex_destroy(&daemon.lock);
+
+    return status;
+}
+
+#else
+
+int bk_daemon_run(const BKDaemonOptions * options) {
+    (void) options;
+    fprintf(stderr, "ERROR: the job daemon is not supported on Windows\n");
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+#endif
@@ -0,0 +1,77 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file daemon.h
+ *      @brief Job daemon declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      The daemon listens on a Unix domain socket and reads requests one line at a time:
+ *
+ *          printer NAME        Print following jobs to NAME (jobs are only generated if unset)
+ *          props UNITS LMARGIN RMARGIN TMARGIN BMARGIN BAR_WIDTH BAR_HEIGHT PADDING
+ *                COLUMN_WIDTH FONTSIZE
+ *                              Set the PostScript properties of following jobs
+ *          layout ROWS COLS    Set the page layout of following jobs, of at most
+ *                              BK_MAX_LABELS_PER_PAGE labels
+ *          label QUANTITY CODE Add QUANTITY copies of CODE (the rest of the line) to the job
+ *          print               Generate and print the job, then start a new one
+ *          render NAME         Render the job with Ghostscript to NAME in the output directory,
+ *                              then start a new one (see BKDaemonOptions)
+ *          quit                Close the connection
+ *
+ *      Settings apply to every later job on the same connection. After @c print the daemon
+ *      replies with a line @c "generated LABELS PAGES BYTES" once the job is generated, then
+ *      @c "ok JOB_ID LABELS PAGES MILLISECONDS" once it is accepted by the print system
+ *      (@c JOB_ID is @c - if the job was not printed). After @c render it replies with
+ *      @c "ok NAME LABELS PAGES MILLISECONDS" once every page is rendered. Any failure is
+ *      replied to with @c "error CODE MESSAGE", which for a @c print or @c render request also
+ *      discards the job.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "gspool.h"
+
+/**
+ *      @defgroup DaemonProperties Job daemon properties
+ */
+/*@{*/
+// clang-format off
+#define BK_DAEMON_DEFAULT_WORKERS   4
+#define BK_DAEMON_BACKLOG           64
+// Interval at which the accept loop checks for shutdown
+#define BK_DAEMON_POLL_MS           500
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Options for running the job daemon
+ *      @details @c workers of 0 selects BK_DAEMON_DEFAULT_WORKERS. With a @c render device, a
+ *               Ghostscript pool is started with these options for as long as the daemon runs,
+ *               and @c render requests write to its output directory. Without one, @c render
+ *               requests are refused.
+ */
+typedef struct BKDaemonOptions {
+    const char * socket_path;
+    int          workers;
+    BKGsOptions  render;
+} BKDaemonOptions;
+
+/**
+ *      @brief Serve jobs on a Unix domain socket until interrupted
+ *      @details Each connection is served by one of a pool of worker threads, which keeps its
+ *               encoding cache and PostScript file between jobs. Every worker renders through the
+ *               one Ghostscript pool, so Ghostscript is only started once rather than for each job.
+ *               Returns on SIGINT or SIGTERM, once requests in progress are complete.
+ *      @param options The socket path, number of worker threads and Ghostscript pool options
+ *      @return SUCCESS, ERR_SOCKET, ERR_UNSUPPORTED_PLATFORM, or as bk_gs_pool_start()
+ */
+int bk_daemon_run(const BKDaemonOptions *);
+
+#endif
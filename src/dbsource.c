@@ -0,0 +1,158 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file dbsource.c
+ *      @brief SQLite job source implementations as defined in dbsource.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "dbsource.h"
+
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *      @details The database is opened read-write, as rows are marked printed through the same
+ *              connection. A busy timeout is set since the database is shared with the process
+ *              which writes the rows.
+ */
+int bk_db_open(BKDBSource * db_source, const char * path, const char * query) {
+    memset(db_source, 0, sizeof *db_source);
+
+    if (NULL == query) {
+        query = BK_DB_DEFAULT_QUERY;
+    }
+
+    if (SQLITE_OK != sqlite3_open_v2(path, &db_source->db, SQLITE_OPEN_READWRITE, NULL)) {
+        fprintf(stderr, "ERROR: could not open database: %s\n", sqlite3_errmsg(db_source->db));
+        bk_db_close(db_source);
+        return ERR_SQLITE;
+    }
+
+    sqlite3_busy_timeout(db_source->db, BK_DB_BUSY_TIMEOUT);
+
+    if (SQLITE_OK != sqlite3_prepare_v2(db_source->db, query, -1, &db_source->stmt, NULL)) {
+        fprintf(stderr, "ERROR: could not prepare query: %s\n", sqlite3_errmsg(db_source->db));
+        bk_db_close(db_source);
+        return ERR_SQLITE;
+    }
+
+    if (sqlite3_column_count(db_source->stmt) < 2) {
+        fprintf(stderr, "ERROR: query must yield at least (code, quantity) columns\n");
+        bk_db_close(db_source);
+        return ERR_SQLITE;
+    }
+    db_source->has_keys = sqlite3_column_count(db_source->stmt) >= 3;
+
+    return SUCCESS;
+}
+
+BKSource bk_db_source(BKDBSource * db_source) {
+    BKSource source = { bk_db_next, db_source };
+    return source;
+}
+
+/**
+ *      @details The barcode text returned points into SQLite's row buffer, which remains valid
+ *              until the cursor is next stepped.
+ */
+int bk_db_next(void * ctx, const char ** barcode, int * quantity) {
+    BKDBSource * db_source = ctx;
+
+    switch (sqlite3_step(db_source->stmt)) {
+        case SQLITE_ROW:
+            break;
+        case SQLITE_DONE:
+            return BK_SOURCE_END;
+        default:
+            fprintf(stderr, "ERROR: could not read row: %s\n", sqlite3_errmsg(db_source->db));
+            return ERR_SQLITE;
+    }
+
+    const char * text = (const char *) sqlite3_column_text(db_source->stmt, 0);
+    *barcode          = NULL == text ? "" : text;
+    *quantity         = SQLITE_NULL == sqlite3_column_type(db_source->stmt, 1)
+                    ? 1
+                    : sqlite3_column_int(db_source->stmt, 1);
+
+    if (db_source->has_keys) {
+        if (db_source->num_keys == db_source->keys_cap) {
+            db_source->keys_cap =
+                db_source->keys_cap ? db_source->keys_cap * 2 : BK_DB_INITIAL_KEYS;
+            size_t keys_size = sizeof *db_source->keys * db_source->keys_cap;
+            db_source->keys  = realloc(db_source->keys, keys_size);
+            VERIFY_NULL_BC(db_source->keys, keys_size);
+        }
+        db_source->keys[db_source->num_keys++] = sqlite3_column_int64(db_source->stmt, 2);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ *      @details The query cursor is reset first so that it no longer holds a read transaction.
+ *              Marking is all-or-nothing: on any failure the transaction is rolled back, and the
+ *              rows will be read again next time.
+ */
+int bk_db_mark_printed(BKDBSource * db_source, const char * mark) {
+    sqlite3_stmt * stmt   = NULL;
+    int            status = SUCCESS;
+
+    if (!db_source->has_keys || 0 == db_source->num_keys) {
+        return SUCCESS;
+    }
+
+    if (NULL == mark) {
+        mark = BK_DB_DEFAULT_MARK;
+    }
+
+    sqlite3_reset(db_source->stmt);
+
+    if (SQLITE_OK != sqlite3_exec(db_source->db, "BEGIN IMMEDIATE", NULL, NULL, NULL)) {
+        fprintf(stderr, "ERROR: could not begin transaction: %s\n", sqlite3_errmsg(db_source->db));
+        return ERR_SQLITE;
+    }
+
+    if (SQLITE_OK != sqlite3_prepare_v2(db_source->db, mark, -1, &stmt, NULL)) {
+        status = ERR_SQLITE;
+    }
+
+    for (size_t i = 0; i < db_source->num_keys && SUCCESS == status; i++) {
+        sqlite3_bind_int64(stmt, 1, db_source->keys[i]);
+        if (SQLITE_DONE != sqlite3_step(stmt)) {
+            status = ERR_SQLITE;
+        }
+        sqlite3_reset(stmt);
+    }
+
+    if (SUCCESS == status
+        && SQLITE_OK != sqlite3_exec(db_source->db, "COMMIT", NULL, NULL, NULL)) {
+        status = ERR_SQLITE;
+    }
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "ERROR: could not mark rows printed: %s\n", sqlite3_errmsg(db_source->db));
+        sqlite3_exec(db_source->db, "ROLLBACK", NULL, NULL, NULL);
+    } else {
+        db_source->num_keys = 0;
+    }
+
+    sqlite3_finalize(stmt);
+
+    return status;
+}
+
+void bk_db_close(BKDBSource * db_source) {
+    sqlite3_finalize(db_source->stmt);
+    sqlite3_close(db_source->db);
+    free(db_source->keys);
+    memset(db_source, 0, sizeof *db_source);
+}
@@ -0,0 +1,87 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file dbsource.h
+ *      @brief SQLite job source declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef DBSOURCE_H
+#define DBSOURCE_H
+
+#include "backend.h"
+#include "sqlite3.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *      @defgroup DBSourceProperties SQLite job source properties
+ */
+/*@{*/
+// clang-format off
+/*      @brief Query used when none is given - yields (code, quantity, key) for unprinted rows */
+#define BK_DB_DEFAULT_QUERY \
+    "SELECT code, quantity, rowid FROM labels WHERE printed = 0 ORDER BY rowid"
+/*      @brief Statement used to mark a row printed when none is given - bound to each row's key */
+#define BK_DB_DEFAULT_MARK      "UPDATE labels SET printed = 1 WHERE rowid = ?1"
+// Milliseconds to wait for another process's lock on the database
+#define BK_DB_BUSY_TIMEOUT      5000
+#define BK_DB_INITIAL_KEYS      1024
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief A job source reading rows from an SQLite query through a cursor
+ *      @details The query must yield the barcode text in its first column and the quantity in its
+ *              second. If it yields a third column, its integer value is recorded as the row's key
+ *              and passed to the mark statement by bk_db_mark_printed(). Keys are the only per-row
+ *              state retained - barcodes are encoded straight from the cursor.
+ */
+typedef struct BKDBSource {
+    sqlite3 *      db;
+    sqlite3_stmt * stmt;
+    int64_t *      keys;
+    size_t         num_keys;
+    size_t         keys_cap;
+    bool           has_keys;
+} BKDBSource;
+
+/**
+ *      @brief Open a database and prepare a query
+ *      @param db_source The source to initialise
+ *      @param path Path of the SQLite database
+ *      @param query The query yielding rows, or NULL for BK_DB_DEFAULT_QUERY
+ *      @return SUCCESS, ERR_SQLITE
+ */
+int bk_db_open(BKDBSource *, const char *, const char *);
+
+/**
+ *      @brief Get a BKSource reading from an open database source
+ */
+BKSource bk_db_source(BKDBSource *);
+
+/**
+ *      @brief BKSource callback stepping the query cursor
+ */
+int bk_db_next(void *, const char **, int *);
+
+/**
+ *      @brief Mark every row read so far as printed, in a single transaction
+ *      @param db_source An open source, read to completion
+ *      @param mark The statement to run for each row key, or NULL for BK_DB_DEFAULT_MARK
+ *      @return SUCCESS, ERR_SQLITE
+ */
+int bk_db_mark_printed(BKDBSource *, const char *);
+
+/**
+ *      @brief Finalise the query and close the database
+ */
+void bk_db_close(BKDBSource *);
+
+#endif
@@ -37,6 +37,20 @@
 #define ERR_FLUSH                           23
 #define ERR_SYSTEM                          24
 #define ERR_PRINTER_LIST                    25
+#define ERR_FILE_OPEN_FAILED                26
+#define ERR_MMAP                            27
+#define ERR_UNSUPPORTED_FORMAT              28
+#define ERR_IMPORT_ROW                      29
+#define ERR_ARCHIVE                         30
+#define ERR_PRINT_FAILED                    31
+#define ERR_SQLITE                          32
+#define ERR_SPOOL                           33
+#define ERR_UNSUPPORTED_PLATFORM            34
+#define ERR_SOCKET                          35
+#define ERR_PROTOCOL                        36
+#define ERR_RING                            37
+#define ERR_CANCELLED                       38
+#define ERR_GHOSTSCRIPT                     39
 /*@}*/
 
 // clang-format on
@@ -0,0 +1,355 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file fanout.c
+ *      @brief Implementations for generating several outputs from one read of a source as
+ *             defined in fanout.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "fanout.h"
+
+#include "error.h"
+#include "job.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifndef _WIN32
+/*      @brief Rows read from the source, shared by every sink until the last has read them */
+typedef struct FanoutBlock {
+    BKJob                job;
+    long                 refs;
+    struct FanoutBlock * next_free;
+} FanoutBlock;
+
+struct Fanout;
+
+/*      @brief A sink, the blocks queued for it and its position in them */
+typedef struct FanoutQueue {
+    struct Fanout * fanout;
+    BKFanoutSink *  sink;
+    pthread_t       thread;
+    bool            started;
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty, not_full;
+    FanoutBlock *   blocks[BK_FANOUT_QUEUE_BLOCKS];
+    int             head, count;
+    // Set once the source has been read, with the status it ended with
+    bool            closed;
+    int             source_status;
+    // Set once the sink has stopped reading, so that it is handed no more blocks
+    bool            finished;
+    // The block being read by the sink, and its next row
+    FanoutBlock *   current;
+    int             next;
+} FanoutQueue;
+
+/*      @brief The sinks of a source being read, and blocks kept for reuse once read */
+typedef struct Fanout {
+    FanoutQueue     queues[BK_FANOUT_MAX_SINKS];
+    int             num_queues;
+    pthread_mutex_t lock;
+    FanoutBlock *   free_blocks;
+} Fanout;
+
+/*      @brief Get an empty block, reusing one every sink has read if there is one */
+static FanoutBlock * fanout_block(Fanout * fanout) {
+    pthread_mutex_lock(&fanout->lock);
+    FanoutBlock * block = fanout->free_blocks;
+    if (NULL != block) {
+        fanout->free_blocks = block->next_free;
+    }
+    pthread_mutex_unlock(&fanout->lock);
+
+    if (NULL == block) {
+        size_t block_size = sizeof *block;
+        block             = malloc(block_size);
+        VERIFY_NULL_BC(block, block_size);
+        bk_job_init(&block->job);
+    }
+
+    return block;
+}
+
+/*      @brief Give up one sink's share of a block, keeping it for reuse once every sink has */
+static void fanout_release(Fanout * fanout, FanoutBlock * block) {
+    if (0 != __atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+
+    // The block's storage is kept, so that later blocks fill without allocating
+    bk_job_clear(&block->job);
+    pthread_mutex_lock(&fanout->lock);
+    block->next_free    = fanout->free_blocks;
+    fanout->free_blocks = block;
+    pthread_mutex_unlock(&fanout->lock);
+}
+
+/**
+ *      @brief Queue a full block for every sink still reading, waiting for any whose queue is full
+ *      @return Whether any sink is still reading
+ */
+static bool fanout_publish(Fanout * fanout, FanoutBlock * block) {
+    bool reading = false;
+
+    block->refs = fanout->num_queues;
+
+    for (int i = 0; i < fanout->num_queues; i++) {
+        FanoutQueue * queue = &fanout->queues[i];
+
+        pthread_mutex_lock(&queue->lock);
+        if (BK_FANOUT_QUEUE_BLOCKS == queue->count && !queue->finished) {
+            // Time spent held up by the slowest sink
+            uint64_t span = bk_trace_begin();
+            while (BK_FANOUT_QUEUE_BLOCKS == queue->count && !queue->finished) {
+                pthread_cond_wait(&queue->not_full, &queue->lock);
+            }
+            bk_trace_end(BK_TRACE_FANOUT_WAIT, span);
+        }
+
+        if (queue->finished) {
+            pthread_mutex_unlock(&queue->lock);
+            fanout_release(fanout, block);
+            continue;
+        }
+
+        queue->blocks[(queue->head + queue->count) % BK_FANOUT_QUEUE_BLOCKS] = block;
+        queue->count++;
+        reading = true;
+        pthread_cond_signal(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    return reading;
+}
+
+/*      @brief Take the next block queued for a sink, or NULL once the source has been read */
+static FanoutBlock * fanout_take(FanoutQueue * queue) {
+    FanoutBlock * block = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    while (0 == queue->count && !queue->closed) {
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->count > 0) {
+        block       = queue->blocks[queue->head];
+        queue->head = (queue->head + 1) % BK_FANOUT_QUEUE_BLOCKS;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return block;
+}
+
+/*      @brief BKSource callback reading the blocks queued for a sink */
+static int fanout_next(void * ctx, const char ** barcode, int * quantity) {
+    FanoutQueue * queue = ctx;
+
+    while (NULL == queue->current || queue->next == queue->current->job.num_barcodes) {
+        if (NULL != queue->current) {
+            fanout_release(queue->fanout, queue->current);
+        }
+
+        queue->current = fanout_take(queue);
+        queue->next    = 0;
+        if (NULL == queue->current) {
+            return SUCCESS == queue->source_status ? BK_SOURCE_END : queue->source_status;
+        }
+    }
+
+    *barcode  = bk_job_barcode(&queue->current->job, queue->next);
+    *quantity = queue->current->job.quantities[queue->next];
+    queue->next++;
+
+    return SUCCESS;
+}
+
+/*      @brief Stop handing a sink blocks, giving up those it had not read */
+static void fanout_finish(FanoutQueue * queue) {
+    if (NULL != queue->current) {
+        fanout_release(queue->fanout, queue->current);
+        queue->current = NULL;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->finished = true;
+    for (; queue->count > 0; queue->count--) {
+        fanout_release(queue->fanout, queue->blocks[queue->head]);
+        queue->head = (queue->head + 1) % BK_FANOUT_QUEUE_BLOCKS;
+    }
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+static void * fanout_writer(void * arg) {
+    FanoutQueue * queue  = arg;
+    BKSource      source = { fanout_next, queue };
+    uint64_t      start  = bk_clock_ns();
+
+    bk_trace_thread_name("fanout writer");
+
+    queue->sink->status     = queue->sink->generate(queue->sink->ctx, &source);
+    queue->sink->elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    fanout_finish(queue);
+
+    return NULL;
+}
+
+/**
+ *      @details The calling thread only reads the source and queues blocks - every sink, however
+ *              fast, generates on a writer thread of its own.
+ */
+int bk_fanout(BKSource * source, BKFanoutSink * sinks, int num_sinks) {
+    Fanout fanout;
+    int    status;
+
+    if (num_sinks < 1 || num_sinks > BK_FANOUT_MAX_SINKS) {
+        return ERR_ARGUMENT;
+    }
+
+    memset(&fanout, 0, sizeof fanout);
+    fanout.num_queues = num_sinks;
+    pthread_mutex_init(&fanout.lock, NULL);
+    for (int i = 0; i < num_sinks; i++) {
+        FanoutQueue * queue = &fanout.queues[i];
+
+        queue->fanout = &fanout;
+        queue->sink   = &sinks[i];
+        pthread_mutex_init(&queue->lock, NULL);
+        pthread_cond_init(&queue->not_empty, NULL);
+        pthread_cond_init(&queue->not_full, NULL);
+
+        // A sink whose writer cannot be started fails, and is handed no blocks
+        queue->started = 0 == pthread_create(&queue->thread, NULL, fanout_writer, queue);
+        if (!queue->started) {
+            sinks[i].status     = ERR_GENERIC;
+            sinks[i].elapsed_ms = 0;
+            queue->finished     = true;
+        }
+    }
+
+    FanoutBlock * block = fanout_block(&fanout);
+    for (;;) {
+        const char * barcode;
+        int          quantity;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        }
+
+        bk_job_add(&block->job, barcode, strlen(barcode), quantity);
+        if (BK_FANOUT_BLOCK_ROWS == block->job.num_barcodes) {
+            bool reading = fanout_publish(&fanout, block);
+            block        = fanout_block(&fanout);
+            // Every sink has stopped early, so the rest of the source would go unread
+            if (!reading) {
+                break;
+            }
+        }
+    }
+
+    if (block->job.num_barcodes > 0) {
+        fanout_publish(&fanout, block);
+    } else {
+        block->refs = 1;
+        fanout_release(&fanout, block);
+    }
+
+    for (int i = 0; i < num_sinks; i++) {
+        FanoutQueue * queue = &fanout.queues[i];
+
+        pthread_mutex_lock(&queue->lock);
+        queue->source_status = status;
+        queue->closed        = true;
+        pthread_cond_broadcast(&queue->not_empty);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    for (int i = 0; i < num_sinks; i++) {
+        FanoutQueue * queue = &fanout.queues[i];
+
+        if (queue->started) {
+            pthread_join(queue->thread, NULL);
+        }
+        pthread_cond_destroy(&queue->not_full);
+        pthread_cond_destroy(&queue->not_empty);
+        pthread_mutex_destroy(&queue->lock);
+    }
+
+    while (NULL != fanout.free_blocks) {
+        block              = fanout.free_blocks;
+        fanout.free_blocks = block->next_free;
+        bk_job_free(&block->job);
+        free(block);
+    }
+    pthread_mutex_destroy(&fanout.lock);
+
+    return status;
+}
+#else
+/**
+ *      @details Without threads, the source is read into a job in full, and each sink reads the
+ *              job in turn.
+ */
+int bk_fanout(BKSource * source, BKFanoutSink * sinks, int num_sinks) {
+    BKJob job;
+    int   status;
+
+    if (num_sinks < 1 || num_sinks > BK_FANOUT_MAX_SINKS) {
+        return ERR_ARGUMENT;
+    }
+
+    bk_job_init(&job);
+    for (;;) {
+        const char * barcode;
+        int          quantity;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        }
+        bk_job_add(&job, barcode, strlen(barcode), quantity);
+    }
+
+    for (int i = 0; i < num_sinks; i++) {
+        uint64_t start = bk_clock_ns();
+
+        if (SUCCESS == status) {
+            BKJobReader reader;
+            bk_job_read(&job, &reader);
+
+            BKSource job_source = { bk_job_next, &reader };
+            sinks[i].status     = sinks[i].generate(sinks[i].ctx, &job_source);
+
+            bk_job_reader_free(&reader);
+        } else {
+            sinks[i].status = status;
+        }
+        sinks[i].elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    }
+
+    bk_job_free(&job);
+
+    return status;
+}
+#endif
@@ -0,0 +1,68 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file fanout.h
+ *      @brief Declarations for generating several outputs from one read of a source
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      A job printed, archived as PDF and exported as images would otherwise be imported - or
+ *      queried - once for each. Instead the source is read once, on the calling thread, into
+ *      blocks of BK_FANOUT_BLOCK_ROWS rows, and each block is handed to every sink. Each sink
+ *      generates on a writer thread of its own, reading the blocks as a BKSource, so the outputs
+ *      are generated side by side and the whole takes about as long as the slowest.
+ *
+ *      Blocks are shared between the sinks rather than copied, and freed once every sink has
+ *      read them. Each sink queues at most BK_FANOUT_QUEUE_BLOCKS of them, so reading waits for
+ *      the slowest sink rather than holding the job in memory; a sink which stops early, on an
+ *      error, is no longer handed blocks and does not hold up the others.
+ */
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "backend.h"
+
+/**
+ *      @defgroup FanoutProperties Fan-out properties
+ */
+/*@{*/
+// clang-format off
+#define BK_FANOUT_BLOCK_ROWS        256
+// Blocks read ahead of each sink
+#define BK_FANOUT_QUEUE_BLOCKS      64
+#define BK_FANOUT_MAX_SINKS         8
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief One output generated from a fanned-out source
+ *      @details @c generate is called once, on a thread of its own, with @c ctx and a source of
+ *               every row, and returns its status as generators do. A sink which reads the source
+ *               to its end is given BK_SOURCE_END, or the error the source itself returned.
+ *               @c status and @c elapsed_ms are filled in by bk_fanout().
+ */
+typedef struct BKFanoutSink {
+    int (*generate)(void *, BKSource *);
+    void * ctx;
+    int    status;
+    double elapsed_ms;
+} BKFanoutSink;
+
+/**
+ *      @brief Read a source once, generating every sink from it at the same time
+ *      @details On Windows the source is read into memory and the sinks are generated from it one
+ *               after another. A sink whose thread cannot be started is left with ERR_GENERIC.
+ *      @param source The barcodes and quantities to generate
+ *      @param sinks The sinks, each left with its status
+ *      @param num_sinks The length of @c sinks, at most BK_FANOUT_MAX_SINKS
+ *      @return SUCCESS, ERR_ARGUMENT, or any error returned by @c source - the status of each
+ *              sink is left in its @c status
+ */
+int bk_fanout(BKSource *, BKFanoutSink *, int);
+
+#endif
@@ -0,0 +1,740 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file gspool.c
+ *      @brief Ghostscript worker pool implementations as defined in gspool.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "gspool.h"
+
+#include "dbsource.h"
+#include "error.h"
+#include "import.h"
+#include "job.h"
+#include "pdf.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*      @brief Runs the PostScript following it up to MARKER, see gspool.h */
+// clang-format off
+#define GS_RUN_PROC                                                                             \
+    "/bk_run {"                                                                                 \
+    " mark exch { dup null eq { pop } { << /OutputFile 3 -1 roll >> setpagedevice } ifelse }"   \
+    " stopped { cleartomark true } { cleartomark false } ifelse"                                \
+    " /bk_page currentfile 0 (%s) /SubFileDecode filter def"                                    \
+    " /bk_save save def"                                                                        \
+    " { true } { mark { bk_page cvx exec } stopped { cleartomark true } { cleartomark false }"  \
+    " ifelse } ifelse"                                                                          \
+    " bk_page flushfile { (%s error) } { (%s done) } ifelse = flush"                            \
+    " cleardictstack bk_save restore"                                                           \
+    " } bind def\n"
+// clang-format on
+
+/**
+ *      @brief Pages sent together, replied to once every one has been rendered
+ *      @details Guarded by the pool's lock.
+ */
+typedef struct GsBatch {
+    int pending;
+    int status;
+} GsBatch;
+
+/*      @brief A page sent to a process and not yet replied to */
+typedef struct GsRequest {
+    GsBatch *          batch;
+    struct GsRequest * next;
+} GsRequest;
+
+/**
+ *      @brief One Ghostscript process, and the thread reading its replies
+ *      @details @c write_lock is held while a page is sent, so that pages from different threads
+ *              are not interleaved; it is taken before the pool's lock. The request queue,
+ *              @c outstanding, @c alive and @c reserved are guarded by the pool's lock. A worker is
+ *              reserved by one job while a page is sent to it, and for the whole of a job rendered
+ *              as one document, whose later pages continue the output file of the first.
+ */
+typedef struct GsWorker {
+    struct BKGsPool * pool;
+    pid_t             pid;
+    FILE *            in;
+    FILE *            out;
+    pthread_t         reader;
+    pthread_mutex_t   write_lock;
+    GsRequest *       head;
+    GsRequest *       tail;
+    int               outstanding;
+    bool              alive;
+    bool              reserved;
+    char              scratch[BK_TEMPFILE_TEMPLATE_SIZE];
+} GsWorker;
+
+struct BKGsPool {
+    GsWorker *      workers;
+    int             num_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t  replied;
+    char            marker[BK_GS_MARKER_LEN];
+};
+
+/*      @brief Sink state rendering a job's pages through a pool */
+typedef struct GsRender {
+    BKGsPool *   pool;
+    GsBatch      batch;
+    const char * output;
+    bool         per_page;
+    long         page;
+    // The process rendering the document, if not one file per page
+    GsWorker * document;
+    bool *     used;
+} GsRender;
+
+/**
+ *      @brief Write an output file name as a PostScript string literal
+ *      @details Ghostscript formats output file names with the page number, so '%' is doubled.
+ */
+static void gs_write_output(FILE * in, const char * output) {
+    fputc('(', in);
+    for (; '\0' != *output; output++) {
+        if ('(' == *output || ')' == *output || '\\' == *output) {
+            fputc('\\', in);
+        } else if ('%' == *output) {
+            fputc('%', in);
+        }
+        fputc(*output, in);
+    }
+    fputc(')', in);
+}
+
+/*      @brief Complete the oldest request of a worker, with the pool's lock held */
+static void gs_complete(GsWorker * worker, int status) {
+    GsRequest * request = worker->head;
+
+    if (NULL == request) {
+        return;
+    }
+    worker->head = request->next;
+    if (NULL == worker->head) {
+        worker->tail = NULL;
+    }
+    worker->outstanding--;
+
+    if (SUCCESS != status && SUCCESS == request->batch->status) {
+        request->batch->status = status;
+    }
+    request->batch->pending--;
+    free(request);
+}
+
+/**
+ *      @details Lines not starting with the marker were printed by the PostScript itself, and are
+ *              ignored. Once the process exits, every request still outstanding fails.
+ */
+static void * gs_reader(void * data) {
+    GsWorker * worker = data;
+    BKGsPool * pool   = worker->pool;
+    size_t     len    = strlen(pool->marker);
+    char       line[BK_GS_LINE_LEN];
+
+    bk_trace_thread_name("gs reader");
+
+    while (NULL != fgets(line, sizeof line, worker->out)) {
+        if (0 != strncmp(line, pool->marker, len) || ' ' != line[len]) {
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        gs_complete(worker, 0 == strncmp(line + len + 1, "error", 5) ? ERR_GHOSTSCRIPT : SUCCESS);
+        pthread_cond_broadcast(&pool->replied);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    worker->alive = false;
+    while (NULL != worker->head) {
+        gs_complete(worker, ERR_GHOSTSCRIPT);
+    }
+    pthread_cond_broadcast(&pool->replied);
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ *      @brief Send PostScript to a worker as one request of a batch
+ *      @param output The output file to start, or NULL to continue the current one
+ *      @param data PostScript to run with bk_run, or NULL to send @c command alone
+ *      @param command PostScript sent alone, which must print a reply itself
+ */
+// clang-format off
+static int gs_send(
+    GsWorker * worker,
+    GsBatch * batch,
+    const char * output,
+    const char * data,
+    size_t len,
+    const char * command
+) {
+    // clang-format on
+
+    BKGsPool * pool   = worker->pool;
+    int        status = SUCCESS;
+
+    size_t      request_size = sizeof(GsRequest);
+    GsRequest * request      = calloc(1, request_size);
+    VERIFY_NULL_BC(request, request_size);
+    request->batch = batch;
+
+    pthread_mutex_lock(&worker->write_lock);
+
+    // Queued before being written, so that the reply cannot arrive first
+    pthread_mutex_lock(&pool->lock);
+    if (!worker->alive) {
+        pthread_mutex_unlock(&pool->lock);
+        pthread_mutex_unlock(&worker->write_lock);
+        free(request);
+        return ERR_GHOSTSCRIPT;
+    }
+    if (NULL == worker->tail) {
+        worker->head = request;
+    } else {
+        worker->tail->next = request;
+    }
+    worker->tail = request;
+    worker->outstanding++;
+    batch->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (NULL == data) {
+        fputs(command, worker->in);
+    } else {
+        if (NULL == output) {
+            fputs("null", worker->in);
+        } else {
+            gs_write_output(worker->in, output);
+        }
+        fputs(" bk_run\n", worker->in);
+        fwrite(data, 1, len, worker->in);
+        fprintf(worker->in, "\n%s\n", pool->marker);
+    }
+    // A process which has exited fails the request through gs_reader()
+    if (0 != fflush(worker->in) || ferror(worker->in)) {
+        status = ERR_GHOSTSCRIPT;
+    }
+
+    pthread_mutex_unlock(&worker->write_lock);
+
+    return status;
+}
+
+/*      @brief Wait until every request of a batch has been replied to */
+static int gs_wait(BKGsPool * pool, GsBatch * batch) {
+    pthread_mutex_lock(&pool->lock);
+    while (batch->pending > 0) {
+        pthread_cond_wait(&pool->replied, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return batch->status;
+}
+
+/**
+ *      @brief Reserve a worker, to be released with gs_release()
+ *      @details Waits while every live worker is reserved by another job.
+ *      @param worker The worker to reserve, or NULL for the live worker with the fewest pages
+ *              outstanding
+ *      @return The reserved worker, or NULL if none is alive
+ */
+static GsWorker * gs_acquire(BKGsPool * pool, GsWorker * worker) {
+    GsWorker * least = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        bool alive = false;
+        for (int i = 0; i < pool->num_workers; i++) {
+            GsWorker * candidate = &pool->workers[i];
+            if (!candidate->alive || (NULL != worker && worker != candidate)) {
+                continue;
+            }
+            alive = true;
+            if (!candidate->reserved
+                && (NULL == least || candidate->outstanding < least->outstanding)) {
+                least = candidate;
+            }
+        }
+        if (NULL != least || !alive) {
+            break;
+        }
+        pthread_cond_wait(&pool->replied, &pool->lock);
+    }
+    if (NULL != least) {
+        least->reserved = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return least;
+}
+
+/*      @brief Release a worker reserved with gs_acquire() */
+static void gs_release(BKGsPool * pool, GsWorker * worker) {
+    pthread_mutex_lock(&pool->lock);
+    worker->reserved = false;
+    pthread_cond_broadcast(&pool->replied);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*      @brief Start a worker's process and reader thread */
+// clang-format off
+static int gs_spawn(
+    BKGsPool * pool,
+    GsWorker * worker,
+    const BKGsOptions * options,
+    int resolution
+) {
+    // clang-format on
+
+    char   device[BK_GS_LINE_LEN], res[BK_GS_LINE_LEN], output[BK_GS_LINE_LEN];
+    char   permit_dir[BK_GS_LINE_LEN], permit_scratch[BK_GS_LINE_LEN];
+    FILE * scratch;
+    int    in[2], out[2];
+
+    worker->pool = pool;
+    pthread_mutex_init(&worker->write_lock, NULL);
+
+    int status = bk_tempfile_open(worker->scratch, &scratch);
+    if (SUCCESS != status) {
+        worker->scratch[0] = '\0';
+        return status;
+    }
+    fclose(scratch);
+
+    snprintf(device, sizeof device, "-sDEVICE=%s", options->device);
+    snprintf(res, sizeof res, "-r%d", resolution);
+    snprintf(output, sizeof output, "-sOutputFile=%s", worker->scratch);
+    snprintf(permit_dir, sizeof permit_dir, "--permit-file-write=%s/", options->output_dir);
+    snprintf(permit_scratch, sizeof permit_scratch, "--permit-file-write=%s", worker->scratch);
+
+    // Otherwise processes started later would hold this one's input open
+    if (-1 == bk_cloexec_pipe(in)) {
+        return ERR_FORK;
+    }
+    if (-1 == bk_cloexec_pipe(out)) {
+        close(in[0]);
+        close(in[1]);
+        return ERR_FORK;
+    }
+
+    worker->pid = fork();
+    if (0 == worker->pid) {
+        // dup2() clears close-on-exec on the copies, unless an end already is the standard stream
+        if (STDIN_FILENO == in[0]) {
+            fcntl(STDIN_FILENO, F_SETFD, 0);
+        } else {
+            dup2(in[0], STDIN_FILENO);
+        }
+        if (STDOUT_FILENO == out[1]) {
+            fcntl(STDOUT_FILENO, F_SETFD, 0);
+        } else {
+            dup2(out[1], STDOUT_FILENO);
+        }
+        execlp(BK_GS_CMD,
+               BK_GS_CMD,
+               "-q",
+               "-dSAFER",
+               "-dBATCH",
+               "-dNOPAUSE",
+               "-dNOPROMPT",
+               device,
+               res,
+               output,
+               permit_dir,
+               permit_scratch,
+               "-",
+               (char *) NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    close(in[0]);
+    close(out[1]);
+    if (-1 == worker->pid) {
+        close(in[1]);
+        close(out[0]);
+        return ERR_FORK;
+    }
+
+    worker->in    = fdopen(in[1], "w");
+    worker->out   = fdopen(out[0], "r");
+    worker->alive = true;
+    if (0 != pthread_create(&worker->reader, NULL, gs_reader, worker)) {
+        // The process exits once it reaches the end of its input
+        worker->alive = false;
+        fclose(worker->in);
+        fclose(worker->out);
+        worker->in = NULL;
+        while (-1 == waitpid(worker->pid, NULL, 0) && EINTR == errno)
+            ;
+        return ERR_GENERIC;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ *      @details Each process is sent the definition of bk_run, followed by a reply, so that the
+ *              pool is only returned once every process has finished starting. SIGPIPE is
+ *              ignored, as a process may exit while a page is being sent to it.
+ */
+int bk_gs_pool_start(const BKGsOptions * options, BKGsPool ** pool_ptr) {
+    int resolution = options->resolution > 0 ? options->resolution : BK_GS_DEFAULT_RESOLUTION;
+    int workers    = options->workers > 0 ? options->workers : BK_GS_DEFAULT_WORKERS;
+    int status     = SUCCESS;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t     pool_size = sizeof(BKGsPool);
+    BKGsPool * pool      = calloc(1, pool_size);
+    VERIFY_NULL_BC(pool, pool_size);
+    size_t workers_size = sizeof(GsWorker) * workers;
+    pool->workers       = calloc(1, workers_size);
+    VERIFY_NULL_BC(pool->workers, workers_size);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->replied, NULL);
+    snprintf(pool->marker,
+             sizeof pool->marker,
+             "%%%%BarcodeEnd%08lx%06lx",
+             (unsigned long) bk_clock_ns() & 0xffffffffUL,
+             (unsigned long) getpid() & 0xffffffUL);
+
+    // The definition is followed by a reply, so that it is sent as one request
+    char    definition[sizeof GS_RUN_PROC + 4 * BK_GS_MARKER_LEN + sizeof " ready) = flush\n"];
+    GsBatch batch = { 0, SUCCESS };
+
+    int len = snprintf(
+        definition, sizeof definition, GS_RUN_PROC, pool->marker, pool->marker, pool->marker);
+    snprintf(definition + len, sizeof definition - len, "(%s ready) = flush\n", pool->marker);
+
+    // A worker which fails to start is never alive, so is passed over like one which has exited
+    for (int i = 0; i < workers; i++) {
+        int spawn_status = gs_spawn(pool, &pool->workers[i], options, resolution);
+        pool->num_workers++;
+        if (SUCCESS == spawn_status) {
+            gs_send(&pool->workers[i], &batch, NULL, NULL, 0, definition);
+        } else {
+            fprintf(stderr,
+                    "WARNING: could not start a %s worker: error %d\n",
+                    BK_GS_CMD,
+                    spawn_status);
+            status = spawn_status;
+        }
+    }
+    gs_wait(pool, &batch);
+
+    GsWorker * worker = gs_acquire(pool, NULL);
+    if (NULL == worker) {
+        fprintf(stderr, "ERROR: could not start %s\n", BK_GS_CMD);
+        bk_gs_pool_stop(pool);
+        return SUCCESS != status ? status : ERR_GHOSTSCRIPT;
+    }
+    gs_release(pool, worker);
+
+    *pool_ptr = pool;
+    return SUCCESS;
+}
+
+/**
+ *      @brief BKSink callback sending each page generated to a pool
+ *      @details Each page of its own file is sent to the least loaded worker. A document's worker
+ *              is reserved with its first page, and released by bk_gs_render().
+ */
+static int gs_render_write(void * ctx, const char * data, size_t len) {
+    GsRender *   render = ctx;
+    GsWorker *   worker = render->document;
+    const char * output = NULL;
+    char         page_output[BK_GS_LINE_LEN];
+    int          status;
+
+    render->page++;
+    if (render->per_page) {
+        // The page number replaces BK_GS_PAGE_FORMAT, rather than the name being used as a format
+        const char * format = strstr(render->output, BK_GS_PAGE_FORMAT);
+        snprintf(page_output,
+                 sizeof page_output,
+                 "%.*s%ld%s",
+                 (int) (format - render->output),
+                 render->output,
+                 render->page,
+                 format + strlen(BK_GS_PAGE_FORMAT));
+        output = page_output;
+        worker = gs_acquire(render->pool, NULL);
+    } else if (NULL == worker) {
+        output           = render->output;
+        worker           = gs_acquire(render->pool, NULL);
+        render->document = worker;
+    }
+    if (NULL == worker) {
+        return ERR_GHOSTSCRIPT;
+    }
+    render->used[worker - render->pool->workers] = true;
+
+    status = gs_send(worker, &render->batch, output, data, len, NULL);
+    if (render->per_page) {
+        gs_release(render->pool, worker);
+    }
+
+    return status;
+}
+
+/**
+ *      @details bk_generate_stream() writes each page in one call, so each call to the sink is sent
+ *              as a page.
+ */
+// clang-format off
+int bk_gs_render(
+    BKGsPool * pool,
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    const char * output,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    GsRender render = { 0 };
+
+    render.pool         = pool;
+    render.batch.status = SUCCESS;
+    render.output       = output;
+    render.per_page     = NULL != strstr(output, BK_GS_PAGE_FORMAT);
+
+    size_t used_size = sizeof(bool) * pool->num_workers;
+    render.used      = calloc(1, used_size);
+    VERIFY_NULL_BC(render.used, used_size);
+
+    BKSink sink   = { gs_render_write, &render };
+    int    status = bk_generate_stream(source, props, layout, &sink, stats);
+
+    // Switching to the scratch file, with nothing to run, completes the last output file. A
+    // worker since reserved by another job's document is switched once that document is finished,
+    // its first page having already completed this job's file
+    for (int i = 0; i < pool->num_workers; i++) {
+        GsWorker * worker = &pool->workers[i];
+        if (!render.used[i] || (worker != render.document && NULL == gs_acquire(pool, worker))) {
+            continue;
+        }
+        gs_send(worker, &render.batch, worker->scratch, "", 0, NULL);
+        gs_release(pool, worker);
+    }
+
+    int render_status = gs_wait(pool, &render.batch);
+    free(render.used);
+
+    return SUCCESS != status ? status : render_status;
+}
+
+void bk_gs_pool_stop(BKGsPool * pool) {
+    for (int i = 0; i < pool->num_workers; i++) {
+        GsWorker * worker = &pool->workers[i];
+
+        if (NULL != worker->in) {
+            // The process exits once it reaches the end of its input
+            fclose(worker->in);
+            pthread_join(worker->reader, NULL);
+            fclose(worker->out);
+            while (-1 == waitpid(worker->pid, NULL, 0) && EINTR == errno)
+                ;
+        }
+        if ('\0' != worker->scratch[0]) {
+            remove(worker->scratch);
+        }
+        pthread_mutex_destroy(&worker->write_lock);
+    }
+
+    pthread_cond_destroy(&pool->replied);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
+
+#else
+
+int bk_gs_pool_start(const BKGsOptions * options, BKGsPool ** pool) {
+    (void) options;
+    (void) pool;
+    fprintf(stderr, "ERROR: the Ghostscript worker pool is not supported on Windows\n");
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+// clang-format off
+int bk_gs_render(
+    BKGsPool * pool,
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    const char * output,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+    (void) pool;
+    (void) source;
+    (void) props;
+    (void) layout;
+    (void) output;
+    (void) stats;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+void bk_gs_pool_stop(BKGsPool * pool) {
+    (void) pool;
+}
+
+#endif
+
+/*      @brief The Ghostscript device for an output file's extension, or NULL */
+static const char * gs_device(const char * output) {
+    static const char * const devices[][2] = {
+        { ".pdf", BK_GS_PDF_DEVICE },
+        { ".png", "png16m" },
+        { ".tif", "tiffg4" },
+        { ".ps", "ps2write" },
+    };
+    const char * ext = strrchr(output, '.');
+
+    for (size_t i = 0; NULL != ext && i < sizeof devices / sizeof devices[0]; i++) {
+        if (0 == strcmp(ext, devices[i][0])) {
+            return devices[i][1];
+        }
+    }
+
+    return NULL;
+}
+
+/*      @brief Render a source through the pool, or write it as PDF directly without one */
+// clang-format off
+static int export_source(
+    BKGsPool * pool,
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    const char * output,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    if (NULL != pool) {
+        return bk_gs_render(pool, source, props, layout, output, stats);
+    }
+
+    FILE * file = fopen(output, "wb");
+    if (NULL == file) {
+        fprintf(stderr, "ERROR: could not open \"%s\" for writing\n", output);
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    BKSink sink   = { bk_file_write, file };
+    int    status = bk_generate_pdf(source, props, layout, &sink, stats);
+
+    if (0 != fclose(file) && SUCCESS == status) {
+        status = ERR_FILE_CLOSE_FAILED;
+    }
+
+    return status;
+}
+
+/**
+ *      @details PDF output is written directly with bk_generate_pdf() unless a device is given, so
+ *              Ghostscript is only started for other formats or an explicit @c pdfwrite.
+ */
+int bk_gs_export(const BKGsExportOptions * options, FILE * report) {
+    PSProperties    props = PS_DEFAULT_PROPS;
+    Layout          layout;
+    BKGenerateStats stats  = { 0 };
+    BKGsPool *      pool   = NULL;
+    uint64_t        start  = bk_clock_ns();
+    const char *    device = NULL != options->device ? options->device : gs_device(options->output);
+    bool            native;
+    char            dir[BK_GS_LINE_LEN];
+    int             status = SUCCESS;
+
+    layout.cols = BK_DEFAULT_COLS;
+    layout.rows = BK_DEFAULT_ROWS;
+
+    if (NULL == device) {
+        fprintf(stderr, "ERROR: no Ghostscript device for \"%s\"\n", options->output);
+        return ERR_ARGUMENT;
+    }
+    native = NULL == options->device && 0 == strcmp(device, BK_GS_PDF_DEVICE);
+
+    // Output is only permitted into the directory of the output file
+    const char * slash = strrchr(options->output, '/');
+    if (NULL == slash) {
+        strncpy(dir, ".", sizeof dir);
+    } else {
+        snprintf(dir, sizeof dir, "%.*s", (int) (slash - options->output), options->output);
+    }
+
+    if (!native) {
+        BKGsOptions pool_options = { device, dir, options->resolution, options->workers };
+        status                   = bk_gs_pool_start(&pool_options, &pool);
+    }
+
+    if (SUCCESS == status && BK_FORMAT_SQLITE == bk_import_format(options->path)) {
+        BKDBSource db_source;
+
+        status = bk_db_open(&db_source, options->path, options->query);
+        if (SUCCESS == status) {
+            BKSource source = bk_db_source(&db_source);
+            status = export_source(pool, &source, &props, &layout, options->output, &stats);
+            bk_db_close(&db_source);
+        }
+    } else if (SUCCESS == status) {
+        BKJob job;
+
+        bk_job_init(&job);
+        status = bk_import_file(options->path, NULL, &job, NULL);
+        if (SUCCESS == status) {
+            BKJobReader reader;
+            bk_job_read(&job, &reader);
+
+            BKSource source = { bk_job_next, &reader };
+            status = export_source(pool, &source, &props, &layout, options->output, &stats);
+
+            bk_job_reader_free(&reader);
+        }
+        bk_job_free(&job);
+    }
+
+    if (NULL != pool) {
+        bk_gs_pool_stop(pool);
+    }
+
+    if (NULL != report && SUCCESS == status) {
+        fprintf(report,
+                "Rendered %ld labels on %ld pages to %s with %s in %.1f ms\n",
+                stats.labels,
+                stats.pages,
+                options->output,
+                native ? "the PDF backend" : device,
+                (bk_clock_ns() - start) / 1e6);
+    } else if (NULL != report) {
+        fprintf(report, "Could not render %s: error %d\n", options->path, status);
+    }
+
+    return status;
+}
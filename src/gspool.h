@@ -0,0 +1,134 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file gspool.h
+ *      @brief Ghostscript worker pool declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Ghostscript takes hundreds of milliseconds to start, so rather than being run once per job
+ *      it is started once as a pool of long-lived @c gs processes, which are fed PostScript over
+ *      their standard input. The job daemon keeps one pool for as long as it runs (see daemon.h),
+ *      while bk_gs_export() starts one for a single job. Every process in a pool renders with the same output device - a
+ *      raster device such as @c png16m or @c pwgraster, or @c pdfwrite - into files in one
+ *      directory.
+ *
+ *      Each process first defines a procedure, @c bk_run, which takes an output file (or null to
+ *      continue the current one) and runs the PostScript that follows it up to a marker line,
+ *      unique to the pool, inside save and restore. Each page is sent as
+ *
+ *          (OUTPUT) bk_run
+ *          PAGE
+ *          MARKER
+ *
+ *      and is replied to with a line of the marker followed by @c done, or @c error if the page
+ *      could not be rendered. Replies come in the order pages were sent. A page's output file is
+ *      only complete once another output file has been set, so each process is finally switched
+ *      to a scratch file of its own.
+ */
+
+#ifndef GSPOOL_H
+#define GSPOOL_H
+
+#include "backend.h"
+#include "barcode.h"
+
+#include <stdio.h>
+
+/**
+ *      @defgroup GsPoolProperties Ghostscript worker pool properties
+ */
+/*@{*/
+// clang-format off
+#define BK_GS_CMD                   "gs"
+#define BK_GS_DEFAULT_WORKERS       4
+#define BK_GS_DEFAULT_RESOLUTION    300
+#define BK_GS_MARKER_LEN            32
+#define BK_GS_LINE_LEN              256
+// Substituted with the page number in an output file name, for one file per page
+#define BK_GS_PAGE_FORMAT           "%d"
+#define BK_GS_PDF_DEVICE            "pdfwrite"
+// clang-format on
+/*@}*/
+
+/*      @brief A pool of Ghostscript processes, see bk_gs_pool_start() */
+typedef struct BKGsPool BKGsPool;
+
+/**
+ *      @brief Options for starting a pool
+ *      @details @c workers of 0 selects BK_GS_DEFAULT_WORKERS, and @c resolution of 0
+ *               BK_GS_DEFAULT_RESOLUTION (in dots per inch). Output files may only be written to
+ *               @c output_dir.
+ */
+typedef struct BKGsOptions {
+    const char * device;
+    const char * output_dir;
+    int          resolution;
+    int          workers;
+} BKGsOptions;
+
+/**
+ *      @brief A job file to be rendered by Ghostscript without printing
+ *      @details @c device may be NULL to choose one from the extension of @c output (.pdf, .png,
+ *               .tif or .ps) - PDF then being written directly, without Ghostscript - and @c query
+ *               NULL to use BK_DB_DEFAULT_QUERY. Rows of an SQLite source are not marked printed.
+ */
+typedef struct BKGsExportOptions {
+    const char * path;
+    const char * output;
+    const char * device;
+    const char * query;
+    int          resolution;
+    int          workers;
+} BKGsExportOptions;
+
+/**
+ *      @brief Start a pool of Ghostscript processes, waiting until each is ready
+ *      @details Processes which fail to start are left out of the pool, which fails to start only
+ *               if none do.
+ *      @param options The device, output directory, resolution and number of processes
+ *      @param pool Destination for the pool, to be stopped with bk_gs_pool_stop()
+ *      @return SUCCESS, ERR_GHOSTSCRIPT, ERR_FORK, ERR_TEMPORARY_FILE_CREATION_FAILED,
+ *              ERR_GENERIC if a thread could not be started, ERR_UNSUPPORTED_PLATFORM
+ */
+int bk_gs_pool_start(const BKGsOptions *, BKGsPool **);
+
+/**
+ *      @brief Generate a job and render it with a pool
+ *      @details If @c output contains BK_GS_PAGE_FORMAT, each page is rendered to its own file,
+ *               numbered from 1, by whichever process has the fewest pages outstanding - so the
+ *               pages of a job are rendered in parallel. Otherwise every page is rendered into
+ *               @c output as one document, by one process, which is sent no other job's pages until
+ *               the document is finished. May be called from several threads at once.
+ *      @param pool A started pool
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties to be used when generating the PostScript
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param output The output file, within the pool's output directory
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return As bk_generate_stream(), or ERR_GHOSTSCRIPT if a page could not be rendered
+ */
+// clang-format off
+int bk_gs_render(
+    BKGsPool *, BKSource *, PSProperties *, Layout *, const char *, BKGenerateStats *);
+// clang-format on
+
+/**
+ *      @brief Stop a pool's processes, once they have finished the pages sent to them
+ *      @param pool The pool to stop, which is freed
+ */
+void bk_gs_pool_stop(BKGsPool *);
+
+/**
+ *      @brief Render a job file with the default properties and layout through a new pool
+ *      @param options The job file, output and pool options
+ *      @param report Stream to write a one-line summary to, or NULL
+ *      @return SUCCESS, or any error from import, generation or rendering
+ */
+int bk_gs_export(const BKGsExportOptions *, FILE *);
+
+#endif
@@ -0,0 +1,874 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file images.c
+ *      @brief Per-barcode image export implementations as defined in images.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "images.h"
+
+#include "alloc.h"
+#include "backend.h"
+#include "cache.h"
+#include "dbsource.h"
+#include "error.h"
+#include "import.h"
+#include "job.h"
+#include "metrics.h"
+#include "modules.h"
+#include "scanline.h"
+#include "trace.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifndef S_ISDIR
+#define S_ISDIR(mode) (((mode) &S_IFMT) == S_IFDIR)
+#endif
+
+/**
+ *      @defgroup ImageText Image file text and properties
+ */
+/*@{*/
+// clang-format off
+#define IMAGE_PNG_SIGNATURE     "\x89PNG\r\n\x1a\n"
+// Rows are filtered to mostly zeros, which runs of repeated bytes alone compress well
+#define IMAGE_PNG_LEVEL         Z_BEST_SPEED
+#define IMAGE_PNG_STRATEGY      Z_RLE
+#define IMAGE_PNG_FILTER_UP     2
+#define IMAGE_PNG_INK           0x00
+#define IMAGE_PNG_PAPER         0xFF
+#define IMAGE_METRES_PER_INCH   0.0254
+#define IMAGE_SVG_HEADER                                                                        \
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"                                              \
+    "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%s%s\" height=\"%s%s\""                  \
+    " viewBox=\"0 0 %ld %ld\">\n"                                                               \
+    "<rect width=\"%ld\" height=\"%ld\" fill=\"#fff\"/>\n"
+#define IMAGE_SVG_TEXT                                                                          \
+    "<text x=\"%ld\" y=\"%ld\" font-family=\"Courier, monospace\" font-size=\"%ld\""            \
+    " text-anchor=\"middle\">"
+#define IMAGE_NUMBER_LEN        32
+// Characters written unescaped in file names, besides letters and digits
+#define IMAGE_NAME_SAFE         "-_."
+// clang-format on
+/*@}*/
+
+#ifdef _WIN32
+#define IMAGE_LOCK(export)
+#define IMAGE_UNLOCK(export)
+#else
+#define IMAGE_LOCK(export) pthread_mutex_lock(&(export)->lock)
+#define IMAGE_UNLOCK(export) pthread_mutex_unlock(&(export)->lock)
+#endif
+
+/**
+ *      @brief The size of each image
+ *      @details PNG images are measured in pixels, and SVG images in thousandths of the units of
+ *               the PostScript properties so that their coordinates are whole numbers.
+ */
+typedef struct ImageGeometry {
+    int          padding, module, bar_height;
+    long         pixels_per_metre;
+    long         svg_padding, svg_module, svg_bar_height, svg_fontsize;
+    const char * svg_unit;
+} ImageGeometry;
+
+/*      @brief A growable buffer an image is drawn or read into */
+typedef struct ImageBuffer {
+    unsigned char * data;
+    size_t          len;
+    size_t          size;
+} ImageBuffer;
+
+/*      @brief An export in progress, shared by its workers */
+typedef struct ImageExport {
+    const BKImageOptions * options;
+    ImageGeometry          geometry;
+    unsigned               formats;
+    // Files written and left as they were, barcodes which failed, and the first failure
+    long                   written, unchanged, failed;
+    size_t                 bytes;
+    int                    status;
+#ifndef _WIN32
+    pthread_mutex_t        lock;
+    pthread_cond_t         not_empty, not_full;
+    // Barcodes waiting to be exported, owned by the queue
+    char *                 queue[BK_IMAGE_QUEUE_LEN];
+    int                    head, count;
+    bool                   closed;
+    // Worker threads started, or 0 if images are exported on the calling thread
+    int                    threads;
+#endif
+} ImageExport;
+
+/*      @brief The working storage of one worker, reused from image to image */
+typedef struct ImageWorker {
+    ImageExport * export;
+    z_stream      zstream;
+    bool          zstream_ready;
+    ImageBuffer   scanline, raw, image, existing;
+#ifndef _WIN32
+    pthread_t     thread;
+#endif
+} ImageWorker;
+
+static void buffer_reserve(ImageBuffer * buffer, size_t len) {
+    if (buffer->len + len > buffer->size) {
+        size_t size = buffer->size > 0 ? buffer->size : 4096;
+        while (size < buffer->len + len) {
+            size *= 2;
+        }
+        buffer->data = bk_realloc(buffer->data, size);
+        VERIFY_NULL_BC(buffer->data, size);
+        buffer->size = size;
+    }
+}
+
+static void buffer_append(ImageBuffer * buffer, const void * data, size_t len) {
+    if (len > 0) {
+        buffer_reserve(buffer, len);
+        memcpy(buffer->data + buffer->len, data, len);
+        buffer->len += len;
+    }
+}
+
+static void buffer_printf(ImageBuffer * buffer, const char * format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    if (len > 0) {
+        buffer_reserve(buffer, len + 1);
+        va_start(args, format);
+        vsnprintf((char *) buffer->data + buffer->len, len + 1, format, args);
+        va_end(args);
+        buffer->len += len;
+    }
+}
+
+static void buffer_free(ImageBuffer * buffer) {
+    bk_free(buffer->data);
+    memset(buffer, 0, sizeof *buffer);
+}
+
+static void buffer_be32(ImageBuffer * buffer, uint32_t value) {
+    unsigned char bytes[4];
+
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (value >> (24 - 8 * i)) & 0xFF;
+    }
+    buffer_append(buffer, bytes, 4);
+}
+
+/*      @brief Format thousandths of a unit as a number, without the locale's decimal separator */
+static void format_thousandths(char * dest, long thousandths) {
+    int len = snprintf(dest, IMAGE_NUMBER_LEN, "%ld.%03ld", thousandths / 1000, thousandths % 1000);
+
+    // Trailing zeros, then a bare point
+    while ('0' == dest[len - 1]) {
+        dest[--len] = '\0';
+    }
+    if ('.' == dest[len - 1]) {
+        dest[--len] = '\0';
+    }
+}
+
+/*      @brief Write a PNG chunk, its CRC covering its type and data */
+// clang-format off
+static void png_chunk(
+    ImageBuffer * image,
+    const char * type,
+    const unsigned char * data,
+    size_t len
+) {
+    // clang-format on
+    buffer_be32(image, len);
+    buffer_append(image, type, 4);
+    buffer_append(image, data, len);
+
+    // crc32() of NULL restarts the CRC, rather than leaving it as it is
+    uLong crc = crc32(0, (const Bytef *) type, 4);
+    if (len > 0) {
+        crc = crc32(crc, data, len);
+    }
+    buffer_be32(image, crc);
+}
+
+/**
+ *      @brief Draw a barcode's scanline and its quiet zone, packed to one bit per pixel
+ *      @return The number of bytes in the scanline
+ */
+static size_t png_scanline(ImageWorker * worker, const BKModules * modules, size_t width) {
+    const ImageGeometry * geometry = &worker->export->geometry;
+    size_t                padding  = geometry->padding;
+
+    worker->scanline.len = 0;
+    buffer_reserve(&worker->scanline, BK_SCANLINE_SIZE(width));
+    unsigned char * line = worker->scanline.data;
+
+    memset(line, IMAGE_PNG_PAPER, padding);
+    int pixels = bk_scanline_8bpp(
+        modules, geometry->module, IMAGE_PNG_INK, IMAGE_PNG_PAPER, line + padding);
+    // The quiet zone after the bars, and the padding packed into the last byte
+    memset(line + padding + pixels, IMAGE_PNG_PAPER, padding + BK_SCANLINE_PADDING);
+
+    return bk_scanline_pack(line, width);
+}
+
+/**
+ *      @brief Draw a barcode as a 1-bit greyscale PNG
+ *      @details Every row but the first is filtered as its difference from the row above, so only
+ *               the rows where the bars start and end are other than zeros - each a scanline with
+ *               the differences as its values - and the image compresses to little more than a
+ *               row however tall it is.
+ */
+static int draw_png(ImageWorker * worker, const BKModules * modules) {
+    const ImageGeometry * geometry = &worker->export->geometry;
+    size_t                padding  = geometry->padding;
+    size_t                width    = (size_t) modules->num_modules * geometry->module + 2 * padding;
+    size_t                height   = geometry->bar_height + 2 * padding;
+    size_t                bytes    = png_scanline(worker, modules, width);
+    const unsigned char * line     = worker->scanline.data;
+    // Each row starts with its filter type
+    size_t                row_len  = bytes + 1;
+    size_t                total    = row_len * height;
+
+    worker->raw.len = 0;
+    buffer_reserve(&worker->raw, total);
+    unsigned char * raw = worker->raw.data;
+
+    memset(raw, 0, total);
+    for (size_t y = 1; y < height; y++) {
+        raw[y * row_len] = IMAGE_PNG_FILTER_UP;
+    }
+
+    if (0 == padding) {
+        memcpy(raw + 1, line, bytes);
+    } else if (geometry->bar_height > 0) {
+        unsigned char * top    = raw + padding * row_len + 1;
+        unsigned char * bottom = top + geometry->bar_height * row_len;
+
+        // Packed, paper is all bits set
+        memset(raw + 1, IMAGE_PNG_PAPER, bytes);
+        for (size_t i = 0; i < bytes; i++) {
+            top[i]    = (unsigned char) (line[i] - IMAGE_PNG_PAPER);
+            bottom[i] = (unsigned char) (IMAGE_PNG_PAPER - line[i]);
+        }
+    } else {
+        memset(raw + 1, IMAGE_PNG_PAPER, bytes);
+    }
+
+    if (!worker->zstream_ready) {
+        memset(&worker->zstream, 0, sizeof worker->zstream);
+        int status = deflateInit2(
+            &worker->zstream, IMAGE_PNG_LEVEL, Z_DEFLATED, 15, 8, IMAGE_PNG_STRATEGY);
+        if (Z_OK != status) {
+            return ERR_GENERIC;
+        }
+        worker->zstream_ready = true;
+    } else {
+        deflateReset(&worker->zstream);
+    }
+
+    unsigned char header[13];
+    uint32_t      ppm = geometry->pixels_per_metre;
+    unsigned char phys[9] = { ppm >> 24, (ppm >> 16) & 0xFF, (ppm >> 8) & 0xFF, ppm & 0xFF,
+                              ppm >> 24, (ppm >> 16) & 0xFF, (ppm >> 8) & 0xFF, ppm & 0xFF,
+                              1 };
+    // Width and height, then 1-bit greyscale, deflate, standard filters and no interlacing
+    for (int i = 0; i < 4; i++) {
+        header[i]     = (width >> (24 - 8 * i)) & 0xFF;
+        header[4 + i] = (height >> (24 - 8 * i)) & 0xFF;
+    }
+    memcpy(header + 8, "\x01\x00\x00\x00\x00", 5);
+
+    ImageBuffer * image = &worker->image;
+    image->len          = 0;
+    buffer_append(image, IMAGE_PNG_SIGNATURE, sizeof IMAGE_PNG_SIGNATURE - 1);
+    png_chunk(image, "IHDR", header, sizeof header);
+    png_chunk(image, "pHYs", phys, sizeof phys);
+
+    // The data is compressed straight into its chunk, whose length is filled in after
+    size_t bound = deflateBound(&worker->zstream, total);
+    buffer_reserve(image, 8 + bound + 4);
+    size_t start = image->len;
+    image->len += 8;
+    memcpy(image->data + start + 4, "IDAT", 4);
+
+    worker->zstream.next_in   = raw;
+    worker->zstream.avail_in  = total;
+    worker->zstream.next_out  = image->data + image->len;
+    worker->zstream.avail_out = bound;
+    if (Z_STREAM_END != deflate(&worker->zstream, Z_FINISH)) {
+        return ERR_GENERIC;
+    }
+
+    size_t len = bound - worker->zstream.avail_out;
+    for (int i = 0; i < 4; i++) {
+        image->data[start + i] = (len >> (24 - 8 * i)) & 0xFF;
+    }
+    image->len += len;
+    buffer_be32(image, crc32(0, image->data + start + 4, len + 4));
+    png_chunk(image, "IEND", NULL, 0);
+
+    return SUCCESS;
+}
+
+/*      @brief Draw a barcode as SVG, its bars as a single path */
+static int draw_svg(ImageWorker * worker, const char * barcode, const BKModules * modules) {
+    const ImageGeometry * geometry = &worker->export->geometry;
+    long width  = modules->num_modules * geometry->svg_module + 2 * geometry->svg_padding;
+    long height = geometry->svg_bar_height + geometry->svg_fontsize + 2 * geometry->svg_padding;
+    long x      = geometry->svg_padding;
+    char width_text[IMAGE_NUMBER_LEN], height_text[IMAGE_NUMBER_LEN];
+
+    format_thousandths(width_text, width);
+    format_thousandths(height_text, height);
+
+    ImageBuffer * image = &worker->image;
+    image->len          = 0;
+    buffer_printf(image,
+                  IMAGE_SVG_HEADER,
+                  width_text,
+                  geometry->svg_unit,
+                  height_text,
+                  geometry->svg_unit,
+                  width,
+                  height,
+                  width,
+                  height);
+
+    buffer_printf(image, "<path d=\"");
+    for (int e = 0; e < modules->num_elements; e++) {
+        long element = modules->widths[e] * geometry->svg_module;
+        // Elements alternate between bars and spaces
+        if (0 == e % 2) {
+            buffer_printf(image,
+                          "M%ld %ldh%ldv%ldh-%ldz",
+                          x,
+                          geometry->svg_padding,
+                          element,
+                          geometry->svg_bar_height,
+                          element);
+        }
+        x += element;
+    }
+    buffer_printf(image, "\"/>\n");
+
+    if (geometry->svg_fontsize > 0) {
+        buffer_printf(image,
+                      IMAGE_SVG_TEXT,
+                      width / 2,
+                      height - geometry->svg_padding,
+                      geometry->svg_fontsize);
+        for (const char * c = barcode; '\0' != *c; c++) {
+            switch (*c) {
+            case '&':
+                buffer_printf(image, "&amp;");
+                break;
+            case '<':
+                buffer_printf(image, "&lt;");
+                break;
+            case '>':
+                buffer_printf(image, "&gt;");
+                break;
+            default:
+                buffer_append(image, c, 1);
+            }
+        }
+        buffer_printf(image, "</text>\n");
+    }
+    buffer_printf(image, "</svg>\n");
+
+    return SUCCESS;
+}
+
+/*      @brief Write a barcode's file name, escaping characters unsafe in file names */
+static void image_name(const char * barcode, char * dest) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    for (const char * c = barcode; '\0' != *c; c++) {
+        unsigned char ch = *c;
+        // A leading '.' would hide the file, or name a directory
+        bool safe = isalnum(ch) || NULL != strchr(IMAGE_NAME_SAFE, ch);
+        if (safe && !('.' == ch && c == barcode)) {
+            *dest++ = ch;
+        } else {
+            *dest++ = '%';
+            *dest++ = hex[ch >> 4];
+            *dest++ = hex[ch & 0xF];
+        }
+    }
+    *dest = '\0';
+}
+
+/*      @brief Whether a file holds exactly an image, read into @c existing to compare */
+static bool image_unchanged(const char * path, const ImageBuffer * image, ImageBuffer * existing) {
+    struct stat st;
+
+    if (0 != stat(path, &st) || (size_t) st.st_size != image->len) {
+        return false;
+    }
+
+    FILE * file = fopen(path, "rb");
+    if (NULL == file) {
+        return false;
+    }
+    existing->len = 0;
+    buffer_reserve(existing, image->len);
+    size_t read = fread(existing->data, 1, image->len, file);
+    fclose(file);
+
+    return read == image->len && 0 == memcmp(existing->data, image->data, image->len);
+}
+
+/**
+ *      @brief Write an image atomically, unless its file already holds it
+ *      @details The image is written to a temporary file beside its own, which is renamed over
+ *               it once closed.
+ */
+// clang-format off
+static int image_store(
+    ImageWorker * worker,
+    const char * name,
+    const char * extension,
+    bool * unchanged
+) {
+    // clang-format on
+    const ImageBuffer * image = &worker->image;
+    char                path[BK_IMAGE_PATH_LEN];
+    char                tmp_path[BK_IMAGE_PATH_LEN + sizeof BK_IMAGE_TMP_SUFFIX];
+    int                 status = SUCCESS;
+
+    snprintf(path, sizeof path, "%s/%s.%s", worker->export->options->dir, name, extension);
+    snprintf(tmp_path, sizeof tmp_path, "%s" BK_IMAGE_TMP_SUFFIX, path);
+
+    *unchanged = image_unchanged(path, image, &worker->existing);
+    if (*unchanged) {
+        return SUCCESS;
+    }
+
+    FILE * file = fopen(tmp_path, "wb");
+    if (NULL == file) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+    if (image->len != fwrite(image->data, 1, image->len, file)) {
+        status = ERR_FILE_WRITE_FAILED;
+    }
+    if (0 != fclose(file) && SUCCESS == status) {
+        status = ERR_FILE_WRITE_FAILED;
+    }
+#ifdef _WIN32
+    // rename() does not replace an existing file on Windows
+    if (SUCCESS == status) {
+        remove(path);
+    }
+#endif
+    if (SUCCESS == status && 0 != rename(tmp_path, path)) {
+        status = ERR_FILE_WRITE_FAILED;
+    }
+    if (SUCCESS != status) {
+        remove(tmp_path);
+    }
+
+    return status;
+}
+
+/*      @brief Draw and write every format of one barcode's images */
+static void image_export(ImageWorker * worker, const char * barcode) {
+    ImageExport * export = worker->export;
+    BKModules     modules;
+    char          name[3 * BK_BARCODE_LENGTH + 1];
+    long          written = 0, unchanged = 0;
+    size_t        bytes   = 0;
+    int           status  = SUCCESS;
+
+    if (strlen(barcode) > BK_BARCODE_LENGTH) {
+        status = ERR_DATA_LENGTH;
+    } else {
+        status = bk_modules_encode(barcode, strlen(barcode), &modules);
+        image_name(barcode, name);
+    }
+
+    for (unsigned format = BK_IMAGE_PNG; format <= BK_IMAGE_SVG; format <<= 1) {
+        bool same;
+
+        if (SUCCESS != status) {
+            break;
+        }
+
+        if (0 == (export->formats & format)) {
+            continue;
+        } else if (BK_IMAGE_PNG == format) {
+            status = draw_png(worker, &modules);
+        } else {
+            status = draw_svg(worker, barcode, &modules);
+        }
+
+        if (SUCCESS == status) {
+            status = image_store(worker, name, BK_IMAGE_PNG == format ? "png" : "svg", &same);
+        }
+        if (SUCCESS == status && same) {
+            unchanged++;
+        } else if (SUCCESS == status) {
+            written++;
+            bytes += worker->image.len;
+        }
+    }
+
+    if (SUCCESS != status) {
+        fprintf(stderr, "ERROR: could not export \"%s\": error %d\n", barcode, status);
+    }
+
+    IMAGE_LOCK(export);
+    export->written += written;
+    export->unchanged += unchanged;
+    export->bytes += bytes;
+    if (SUCCESS != status) {
+        export->failed++;
+        if (SUCCESS == export->status) {
+            export->status = status;
+        }
+    }
+    IMAGE_UNLOCK(export);
+}
+
+static void image_worker_free(ImageWorker * worker) {
+    if (worker->zstream_ready) {
+        deflateEnd(&worker->zstream);
+    }
+    buffer_free(&worker->scanline);
+    buffer_free(&worker->raw);
+    buffer_free(&worker->image);
+    buffer_free(&worker->existing);
+}
+
+#ifndef _WIN32
+/*      @brief Take the next barcode from the queue, or NULL once it is closed and empty */
+static char * image_take(ImageExport * export) {
+    char * barcode = NULL;
+
+    pthread_mutex_lock(&export->lock);
+    while (0 == export->count && !export->closed) {
+        pthread_cond_wait(&export->not_empty, &export->lock);
+    }
+    if (export->count > 0) {
+        barcode      = export->queue[export->head];
+        export->head = (export->head + 1) % BK_IMAGE_QUEUE_LEN;
+        export->count--;
+        pthread_cond_signal(&export->not_full);
+    }
+    pthread_mutex_unlock(&export->lock);
+
+    return barcode;
+}
+
+static void * image_worker(void * arg) {
+    ImageWorker * worker = arg;
+    char *        barcode;
+
+    bk_trace_thread_name("image worker");
+
+    while (NULL != (barcode = image_take(worker->export))) {
+        image_export(worker, barcode);
+        free(barcode);
+    }
+
+    return NULL;
+}
+#endif
+
+/**
+ *      @brief Hand a distinct barcode to the workers, waiting while the queue is full
+ *      @details Without threads, the image is exported by the first worker straight away.
+ */
+static void image_submit(ImageExport * export, ImageWorker * workers, const char * barcode) {
+#ifdef _WIN32
+    image_export(&workers[0], barcode);
+#else
+    if (0 == export->threads) {
+        image_export(&workers[0], barcode);
+        return;
+    }
+
+    size_t len  = strlen(barcode) + 1;
+    char * copy = malloc(len);
+    VERIFY_NULL_BC(copy, len);
+    memcpy(copy, barcode, len);
+
+    pthread_mutex_lock(&export->lock);
+    while (BK_IMAGE_QUEUE_LEN == export->count) {
+        pthread_cond_wait(&export->not_full, &export->lock);
+    }
+    export->queue[(export->head + export->count) % BK_IMAGE_QUEUE_LEN] = copy;
+    export->count++;
+    pthread_cond_signal(&export->not_empty);
+    pthread_mutex_unlock(&export->lock);
+#endif
+}
+
+/*      @brief Read a source, handing each barcode to the workers the first time it is seen */
+// clang-format off
+static int image_read(
+    ImageExport * export,
+    ImageWorker * workers,
+    BKSource * source,
+    long * labels,
+    long * distinct
+) {
+    // clang-format on
+    BKSymbolTable seen;
+    int           status;
+
+    bk_symbols_init(&seen);
+
+    for (;;) {
+        const char * barcode;
+        int          quantity;
+        long         id;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        } else if (quantity <= 0) {
+            continue;
+        }
+
+        *labels += quantity;
+        if (!bk_symbols_lookup(&seen, barcode, &id)) {
+            bk_symbols_insert(&seen, barcode, *distinct);
+            (*distinct)++;
+            image_submit(export, workers, barcode);
+        }
+    }
+
+    bk_symbols_free(&seen);
+
+    return status;
+}
+
+static void image_geometry(const BKImageOptions * options, ImageGeometry * geometry) {
+    PSProperties props      = PS_DEFAULT_PROPS;
+    int          resolution = options->resolution > 0 ? options->resolution
+                                                      : BK_IMAGE_DEFAULT_RESOLUTION;
+    double       points;
+
+    // Points per unit of the properties
+    if (0 == strcmp(props.units, "mm")) {
+        points             = 72 / 25.4;
+        geometry->svg_unit = "mm";
+    } else if (0 == strcmp(props.units, "cm")) {
+        points             = 72 / 2.54;
+        geometry->svg_unit = "cm";
+    } else if (0 == strcmp(props.units, "in")) {
+        points             = 72;
+        geometry->svg_unit = "in";
+    } else {
+        points             = 1;
+        geometry->svg_unit = "pt";
+    }
+    double pixels = points * resolution / 72;
+
+    geometry->padding          = lround(props.padding * pixels);
+    geometry->module           = lround(props.bar_width * pixels);
+    geometry->bar_height       = lround(props.bar_height * pixels);
+    geometry->pixels_per_metre = lround(resolution / IMAGE_METRES_PER_INCH);
+    if (geometry->module < 1) {
+        geometry->module = 1;
+    }
+
+    geometry->svg_padding    = lround(props.padding * 1000);
+    geometry->svg_module     = lround(props.bar_width * 1000);
+    geometry->svg_bar_height = lround(props.bar_height * 1000);
+    geometry->svg_fontsize   = lround(props.fontsize * 1000);
+}
+
+int bk_image_formats(const char * names, unsigned * formats) {
+    *formats = 0;
+
+    while ('\0' != *names) {
+        size_t len = strcspn(names, ",");
+
+        if (3 == len && 0 == strncmp(names, "png", 3)) {
+            *formats |= BK_IMAGE_PNG;
+        } else if (3 == len && 0 == strncmp(names, "svg", 3)) {
+            *formats |= BK_IMAGE_SVG;
+        } else {
+            return ERR_INVALID_STRING;
+        }
+
+        names += len;
+        if (',' == *names) {
+            names++;
+        }
+    }
+
+    return 0 != *formats ? SUCCESS : ERR_INVALID_STRING;
+}
+
+/**
+ *      @details Images are exported while the source is still being read, the reader waiting for
+ *              the workers once BK_IMAGE_QUEUE_LEN barcodes are queued.
+ */
+int bk_images_generate(BKSource * source, const BKImageOptions * options, BKImageStats * stats) {
+    ImageExport   export;
+    ImageWorker * workers;
+    BKImageStats  local;
+    int           status;
+#ifdef _WIN32
+    // Images are exported on the calling thread
+    int num_workers = 1;
+#else
+    int num_workers = options->workers > 0 ? options->workers : BK_IMAGE_DEFAULT_WORKERS;
+#endif
+
+    if (NULL == stats) {
+        stats = &local;
+    }
+    memset(stats, 0, sizeof *stats);
+    memset(&export, 0, sizeof export);
+    export.options = options;
+    export.formats = 0 != options->formats ? options->formats : BK_IMAGE_PNG;
+    image_geometry(options, &export.geometry);
+
+    struct stat st;
+    if (0 != stat(options->dir, &st) || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "ERROR: \"%s\" is not a directory\n", options->dir);
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    uint64_t job_start = bk_trace_begin();
+
+    size_t workers_size = sizeof *workers * num_workers;
+    workers             = calloc(1, workers_size);
+    VERIFY_NULL_BC(workers, workers_size);
+    for (int i = 0; i < num_workers; i++) {
+        workers[i].export = &export;
+    }
+
+#ifndef _WIN32
+    pthread_mutex_init(&export.lock, NULL);
+    pthread_cond_init(&export.not_empty, NULL);
+    pthread_cond_init(&export.not_full, NULL);
+    for (int i = 0; i < num_workers; i++) {
+        if (0 != pthread_create(&workers[i].thread, NULL, image_worker, &workers[i])) {
+            break;
+        }
+        export.threads++;
+    }
+    // Without any worker thread, the images are exported on this one
+    if (export.threads < num_workers) {
+        fprintf(stderr, "WARNING: started %d of %d image workers\n", export.threads, num_workers);
+        num_workers = export.threads > 0 ? export.threads : 1;
+    }
+#endif
+
+    status = image_read(&export, workers, source, &stats->labels, &stats->barcodes);
+
+#ifndef _WIN32
+    // Workers finish the barcodes queued before stopping
+    pthread_mutex_lock(&export.lock);
+    export.closed = true;
+    pthread_cond_broadcast(&export.not_empty);
+    pthread_mutex_unlock(&export.lock);
+    for (int i = 0; i < export.threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&export.not_full);
+    pthread_cond_destroy(&export.not_empty);
+    pthread_mutex_destroy(&export.lock);
+#endif
+
+    for (int i = 0; i < num_workers; i++) {
+        image_worker_free(&workers[i]);
+    }
+    free(workers);
+
+    if (SUCCESS == status) {
+        status = export.status;
+    }
+    stats->workers   = num_workers;
+    stats->written   = export.written;
+    stats->unchanged = export.unchanged;
+    stats->failed    = export.failed;
+    stats->bytes     = export.bytes;
+
+    bk_metrics_observe(BK_METRIC_JOB_SECONDS, bk_trace_end(BK_TRACE_IMAGES, job_start));
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_JOBS : BK_METRIC_JOB_FAILURES, 1);
+    bk_metrics_add(BK_METRIC_LABELS, stats->barcodes);
+    bk_metrics_add(BK_METRIC_BYTES, stats->bytes);
+
+    return status;
+}
+
+int bk_images_export(const BKImageOptions * options, FILE * report) {
+    BKImageStats stats;
+    uint64_t     start = bk_clock_ns();
+    int          status;
+
+    memset(&stats, 0, sizeof stats);
+
+    if (BK_FORMAT_SQLITE == bk_import_format(options->path)) {
+        BKDBSource db_source;
+
+        status = bk_db_open(&db_source, options->path, options->query);
+        if (SUCCESS == status) {
+            BKSource source = bk_db_source(&db_source);
+            status          = bk_images_generate(&source, options, &stats);
+            bk_db_close(&db_source);
+        }
+    } else {
+        BKJob job;
+
+        bk_job_init(&job);
+        status = bk_import_file(options->path, NULL, &job, NULL);
+        if (SUCCESS == status) {
+            BKJobReader reader;
+            bk_job_read(&job, &reader);
+
+            BKSource source = { bk_job_next, &reader };
+            status          = bk_images_generate(&source, options, &stats);
+
+            bk_job_reader_free(&reader);
+        }
+        bk_job_free(&job);
+    }
+
+    if (NULL != report) {
+        fprintf(report,
+                "Exported %ld barcodes (%ld labels) to %s with %d workers in %.1f ms:"
+                " %ld images written, %ld unchanged, %ld barcodes failed\n",
+                stats.barcodes,
+                stats.labels,
+                options->dir,
+                stats.workers,
+                (bk_clock_ns() - start) / 1e6,
+                stats.written,
+                stats.unchanged,
+                stats.failed);
+    }
+
+    return status;
+}
@@ -0,0 +1,119 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file images.h
+ *      @brief Per-barcode image export declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Rather than sheets of labels, each distinct barcode of a job is exported as image files of
+ *      its own, named after it (e.g. SKU123.png), for upload to other systems. PNG images hold
+ *      the bars alone, a bit per pixel at the given resolution drawn with the kernels of
+ *      scanline.h; as every row of the bars is the same, each row is stored as its difference
+ *      from the one above, leaving only a few rows to draw and compress. SVG images hold the bars
+ *      and the barcode's text, in the units of the PostScript properties.
+ *
+ *      The job is read and its barcodes made distinct on the calling thread, and the images are
+ *      drawn and written by a pool of worker threads. Each file is written under a temporary
+ *      name and renamed over its final name once complete, so that a file is never seen half
+ *      written, and is not written at all if it already holds exactly the image drawn.
+ *
+ *      Characters of a barcode other than letters, digits, '-', '_' and '.' (except a leading
+ *      '.') are written as '%' followed by their two hex digits in its file name.
+ */
+
+#ifndef IMAGES_H
+#define IMAGES_H
+
+#include "backend.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ *      @defgroup ImageProperties Image export properties
+ */
+/*@{*/
+// clang-format off
+#define BK_IMAGE_DEFAULT_RESOLUTION 300
+#define BK_IMAGE_DEFAULT_WORKERS    4
+// Barcodes read ahead of the workers
+#define BK_IMAGE_QUEUE_LEN          1024
+#define BK_IMAGE_PATH_LEN           4096
+#define BK_IMAGE_TMP_SUFFIX         ".tmp"
+// clang-format on
+/*@}*/
+
+/**
+ *      @defgroup ImageFormats Image formats, combined with |
+ */
+/*@{*/
+// clang-format off
+#define BK_IMAGE_PNG                (1 << 0)
+#define BK_IMAGE_SVG                (1 << 1)
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief A job file to be exported as one image per distinct barcode
+ *      @details @c formats of 0 selects BK_IMAGE_PNG, @c resolution of 0
+ *               BK_IMAGE_DEFAULT_RESOLUTION (in dots per inch) and @c workers of 0
+ *               BK_IMAGE_DEFAULT_WORKERS. @c query may be NULL to use BK_DB_DEFAULT_QUERY. Rows of
+ *               an SQLite source are not marked printed.
+ */
+typedef struct BKImageOptions {
+    const char * path;
+    const char * query;
+    const char * dir;
+    unsigned     formats;
+    int          resolution;
+    int          workers;
+} BKImageOptions;
+
+/*      @brief Summary of an image export */
+typedef struct BKImageStats {
+    long   barcodes;
+    long   labels;
+    long   written;
+    long   unchanged;
+    long   failed;
+    size_t bytes;
+    int    workers;
+} BKImageStats;
+
+/**
+ *      @brief Parse a comma-separated list of image formats, e.g. "png,svg"
+ *      @param names The list to parse
+ *      @param formats Destination for the formats
+ *      @return SUCCESS, ERR_INVALID_STRING
+ */
+int bk_image_formats(const char *, unsigned *);
+
+/**
+ *      @brief Export a source with the default properties as one image per distinct barcode
+ *      @details Barcodes which cannot be encoded, or whose images cannot be written, do not stop
+ *               the others being exported. @c path and @c query of the options are not used.
+ *               If no worker thread can be started, images are exported on the calling thread.
+ *      @param source The barcodes and quantities to export
+ *      @param options The output directory and formats
+ *      @param stats Destination for a summary of the export, or NULL
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED if the directory does not exist, or the first error
+ *              from @c source, encoding or writing
+ */
+int bk_images_generate(BKSource *, const BKImageOptions *, BKImageStats *);
+
+/**
+ *      @brief Export a job file with the default properties as one image per distinct barcode
+ *      @details Barcodes which cannot be encoded, or whose images cannot be written, do not stop
+ *               the others being exported.
+ *      @param options The job file, output directory and formats
+ *      @param report Stream to write a one-line summary to, or NULL
+ *      @return SUCCESS, or the first error from import, encoding or writing
+ */
+int bk_images_export(const BKImageOptions *, FILE *);
+
+#endif
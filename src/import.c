@@ -0,0 +1,542 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file import.c
+ *      @brief Job file import implementations as defined in import.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "import.h"
+
+#include "backend.h"
+#include "error.h"
+#include "sheet.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#define strncasecmp _strnicmp
+#else
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BK_SCAN_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+static int ctz32(unsigned int x) {
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return (int) idx;
+}
+#else
+#define ctz32 __builtin_ctz
+#endif
+#endif
+
+int bk_file_map(const char * path, BKMappedFile * mapped) {
+    memset(mapped, 0, sizeof *mapped);
+
+#ifdef _WIN32
+    LARGE_INTEGER size;
+
+    mapped->file = CreateFileA(
+        path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (INVALID_HANDLE_VALUE == mapped->file) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    if (!GetFileSizeEx(mapped->file, &size)) {
+        CloseHandle(mapped->file);
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    // Empty files cannot be mapped, but are valid (empty) job files
+    mapped->len = (size_t) size.QuadPart;
+    if (0 == mapped->len) {
+        mapped->data = "";
+        return SUCCESS;
+    }
+
+    mapped->mapping = CreateFileMappingA(mapped->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL == mapped->mapping) {
+        CloseHandle(mapped->file);
+        return ERR_MMAP;
+    }
+
+    mapped->data = MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (NULL == mapped->data) {
+        CloseHandle(mapped->mapping);
+        CloseHandle(mapped->file);
+        return ERR_MMAP;
+    }
+#else
+    struct stat st;
+
+    mapped->fd = open(path, O_RDONLY);
+    if (-1 == mapped->fd) {
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    if (-1 == fstat(mapped->fd, &st)) {
+        close(mapped->fd);
+        return ERR_FILE_OPEN_FAILED;
+    }
+
+    // Empty files cannot be mapped, but are valid (empty) job files
+    mapped->len = (size_t) st.st_size;
+    if (0 == mapped->len) {
+        mapped->data = "";
+        return SUCCESS;
+    }
+
+    void * data = mmap(NULL, mapped->len, PROT_READ, MAP_PRIVATE, mapped->fd, 0);
+    if (MAP_FAILED == data) {
+        close(mapped->fd);
+        return ERR_MMAP;
+    }
+    // The file is read front to back exactly once. Advice values are not flags, so each is given
+    // in a call of its own
+    madvise(data, mapped->len, MADV_SEQUENTIAL);
+    madvise(data, mapped->len, MADV_WILLNEED);
+    mapped->data = data;
+#endif
+
+    return SUCCESS;
+}
+
+void bk_file_unmap(BKMappedFile * mapped) {
+#ifdef _WIN32
+    if (mapped->len > 0) {
+        UnmapViewOfFile(mapped->data);
+        CloseHandle(mapped->mapping);
+    }
+    CloseHandle(mapped->file);
+#else
+    if (mapped->len > 0) {
+        munmap((void *) mapped->data, mapped->len);
+    }
+    close(mapped->fd);
+#endif
+    memset(mapped, 0, sizeof *mapped);
+}
+
+void bk_file_release(BKMappedFile * mapped, size_t len) {
+#ifdef _WIN32
+    (void) mapped;
+    (void) len;
+#else
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    // The mapping is private and never written, so its pages can be dropped without being saved
+    len &= ~(page - 1);
+    if (len > 0 && len <= mapped->len) {
+        madvise((void *) mapped->data, len, MADV_DONTNEED);
+    }
+#endif
+}
+
+BKImportFormat bk_import_format(const char * path) {
+    const char * ext = strrchr(path, '.');
+
+    if (NULL == ext) {
+        return BK_FORMAT_UNKNOWN;
+    } else if (0 == strcasecmp(ext, ".csv") || 0 == strcasecmp(ext, ".txt")) {
+        return BK_FORMAT_CSV;
+    } else if (0 == strcasecmp(ext, ".tsv") || 0 == strcasecmp(ext, ".tab")) {
+        return BK_FORMAT_TSV;
+    } else if (0 == strcasecmp(ext, ".xlsx")) {
+        return BK_FORMAT_XLSX;
+    } else if (0 == strcasecmp(ext, ".ods")) {
+        return BK_FORMAT_ODS;
+    } else if (0 == strcasecmp(ext, ".sqlite") || 0 == strcasecmp(ext, ".sqlite3")
+               || 0 == strcasecmp(ext, ".db")) {
+        return BK_FORMAT_SQLITE;
+    }
+
+    return BK_FORMAT_UNKNOWN;
+}
+
+/**
+ *      @details Dispatches on the file extension, and times the import so that callers can report
+ *              it.
+ */
+// clang-format off
+int bk_import_file(
+    const char * path,
+    const BKImportOptions * options,
+    BKJob * job,
+    BKImportStats * stats
+) {
+    // clang-format on
+
+    switch (bk_import_format(path)) {
+        case BK_FORMAT_CSV:
+        case BK_FORMAT_TSV:
+            return bk_import_csv(path, options, job, stats);
+        case BK_FORMAT_XLSX:
+            return bk_import_xlsx(path, options, job, stats);
+        case BK_FORMAT_ODS:
+            return bk_import_ods(path, options, job, stats);
+        default:
+            return ERR_UNSUPPORTED_FORMAT;
+    }
+}
+
+/**
+ *      @details Returns a pointer to the first byte in [p, end) which is significant to the
+ *              delimited text grammar - a delimiter, quote, or line ending - or @c end if there is
+ *              none. Sixteen bytes are compared at a time where SSE2 is available; almost every
+ *              byte in a job file is barcode text, so this is where import time is spent.
+ */
+static const char * scan_special(const char * p, const char * end, char delim) {
+#ifdef BK_SCAN_SSE2
+    const __m128i v_delim = _mm_set1_epi8(delim);
+    const __m128i v_lf    = _mm_set1_epi8('\n');
+    const __m128i v_cr    = _mm_set1_epi8('\r');
+    const __m128i v_quote = _mm_set1_epi8(BK_IMPORT_QUOTE);
+
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) p);
+        __m128i hits  = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, v_delim), _mm_cmpeq_epi8(chunk, v_lf)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, v_cr), _mm_cmpeq_epi8(chunk, v_quote)));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            return p + ctz32(mask);
+        }
+        p += 16;
+    }
+#endif
+
+    while (p < end && *p != delim && *p != '\n' && *p != '\r' && *p != BK_IMPORT_QUOTE) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ *      @brief A single field of a record - a view into the imported text
+ */
+typedef struct Field {
+    const char * start;
+    size_t       len;
+    bool         escaped; // Contains doubled quotes which must be collapsed
+} Field;
+
+/**
+ *      @details Parses one field starting at @c *pp and leaves @c *pp at the byte following it (a
+ *              delimiter, line ending, or @c end).
+ */
+static void parse_field(const char ** pp, const char * end, char delim, Field * field) {
+    const char * p = *pp;
+
+    field->escaped = false;
+
+    if (p < end && BK_IMPORT_QUOTE == *p) {
+        // Quoted field: runs until a quote which is not immediately followed by another quote
+        const char * start = ++p;
+        while (p < end) {
+            const char * q = memchr(p, BK_IMPORT_QUOTE, end - p);
+            if (NULL == q) {
+                p = end;
+                break;
+            } else if (q + 1 < end && BK_IMPORT_QUOTE == q[1]) {
+                field->escaped = true;
+                p              = q + 2;
+            } else {
+                p = q;
+                break;
+            }
+        }
+        field->start = start;
+        field->len   = p - start;
+
+        // Skip the closing quote and anything between it and the end of the field
+        while (p < end && *p != delim && *p != '\n' && *p != '\r') {
+            p++;
+        }
+    } else {
+        // Unquoted field: a quote part way through is taken literally
+        const char * start = p;
+        p                  = scan_special(p, end, delim);
+        while (p < end && BK_IMPORT_QUOTE == *p) {
+            p = scan_special(p + 1, end, delim);
+        }
+        field->start = start;
+        field->len   = p - start;
+    }
+
+    *pp = p;
+}
+
+/**
+ *      @details Parses a quantity field of the form @c /\s*[0-9]+\s*\/. An empty field is a
+ *              quantity of 1.
+ */
+static bool parse_quantity(const Field * field, int * dest) {
+    const char * p   = field->start;
+    const char * end = field->start + field->len;
+    long         qty = 0;
+
+    while (p < end && isspace((unsigned char) *p)) {
+        p++;
+    }
+    while (end > p && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+
+    if (p == end) {
+        *dest = 1;
+        return true;
+    }
+
+    for (; p < end; p++) {
+        if (!isdigit((unsigned char) *p)) {
+            return false;
+        }
+        qty = qty * 10 + (*p - '0');
+        if (qty > INT_MAX) {
+            return false;
+        }
+    }
+
+    *dest = (int) qty;
+    return true;
+}
+
+static bool match_column_name(const Field * field, const char * names[]) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strlen(names[i]) == field->len && 0 == strncasecmp(field->start, names[i], field->len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *      @details Adds a code field to the job, collapsing doubled quotes if necessary. Surrounding
+ *              whitespace is not significant in barcode text and is removed.
+ */
+static int add_code(BKJob * job, const Field * field, int quantity) {
+    const char * p   = field->start;
+    const char * end = field->start + field->len;
+
+    while (p < end && isspace((unsigned char) *p)) {
+        p++;
+    }
+    while (end > p && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+
+    if (p == end) {
+        // Blank rows are skipped
+        return SUCCESS;
+    }
+
+    if (end - p >= BK_BARCODE_LENGTH) {
+        return ERR_DATA_LENGTH;
+    }
+
+    if (field->escaped) {
+        char   unescaped[BK_BARCODE_LENGTH];
+        size_t len = 0;
+        for (; p < end; p++) {
+            unescaped[len++] = *p;
+            if (BK_IMPORT_QUOTE == *p && p + 1 < end && BK_IMPORT_QUOTE == p[1]) {
+                p++;
+            }
+        }
+        bk_job_add(job, unescaped, len, quantity);
+    } else {
+        bk_job_add(job, p, end - p, quantity);
+    }
+
+    return SUCCESS;
+}
+
+/**
+ *      @details Records are parsed in place from @c data; the only copies made are into the job's
+ *              string pool, which is reserved up front to hold the entire input so that it never
+ *              grows during the import. When @c data is the whole of @c mapped and the job has a
+ *              memory budget, input which has been imported is released as the import goes.
+ */
+// clang-format off
+static int import_delimited(
+    const char * data,
+    size_t len,
+    const BKImportOptions * options,
+    BKJob * job,
+    BKMappedFile * mapped
+) {
+    // clang-format on
+
+    const char * code_names[]     = BK_IMPORT_CODE_NAMES;
+    const char * quantity_names[] = BK_IMPORT_QUANTITY_NAMES;
+
+    const char * p        = data;
+    const char * end      = data + len;
+    char         delim    = options->delimiter;
+    int          code_c   = options->code_column;
+    int          qty_c    = options->quantity_column;
+    int          header   = options->header;
+    long         record   = 0;
+    size_t       released = 0;
+
+    /* Every string stored is shorter than the input it was parsed from, plus its terminator. A
+       job with a budget grows (and spills) as it goes instead. */
+    if (0 == job->budget) {
+        bk_job_reserve(job, job->capacity, job->pool_len + len + 1);
+    }
+
+    while (p < end) {
+        Field code = { NULL, 0, false }, quantity = { NULL, 0, false };
+        int   column = 0;
+
+        // Nothing before the start of a record is referred to again
+        if (NULL != mapped && job->budget > 0
+            && (size_t)(p - data) - released >= BK_IMPORT_RELEASE_BYTES) {
+            released = p - data;
+            bk_file_release(mapped, released);
+        }
+
+        record++;
+
+        // Split one record into fields, keeping only the mapped columns
+        for (;;) {
+            Field field;
+            parse_field(&p, end, delim, &field);
+
+            if (column == code_c) {
+                code = field;
+            } else if (column == qty_c) {
+                quantity = field;
+            }
+
+            if (1 == record && header != BK_IMPORT_HEADER_NO) {
+                // Remap columns by name if this turns out to be a header row
+                if (match_column_name(&field, code_names)) {
+                    code_c = column;
+                    header = BK_IMPORT_HEADER_YES;
+                } else if (match_column_name(&field, quantity_names)) {
+                    qty_c  = column;
+                    header = BK_IMPORT_HEADER_YES;
+                }
+            }
+            column++;
+
+            if (p < end && *p == delim) {
+                p++;
+                continue;
+            }
+            if (p < end && '\r' == *p) {
+                p++;
+            }
+            if (p < end && '\n' == *p) {
+                p++;
+            }
+            break;
+        }
+
+        if (1 == record && header != BK_IMPORT_HEADER_NO) {
+            int qty;
+            if (BK_IMPORT_HEADER_YES == header
+                || (quantity.start != NULL && !parse_quantity(&quantity, &qty))) {
+                // Header row: nothing to import
+                continue;
+            }
+        }
+
+        if (NULL == code.start) {
+            continue;
+        }
+
+        int qty = 1;
+        if (quantity.start != NULL && !parse_quantity(&quantity, &qty)) {
+            fprintf(stderr, "ERROR: invalid quantity on record %ld\n", record);
+            return ERR_IMPORT_ROW;
+        }
+
+        if (SUCCESS != add_code(job, &code, qty)) {
+            fprintf(stderr,
+                    "ERROR: barcode on record %ld exceeds %d characters\n",
+                    record,
+                    BK_BARCODE_LENGTH - 1);
+            return ERR_IMPORT_ROW;
+        }
+    }
+
+    return SUCCESS;
+}
+
+// clang-format off
+int bk_import_delimited(
+    const char * data,
+    size_t len,
+    const BKImportOptions * options,
+    BKJob * job
+) {
+    // clang-format on
+
+    return import_delimited(data, len, options, job, NULL);
+}
+
+// clang-format off
+int bk_import_csv(
+    const char * path,
+    const BKImportOptions * options,
+    BKJob * job,
+    BKImportStats * stats
+) {
+    // clang-format on
+
+    BKImportOptions defaults = BK_IMPORT_DEFAULT_OPTIONS;
+    BKMappedFile    mapped;
+    uint64_t        start  = bk_clock_ns();
+    long            rows   = bk_job_rows(job);
+    long            labels = bk_job_labels(job);
+    int             status;
+
+    if (NULL == options) {
+        options = &defaults;
+    }
+
+    BKImportOptions opts = *options;
+    if (0 == opts.delimiter) {
+        opts.delimiter =
+            BK_FORMAT_TSV == bk_import_format(path) ? BK_IMPORT_TSV_DELIM : BK_IMPORT_CSV_DELIM;
+    }
+
+    if (SUCCESS != (status = bk_file_map(path, &mapped))) {
+        return status;
+    }
+
+    status = import_delimited(mapped.data, mapped.len, &opts, job, &mapped);
+
+    if (NULL != stats) {
+        stats->rows       = bk_job_rows(job) - rows;
+        stats->labels     = bk_job_labels(job) - labels;
+        stats->bytes      = mapped.len;
+        stats->elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    }
+
+    bk_file_unmap(&mapped);
+
+    return status;
+}
@@ -0,0 +1,159 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file import.h
+ *      @brief Job file import declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "job.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+/**
+ *      @defgroup ImportProperties Job file import properties
+ */
+/*@{*/
+// clang-format off
+#define BK_IMPORT_HEADER_AUTO   -1
+#define BK_IMPORT_HEADER_NO     0
+#define BK_IMPORT_HEADER_YES    1
+#define BK_IMPORT_NO_COLUMN     -1
+#define BK_IMPORT_CSV_DELIM     ','
+#define BK_IMPORT_TSV_DELIM     '\t'
+#define BK_IMPORT_QUOTE         '"'
+// Header names recognised (case-insensitively) when a header row is present
+#define BK_IMPORT_CODE_NAMES        { "barcode", "code", "sku", NULL }
+#define BK_IMPORT_QUANTITY_NAMES    { "quantity", "qty", "count", NULL }
+
+#define BK_IMPORT_DEFAULT_OPTIONS { 0, 0, 1, BK_IMPORT_HEADER_AUTO }
+// Input read between releases of a mapping, when importing into a job with a memory budget
+#define BK_IMPORT_RELEASE_BYTES (4 * 1024 * 1024)
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Job file formats recognised by bk_import_file()
+ */
+typedef enum BKImportFormat {
+    BK_FORMAT_UNKNOWN = 0,
+    BK_FORMAT_CSV,
+    BK_FORMAT_TSV,
+    BK_FORMAT_XLSX,
+    BK_FORMAT_ODS,
+    BK_FORMAT_SQLITE,
+} BKImportFormat;
+
+/**
+ *      @brief Column mapping used when importing delimited text
+ *      @details @c delimiter of 0 selects the delimiter from the file extension. Columns are
+ *              zero-indexed; @c quantity_column may be BK_IMPORT_NO_COLUMN, in which case every
+ *              barcode is printed once. When a header row is present, recognised column names
+ *              override the configured indices.
+ */
+typedef struct BKImportOptions {
+    char delimiter;
+    int  code_column;
+    int  quantity_column;
+    int  header;
+} BKImportOptions;
+
+/**
+ *      @brief Summary of a completed import
+ */
+typedef struct BKImportStats {
+    long   rows;
+    long   labels;
+    size_t bytes;
+    double elapsed_ms;
+} BKImportStats;
+
+/**
+ *      @brief A read-only memory mapping of a whole file
+ */
+typedef struct BKMappedFile {
+    const char * data;
+    size_t       len;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} BKMappedFile;
+
+/**
+ *      @brief Map a file read-only into memory
+ *      @param path Path of the file to map
+ *      @param mapped Destination mapping
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_MMAP
+ */
+int bk_file_map(const char *, BKMappedFile *);
+
+/**
+ *      @brief Release a mapping created by bk_file_map()
+ */
+void bk_file_unmap(BKMappedFile *);
+
+/**
+ *      @brief Drop the start of a mapping from memory, to be read from the file again if needed
+ *      @details Has no effect on Windows, where the system trims the working set of a sequential
+ *               mapping itself.
+ *      @param mapped The mapping
+ *      @param len Number of bytes from the start of the mapping which are no longer needed
+ */
+void bk_file_release(BKMappedFile *, size_t);
+
+/**
+ *      @brief Determine the format of a job file from its extension
+ *      @param path Path of the job file
+ *      @return The detected format, or BK_FORMAT_UNKNOWN
+ */
+BKImportFormat bk_import_format(const char *);
+
+/**
+ *      @brief Import a job file of any supported format, appending its rows to a job
+ *      @param path Path of the job file
+ *      @param options Column mapping, or NULL for BK_IMPORT_DEFAULT_OPTIONS
+ *      @param job Destination job
+ *      @param stats Destination for an import summary, or NULL
+ *      @return SUCCESS, ERR_UNSUPPORTED_FORMAT, or any error from the format-specific importer.
+ *              SQLite databases are not imported, but read as a source (see dbsource.h).
+ *      @see bk_import_csv(), bk_import_xlsx(), bk_import_ods()
+ */
+int bk_import_file(const char *, const BKImportOptions *, BKJob *, BKImportStats *);
+
+/**
+ *      @brief Import a CSV or TSV file via a memory mapping
+ *      @param path Path of the file
+ *      @param options Column mapping, or NULL for BK_IMPORT_DEFAULT_OPTIONS
+ *      @param job Destination job
+ *      @param stats Destination for an import summary, or NULL
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_MMAP, ERR_IMPORT_ROW
+ */
+int bk_import_csv(const char *, const BKImportOptions *, BKJob *, BKImportStats *);
+
+/**
+ *      @brief Import delimited text already held in memory
+ *      @param data The text to import - need not be null-terminated
+ *      @param len Length of @c data
+ *      @param options Column mapping - @c delimiter must be set
+ *      @param job Destination job
+ *      @return SUCCESS, ERR_IMPORT_ROW
+ */
+int bk_import_delimited(const char *, size_t, const BKImportOptions *, BKJob *);
+
+#endif
@@ -0,0 +1,257 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file job.c
+ *      @brief Job model function implementations as defined in job.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "job.h"
+
+#include "alloc.h"
+#include "backend.h"
+#include "error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void bk_job_init(BKJob * job) {
+    memset(job, 0, sizeof *job);
+}
+
+/**
+ *      @details Row arrays and the string pool are grown independently. Growth is geometric so the
+ *              amortised cost of bk_job_add() is constant.
+ */
+void bk_job_reserve(BKJob * job, int rows, size_t bytes) {
+    if (rows > job->capacity) {
+        size_t offsets_size    = sizeof *job->offsets * rows;
+        size_t quantities_size = sizeof *job->quantities * rows;
+
+        job->offsets = bk_realloc(job->offsets, offsets_size);
+        VERIFY_NULL_BC(job->offsets, offsets_size);
+        job->quantities = bk_realloc(job->quantities, quantities_size);
+        VERIFY_NULL_BC(job->quantities, quantities_size);
+
+        // The index is rebuilt on demand, so it only needs to be discarded here
+        bk_free(job->barcodes);
+        job->barcodes = NULL;
+
+        job->capacity = rows;
+    }
+
+    if (bytes > job->pool_cap) {
+        job->pool = bk_realloc(job->pool, bytes);
+        VERIFY_NULL_BC(job->pool, bytes);
+        job->pool_cap = bytes;
+    }
+}
+
+/*      @brief Header of a row in a spill file, followed by @c len bytes of barcode text */
+typedef struct JobSpillRow {
+    int          quantity;
+    unsigned int len;
+} JobSpillRow;
+
+/*      @brief Storage held by a job of the given capacity */
+static size_t job_size(int rows, size_t bytes, bool indexed) {
+    size_t row_size = sizeof(size_t) + sizeof(int) + (indexed ? sizeof(char *) : 0);
+    return row_size * rows + bytes;
+}
+
+/**
+ *      @details Rows are appended to the spill file, created on first use, and removed from memory.
+ *              Should the file not be created, the job continues in memory over its budget; should
+ *              a write fail, the error is kept and returned when the job is read.
+ */
+static void job_spill(BKJob * job) {
+    if (NULL == job->spill) {
+        job->spill = tmpfile();
+        if (NULL == job->spill) {
+            fprintf(stderr, "ERROR: could not create a spill file - continuing over budget\n");
+            job->budget = 0;
+            return;
+        }
+    } else if (0 != fseek(job->spill, 0, SEEK_END)) {
+        job->spill_status = ERR_FILE_WRITE_FAILED;
+        return;
+    }
+
+    for (int i = 0; i < job->num_barcodes; i++) {
+        const char * barcode = bk_job_barcode(job, i);
+        JobSpillRow  row     = { job->quantities[i], (unsigned int) strlen(barcode) };
+
+        if (1 != fwrite(&row, sizeof row, 1, job->spill)
+            || row.len != fwrite(barcode, 1, row.len, job->spill)) {
+            job->spill_status = ERR_FILE_WRITE_FAILED;
+            break;
+        }
+        job->spilled_labels += row.quantity;
+    }
+    job->spilled_rows += job->num_barcodes;
+
+    job->num_barcodes = 0;
+    job->pool_len     = 0;
+}
+
+void bk_job_set_budget(BKJob * job, size_t bytes) {
+    job->budget = bytes;
+}
+
+size_t bk_job_size(const BKJob * job) {
+    return job_size(job->capacity, job->pool_cap, NULL != job->barcodes);
+}
+
+/**
+ *      @details With a budget, storage which is full is only grown if the grown job would fit in
+ *              the budget - otherwise the rows held are spilled and the storage reused.
+ */
+void bk_job_add(BKJob * job, const char * barcode, size_t len, int quantity) {
+    if (job->num_barcodes == job->capacity || job->pool_len + len + 1 > job->pool_cap) {
+        int    rows  = job->capacity;
+        size_t bytes = job->pool_cap;
+
+        if (job->num_barcodes == rows) {
+            rows = rows ? rows * BK_JOB_GROWTH_FACTOR : BK_JOB_INITIAL_ROWS;
+        }
+        if (job->pool_len + len + 1 > bytes) {
+            bytes = bytes ? bytes * BK_JOB_GROWTH_FACTOR : BK_JOB_INITIAL_POOL;
+            if (bytes < job->pool_len + len + 1) {
+                bytes = job->pool_len + len + 1;
+            }
+        }
+
+        if (job->budget > 0 && job->num_barcodes > 0 && job_size(rows, bytes, false) > job->budget) {
+            job_spill(job);
+            rows  = job->capacity > 0 ? job->capacity : rows;
+            bytes = job->pool_cap >= len + 1 ? job->pool_cap : bytes;
+        }
+
+        bk_job_reserve(job, rows, bytes);
+    }
+
+    memcpy(job->pool + job->pool_len, barcode, len);
+    job->pool[job->pool_len + len] = '\0';
+
+    job->offsets[job->num_barcodes]    = job->pool_len;
+    job->quantities[job->num_barcodes] = quantity;
+    job->num_barcodes++;
+
+    job->pool_len += len + 1;
+}
+
+void bk_job_index(BKJob * job) {
+    if (NULL == job->barcodes && job->capacity > 0) {
+        size_t barcodes_size = sizeof *job->barcodes * job->capacity;
+        job->barcodes        = bk_calloc(barcodes_size);
+        VERIFY_NULL_BC(job->barcodes, barcodes_size);
+    }
+
+    for (int i = 0; i < job->num_barcodes; i++) {
+        job->barcodes[i] = job->pool + job->offsets[i];
+    }
+}
+
+const char * bk_job_barcode(const BKJob * job, int idx) {
+    return job->pool + job->offsets[idx];
+}
+
+long bk_job_rows(const BKJob * job) {
+    return job->spilled_rows + job->num_barcodes;
+}
+
+long bk_job_labels(const BKJob * job) {
+    long labels = job->spilled_labels;
+    for (int i = 0; i < job->num_barcodes; i++) {
+        labels += job->quantities[i];
+    }
+    return labels;
+}
+
+void bk_job_read(BKJob * job, BKJobReader * reader) {
+    memset(reader, 0, sizeof *reader);
+    reader->job          = job;
+    reader->spilled_left = job->spilled_rows;
+
+    if (NULL != job->spill && 0 != fseek(job->spill, 0, SEEK_SET)) {
+        job->spill_status = ERR_FREAD;
+    }
+}
+
+int bk_job_next(void * ctx, const char ** barcode, int * quantity) {
+    BKJobReader * reader = ctx;
+    BKJob *       job    = reader->job;
+
+    if (SUCCESS != job->spill_status) {
+        return job->spill_status;
+    }
+
+    if (reader->spilled_left > 0) {
+        JobSpillRow row;
+        if (1 != fread(&row, sizeof row, 1, job->spill)) {
+            return ERR_FREAD;
+        }
+
+        if (row.len + 1 > reader->buf_cap) {
+            reader->buf_cap = row.len + 1;
+            reader->buf     = bk_realloc(reader->buf, reader->buf_cap);
+            VERIFY_NULL_BC(reader->buf, reader->buf_cap);
+        }
+        if (row.len != fread(reader->buf, 1, row.len, job->spill)) {
+            return ERR_FREAD;
+        }
+        reader->buf[row.len] = '\0';
+        reader->spilled_left--;
+
+        *barcode  = reader->buf;
+        *quantity = row.quantity;
+        return SUCCESS;
+    }
+
+    if (reader->next >= job->num_barcodes) {
+        return BK_SOURCE_END;
+    }
+
+    *barcode  = bk_job_barcode(job, reader->next);
+    *quantity = job->quantities[reader->next];
+    reader->next++;
+
+    return SUCCESS;
+}
+
+void bk_job_reader_free(BKJobReader * reader) {
+    bk_free(reader->buf);
+    memset(reader, 0, sizeof *reader);
+}
+
+/*      @brief Discard a job's spill file, and the rows in it */
+static void job_unspill(BKJob * job) {
+    if (NULL != job->spill) {
+        fclose(job->spill);
+    }
+    job->spill          = NULL;
+    job->spilled_rows   = 0;
+    job->spilled_labels = 0;
+    job->spill_status   = SUCCESS;
+}
+
+void bk_job_clear(BKJob * job) {
+    job->num_barcodes = 0;
+    job->pool_len     = 0;
+    job_unspill(job);
+}
+
+void bk_job_free(BKJob * job) {
+    job_unspill(job);
+    bk_free(job->pool);
+    bk_free(job->offsets);
+    bk_free(job->quantities);
+    bk_free(job->barcodes);
+    bk_job_init(job);
+}
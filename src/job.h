@@ -0,0 +1,157 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file job.h
+ *      @brief Job model declarations - a list of barcodes and quantities to be generated
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef JOB_H
+#define JOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ *      @defgroup JobProperties Job model growth parameters
+ */
+/*@{*/
+// clang-format off
+#define BK_JOB_INITIAL_ROWS     64
+#define BK_JOB_INITIAL_POOL     1024
+#define BK_JOB_GROWTH_FACTOR    2
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief A list of barcodes and the number of times each is to be printed
+ *      @details Barcode strings are stored null-terminated, back to back, in a single string pool.
+ *              Rows refer to the pool by offset so that the pool may grow (and move) while rows are
+ *              being added. All storage grows geometrically, so adding a row never allocates on its
+ *              own - a job of a million rows is built with a handful of allocations.
+ *              @c barcodes is only valid after bk_job_index() and until the next bk_job_add().
+ *
+ *              A job given a memory budget with bk_job_set_budget() keeps at most that much in
+ *              memory: rather than growing past it, rows added so far are moved to a temporary
+ *              spill file. Only a BKJobReader reads spilled rows - @c barcodes, @c quantities and
+ *              @c num_barcodes cover the rows still in memory.
+ */
+typedef struct BKJob {
+    char *   pool;
+    size_t   pool_len;
+    size_t   pool_cap;
+    size_t * offsets;
+    int *    quantities;
+    char **  barcodes;
+    int      num_barcodes;
+    int      capacity;
+    size_t   budget;
+    FILE *   spill;
+    long     spilled_rows;
+    long     spilled_labels;
+    int      spill_status;
+} BKJob;
+
+/**
+ *      @brief Reading position in a job, spilled rows first
+ *      @see bk_job_next()
+ */
+typedef struct BKJobReader {
+    BKJob * job;
+    long    spilled_left;
+    int     next;
+    char *  buf;
+    size_t  buf_cap;
+} BKJobReader;
+
+/**
+ *      @brief Initialise an empty job
+ *      @param job The job to initialise
+ */
+void bk_job_init(BKJob *);
+
+/**
+ *      @brief Reserve storage so that a number of rows and string bytes can be added without growth
+ *      @param job The job to reserve storage in
+ *      @param rows The total number of rows the job should be able to hold
+ *      @param bytes The total number of string pool bytes (including null terminators) required
+ */
+void bk_job_reserve(BKJob *, int, size_t);
+
+/**
+ *      @brief Limit the memory a job may hold, spilling rows to a temporary file beyond it
+ *      @param job The job to limit, before any rows are added
+ *      @param bytes The most storage the job may hold, or 0 for no limit
+ */
+void bk_job_set_budget(BKJob *, size_t);
+
+/**
+ *      @brief Storage currently held by a job, in bytes
+ */
+size_t bk_job_size(const BKJob *);
+
+/**
+ *      @brief Append a barcode to a job
+ *      @param job The job to append to
+ *      @param barcode The barcode text - need not be null-terminated
+ *      @param len The length of @c barcode
+ *      @param quantity The number of times the barcode is to be printed
+ */
+void bk_job_add(BKJob *, const char *, size_t, int);
+
+/**
+ *      @brief Fill @c job->barcodes with pointers into the string pool, for use with bk_generate()
+ *      @param job The job to index
+ */
+void bk_job_index(BKJob *);
+
+/**
+ *      @brief Get the text of a single barcode in a job
+ *      @param job The job
+ *      @param idx Row index
+ *      @return A pointer into the job's string pool
+ */
+const char * bk_job_barcode(const BKJob *, int);
+
+/**
+ *      @brief Total number of rows in a job, including those spilled
+ */
+long bk_job_rows(const BKJob *);
+
+/**
+ *      @brief Total number of labels in a job (the sum of all quantities), including those spilled
+ */
+long bk_job_labels(const BKJob *);
+
+/**
+ *      @brief Start reading a job from its first row
+ *      @param job The job to read, which must not be added to while it is read
+ *      @param reader Destination reader, to be released with bk_job_reader_free()
+ */
+void bk_job_read(BKJob *, BKJobReader *);
+
+/**
+ *      @brief BKSource callback reading a BKJobReader
+ *      @return SUCCESS, BK_SOURCE_END, or an error spilling or reading back the job's rows
+ */
+int bk_job_next(void *, const char **, int *);
+
+void bk_job_reader_free(BKJobReader *);
+
+/**
+ *      @brief Remove every row from a job, keeping its storage (and budget) for reuse
+ */
+void bk_job_clear(BKJob *);
+
+/**
+ *      @brief Release the storage held by a job
+ */
+void bk_job_free(BKJob *);
+
+#endif
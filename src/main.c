@@ -12,7 +12,16 @@
  */
 
 #include "backend.h"
+#include "batch.h"
+#include "daemon.h"
+#include "dbsource.h"
 #include "error.h"
+#include "gspool.h"
+#include "images.h"
+#include "metrics.h"
+#include "ring.h"
+#include "spool.h"
+#include "trace.h"
 #include "ui.h"
 #include "util.h"
 
@@ -36,8 +45,10 @@ const char CMD_LINE_OPTS[NUM_CMD_LINE_OPTS][CMD_LINE_OPTS_LENGTH] = { "--help",
 const void (* CMD_LINE_OPTS_F[NUM_CMD_LINE_OPTS])(void) = { help_msg, license_msg, startup_msg};
 
 int main(int argc, char ** argv) {
+    CmdLineOptions options;
+
     // Process command line options
-    if (!(argc > 1 && strcmp(argv[1], "--quiet") == 0)) {
+    if (!(argc > 1 && strcmp(argv[1], CMD_LINE_QUIET) == 0)) {
         startup_msg();
         if (argc > 1) {
             for (int i = 0; i < NUM_CMD_LINE_OPTS; i++) {
@@ -46,11 +57,22 @@ int main(int argc, char ** argv) {
                     exit(EXIT_SUCCESS);
                 }
             }
-            fprintf(stderr, "Error: invalid command line option\n");
-            exit(EXIT_FAILURE);
         }
     }
-    
+
+    if (SUCCESS != cmd_line_parse(argc, argv, &options)) {
+        exit(EXIT_FAILURE);
+    }
+
+    // Before any other thread is started, see trace.h
+    if (SUCCESS != bk_trace_init()) {
+        fprintf(stderr, "Warning: could not start tracing\n");
+    }
+
+    if (NULL != options.metrics_path && SUCCESS != bk_metrics_init(options.metrics_path, 0)) {
+        fprintf(stderr, "Warning: could not start writing metrics\n");
+    }
+
     atexit(cleanup);
 
     int status = bk_init();
@@ -63,8 +85,52 @@ int main(int argc, char ** argv) {
         exit(EXIT_FAILURE);
     }
 
-    // Ignore all other command line options by setting passing argc as 1
-    return g_application_run(G_APPLICATION(barcode_app_new()), 1, argv);
+    /* Hand a print job to an instance which is already running, which prints it with resources it
+       has already loaded. Otherwise the job is printed here, without starting the user interface.
+       The backend is initialised first: should the running instance exit before the job reaches
+       it, this process becomes the primary instance and prints the job itself.
+     */
+    if (NULL != options.batch.path && ui_primary_running()) {
+        uint64_t start  = bk_clock_ns();
+        status          = g_application_run(G_APPLICATION(barcode_app_new()), argc, argv);
+        if (!options.quiet) {
+            printf("Handled by the running instance in %.1f ms\n", (bk_clock_ns() - start) / 1e6);
+        }
+        return status;
+    }
+
+    // Print the job without starting the user interface
+    if (NULL != options.batch.path) {
+        exit(SUCCESS == bk_batch_print(&options.batch, stdout) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Export an image of each barcode rather than sheets of labels
+    if (NULL != options.images.dir) {
+        exit(SUCCESS == bk_images_export(&options.images, stdout) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Render the job with Ghostscript rather than printing it
+    if (NULL != options.export.path) {
+        exit(SUCCESS == bk_gs_export(&options.export, stdout) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Serve jobs over a socket until interrupted
+    if (NULL != options.server.socket_path) {
+        exit(SUCCESS == bk_daemon_run(&options.server) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Print jobs written to a shared memory ring until interrupted
+    if (NULL != options.ring.name) {
+        exit(SUCCESS == bk_ring_serve(&options.ring) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // Print job files dropped into a spool directory until interrupted
+    if (NULL != options.spool.dir) {
+        exit(SUCCESS == bk_spool_run(&options.spool) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    // The command line is handled by barcode_app_command_line(), here or in a running instance
+    return g_application_run(G_APPLICATION(barcode_app_new()), argc, argv);
 }
 
 void cleanup(void) {
@@ -160,12 +226,66 @@ void license_msg(void) {
 
 void help_msg(void) {
     printf(
-        "Usage: barcode.exe [ --help | --license | --startup ]\
+        "Usage: barcode.exe [ --help | --license | --startup |\
+       \n                      [ --quiet ] [ --query SQL ] [ --mark SQL ] [ FILE... ] |\
+       \n                      [ --quiet ] --print-job FILE --printer PRINTER\
+       \n                                  [ --query SQL ] [ --mark SQL ]\
+       \n                                  [ --language LANG ] [ --resolution DPI ]\
+       \n                                  [ --raster DPI ] [ --archive PDF ]\
+       \n                                  [ --images DIR [ --format FORMATS ] ] |\
+       \n                      [ --quiet ] --export FILE --output OUTPUT [ --device DEVICE ]\
+       \n                                  [ --resolution DPI ] [ --jobs N ] |\
+       \n                      [ --quiet ] --export FILE --images DIR [ --format FORMATS ]\
+       \n                                  [ --resolution DPI ] [ --jobs N ] |\
+       \n                      [ --quiet ] --watch DIR --printer PRINTER [ --jobs N ] |\
+       \n                      [ --quiet ] --daemon SOCKET [ --jobs N ]\
+       \n                                  [ --device DEVICE --output DIR\
+       \n                                    [ --resolution DPI ] ] |\
+       \n                      [ --quiet ] --ring NAME [ --printer PRINTER ] ]\
+       \n    FILE        Job file(s) to import: .csv, .tsv, .xlsx or .ods, or an SQLite\
+       \n                database (.sqlite, .db) to print labels from\
        \n    --help      Display this help dialogue and exit\
        \n    --license   Display third-party copyright and license notices and exit\
        \n    --startup   Display the startup message and exit\
        \n    --quiet     Do not display the startup message and run the program as\
        \n                normal\
+       \n    --print-job Print a job file to PRINTER without starting the user interface,\
+       \n                or through the instance already running if there is one\
+       \n    --printer   The printer used by --print-job and --watch\
+       \n    --export    Render a job file to OUTPUT with a pool of Ghostscript processes\
+       \n                (Unix only), one file per page if OUTPUT contains %%d\
+       \n    --device    Ghostscript device used by --export, by default chosen from the\
+       \n                extension of OUTPUT (.pdf, .png, .tif or .ps) - PDF is written\
+       \n                without Ghostscript unless --device pdfwrite is given - or by\
+       \n                --daemon to render jobs into the directory DIR\
+       \n    --resolution Resolution used by --export, --daemon and --images in dots per\
+       \n                inch, by default 300, or of the thermal printer used by\
+       \n                --print-job, by default 203\
+       \n    --language  Language --print-job prints in: ps (the default), zpl or epl for\
+       \n                thermal label printers, or zpl-graphic or epl-graphic to send\
+       \n                barcodes as bitmaps of exactly the same geometry as PostScript\
+       \n    --images    Export an image of each distinct barcode of a job file to DIR,\
+       \n                named after the barcode, instead of rendering it to OUTPUT - or\
+       \n                as well as printing it with --print-job\
+       \n    --archive   Write the job printed by --print-job to PDF as well, from the\
+       \n                same read of the job\
+       \n    --format    Formats exported by --images: png (the default), svg or png,svg\
+       \n    --raster    Rasterise the PostScript printed by --print-job at DPI, for\
+       \n                printers which are slow to draw vector barcodes\
+       \n    --watch     Print job files dropped into DIR until interrupted (Linux only)\
+       \n    --daemon    Serve jobs on the Unix domain socket SOCKET until interrupted\
+       \n                (see daemon.h for the protocol)\
+       \n    --ring      Print jobs written to the shared memory ring NAME (e.g. /barcode)\
+       \n                until interrupted (Linux only; see ring.h for the format)\
+       \n    --jobs      Number of jobs --watch or --daemon processes concurrently, or\
+       \n                of Ghostscript processes or threads used by --export and --daemon,\
+       \n                by default 4\
+       \n    --metrics   Rewrite throughput metrics to FILE (e.g. barcode.prom) in the\
+       \n                Prometheus text format every 15 seconds, with any other mode\
+       \n    --query     SQLite query yielding (code, quantity[, key]) rows, by default\
+       \n                \"" BK_DB_DEFAULT_QUERY "\"\
+       \n    --mark      SQLite statement run for each key once printed, by default\
+       \n                \"" BK_DB_DEFAULT_MARK "\"\
        \n"
         );
 }
@@ -0,0 +1,284 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file metrics.c
+ *      @brief Throughput metrics implementations as defined in metrics.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "metrics.h"
+
+#include "error.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#ifdef _MSC_VER
+#define METRICS_ADD(ptr, value) InterlockedExchangeAdd64((volatile LONG64 *) (ptr), (value))
+#define METRICS_LOAD(ptr) InterlockedCompareExchange64((volatile LONG64 *) (ptr), 0, 0)
+#define METRICS_STORE(ptr, value) InterlockedExchange64((volatile LONG64 *) (ptr), (value))
+#define METRICS_TRY_LOCK(ptr) (0 == InterlockedExchange((volatile LONG *) (ptr), 1))
+#define METRICS_UNLOCK(ptr) InterlockedExchange((volatile LONG *) (ptr), 0)
+#else
+#define METRICS_ADD(ptr, value) __atomic_add_fetch((ptr), (value), __ATOMIC_RELAXED)
+#define METRICS_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define METRICS_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#define METRICS_TRY_LOCK(ptr) (0 == __atomic_exchange_n((ptr), 1, __ATOMIC_ACQUIRE))
+#define METRICS_UNLOCK(ptr) __atomic_store_n((ptr), 0, __ATOMIC_RELEASE)
+#endif
+
+/*      @brief Name and help text of a metric, as exposed */
+typedef struct MetricInfo {
+    const char * name;
+    const char * help;
+} MetricInfo;
+
+/*      @brief A histogram's observations, per bucket (not cumulative) and in total */
+typedef struct MetricHistogram {
+    int64_t buckets[BK_METRICS_NUM_BUCKETS + 1];
+    int64_t sum_ns;
+} MetricHistogram;
+
+// clang-format off
+static const MetricInfo counter_info[BK_METRICS_NUM_COUNTERS] = {
+    { "jobs_total",             "Jobs generated" },
+    { "job_failures_total",     "Jobs which could not be generated" },
+    { "labels_total",           "Labels generated" },
+    { "pages_total",            "Pages generated" },
+    { "bytes_total",            "Bytes of PostScript generated" },
+    { "prints_total",           "Print requests made through lp" },
+    { "print_failures_total",   "Print requests which lp failed or could not be started for" },
+    { "spooled_bytes_total",    "Bytes of PostScript handed to lp" },
+    { "cache_hits_total",       "Barcodes found in an encoding cache" },
+    { "cache_misses_total",     "Barcodes encoded as they were not in an encoding cache" },
+};
+
+static const MetricInfo gauge_info[BK_METRICS_NUM_GAUGES] = {
+    { "spool_queue_depth",      "Spool directory jobs waiting to be printed" },
+    { "daemon_queue_depth",     "Daemon connections waiting for a worker" },
+    { "ring_backlog_bytes",     "Bytes written to the shared memory ring but not yet read" },
+};
+
+static const MetricInfo histogram_info[BK_METRICS_NUM_HISTOGRAMS] = {
+    { "job_seconds",            "Time taken to generate a job" },
+    { "encode_seconds",         "Time taken to read and encode the labels of a page" },
+    { "layout_seconds",         "Time taken to lay out a page" },
+    { "write_seconds",          "Time taken to write a page" },
+    { "print_seconds",          "Time taken to hand a job to lp" },
+};
+// clang-format on
+
+static const double bucket_bounds[BK_METRICS_NUM_BUCKETS] = BK_METRICS_BUCKETS;
+
+bool bk_metrics_enabled = false;
+
+static char *          metrics_path;
+static unsigned        metrics_interval;
+static long            metrics_writing;
+static int64_t         counters[BK_METRICS_NUM_COUNTERS];
+static int64_t         gauges[BK_METRICS_NUM_GAUGES];
+static MetricHistogram histograms[BK_METRICS_NUM_HISTOGRAMS];
+
+void bk_metrics_add(int counter, uint64_t value) {
+    if (bk_metrics_enabled) {
+        METRICS_ADD(&counters[counter], (int64_t) value);
+    }
+}
+
+void bk_metrics_gauge_add(int gauge, int64_t value) {
+    if (bk_metrics_enabled) {
+        METRICS_ADD(&gauges[gauge], value);
+    }
+}
+
+void bk_metrics_gauge_set(int gauge, int64_t value) {
+    if (bk_metrics_enabled) {
+        METRICS_STORE(&gauges[gauge], value);
+    }
+}
+
+void bk_metrics_observe(int histogram, uint64_t duration) {
+    if (!bk_metrics_enabled || 0 == duration) {
+        return;
+    }
+
+    double seconds = duration / 1e9;
+    int    bucket  = 0;
+    while (bucket < BK_METRICS_NUM_BUCKETS && seconds > bucket_bounds[bucket]) {
+        bucket++;
+    }
+
+    METRICS_ADD(&histograms[histogram].buckets[bucket], 1);
+    METRICS_ADD(&histograms[histogram].sum_ns, (int64_t) duration);
+}
+
+static void metrics_write_header(FILE * file, const MetricInfo * info, const char * type) {
+    fprintf(file, "# HELP " BK_METRICS_PREFIX "%s %s\n", info->name, info->help);
+    fprintf(file, "# TYPE " BK_METRICS_PREFIX "%s %s\n", info->name, type);
+}
+
+/**
+ *      @details The metrics are written to a temporary file which then replaces the metrics file,
+ *              as a textfile collector requires. A histogram's count is the sum of its buckets,
+ *              so the two agree even while observations are being made.
+ */
+int bk_metrics_write(void) {
+    if (NULL == metrics_path || !METRICS_TRY_LOCK(&metrics_writing)) {
+        return SUCCESS;
+    }
+
+    size_t pathlen  = strlen(metrics_path) + sizeof ".tmp";
+    char * tmp_path = malloc(pathlen);
+    FILE * file     = NULL;
+    int    status   = SUCCESS;
+
+    if (NULL != tmp_path) {
+        snprintf(tmp_path, pathlen, "%s.tmp", metrics_path);
+        file = fopen(tmp_path, "w");
+    }
+
+    if (NULL == file) {
+        status = ERR_FILE_OPEN_FAILED;
+    } else {
+        for (int i = 0; i < BK_METRICS_NUM_COUNTERS; i++) {
+            metrics_write_header(file, &counter_info[i], "counter");
+            fprintf(file,
+                    BK_METRICS_PREFIX "%s %lld\n",
+                    counter_info[i].name,
+                    (long long) METRICS_LOAD(&counters[i]));
+        }
+
+        for (int i = 0; i < BK_METRICS_NUM_GAUGES; i++) {
+            metrics_write_header(file, &gauge_info[i], "gauge");
+            fprintf(file,
+                    BK_METRICS_PREFIX "%s %lld\n",
+                    gauge_info[i].name,
+                    (long long) METRICS_LOAD(&gauges[i]));
+        }
+
+        for (int i = 0; i < BK_METRICS_NUM_HISTOGRAMS; i++) {
+            const char * name  = histogram_info[i].name;
+            long long    count = 0;
+
+            metrics_write_header(file, &histogram_info[i], "histogram");
+            for (int b = 0; b <= BK_METRICS_NUM_BUCKETS; b++) {
+                count += METRICS_LOAD(&histograms[i].buckets[b]);
+                if (b < BK_METRICS_NUM_BUCKETS) {
+                    fprintf(file,
+                            BK_METRICS_PREFIX "%s_bucket{le=\"%g\"} %lld\n",
+                            name,
+                            bucket_bounds[b],
+                            count);
+                } else {
+                    fprintf(file, BK_METRICS_PREFIX "%s_bucket{le=\"+Inf\"} %lld\n", name, count);
+                }
+            }
+            fprintf(file,
+                    BK_METRICS_PREFIX "%s_sum %.9f\n",
+                    name,
+                    METRICS_LOAD(&histograms[i].sum_ns) / 1e9);
+            fprintf(file, BK_METRICS_PREFIX "%s_count %lld\n", name, count);
+        }
+
+        if (ferror(file)) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+        if (0 != fclose(file) && SUCCESS == status) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+#ifdef _WIN32
+        // rename() does not replace an existing file on Windows
+        remove(metrics_path);
+#endif
+        if (SUCCESS == status && 0 != rename(tmp_path, metrics_path)) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+    }
+
+    free(tmp_path);
+    METRICS_UNLOCK(&metrics_writing);
+
+    return status;
+}
+
+static void metrics_atexit(void) {
+    bk_metrics_write();
+}
+
+/*      @brief Rewrite the metrics file every interval, for as long as the process runs */
+#ifdef _WIN32
+static DWORD WINAPI metrics_thread(LPVOID arg) {
+#else
+static void * metrics_thread(void * arg) {
+#endif
+    (void) arg;
+
+    bk_trace_thread_name("metrics");
+
+    for (;;) {
+#ifdef _WIN32
+        Sleep(metrics_interval * 1000);
+#else
+        struct timespec interval = { metrics_interval, 0 };
+        while (0 != nanosleep(&interval, &interval))
+            ;
+#endif
+        if (SUCCESS != bk_metrics_write()) {
+            fprintf(stderr, "Warning: could not write metrics to %s\n", metrics_path);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *      @details Spans are timed from here on, as the latency histograms are observed from them. The
+ *              file is written at once, so that it exists before anything has happened.
+ */
+int bk_metrics_init(const char * path, unsigned interval) {
+    if (NULL != metrics_path) {
+        return SUCCESS;
+    }
+
+    metrics_path = strdup(path);
+    VERIFY_NULL_BC(metrics_path, strlen(path) + 1);
+
+    metrics_interval   = interval > 0 ? interval : BK_METRICS_INTERVAL;
+    bk_metrics_enabled = true;
+    bk_trace_time_spans();
+    atexit(metrics_atexit);
+
+    if (SUCCESS != bk_metrics_write()) {
+        fprintf(stderr, "Warning: could not write metrics to %s\n", metrics_path);
+    }
+
+#ifdef _WIN32
+    HANDLE thread = CreateThread(NULL, 0, metrics_thread, NULL, 0, NULL);
+    if (NULL == thread) {
+        return ERR_GENERIC;
+    }
+    CloseHandle(thread);
+#else
+    pthread_t thread;
+    if (0 != pthread_create(&thread, NULL, metrics_thread, NULL)) {
+        return ERR_GENERIC;
+    }
+    pthread_detach(thread);
+#endif
+
+    return SUCCESS;
+}
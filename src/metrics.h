@@ -0,0 +1,116 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file metrics.h
+ *      @brief Throughput metrics, written as a Prometheus text exposition file
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Once bk_metrics_init() has been called the metrics file is rewritten every interval, and on
+ *      exit, for a node exporter textfile collector to pick up - the application does not serve
+ *      them itself. Counters and gauges are updated atomically from any thread.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *      @defgroup MetricsProperties Metrics properties
+ */
+/*@{*/
+// clang-format off
+#define BK_METRICS_INTERVAL     15
+#define BK_METRICS_PREFIX       "barcode_"
+// Upper bounds of the latency histogram buckets, in seconds, besides +Inf
+#define BK_METRICS_BUCKETS      { 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,   \
+                                  0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10 }
+#define BK_METRICS_NUM_BUCKETS  16
+// clang-format on
+/*@}*/
+
+/**
+ *      @defgroup MetricsCounters Counters
+ */
+/*@{*/
+// clang-format off
+#define BK_METRIC_JOBS              0
+#define BK_METRIC_JOB_FAILURES      1
+#define BK_METRIC_LABELS            2
+#define BK_METRIC_PAGES             3
+#define BK_METRIC_BYTES             4
+#define BK_METRIC_PRINTS            5
+#define BK_METRIC_PRINT_FAILURES    6
+#define BK_METRIC_BYTES_SPOOLED     7
+#define BK_METRIC_CACHE_HITS        8
+#define BK_METRIC_CACHE_MISSES      9
+#define BK_METRICS_NUM_COUNTERS     10
+// clang-format on
+/*@}*/
+
+/**
+ *      @defgroup MetricsGauges Gauges
+ */
+/*@{*/
+// clang-format off
+#define BK_METRIC_SPOOL_QUEUE       0
+#define BK_METRIC_DAEMON_QUEUE      1
+#define BK_METRIC_RING_BACKLOG      2
+#define BK_METRICS_NUM_GAUGES       3
+// clang-format on
+/*@}*/
+
+/**
+ *      @defgroup MetricsHistograms Latency histograms
+ */
+/*@{*/
+// clang-format off
+#define BK_METRIC_JOB_SECONDS       0
+#define BK_METRIC_ENCODE_SECONDS    1
+#define BK_METRIC_LAYOUT_SECONDS    2
+#define BK_METRIC_WRITE_SECONDS     3
+#define BK_METRIC_PRINT_SECONDS     4
+#define BK_METRICS_NUM_HISTOGRAMS   5
+// clang-format on
+/*@}*/
+
+/*      @brief Whether metrics are being collected */
+extern bool bk_metrics_enabled;
+
+/**
+ *      @brief Start collecting metrics, writing them to a file every interval
+ *      @param path Path of the metrics file, which should end in .prom for a textfile collector
+ *      @param interval Seconds between writes, or 0 for BK_METRICS_INTERVAL
+ *      @return SUCCESS, or ERR_GENERIC if the writing thread could not be started
+ */
+int bk_metrics_init(const char *, unsigned);
+
+/*      @brief Add to a counter, if metrics are being collected */
+void bk_metrics_add(int, uint64_t);
+
+/*      @brief Add to (or with a negative value, subtract from) a gauge */
+void bk_metrics_gauge_add(int, int64_t);
+
+void bk_metrics_gauge_set(int, int64_t);
+
+/**
+ *      @brief Record a latency in a histogram
+ *      @param histogram One of the BK_METRIC_ _SECONDS histograms
+ *      @param duration The latency in nanoseconds, as returned by bk_trace_end(); 0 is ignored, as
+ *                      from a span which was not timed
+ */
+void bk_metrics_observe(int, uint64_t);
+
+/**
+ *      @brief Write the metrics file now
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_FILE_WRITE_FAILED
+ */
+int bk_metrics_write(void);
+
+#endif
@@ -0,0 +1,130 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file modules.c
+ *      @brief Code 128 module width encoding implementations as defined in modules.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "modules.h"
+
+#include "error.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+/**
+ *      @defgroup ModulesSymbols Code 128 symbol values
+ */
+/*@{*/
+// clang-format off
+#define MODULES_CODE_C      99
+#define MODULES_CODE_B      100
+#define MODULES_START_B     104
+#define MODULES_START_C     105
+#define MODULES_CHECK_MOD   103
+// Run of digits worth changing to code set C for
+#define MODULES_MIN_C_RUN   4
+// clang-format on
+/*@}*/
+
+/*      @brief Bar and space widths of each symbol value, bar first */
+static const char symbol_widths[][BK_MODULES_SYMBOL_ELEMENTS + 1] = {
+    "212222", "222122", "222221", "121223", "121322", "131222", "122213", "122312", "132212",
+    "221213", "221312", "231212", "112232", "122132", "122231", "113222", "123122", "123221",
+    "223211", "221132", "221231", "213212", "223112", "312131", "311222", "321122", "321221",
+    "312212", "322112", "322211", "212123", "212321", "232121", "111323", "131123", "131321",
+    "112313", "132113", "132311", "211313", "231113", "231311", "112133", "112331", "132131",
+    "113123", "113321", "133121", "313121", "211331", "231131", "213113", "213311", "213131",
+    "311123", "311321", "331121", "312113", "312311", "332111", "314111", "221411", "431111",
+    "111224", "111422", "121124", "121421", "141122", "141221", "112214", "112412", "122114",
+    "122411", "142112", "142211", "241211", "221114", "413111", "241112", "134111", "111242",
+    "121142", "121241", "114212", "124112", "124211", "411212", "421112", "421211", "212141",
+    "214121", "412121", "111143", "111341", "131141", "114113", "114311", "411113", "411311",
+    "113141", "114131", "311141", "411131", "211412", "211214", "211232",
+};
+
+static const char stop_widths[] = "2331112";
+
+/*      @brief Number of digits from the start of @c str, up to @c len */
+static size_t digit_run(const char * str, size_t len) {
+    size_t run = 0;
+    while (run < len && str[run] >= '0' && str[run] <= '9') {
+        run++;
+    }
+    return run;
+}
+
+static void append_widths(BKModules * modules, const char * widths) {
+    for (; '\0' != *widths; widths++) {
+        int width                                = *widths - '0';
+        modules->widths[modules->num_elements++] = width;
+        modules->num_modules += width;
+    }
+}
+
+/**
+ *      @details Code set C is started in, or changed to, for a run of at least MODULES_MIN_C_RUN
+ *              digits, an odd digit being encoded in code set B first. This is not always the
+ *              shortest encoding, but is never longer than code set B alone.
+ */
+int bk_modules_encode(const char * barcode, size_t len, BKModules * modules) {
+    int    symbols[BK_MODULES_MAX_SYMBOLS];
+    int    num_symbols = 0;
+    size_t i           = 0;
+    bool   code_c;
+
+    if (0 == len || len > C128_MAX_STRING_LEN) {
+        return ERR_DATA_LENGTH;
+    }
+    for (size_t c = 0; c < len; c++) {
+        if (barcode[c] < ' ' || barcode[c] > '~') {
+            return ERR_CHAR_INVALID;
+        }
+    }
+
+    size_t run             = digit_run(barcode, len);
+    code_c                 = run >= MODULES_MIN_C_RUN || (run == len && 0 == len % 2);
+    symbols[num_symbols++] = code_c ? MODULES_START_C : MODULES_START_B;
+
+    while (i < len) {
+        run = digit_run(barcode + i, len - i);
+        if (code_c) {
+            if (run >= 2) {
+                symbols[num_symbols++] = (barcode[i] - '0') * 10 + barcode[i + 1] - '0';
+                i += 2;
+                continue;
+            }
+            symbols[num_symbols++] = MODULES_CODE_B;
+            code_c                 = false;
+        } else if (run >= MODULES_MIN_C_RUN) {
+            if (run % 2) {
+                symbols[num_symbols++] = barcode[i++] - ' ';
+            }
+            symbols[num_symbols++] = MODULES_CODE_C;
+            code_c                 = true;
+        } else {
+            symbols[num_symbols++] = barcode[i++] - ' ';
+        }
+    }
+
+    int check = symbols[0];
+    for (int s = 1; s < num_symbols; s++) {
+        check += symbols[s] * s;
+    }
+    symbols[num_symbols++] = check % MODULES_CHECK_MOD;
+
+    modules->num_elements = 0;
+    modules->num_modules  = 0;
+    for (int s = 0; s < num_symbols; s++) {
+        append_widths(modules, symbol_widths[symbols[s]]);
+    }
+    append_widths(modules, stop_widths);
+
+    return SUCCESS;
+}
@@ -0,0 +1,60 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file modules.h
+ *      @brief Code 128 module width encoding declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      libbarcode only exposes an encoding through the PostScript it lays out, so barcodes drawn
+ *      by other means are encoded here as the widths of their bars and spaces. Code sets B and C
+ *      are used - C for runs of digits long enough to be shorter in it - which covers every
+ *      printable ASCII barcode.
+ */
+
+#ifndef MODULES_H
+#define MODULES_H
+
+#include "barcode.h"
+
+#include <stddef.h>
+
+/**
+ *      @defgroup ModulesProperties Module encoding properties
+ */
+/*@{*/
+// clang-format off
+// Each data character may need a code set change, plus the start and check symbols
+#define BK_MODULES_MAX_SYMBOLS      (2 * C128_MAX_STRING_LEN + 2)
+#define BK_MODULES_SYMBOL_ELEMENTS  6
+#define BK_MODULES_STOP_ELEMENTS    7
+#define BK_MODULES_MAX_ELEMENTS     (BK_MODULES_MAX_SYMBOLS * BK_MODULES_SYMBOL_ELEMENTS        \
+                                     + BK_MODULES_STOP_ELEMENTS)
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief The bars and spaces of an encoded barcode
+ *      @details @c widths alternates between bars and spaces, starting and ending with a bar, each
+ *               from 1 to 4 modules wide. Quiet zones are not included.
+ */
+typedef struct BKModules {
+    unsigned char widths[BK_MODULES_MAX_ELEMENTS];
+    int           num_elements;
+    int           num_modules;
+} BKModules;
+
+/**
+ *      @brief Encode a barcode as the widths of its bars and spaces
+ *      @param barcode The barcode text
+ *      @param len The length of @c barcode
+ *      @param modules Destination for the encoding
+ *      @return SUCCESS, ERR_DATA_LENGTH, ERR_CHAR_INVALID
+ */
+int bk_modules_encode(const char *, size_t, BKModules *);
+
+#endif
@@ -0,0 +1,540 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file pdf.c
+ *      @brief Direct PDF generation implementations as defined in pdf.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "pdf.h"
+
+#include "alloc.h"
+#include "cache.h"
+#include "error.h"
+#include "metrics.h"
+#include "modules.h"
+#include "trace.h"
+#include "zlib.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *      @defgroup PdfObjects Objects numbered before any page or barcode
+ */
+/*@{*/
+// clang-format off
+#define PDF_CATALOG         1
+#define PDF_PAGES           2
+#define PDF_FONT            3
+#define PDF_FIRST_FREE      4
+// The second line marks the file as binary
+#define PDF_HEADER          "%PDF-1.4\n%\xe2\xe3\xcf\xd3\n"
+// Buffered output is written out once it reaches this size
+#define PDF_CHUNK_SIZE      4096
+// clang-format on
+/*@}*/
+
+/*      @brief A growable output buffer */
+typedef struct PdfBuffer {
+    char * data;
+    size_t len;
+    size_t size;
+} PdfBuffer;
+
+/*      @brief Label geometry, in points */
+typedef struct PdfGeometry {
+    double lmargin, tmargin, padding;
+    double bar_width, bar_height, fontsize;
+    double column_width, row_height;
+} PdfGeometry;
+
+/*      @brief The state of one PDF being generated */
+typedef struct PdfWriter {
+    BKSink *    sink;
+    size_t      offset;
+    PdfGeometry geometry;
+    // Offset of each object by number - object 0 is the head of the free list
+    size_t * offsets;
+    long     num_objects;
+    long     max_objects;
+    // Page objects, in order, for the page tree
+    long * pages;
+    long   num_pages;
+    long   max_pages;
+    // XObjects of the barcodes drawn, by barcode
+    BKSymbolTable symbols;
+    PdfBuffer     content, form, dict, deflated;
+    z_stream      zstream;
+} PdfWriter;
+
+/*      @brief Points per unit of the given units */
+static double unit_points(const char * units) {
+    if (0 == strcmp(units, "mm")) {
+        return 72 / 25.4;
+    } else if (0 == strcmp(units, "cm")) {
+        return 72 / 2.54;
+    } else if (0 == strcmp(units, "in")) {
+        return 72;
+    }
+    return 1;
+}
+
+static void buffer_reserve(PdfBuffer * buffer, size_t len) {
+    if (buffer->len + len <= buffer->size) {
+        return;
+    }
+
+    size_t size = buffer->size ? buffer->size : PDF_CHUNK_SIZE;
+    while (size < buffer->len + len) {
+        size *= 2;
+    }
+    buffer->data = bk_realloc(buffer->data, size);
+    VERIFY_NULL_BC(buffer->data, size);
+    buffer->size = size;
+}
+
+static void buffer_append(PdfBuffer * buffer, const char * data, size_t len) {
+    if (0 == len) {
+        return;
+    }
+    buffer_reserve(buffer, len);
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+}
+
+/*      @brief Append formatted text, which must not format floating point numbers */
+static void buffer_printf(PdfBuffer * buffer, const char * format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    buffer_reserve(buffer, len + 1);
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->len, len + 1, format, args);
+    va_end(args);
+    buffer->len += len;
+}
+
+/**
+ *      @brief Append a number and a space
+ *      @details Numbers are written to thousandths of a point without trailing zeros. printf()'s
+ *              %f is not used, as a locale set by GTK may write it with a decimal comma.
+ */
+static void buffer_number(PdfBuffer * buffer, double number) {
+    long long thousandths = llround(number * 1000);
+    long long whole = llabs(thousandths) / 1000, fraction = llabs(thousandths) % 1000;
+    int       digits = 3;
+
+    while (digits > 0 && 0 != fraction && 0 == fraction % 10) {
+        fraction /= 10;
+        digits--;
+    }
+    if (0 == fraction) {
+        buffer_printf(buffer, "%s%lld ", thousandths < 0 ? "-" : "", whole);
+    } else {
+        buffer_printf(
+            buffer, "%s%lld.%0*lld ", thousandths < 0 ? "-" : "", whole, digits, fraction);
+    }
+}
+
+static void buffer_free(PdfBuffer * buffer) {
+    bk_free(buffer->data);
+    memset(buffer, 0, sizeof *buffer);
+}
+
+static int pdf_write(PdfWriter * writer, const char * data, size_t len) {
+    int status = writer->sink->write(writer->sink->ctx, data, len);
+    writer->offset += len;
+    return status;
+}
+
+/*      @brief Write a buffer out, emptying it */
+static int pdf_flush(PdfWriter * writer, PdfBuffer * buffer) {
+    int status  = pdf_write(writer, buffer->data, buffer->len);
+    buffer->len = 0;
+    return status;
+}
+
+/*      @brief Number a new object, to be written with pdf_begin() */
+static long pdf_new_object(PdfWriter * writer) {
+    if (writer->num_objects == writer->max_objects) {
+        writer->max_objects *= 2;
+        size_t size     = sizeof *writer->offsets * writer->max_objects;
+        writer->offsets = bk_realloc(writer->offsets, size);
+        VERIFY_NULL_BC(writer->offsets, size);
+    }
+    writer->offsets[writer->num_objects] = 0;
+    return writer->num_objects++;
+}
+
+/*      @brief Start an object at the current offset, in @c buffer */
+static void pdf_begin(PdfWriter * writer, PdfBuffer * buffer, long object) {
+    writer->offsets[object] = writer->offset + buffer->len;
+    buffer_printf(buffer, "%ld 0 obj\n", object);
+}
+
+/**
+ *      @brief Write an object holding a compressed stream
+ *      @param dict Entries of the stream's dictionary besides its length and filter
+ *      @param data The stream's contents, which are compressed
+ */
+// clang-format off
+static int pdf_write_stream(
+    PdfWriter * writer,
+    long object,
+    PdfBuffer * dict,
+    PdfBuffer * data
+) {
+    // clang-format on
+
+    PdfBuffer * deflated = &writer->deflated;
+    z_stream *  zstream  = &writer->zstream;
+
+    deflated->len = 0;
+    buffer_reserve(deflated, deflateBound(zstream, data->len));
+    zstream->next_in   = (Bytef *) data->data;
+    zstream->avail_in  = data->len;
+    zstream->next_out  = (Bytef *) deflated->data;
+    zstream->avail_out = deflated->size;
+    if (Z_STREAM_END != deflate(zstream, Z_FINISH)) {
+        deflateReset(zstream);
+        return ERR_GENERIC;
+    }
+    deflated->len = zstream->total_out;
+    deflateReset(zstream);
+
+    PdfBuffer header = { 0 };
+    pdf_begin(writer, &header, object);
+    buffer_append(&header, "<< ", 3);
+    buffer_append(&header, dict->data, dict->len);
+    buffer_printf(&header, "/Length %zu /Filter /FlateDecode >>\nstream\n", deflated->len);
+
+    int status = pdf_flush(writer, &header);
+    if (SUCCESS == status) {
+        status = pdf_flush(writer, deflated);
+    }
+    if (SUCCESS == status) {
+        static const char end[] = "\nendstream\nendobj\n";
+        status                  = pdf_write(writer, end, sizeof end - 1);
+    }
+
+    buffer_free(&header);
+    return status;
+}
+
+/*      @brief Draw a barcode's bars and text as the contents of its XObject */
+static void draw_symbol(PdfWriter * writer, const char * barcode, const BKModules * modules) {
+    const PdfGeometry * geometry = &writer->geometry;
+    PdfBuffer *         form     = &writer->form;
+    double              x        = geometry->padding;
+    double              bars_y   = geometry->padding + geometry->fontsize;
+
+    form->len = 0;
+    for (int e = 0; e < modules->num_elements; e++) {
+        double width = modules->widths[e] * geometry->bar_width;
+        // Elements alternate between bars and spaces
+        if (0 == e % 2) {
+            buffer_number(form, x);
+            buffer_number(form, bars_y);
+            buffer_number(form, width);
+            buffer_number(form, geometry->bar_height);
+            buffer_append(form, "re\n", 3);
+        }
+        x += width;
+    }
+    buffer_append(form, "f\n", 2);
+
+    if (geometry->fontsize > 0) {
+        size_t len        = strlen(barcode);
+        double bars_width = modules->num_modules * geometry->bar_width;
+        double text_width = len * BK_PDF_FONT_ADVANCE * geometry->fontsize;
+
+        buffer_append(form, "BT /F1 ", 7);
+        buffer_number(form, geometry->fontsize);
+        buffer_append(form, "Tf ", 3);
+        buffer_number(form, geometry->padding + (bars_width - text_width) / 2);
+        buffer_number(form, geometry->padding);
+        buffer_append(form, "Td (", 4);
+        for (size_t i = 0; i < len; i++) {
+            if ('(' == barcode[i] || ')' == barcode[i] || '\\' == barcode[i]) {
+                buffer_append(form, "\\", 1);
+            }
+            buffer_append(form, &barcode[i], 1);
+        }
+        buffer_append(form, ") Tj ET\n", 8);
+    }
+}
+
+/**
+ *      @brief Get the XObject of a barcode, writing it if it has not been written
+ *      @details The barcodes remembered are forgotten once there are more than BK_PDF_MAX_SYMBOLS
+ *              of them, so that the table stays bounded however many distinct barcodes a job
+ *              has.
+ */
+static int symbol_object(PdfWriter * writer, const char * barcode, long * object) {
+    if (bk_symbols_lookup(&writer->symbols, barcode, object)) {
+        return SUCCESS;
+    }
+    if (writer->symbols.num_entries >= BK_PDF_MAX_SYMBOLS) {
+        bk_symbols_clear(&writer->symbols);
+    }
+
+    BKModules modules;
+    int       status = bk_modules_encode(barcode, strlen(barcode), &modules);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    const PdfGeometry * geometry = &writer->geometry;
+    PdfBuffer *         dict     = &writer->dict;
+
+    draw_symbol(writer, barcode, &modules);
+    dict->len = 0;
+    buffer_append(dict, "/Type /XObject /Subtype /Form /BBox [0 0 ", 41);
+    buffer_number(dict, geometry->column_width);
+    buffer_number(dict, geometry->row_height);
+    buffer_printf(dict, "] /Resources << /Font << /F1 %d 0 R >> >> ", PDF_FONT);
+
+    *object = pdf_new_object(writer);
+    status  = pdf_write_stream(writer, *object, dict, &writer->form);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    bk_symbols_insert(&writer->symbols, barcode, *object);
+
+    return SUCCESS;
+}
+
+/**
+ *      @brief Write a page's content stream and page object
+ *      @param used The distinct XObjects placed on the page
+ *      @param num_used The length of @c used
+ */
+static int emit_page(PdfWriter * writer, const long * used, int num_used) {
+    long contents = pdf_new_object(writer);
+    long page     = pdf_new_object(writer);
+
+    writer->dict.len = 0;
+    int status       = pdf_write_stream(writer, contents, &writer->dict, &writer->content);
+    writer->content.len = 0;
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    PdfBuffer * buffer = &writer->dict;
+    pdf_begin(writer, buffer, page);
+    buffer_printf(buffer, "<< /Type /Page /Parent %d 0 R /MediaBox [0 0 ", PDF_PAGES);
+    buffer_number(buffer, BK_PDF_PAGE_WIDTH);
+    buffer_number(buffer, BK_PDF_PAGE_HEIGHT);
+    buffer_append(buffer, "] /Resources << /XObject <<", 27);
+    for (int i = 0; i < num_used; i++) {
+        buffer_printf(buffer, " /X%ld %ld 0 R", used[i], used[i]);
+    }
+    buffer_printf(buffer, " >> >> /Contents %ld 0 R >>\nendobj\n", contents);
+
+    if (writer->num_pages == writer->max_pages) {
+        writer->max_pages = writer->max_pages ? writer->max_pages * 2 : BK_PDF_INITIAL_OBJECTS;
+        size_t size       = sizeof *writer->pages * writer->max_pages;
+        writer->pages     = bk_realloc(writer->pages, size);
+        VERIFY_NULL_BC(writer->pages, size);
+    }
+    writer->pages[writer->num_pages++] = page;
+
+    return pdf_flush(writer, buffer);
+}
+
+/**
+ *      @brief Write the font, catalog and page tree, then the cross-reference table and trailer
+ *      @details The page tree and table are written a chunk at a time as they are formatted.
+ */
+static int emit_trailer(PdfWriter * writer) {
+    PdfBuffer * buffer = &writer->dict;
+    int         status = SUCCESS;
+
+    buffer->len = 0;
+    pdf_begin(writer, buffer, PDF_FONT);
+    buffer_printf(buffer,
+                  "<< /Type /Font /Subtype /Type1 /BaseFont /%s /Encoding /WinAnsiEncoding >>\n"
+                  "endobj\n",
+                  BK_PDF_FONT);
+    pdf_begin(writer, buffer, PDF_CATALOG);
+    buffer_printf(buffer, "<< /Type /Catalog /Pages %d 0 R >>\nendobj\n", PDF_PAGES);
+    pdf_begin(writer, buffer, PDF_PAGES);
+    buffer_append(buffer, "<< /Type /Pages /Kids [", 23);
+    for (long i = 0; i < writer->num_pages && SUCCESS == status; i++) {
+        buffer_printf(buffer, " %ld 0 R", writer->pages[i]);
+        if (buffer->len >= PDF_CHUNK_SIZE) {
+            status = pdf_flush(writer, buffer);
+        }
+    }
+    buffer_printf(buffer, " ] /Count %ld >>\nendobj\n", writer->num_pages);
+
+    size_t xref = writer->offset + buffer->len;
+    buffer_printf(buffer, "xref\n0 %ld\n0000000000 65535 f \n", writer->num_objects);
+    for (long i = 1; i < writer->num_objects && SUCCESS == status; i++) {
+        buffer_printf(buffer, "%010zu 00000 n \n", writer->offsets[i]);
+        if (buffer->len >= PDF_CHUNK_SIZE) {
+            status = pdf_flush(writer, buffer);
+        }
+    }
+    buffer_printf(buffer,
+                  "trailer\n<< /Size %ld /Root %d 0 R >>\nstartxref\n%zu\n%%%%EOF\n",
+                  writer->num_objects,
+                  PDF_CATALOG,
+                  xref);
+
+    return SUCCESS == status ? pdf_flush(writer, buffer) : status;
+}
+
+static void writer_free(PdfWriter * writer) {
+    bk_symbols_free(&writer->symbols);
+    bk_free(writer->offsets);
+    bk_free(writer->pages);
+    buffer_free(&writer->content);
+    buffer_free(&writer->form);
+    buffer_free(&writer->dict);
+    buffer_free(&writer->deflated);
+    deflateEnd(&writer->zstream);
+}
+
+/**
+ *      @details Rows are pulled from the source one at a time, as for bk_generate_stream(), and
+ *              each label appended to the content stream of the page in progress as a placement
+ *              of its barcode's XObject. A page is compressed and written as soon as it is full.
+ */
+// clang-format off
+int bk_generate_pdf(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    BKSink * sink,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    int       per_page;
+    double    points   = unit_points(props->units);
+    long      labels   = 0;
+    int       on_page  = 0, num_used = 0;
+    long *    used;
+    PdfWriter writer;
+
+    if (SUCCESS != bk_layout_check(layout)) {
+        return ERR_INVALID_LAYOUT;
+    }
+    per_page = layout->rows * layout->cols;
+
+    uint64_t job_start = bk_trace_begin();
+
+    memset(&writer, 0, sizeof writer);
+    bk_symbols_init(&writer.symbols);
+    writer.sink                  = sink;
+    writer.geometry.lmargin      = props->lmargin * points;
+    writer.geometry.tmargin      = props->tmargin * points;
+    writer.geometry.padding      = props->padding * points;
+    writer.geometry.bar_width    = props->bar_width * points;
+    writer.geometry.bar_height   = props->bar_height * points;
+    writer.geometry.fontsize     = props->fontsize * points;
+    writer.geometry.column_width = props->column_width * points;
+    writer.geometry.row_height   = writer.geometry.bar_height + writer.geometry.fontsize
+                                 + 2 * writer.geometry.padding;
+
+    writer.max_objects = BK_PDF_INITIAL_OBJECTS;
+    size_t offsets_size = sizeof *writer.offsets * writer.max_objects;
+    writer.offsets      = bk_realloc(NULL, offsets_size);
+    VERIFY_NULL_BC(writer.offsets, offsets_size);
+    writer.offsets[0]  = 0;
+    writer.num_objects = PDF_FIRST_FREE;
+
+    size_t used_size = sizeof *used * per_page;
+    used             = bk_realloc(NULL, used_size);
+    VERIFY_NULL_BC(used, used_size);
+
+    int status = Z_OK == deflateInit(&writer.zstream, Z_DEFAULT_COMPRESSION) ? SUCCESS
+                                                                              : ERR_GENERIC;
+    if (SUCCESS == status) {
+        status = pdf_write(&writer, PDF_HEADER, sizeof PDF_HEADER - 1);
+    }
+
+    while (SUCCESS == status) {
+        const char * barcode;
+        int          quantity;
+        long         object;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        } else if (quantity <= 0) {
+            continue;
+        }
+
+        status = symbol_object(&writer, barcode, &object);
+
+        for (int copy = 0; copy < quantity && SUCCESS == status; copy++) {
+            const PdfGeometry * geometry = &writer.geometry;
+            int                 column   = on_page % layout->cols;
+            int                 row      = on_page / layout->cols;
+            double              top      = geometry->tmargin + (row + 1) * geometry->row_height;
+
+            buffer_append(&writer.content, "q 1 0 0 1 ", 10);
+            buffer_number(&writer.content, geometry->lmargin + column * geometry->column_width);
+            buffer_number(&writer.content, BK_PDF_PAGE_HEIGHT - top);
+            buffer_printf(&writer.content, "cm /X%ld Do Q\n", object);
+
+            int u = 0;
+            while (u < num_used && used[u] != object) {
+                u++;
+            }
+            if (u == num_used) {
+                used[num_used++] = object;
+            }
+            labels++;
+
+            if (++on_page == per_page) {
+                status   = emit_page(&writer, used, num_used);
+                on_page  = 0;
+                num_used = 0;
+            }
+        }
+    }
+
+    // Final, partially filled page
+    if (SUCCESS == status && on_page > 0) {
+        status = emit_page(&writer, used, num_used);
+    }
+    if (SUCCESS == status) {
+        status = emit_trailer(&writer);
+    }
+
+    if (NULL != stats) {
+        stats->labels = labels;
+        stats->pages  = writer.num_pages;
+        stats->bytes  = writer.offset;
+    }
+
+    bk_metrics_observe(BK_METRIC_JOB_SECONDS, bk_trace_end(BK_TRACE_PDF, job_start));
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_JOBS : BK_METRIC_JOB_FAILURES, 1);
+    bk_metrics_add(BK_METRIC_LABELS, labels);
+    bk_metrics_add(BK_METRIC_PAGES, writer.num_pages);
+    bk_metrics_add(BK_METRIC_BYTES, writer.offset);
+
+    bk_free(used);
+    writer_free(&writer);
+
+    return status;
+}
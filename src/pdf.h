@@ -0,0 +1,63 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file pdf.h
+ *      @brief Direct PDF generation declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Labels are written straight to PDF, from their module widths (see modules.h), rather than
+ *      generated as PostScript and converted. Each distinct barcode is drawn once, as a Form
+ *      XObject holding its bars and text, and each label is a placement of it with @c Do - so the
+ *      size of a file depends on the barcodes in it rather than on their quantities.
+ *
+ *      Objects are written to the sink as soon as they are complete: a barcode's XObject when it
+ *      is first used, and a page's compressed content stream and page object once the page is
+ *      full. Only the offset of each object is kept for the cross-reference table, which is
+ *      written at the end with the page tree.
+ */
+
+#ifndef PDF_H
+#define PDF_H
+
+#include "backend.h"
+#include "barcode.h"
+
+/**
+ *      @defgroup PdfProperties PDF generation properties
+ */
+/*@{*/
+// clang-format off
+// The page, in points (A4)
+#define BK_PDF_PAGE_WIDTH           595.28
+#define BK_PDF_PAGE_HEIGHT          841.89
+// Text is set in Courier, whose glyphs are all 600/1000 em wide
+#define BK_PDF_FONT                 "Courier"
+#define BK_PDF_FONT_ADVANCE         0.6
+// Barcodes whose XObjects are remembered for reuse - beyond this they are forgotten
+#define BK_PDF_MAX_SYMBOLS          4096
+#define BK_PDF_INITIAL_OBJECTS      1024
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Generates PDF from a stream of barcodes, one page at a time
+ *      @details Barcodes which have already been drawn are placed again, unless more than
+ *               BK_PDF_MAX_SYMBOLS have been since, in which case they are drawn anew. Memory use
+ *               is bounded by one page and the remembered barcodes, besides the offset kept of
+ *               each object.
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties, giving the size and position of each label
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param sink The destination for the generated PDF
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return SUCCESS, ERR_INVALID_LAYOUT, ERR_DATA_LENGTH, ERR_CHAR_INVALID, ERR_GENERIC (if a
+ *              stream could not be compressed), or any error returned by @c source or @c sink
+ */
+int bk_generate_pdf(BKSource *, PSProperties *, Layout *, BKSink *, BKGenerateStats *);
+
+#endif
@@ -0,0 +1,759 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file preview.c
+ *      @brief Live print preview implementations as defined in preview.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "preview.h"
+
+#include "error.h"
+#include "modules.h"
+#include "win.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*      @brief A barcode previewed, and the labels it occupies */
+typedef struct PreviewItem {
+    char *   barcode;
+    uint64_t hash;
+    int      quantity;
+    long     first_label;
+} PreviewItem;
+
+/*      @brief Label geometry, in points */
+typedef struct PreviewGeometry {
+    double lmargin, tmargin, padding;
+    double bar_width, bar_height, fontsize;
+    double column_width, row_height;
+    int    rows, cols;
+} PreviewGeometry;
+
+/*      @brief A drawing area showing every page at a given scale */
+typedef struct PreviewView {
+    GtkWidget * area;
+    // Pixels per point
+    double scale;
+} PreviewView;
+
+enum { VIEW_PAGES, VIEW_THUMBNAILS, NUM_VIEWS };
+
+/**
+ *      @brief Where a tile is
+ *      @details The zoom is the scale in thousandths, so that views at the same scale share tiles.
+ */
+typedef struct TileKey {
+    long page;
+    int  zoom;
+    int  column, row;
+} TileKey;
+
+/*      @brief A rasterised tile, and the page contents it shows */
+typedef struct Tile {
+    TileKey           key;
+    uint64_t          hash;
+    cairo_surface_t * surface;
+    size_t            bytes;
+    GList *           lru;
+} Tile;
+
+/*      @brief A label to be drawn on a tile, copied so that the tile can be drawn on any thread */
+typedef struct TileLabel {
+    double x, y;
+    char * barcode;
+} TileLabel;
+
+/*      @brief A tile being rasterised on a worker thread */
+typedef struct TileTask {
+    TileKey           key;
+    uint64_t          hash;
+    double            scale;
+    PreviewGeometry   geometry;
+    TileLabel *       labels;
+    int               num_labels;
+    cairo_surface_t * surface;
+} TileTask;
+
+static PreviewView     views[NUM_VIEWS];
+static PreviewItem *   items;
+static int             num_items;
+static long            num_labels;
+static PreviewGeometry geometry;
+static uint64_t        geometry_hash;
+
+/*      @brief Tiles by key, and most recently drawn first */
+static GHashTable * tiles;
+static GQueue       tile_lru = G_QUEUE_INIT;
+static size_t       tile_bytes, tile_budget;
+/*      @brief Page contents hash of the tile being rasterised, by key */
+static GHashTable * pending;
+
+static uint64_t hash_bytes(uint64_t hash, const void * data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ ((const unsigned char *) data)[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static guint tile_key_hash(gconstpointer data) {
+    const TileKey * key  = data;
+    uint64_t        hash = (FNV_OFFSET ^ key->page) * FNV_PRIME;
+    hash                 = (hash ^ key->zoom) * FNV_PRIME;
+    hash                 = (hash ^ key->column) * FNV_PRIME;
+    return (hash ^ key->row) * FNV_PRIME;
+}
+
+static gboolean tile_key_equal(gconstpointer a, gconstpointer b) {
+    const TileKey *x = a, *y = b;
+    return x->page == y->page && x->zoom == y->zoom && x->column == y->column && x->row == y->row;
+}
+
+static void tile_free(gpointer data) {
+    Tile * tile = data;
+    g_queue_delete_link(&tile_lru, tile->lru);
+    tile_bytes -= tile->bytes;
+    cairo_surface_destroy(tile->surface);
+    g_free(tile);
+}
+
+static void tile_task_free(gpointer data) {
+    TileTask * task = data;
+    for (int i = 0; i < task->num_labels; i++) {
+        g_free(task->labels[i].barcode);
+    }
+    g_free(task->labels);
+    if (NULL != task->surface) {
+        cairo_surface_destroy(task->surface);
+    }
+    g_free(task);
+}
+
+/*      @brief Points per unit of the given units */
+static double unit_points(const char * units) {
+    if (0 == strcmp(units, UNIT_ID_MM)) {
+        return 72 / 25.4;
+    } else if (0 == strcmp(units, UNIT_ID_CM)) {
+        return 72 / 2.54;
+    } else if (0 == strcmp(units, UNIT_ID_IN)) {
+        return 72;
+    }
+    return 1;
+}
+
+static int labels_per_page(void) {
+    return geometry.rows > 0 && geometry.cols > 0 ? geometry.rows * geometry.cols : 0;
+}
+
+static long num_pages(void) {
+    int per_page = labels_per_page();
+    return per_page > 0 ? (num_labels + per_page - 1) / per_page : 0;
+}
+
+static int zoom_key(double scale) {
+    return lround(scale * 1000);
+}
+
+static int page_width(double scale) {
+    return ceil(PREVIEW_PAGE_WIDTH * scale);
+}
+
+static int page_height(double scale) {
+    return ceil(PREVIEW_PAGE_HEIGHT * scale);
+}
+
+/*      @brief Pixels from the top of one page to the next */
+static int page_stride(double scale) {
+    return page_height(scale) + PREVIEW_PAGE_GAP;
+}
+
+/*      @brief Position of a label on its page, in points */
+static void label_origin(long label, double * x, double * y) {
+    int slot = label % labels_per_page();
+    *x       = geometry.lmargin + slot % geometry.cols * geometry.column_width;
+    *y       = geometry.tmargin + slot / geometry.cols * geometry.row_height;
+}
+
+/**
+ *      @details Items without labels share their first label with the next item, so the last item
+ *              starting at or before a label is the one it belongs to.
+ */
+static PreviewItem * find_item(long label) {
+    int low = 0, high = num_items - 1;
+    while (low < high) {
+        int mid = low + (high - low + 1) / 2;
+        if (items[mid].first_label <= label) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return &items[low];
+}
+
+/*      @brief Hash of everything drawn on a page, which changes whenever any of it does */
+static uint64_t page_hash(long page) {
+    int      per_page = labels_per_page();
+    uint64_t hash     = geometry_hash;
+    for (long label = page * per_page; label < (page + 1) * per_page && label < num_labels;
+         label++) {
+        hash = (hash ^ find_item(label)->hash) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static void update_size(PreviewView * view) {
+    if (NULL == view->area) {
+        return;
+    }
+
+    long pages  = num_pages();
+    int  width  = 2 * PREVIEW_PAGE_GAP + page_width(view->scale);
+    int  height = pages > 0 ? PREVIEW_PAGE_GAP + pages * page_stride(view->scale) : 0;
+    int  current_width, current_height;
+
+    gtk_widget_get_size_request(view->area, &current_width, &current_height);
+    if (width != current_width || height != current_height) {
+        gtk_widget_set_size_request(view->area, width, height);
+    }
+}
+
+static void update_sizes(void) {
+    for (int v = 0; v < NUM_VIEWS; v++) {
+        update_size(&views[v]);
+    }
+}
+
+/**
+ *      @details A few labels are redrawn one by one. More - when a quantity has changed, say, and
+ *              moved every label after it - redraw the view from the first label's page on,
+ *              which GTK clips to what is in view.
+ */
+static void redraw_labels(PreviewView * view, long from, long to) {
+    if (NULL == view->area || from >= to || 0 == labels_per_page()) {
+        return;
+    }
+
+    double scale  = view->scale;
+    int    stride = page_stride(scale);
+
+    if (to - from > PREVIEW_MAX_LABEL_REDRAWS) {
+        int top = PREVIEW_PAGE_GAP + from / labels_per_page() * stride;
+        gtk_widget_queue_draw_area(view->area,
+                                   0,
+                                   top,
+                                   gtk_widget_get_allocated_width(view->area),
+                                   gtk_widget_get_allocated_height(view->area) - top);
+        return;
+    }
+
+    for (long label = from; label < to; label++) {
+        double x, y;
+        int    top = PREVIEW_PAGE_GAP + label / labels_per_page() * stride;
+        label_origin(label, &x, &y);
+
+        // One pixel either side for antialiasing
+        gtk_widget_queue_draw_area(view->area,
+                                   floor(PREVIEW_PAGE_GAP + x * scale) - 1,
+                                   floor(top + y * scale) - 1,
+                                   ceil(geometry.column_width * scale) + 2,
+                                   ceil(geometry.row_height * scale) + 2);
+    }
+}
+
+static void redraw_all_labels(long from, long to) {
+    for (int v = 0; v < NUM_VIEWS; v++) {
+        redraw_labels(&views[v], from, to);
+    }
+}
+
+static void queue_draw_all(void) {
+    for (int v = 0; v < NUM_VIEWS; v++) {
+        if (NULL != views[v].area) {
+            gtk_widget_queue_draw(views[v].area);
+        }
+    }
+}
+
+/*      @brief Number the labels of every item from @c from on */
+static void relabel(int from) {
+    long label = from > 0 ? items[from - 1].first_label + items[from - 1].quantity : 0;
+    for (int i = from; i < num_items; i++) {
+        items[i].first_label = label;
+        label += items[i].quantity;
+    }
+    num_labels = label;
+}
+
+/*      @brief Draw a label with its top left corner at (x, y), in points */
+// clang-format off
+static void draw_label(
+    cairo_t * cr,
+    const PreviewGeometry * geometry,
+    const char * barcode,
+    double x,
+    double y,
+    double scale
+) {
+    // clang-format on
+
+    BKModules modules;
+    int       status = bk_modules_encode(barcode, strlen(barcode), &modules);
+    double    bars_x = x + geometry->padding, bars_y = y + geometry->padding, bars_width;
+
+    if (SUCCESS == status) {
+        bars_width = modules.num_modules * geometry->bar_width;
+        cairo_set_source_rgb(cr, 0, 0, 0);
+        for (int e = 0; e < modules.num_elements; e++) {
+            double width = modules.widths[e] * geometry->bar_width;
+            // Elements alternate between bars and spaces
+            if (0 == e % 2) {
+                cairo_rectangle(cr, bars_x, bars_y, width, geometry->bar_height);
+            }
+            bars_x += width;
+        }
+        cairo_fill(cr);
+    } else {
+        // Barcodes which cannot be encoded are outlined in red
+        bars_width = geometry->column_width - 2 * geometry->padding;
+        cairo_set_source_rgb(cr, 0.8, 0, 0);
+        cairo_set_line_width(cr, 1 / scale);
+        cairo_rectangle(cr, bars_x, bars_y, bars_width, geometry->bar_height);
+        cairo_stroke(cr);
+    }
+
+    if (geometry->fontsize > 0) {
+        cairo_text_extents_t extents;
+        cairo_text_extents(cr, barcode, &extents);
+        cairo_move_to(cr,
+                      x + geometry->padding + (bars_width - extents.x_advance) / 2,
+                      bars_y + geometry->bar_height + geometry->fontsize);
+        cairo_show_text(cr, barcode);
+    }
+}
+
+/*      @brief Rasterise a tile, on a worker thread */
+// clang-format off
+static void tile_thread(
+    GTask * gtask,
+    gpointer source,
+    gpointer data,
+    GCancellable * cancellable
+) {
+    // clang-format on
+    (void) source;
+    (void) cancellable;
+
+    TileTask * task = data;
+    int        left = task->key.column * PREVIEW_TILE_SIZE, top = task->key.row * PREVIEW_TILE_SIZE;
+    int        width  = MIN(PREVIEW_TILE_SIZE, page_width(task->scale) - left);
+    int        height = MIN(PREVIEW_TILE_SIZE, page_height(task->scale) - top);
+
+    task->surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    cairo_t * cr  = cairo_create(task->surface);
+
+    cairo_set_source_rgb(cr, 1, 1, 1);
+    cairo_paint(cr);
+    cairo_translate(cr, -left, -top);
+    cairo_scale(cr, task->scale, task->scale);
+    cairo_select_font_face(cr, PREVIEW_FONT, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(cr, task->geometry.fontsize);
+
+    for (int i = 0; i < task->num_labels; i++) {
+        TileLabel * label = &task->labels[i];
+        draw_label(cr, &task->geometry, label->barcode, label->x, label->y, task->scale);
+    }
+
+    cairo_destroy(cr);
+    g_task_return_boolean(gtask, TRUE);
+}
+
+/*      @brief The tile cache limit, in bytes */
+static size_t cache_budget(void) {
+    const char * env = getenv(PREVIEW_CACHE_ENV);
+    long         mb  = NULL != env ? atol(env) : PREVIEW_DEFAULT_CACHE_MB;
+    return (size_t) MAX(mb, 1) << 20;
+}
+
+/*      @brief Add a tile to the cache, replacing any older tile of the same key */
+static void cache_insert(TileTask * task) {
+    Tile * tile    = g_new0(Tile, 1);
+    tile->key      = task->key;
+    tile->hash     = task->hash;
+    tile->surface  = task->surface;
+    tile->bytes    = cairo_image_surface_get_stride(task->surface) *
+                  cairo_image_surface_get_height(task->surface);
+    task->surface = NULL;
+
+    g_hash_table_replace(tiles, &tile->key, tile);
+    g_queue_push_head(&tile_lru, tile);
+    tile->lru = g_queue_peek_head_link(&tile_lru);
+    tile_bytes += tile->bytes;
+
+    while (tile_bytes > tile_budget && tile_lru.length > 1) {
+        Tile * oldest = g_queue_peek_tail(&tile_lru);
+        g_hash_table_remove(tiles, &oldest->key);
+    }
+}
+
+/**
+ *      @details Tiles are only kept if they still show their page as it is, and the views are
+ *              redrawn where they show the tile.
+ */
+static void tile_done(GObject * source, GAsyncResult * result, gpointer user_data) {
+    (void) source;
+    (void) user_data;
+
+    TileTask * task = g_task_get_task_data(G_TASK(result));
+    uint64_t * hash;
+
+    if (NULL == tiles) {
+        return;
+    }
+
+    hash = g_hash_table_lookup(pending, &task->key);
+    if (NULL != hash && *hash == task->hash) {
+        g_hash_table_remove(pending, &task->key);
+    }
+    if (task->key.page >= num_pages() || page_hash(task->key.page) != task->hash) {
+        return;
+    }
+
+    cache_insert(task);
+
+    for (int v = 0; v < NUM_VIEWS; v++) {
+        PreviewView * view = &views[v];
+        if (NULL != view->area && zoom_key(view->scale) == task->key.zoom) {
+            gtk_widget_queue_draw_area(view->area,
+                                       PREVIEW_PAGE_GAP + task->key.column * PREVIEW_TILE_SIZE,
+                                       PREVIEW_PAGE_GAP + task->key.page * page_stride(view->scale)
+                                           + task->key.row * PREVIEW_TILE_SIZE,
+                                       PREVIEW_TILE_SIZE,
+                                       PREVIEW_TILE_SIZE);
+        }
+    }
+}
+
+/**
+ *      @details The labels the tile overlaps are copied for the worker thread, so that items may
+ *              change while it draws. A tile already being rasterised with the same contents is not
+ *              rasterised again.
+ */
+static void request_tile(const TileKey * key, uint64_t hash, double scale) {
+    uint64_t * pending_hash = g_hash_table_lookup(pending, key);
+    if (NULL != pending_hash && *pending_hash == hash) {
+        return;
+    }
+
+    TileTask * task = g_new0(TileTask, 1);
+    task->key       = *key;
+    task->hash      = hash;
+    task->scale     = scale;
+    task->geometry  = geometry;
+
+    // The tile, in points on its page
+    double left     = key->column * PREVIEW_TILE_SIZE / scale;
+    double top      = key->row * PREVIEW_TILE_SIZE / scale;
+    double right    = left + PREVIEW_TILE_SIZE / scale;
+    double bottom   = top + PREVIEW_TILE_SIZE / scale;
+    int    per_page = labels_per_page();
+    long   first    = key->page * per_page;
+
+    task->labels = g_new(TileLabel, per_page);
+    for (long label = first; label < first + per_page && label < num_labels; label++) {
+        double x, y;
+        label_origin(label, &x, &y);
+        if (x > right || x + geometry.column_width < left || y > bottom ||
+            y + geometry.row_height < top) {
+            continue;
+        }
+        task->labels[task->num_labels].x       = x;
+        task->labels[task->num_labels].y       = y;
+        task->labels[task->num_labels].barcode = g_strdup(find_item(label)->barcode);
+        task->num_labels++;
+    }
+
+    TileKey * pending_key = g_new(TileKey, 1);
+    *pending_key          = *key;
+    pending_hash          = g_new(uint64_t, 1);
+    *pending_hash         = hash;
+    g_hash_table_replace(pending, pending_key, pending_hash);
+
+    GTask * gtask = g_task_new(NULL, NULL, tile_done, NULL);
+    g_task_set_task_data(gtask, task, tile_task_free);
+    g_task_run_in_thread(gtask, tile_thread);
+    g_object_unref(gtask);
+}
+
+/**
+ *      @details Only the tiles within the area being redrawn are drawn, or rasterised if they are
+ *              not cached or no longer show their page as it is. A tile being rasterised is drawn
+ *              from its older version if there is one, and blank otherwise.
+ */
+static gboolean preview_draw(GtkWidget * widget, cairo_t * cr, gpointer data) {
+    (void) widget;
+
+    PreviewView * view = data;
+    double        x1, y1, x2, y2;
+
+    cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+    cairo_set_source_rgb(cr, 0.6, 0.6, 0.6);
+    cairo_paint(cr);
+
+    long pages = num_pages();
+    if (0 == pages) {
+        return FALSE;
+    }
+
+    int  stride     = page_stride(view->scale);
+    int  width      = page_width(view->scale);
+    int  height     = page_height(view->scale);
+    long first_page = MAX(0, floor((y1 - PREVIEW_PAGE_GAP) / stride));
+    long last_page  = MIN(pages - 1, floor((y2 - PREVIEW_PAGE_GAP) / stride));
+    int  first_col  = MAX(0, floor((x1 - PREVIEW_PAGE_GAP) / PREVIEW_TILE_SIZE));
+    int  last_col   = MIN((width - 1) / PREVIEW_TILE_SIZE,
+                        floor((x2 - PREVIEW_PAGE_GAP) / PREVIEW_TILE_SIZE));
+
+    for (long page = first_page; page <= last_page; page++) {
+        int      top       = PREVIEW_PAGE_GAP + page * stride;
+        uint64_t hash      = page_hash(page);
+        int      first_row = MAX(0, floor((y1 - top) / PREVIEW_TILE_SIZE));
+        int      last_row =
+            MIN((height - 1) / PREVIEW_TILE_SIZE, floor((y2 - top) / PREVIEW_TILE_SIZE));
+
+        for (int row = first_row; row <= last_row; row++) {
+            for (int col = first_col; col <= last_col; col++) {
+                TileKey key = { page, zoom_key(view->scale), col, row };
+                Tile *  tile = g_hash_table_lookup(tiles, &key);
+                int     x    = PREVIEW_PAGE_GAP + col * PREVIEW_TILE_SIZE;
+                int     y    = top + row * PREVIEW_TILE_SIZE;
+
+                if (NULL != tile) {
+                    g_queue_unlink(&tile_lru, tile->lru);
+                    g_queue_push_head_link(&tile_lru, tile->lru);
+                    cairo_set_source_surface(cr, tile->surface, x, y);
+                } else {
+                    cairo_set_source_rgb(cr, 1, 1, 1);
+                }
+                cairo_rectangle(cr,
+                                x,
+                                y,
+                                MIN(PREVIEW_TILE_SIZE, width - col * PREVIEW_TILE_SIZE),
+                                MIN(PREVIEW_TILE_SIZE, height - row * PREVIEW_TILE_SIZE));
+                cairo_fill(cr);
+
+                if (NULL == tile || tile->hash != hash) {
+                    request_tile(&key, hash, view->scale);
+                }
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*      @brief Scroll the page view to the page whose thumbnail was clicked */
+static gboolean thumbnail_clicked(GtkWidget * widget, GdkEventButton * event, gpointer data) {
+    (void) widget;
+    (void) data;
+
+    GtkWidget * viewport = NULL != views[VIEW_PAGES].area
+                               ? gtk_widget_get_parent(views[VIEW_PAGES].area)
+                               : NULL;
+    long page = (event->y - PREVIEW_PAGE_GAP) / page_stride(views[VIEW_THUMBNAILS].scale);
+
+    if (NULL == viewport || !GTK_IS_SCROLLABLE(viewport) || page < 0 || page >= num_pages()) {
+        return GDK_EVENT_PROPAGATE;
+    }
+
+    GtkAdjustment * adjustment = gtk_scrollable_get_vadjustment(GTK_SCROLLABLE(viewport));
+    gtk_adjustment_set_value(adjustment, page * page_stride(views[VIEW_PAGES].scale));
+
+    return GDK_EVENT_STOP;
+}
+
+static void view_init(PreviewView * view, GtkWidget * area, double scale) {
+    view->area  = area;
+    view->scale = scale;
+    // Forget the area once its window is closed, until the next window's area is set
+    g_signal_connect(area, "destroy", G_CALLBACK(gtk_widget_destroyed), &view->area);
+    g_signal_connect(area, "draw", G_CALLBACK(preview_draw), view);
+    update_size(view);
+}
+
+void preview_init(GtkWidget * pages, GtkWidget * thumbnails) {
+    if (NULL == tiles) {
+        tiles       = g_hash_table_new_full(tile_key_hash, tile_key_equal, NULL, tile_free);
+        pending     = g_hash_table_new_full(tile_key_hash, tile_key_equal, g_free, g_free);
+        tile_budget = cache_budget();
+    }
+
+    view_init(&views[VIEW_PAGES],
+              pages,
+              0 != views[VIEW_PAGES].scale ? views[VIEW_PAGES].scale : PREVIEW_DEFAULT_ZOOM);
+    view_init(&views[VIEW_THUMBNAILS], thumbnails, PREVIEW_THUMBNAIL_WIDTH / PREVIEW_PAGE_WIDTH);
+
+    gtk_widget_add_events(thumbnails, GDK_BUTTON_PRESS_MASK);
+    g_signal_connect(thumbnails, "button-press-event", G_CALLBACK(thumbnail_clicked), NULL);
+}
+
+/*      @details Tiles at other zooms are left to age out of the cache. */
+void preview_set_zoom(double zoom) {
+    if (zoom <= 0 || zoom == views[VIEW_PAGES].scale) {
+        return;
+    }
+
+    views[VIEW_PAGES].scale = zoom;
+    if (NULL != views[VIEW_PAGES].area) {
+        update_size(&views[VIEW_PAGES]);
+        gtk_widget_queue_draw(views[VIEW_PAGES].area);
+    }
+}
+
+/**
+ *      @details The whole preview is redrawn only if the geometry has changed, which changes the
+ *              hash of every page.
+ */
+void preview_set_layout(const PSProperties * props, const Layout * layout) {
+    double          points = unit_points(props->units);
+    PreviewGeometry new_geometry;
+
+    memset(&new_geometry, 0, sizeof new_geometry);
+    new_geometry.lmargin      = props->lmargin * points;
+    new_geometry.tmargin      = props->tmargin * points;
+    new_geometry.padding      = props->padding * points;
+    new_geometry.bar_width    = props->bar_width * points;
+    new_geometry.bar_height   = props->bar_height * points;
+    new_geometry.fontsize     = props->fontsize * points;
+    new_geometry.column_width = props->column_width * points;
+    new_geometry.row_height   = new_geometry.bar_height + new_geometry.fontsize
+                              + 2 * new_geometry.padding;
+    new_geometry.rows         = layout->rows;
+    new_geometry.cols         = layout->cols;
+
+    if (0 == memcmp(&new_geometry, &geometry, sizeof geometry)) {
+        return;
+    }
+    geometry      = new_geometry;
+    geometry_hash = hash_bytes(FNV_OFFSET, &geometry, sizeof geometry);
+
+    update_sizes();
+    queue_draw_all();
+}
+
+void preview_set_num_items(int new_num_items) {
+    long previous_labels = num_labels;
+
+    if (new_num_items < num_items) {
+        for (int i = new_num_items; i < num_items; i++) {
+            g_free(items[i].barcode);
+        }
+        num_items = new_num_items;
+        relabel(num_items);
+        redraw_all_labels(num_labels, previous_labels);
+        update_sizes();
+    } else if (new_num_items > num_items) {
+        items = g_renew(PreviewItem, items, new_num_items);
+        memset(items + num_items, 0, sizeof *items * (new_num_items - num_items));
+        int first_new = num_items;
+        num_items     = new_num_items;
+        relabel(first_new);
+    }
+}
+
+/**
+ *      @brief Store an item's barcode and quantity, without relabelling or redrawing
+ *      @return Whether either has changed
+ */
+static bool store_item(PreviewItem * item, const char * barcode, int quantity) {
+    if (NULL == barcode || '\0' == *barcode || quantity < 0) {
+        barcode  = "";
+        quantity = 0;
+    }
+
+    bool barcode_changed = NULL == item->barcode || 0 != strcmp(item->barcode, barcode);
+    if (!barcode_changed && quantity == item->quantity) {
+        return false;
+    }
+
+    if (barcode_changed) {
+        g_free(item->barcode);
+        item->barcode = g_strdup(barcode);
+        item->hash    = hash_bytes(FNV_OFFSET, barcode, strlen(barcode));
+    }
+    item->quantity = quantity;
+
+    return true;
+}
+
+/**
+ *      @details Items are relabelled once, from the first whose quantity has changed, and the
+ *              views are resized once. The labels of every changed item - and every label after
+ *              one which has moved - are redrawn as one span, so a whole job is redrawn, and its
+ *              tiles requested, once rather than item by item. Redrawing labels changes the hash
+ *              of their pages, so only the tiles of those pages in view are rasterised again.
+ */
+void preview_set_items(int first, int count, char ** barcodes, int * quantities) {
+    long previous_labels = num_labels;
+    long redraw_from     = LONG_MAX, redraw_to = 0;
+    int  relabel_from    = -1;
+
+    for (int i = first; i < first + count; i++) {
+        PreviewItem * item              = &items[i];
+        int           previous_quantity = item->quantity;
+
+        if (!store_item(item, barcodes[i - first], quantities[i - first])) {
+            continue;
+        }
+        redraw_from = MIN(redraw_from, item->first_label);
+        redraw_to   = MAX(redraw_to, item->first_label + MAX(item->quantity, previous_quantity));
+        if (relabel_from < 0 && item->quantity != previous_quantity) {
+            relabel_from = i + 1;
+        }
+    }
+
+    if (relabel_from > 0) {
+        relabel(relabel_from);
+        update_sizes();
+        redraw_to = MAX(previous_labels, num_labels);
+    }
+    if (redraw_from < redraw_to) {
+        redraw_all_labels(redraw_from, redraw_to);
+    }
+}
+
+void preview_set_item(int index, const char * barcode, int quantity) {
+    preview_set_items(index, 1, (char **) &barcode, &quantity);
+}
+
+/**
+ *      @details Tiles still being rasterised are discarded once done.
+ */
+void preview_cleanup(void) {
+    for (int v = 0; v < NUM_VIEWS; v++) {
+        views[v].area = NULL;
+    }
+    preview_set_num_items(0);
+    g_free(items);
+    items = NULL;
+
+    if (NULL != tiles) {
+        g_hash_table_destroy(tiles);
+        g_hash_table_destroy(pending);
+        tiles   = NULL;
+        pending = NULL;
+    }
+}
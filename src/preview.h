@@ -0,0 +1,106 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file preview.h
+ *      @brief Live print preview declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      The preview draws the labels of the current job straight from their module widths (see
+ *      modules.h) with Cairo, rather than generating PostScript and rendering it. It holds a list
+ *      of items - a barcode and its quantity each - laid out one label after another, as
+ *      refresh_postscript() lays them out.
+ *
+ *      Pages are shown in two views: a zoomable page view and a strip of page thumbnails. Both are
+ *      drawn from tiles, rasterised on worker threads only once they come into view and kept in
+ *      a cache of at most PREVIEW_CACHE_ENV megabytes, least recently drawn first out. Each tile
+ *      records a hash of its page's contents, so that changing a label re-renders the tiles of its
+ *      page alone - the old tile being drawn until its replacement is ready. Items set together
+ *      with preview_set_items() are redrawn together, so loading a job invalidates tiles once.
+ */
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include "barcode.h"
+#include "gtk/gtk.h"
+
+/**
+ *      @defgroup PreviewProperties Preview properties
+ */
+/*@{*/
+// clang-format off
+// The page drawn, in points (A4)
+#define PREVIEW_PAGE_WIDTH          595.28
+#define PREVIEW_PAGE_HEIGHT         841.89
+// Space around and between pages, in pixels
+#define PREVIEW_PAGE_GAP            12
+#define PREVIEW_FONT                "monospace"
+// Changes to more labels than this redraw the rest of the preview rather than each label
+#define PREVIEW_MAX_LABEL_REDRAWS   64
+// Width and height of a tile, in pixels
+#define PREVIEW_TILE_SIZE           256
+#define PREVIEW_THUMBNAIL_WIDTH     96
+// Zoom is in pixels per point
+#define PREVIEW_DEFAULT_ZOOM        0.75
+// Tile cache size in megabytes, overriding the default
+#define PREVIEW_CACHE_ENV           "BARCODE_PREVIEW_CACHE_MB"
+#define PREVIEW_DEFAULT_CACHE_MB    256
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Draw the preview in a pair of drawing areas
+ *      @param pages The GtkDrawingArea for the page view, inside a GtkViewport
+ *      @param thumbnails The GtkDrawingArea for the page thumbnails, clicking on which scrolls the
+ *                        page view to that page
+ */
+void preview_init(GtkWidget *, GtkWidget *);
+
+/**
+ *      @brief Zoom the page view
+ *      @param zoom Pixels per point
+ */
+void preview_set_zoom(double);
+
+/**
+ *      @brief Lay the preview out with new properties
+ *      @param props The PostScript properties labels are generated with
+ *      @param layout The rows and columns of labels on each page
+ */
+void preview_set_layout(const PSProperties *, const Layout *);
+
+/**
+ *      @brief Set the number of items previewed, adding empty items or removing the last
+ *      @param num_items The new number of items
+ */
+void preview_set_num_items(int);
+
+/**
+ *      @brief Set the barcode and quantity of an item, redrawing its labels if either has changed
+ *      @param index The index of the item, less than the number set by preview_set_num_items()
+ *      @param barcode The barcode, or NULL or empty for none
+ *      @param quantity The number of labels of the barcode
+ */
+void preview_set_item(int, const char *, int);
+
+/**
+ *      @brief As preview_set_item(), for a run of items at once
+ *      @details Rather than each item moving the labels of every item after it, items are
+ *               relabelled and the views resized once for the whole run - as when a job is loaded.
+ *      @param first The index of the first item, @c first + @c count being at most the number set
+ *                   by preview_set_num_items()
+ *      @param count The number of items
+ *      @param barcodes The barcode of each item, or NULL or empty for none
+ *      @param quantities The number of labels of each barcode
+ */
+void preview_set_items(int, int, char **, int *);
+
+/*      @brief Release the items previewed and the tile cache */
+void preview_cleanup(void);
+
+#endif
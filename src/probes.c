@@ -0,0 +1,36 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file probes.c
+ *      @brief USDT probe semaphores as declared in probes.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "probes.h"
+
+#ifdef BK_HAVE_SDT
+
+#define PROBE_SEMAPHORE(name)                                                                      \
+    volatile unsigned short BK_PROBE_SEMAPHORE(name) __attribute__((section(".probes"))) = 0
+
+PROBE_SEMAPHORE(job_start);
+PROBE_SEMAPHORE(job_end);
+PROBE_SEMAPHORE(encode);
+PROBE_SEMAPHORE(page);
+PROBE_SEMAPHORE(write);
+PROBE_SEMAPHORE(print_spawn);
+PROBE_SEMAPHORE(print_reap);
+
+uint64_t bk_probe_jobs;
+
+#else
+
+// ISO C forbids an empty translation unit
+typedef int bk_probes_unused;
+
+#endif
@@ -0,0 +1,143 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file probes.h
+ *      @brief USDT (statically defined tracing) probes for perf and bpftrace
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Probes are defined with <sys/sdt.h> (systemtap-sdt-dev, systemtap-sdt-devel) where it is
+ *      available, and compiled out otherwise or when BK_NO_SDT is defined. Each probe has a
+ *      semaphore, which tools attaching to it set, and its arguments are only evaluated while it is
+ *      set - so a probe nobody is attached to costs a test of its semaphore. The provider is
+ *      "barcode":
+ *
+ *          job_start(job, labels_per_page)
+ *          job_end(job, labels, pages, bytes, duration_ns, status)
+ *          encode(job, barcode, length, quantity, duration_ns, cached)
+ *          page(job, page, labels, bytes, duration_ns)     A page laid out
+ *          write(job, page, bytes, duration_ns)            A page written to the sink
+ *          print_spawn(pid, printer, filename)
+ *          print_reap(pid, wait_status, duration_ns)
+ *
+ *      Job IDs number the jobs generated by the process from 1. Barcodes, printers and filenames
+ *      are strings; the PID is that of lp itself for synchronous prints, and otherwise that of the
+ *      process starting it.
+ */
+
+#ifndef PROBES_H
+#define PROBES_H
+
+#include <stdint.h>
+
+#if !defined(BK_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define BK_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef BK_HAVE_SDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define BK_PROBE_SEMAPHORE(name) barcode_##name##_semaphore
+
+// clang-format off
+#define BK_PROBE_DECLARE(name)                                                                     \
+    extern volatile unsigned short BK_PROBE_SEMAPHORE(name)                                        \
+        __attribute__((unused, section(".probes")))
+// clang-format on
+
+BK_PROBE_DECLARE(job_start);
+BK_PROBE_DECLARE(job_end);
+BK_PROBE_DECLARE(encode);
+BK_PROBE_DECLARE(page);
+BK_PROBE_DECLARE(write);
+BK_PROBE_DECLARE(print_spawn);
+BK_PROBE_DECLARE(print_reap);
+
+/*      @brief Jobs generated so far, numbering them for the probes */
+extern uint64_t bk_probe_jobs;
+
+#define BK_PROBE_ENABLED(name) __builtin_expect(BK_PROBE_SEMAPHORE(name), 0)
+#define BK_PROBE_JOB_ID() __atomic_add_fetch(&bk_probe_jobs, 1, __ATOMIC_RELAXED)
+
+#define BK_PROBE2(name, a, b)                                                                      \
+    do {                                                                                           \
+        if (BK_PROBE_ENABLED(name)) {                                                              \
+            STAP_PROBE2(barcode, name, a, b);                                                      \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE3(name, a, b, c)                                                                   \
+    do {                                                                                           \
+        if (BK_PROBE_ENABLED(name)) {                                                              \
+            STAP_PROBE3(barcode, name, a, b, c);                                                   \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE4(name, a, b, c, d)                                                                \
+    do {                                                                                           \
+        if (BK_PROBE_ENABLED(name)) {                                                              \
+            STAP_PROBE4(barcode, name, a, b, c, d);                                                \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE5(name, a, b, c, d, e)                                                             \
+    do {                                                                                           \
+        if (BK_PROBE_ENABLED(name)) {                                                              \
+            STAP_PROBE5(barcode, name, a, b, c, d, e);                                             \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE6(name, a, b, c, d, e, f)                                                          \
+    do {                                                                                           \
+        if (BK_PROBE_ENABLED(name)) {                                                              \
+            STAP_PROBE6(barcode, name, a, b, c, d, e, f);                                          \
+        }                                                                                          \
+    } while (0)
+
+#else
+
+#define BK_PROBE_ENABLED(name) 0
+#define BK_PROBE_JOB_ID() ((uint64_t) 0)
+
+// Arguments are still type-checked, but never evaluated
+#define BK_PROBE2(name, a, b)                                                                      \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            (void) (a), (void) (b);                                                                \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE3(name, a, b, c)                                                                   \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            (void) (a), (void) (b), (void) (c);                                                    \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE4(name, a, b, c, d)                                                                \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            (void) (a), (void) (b), (void) (c), (void) (d);                                        \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE5(name, a, b, c, d, e)                                                             \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            (void) (a), (void) (b), (void) (c), (void) (d), (void) (e);                            \
+        }                                                                                          \
+    } while (0)
+#define BK_PROBE6(name, a, b, c, d, e, f)                                                          \
+    do {                                                                                           \
+        if (0) {                                                                                   \
+            (void) (a), (void) (b), (void) (c), (void) (d), (void) (e), (void) (f);                \
+        }                                                                                          \
+    } while (0)
+
+#endif
+
+/*      @brief The time, if the named probe is enabled, for the duration it reports */
+#define BK_PROBE_CLOCK(name) (BK_PROBE_ENABLED(name) ? bk_clock_ns() : 0)
+
+#endif
@@ -0,0 +1,361 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file raster.c
+ *      @brief Rasterised PostScript generation implementations as defined in raster.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "raster.h"
+
+#include "alloc.h"
+#include "cache.h"
+#include "error.h"
+#include "metrics.h"
+#include "modules.h"
+#include "scanline.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *      @defgroup RasterPostScript Rasterised PostScript text
+ */
+/*@{*/
+// clang-format off
+#define RASTER_LINE_LEN     256
+#define RASTER_HEADER                                                                           \
+    "%%!PS-Adobe-3.0\n"                                                                         \
+    "%%%%Creator: barcode-ui\n"                                                                 \
+    "%%%%Pages: (atend)\n"                                                                      \
+    "%%%%EndComments\n"                                                                         \
+    "%%%%BeginProlog\n"                                                                         \
+    "/bk_pad %d def /bk_bar_height %d def /bk_font %d def\n"
+/* x y text row width bk_label - draws a label with its bottom left corner at (x, y), the row
+   stretched to the height of the bars */
+#define RASTER_LABEL_PROC                                                                       \
+    "/bk_label {\n"                                                                             \
+    " /bk_width exch def /bk_row exch def /bk_text exch def\n"                                  \
+    " gsave translate\n"                                                                        \
+    " gsave bk_pad bk_pad bk_font add translate bk_width bk_bar_height scale\n"                 \
+    " bk_width 1 true [bk_width 0 0 1 0 0] { bk_row } imagemask grestore\n"                     \
+    " bk_font 0 gt {\n"                                                                         \
+    "  bk_pad bk_width bk_text stringwidth pop sub 2 div add bk_pad moveto bk_text show\n"      \
+    " } if\n"                                                                                   \
+    " grestore\n"                                                                               \
+    "} bind def\n"                                                                              \
+    "%%EndProlog\n"
+// Sets up a page in device pixels
+#define RASTER_PAGE_SETUP                                                                       \
+    "%%%%Page: %ld %ld\n"                                                                       \
+    "gsave 72 %d div dup scale /%s findfont bk_font scalefont setfont\n"
+#define RASTER_PAGE_END     "grestore showpage\n"
+#define RASTER_TRAILER      "%%%%Trailer\n%%%%Pages: %ld\n%%%%EOF\n"
+// Longest run RunLengthDecode takes, literal or repeated
+#define RASTER_MAX_RUN      128
+#define RASTER_MIN_REPEAT   3
+#define RASTER_RLE_EOD      128
+// clang-format on
+/*@}*/
+
+/*      @brief Label geometry, in device pixels */
+typedef struct RasterGeometry {
+    int lmargin, tmargin, padding;
+    int module, bar_height, fontsize;
+    int column_width, row_height;
+    int page_height;
+} RasterGeometry;
+
+/*      @brief The state of one job being generated, and the first error writing it */
+typedef struct RasterWriter {
+    BKSink *       sink;
+    size_t         bytes;
+    int            status;
+    RasterGeometry geometry;
+    // Definitions of the barcodes drawn, by barcode
+    BKSymbolTable  symbols;
+    long           next_symbol;
+    // A row, and the row RunLength-encoded
+    unsigned char * row;
+    unsigned char * encoded;
+    size_t          row_size;
+} RasterWriter;
+
+static void raster_write(RasterWriter * writer, const char * data, size_t len) {
+    if (SUCCESS == writer->status) {
+        writer->status = writer->sink->write(writer->sink->ctx, data, len);
+        writer->bytes += len;
+    }
+}
+
+static void raster_printf(RasterWriter * writer, const char * format, ...) {
+    char    line[RASTER_LINE_LEN];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof line, format, args);
+    va_end(args);
+
+    if (len > 0) {
+        raster_write(writer, line, len < (int) sizeof line ? (size_t) len : sizeof line - 1);
+    }
+}
+
+/**
+ *      @brief RunLength-encode data, as RunLengthDecode decodes it
+ *      @param encoded Destination of at least @c len + @c len / RASTER_MAX_RUN + 2 bytes
+ *      @return The length of the encoded data, including its end of data marker
+ */
+static size_t rle_encode(const unsigned char * data, size_t len, unsigned char * encoded) {
+    size_t i = 0, out = 0;
+
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && run < RASTER_MAX_RUN && data[i + run] == data[i]) {
+            run++;
+        }
+
+        // Shorter repeats are copied, as a repeat between copies would cost more than it saves
+        if (run >= RASTER_MIN_REPEAT) {
+            encoded[out++] = 257 - run;
+            encoded[out++] = data[i];
+            i += run;
+        } else {
+            // Copy bytes up to the start of the next repeat
+            size_t start = i;
+            while (i < len && i - start < RASTER_MAX_RUN
+                   && !(i + 2 < len && data[i + 1] == data[i] && data[i + 2] == data[i])) {
+                i++;
+            }
+            encoded[out++] = i - start - 1;
+            memcpy(encoded + out, data + start, i - start);
+            out += i - start;
+        }
+    }
+    encoded[out++] = RASTER_RLE_EOD;
+
+    return out;
+}
+
+/*      @brief Write a barcode as a PostScript string literal */
+static void write_string(RasterWriter * writer, const char * text) {
+    raster_write(writer, "(", 1);
+    for (; '\0' != *text; text++) {
+        if ('(' == *text || ')' == *text || '\\' == *text) {
+            raster_write(writer, "\\", 1);
+        }
+        raster_write(writer, text, 1);
+    }
+    raster_write(writer, ")", 1);
+}
+
+/**
+ *      @brief Get the number of a barcode's definitions, rasterising and defining it if it has not
+ *             been
+ *      @details The row is defined as /R<n>, and the procedure drawing the label as /L<n>. Once
+ *              BK_RASTER_MAX_SYMBOLS barcodes have been defined, every definition is removed so
+ *              that the printer's memory may be reclaimed.
+ */
+static int raster_symbol(RasterWriter * writer, const char * barcode, long * symbol) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    if (bk_symbols_lookup(&writer->symbols, barcode, symbol)) {
+        return SUCCESS;
+    }
+
+    BKModules modules;
+    int       status = bk_modules_encode(barcode, strlen(barcode), &modules);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    if (writer->symbols.num_entries >= BK_RASTER_MAX_SYMBOLS) {
+        for (size_t i = 0; i < writer->symbols.num_slots; i++) {
+            if (NULL != writer->symbols.slots[i].key) {
+                long id = writer->symbols.slots[i].id;
+                raster_printf(writer, "userdict /R%ld undef userdict /L%ld undef\n", id, id);
+            }
+        }
+        bk_symbols_clear(&writer->symbols);
+    }
+
+    const RasterGeometry * geometry = &writer->geometry;
+    int                    width    = modules.num_modules * geometry->module;
+    size_t                 bytes    = (width + 7) / 8;
+    // The row is drawn a byte per pixel before being packed, more than its encoding may take
+    size_t                 needed   = BK_SCANLINE_SIZE(width);
+
+    if (needed > writer->row_size) {
+        writer->row     = bk_realloc(writer->row, needed);
+        VERIFY_NULL_BC(writer->row, needed);
+        writer->encoded = bk_realloc(writer->encoded, needed);
+        VERIFY_NULL_BC(writer->encoded, needed);
+        writer->row_size = needed;
+    }
+
+    // Set bits are painted by imagemask
+    bk_scanline_1bpp(&modules, geometry->module, writer->row);
+    size_t encoded_len = rle_encode(writer->row, bytes, writer->encoded);
+
+    *symbol = writer->next_symbol++;
+    raster_printf(writer, "/R%ld <", *symbol);
+    for (size_t i = 0; i < encoded_len; i++) {
+        char digits[2] = { hex[writer->encoded[i] >> 4], hex[writer->encoded[i] & 0xF] };
+        raster_write(writer, digits, 2);
+    }
+    raster_printf(writer, "> /RunLengthDecode filter %zu string readstring pop def\n", bytes);
+    raster_printf(writer, "/L%ld { ", *symbol);
+    write_string(writer, barcode);
+    raster_printf(writer, " R%ld %d bk_label } bind def\n", *symbol, width);
+
+    bk_symbols_insert(&writer->symbols, barcode, *symbol);
+
+    return writer->status;
+}
+
+/**
+ *      @details Labels are written as they are read, a page being ended once it is full, so memory
+ *              use is bounded by the barcodes remembered rather than the number of labels.
+ */
+// clang-format off
+int bk_generate_raster(
+    BKSource * source,
+    PSProperties * props,
+    Layout * layout,
+    int dpi,
+    BKSink * sink,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    int            per_page;
+    RasterWriter   writer;
+    RasterGeometry geometry;
+    double         points;
+    long           labels = 0, pages = 0;
+    int            on_page = 0;
+    int            status  = SUCCESS;
+
+    if (SUCCESS != bk_layout_check(layout)) {
+        return ERR_INVALID_LAYOUT;
+    } else if (dpi <= 0) {
+        return ERR_ARGUMENT;
+    }
+    per_page = layout->rows * layout->cols;
+
+    // Pixels per unit of the properties
+    if (0 == strcmp(props->units, "mm")) {
+        points = 72 / 25.4;
+    } else if (0 == strcmp(props->units, "cm")) {
+        points = 72 / 2.54;
+    } else if (0 == strcmp(props->units, "in")) {
+        points = 72;
+    } else {
+        points = 1;
+    }
+    double pixels = points * dpi / 72;
+
+    geometry.lmargin      = lround(props->lmargin * pixels);
+    geometry.tmargin      = lround(props->tmargin * pixels);
+    geometry.padding      = lround(props->padding * pixels);
+    geometry.module       = lround(props->bar_width * pixels);
+    geometry.bar_height   = lround(props->bar_height * pixels);
+    geometry.fontsize     = lround(props->fontsize * pixels);
+    geometry.column_width = lround(props->column_width * pixels);
+    geometry.row_height   = geometry.bar_height + geometry.fontsize + 2 * geometry.padding;
+    geometry.page_height  = floor(BK_RASTER_PAGE_HEIGHT * dpi / 72);
+    if (geometry.module < 1) {
+        geometry.module = 1;
+    }
+
+    memset(&writer, 0, sizeof writer);
+    writer.sink     = sink;
+    writer.geometry = geometry;
+    bk_symbols_init(&writer.symbols);
+
+    uint64_t job_start = bk_trace_begin();
+
+    raster_printf(
+        &writer, RASTER_HEADER, geometry.padding, geometry.bar_height, geometry.fontsize);
+    raster_write(&writer, RASTER_LABEL_PROC, sizeof RASTER_LABEL_PROC - 1);
+    status = writer.status;
+
+    while (SUCCESS == status) {
+        const char * barcode;
+        int          quantity;
+        long         symbol;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        } else if (quantity <= 0) {
+            continue;
+        }
+
+        status = raster_symbol(&writer, barcode, &symbol);
+
+        for (int copy = 0; copy < quantity && SUCCESS == status; copy++) {
+            int column = on_page % layout->cols;
+            int row    = on_page / layout->cols;
+
+            if (0 == on_page) {
+                raster_printf(
+                    &writer, RASTER_PAGE_SETUP, pages + 1, pages + 1, dpi, BK_RASTER_FONT);
+            }
+            raster_printf(&writer,
+                          "%d %d L%ld\n",
+                          geometry.lmargin + column * geometry.column_width,
+                          geometry.page_height - geometry.tmargin
+                              - (row + 1) * geometry.row_height,
+                          symbol);
+            labels++;
+
+            if (++on_page == per_page) {
+                raster_write(&writer, RASTER_PAGE_END, sizeof RASTER_PAGE_END - 1);
+                pages++;
+                on_page = 0;
+            }
+            status = writer.status;
+        }
+    }
+
+    // Final, partially filled page
+    if (SUCCESS == status && on_page > 0) {
+        raster_write(&writer, RASTER_PAGE_END, sizeof RASTER_PAGE_END - 1);
+        pages++;
+    }
+    if (SUCCESS == status) {
+        raster_printf(&writer, RASTER_TRAILER, pages);
+        status = writer.status;
+    }
+
+    if (NULL != stats) {
+        stats->labels = labels;
+        stats->pages  = pages;
+        stats->bytes  = writer.bytes;
+    }
+
+    bk_metrics_observe(BK_METRIC_JOB_SECONDS, bk_trace_end(BK_TRACE_RASTER, job_start));
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_JOBS : BK_METRIC_JOB_FAILURES, 1);
+    bk_metrics_add(BK_METRIC_LABELS, labels);
+    bk_metrics_add(BK_METRIC_PAGES, pages);
+    bk_metrics_add(BK_METRIC_BYTES, writer.bytes);
+
+    bk_symbols_free(&writer.symbols);
+    bk_free(writer.row);
+    bk_free(writer.encoded);
+
+    return status;
+}
@@ -0,0 +1,60 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file raster.h
+ *      @brief Rasterised PostScript generation declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      PostScript for printers which are slow to fill the many rectangles of vector barcodes.
+ *      Each distinct barcode is rasterised once at the printer's resolution, from its module
+ *      widths (see modules.h), as a single row of a 1-bit bitmap - every row of a barcode being
+ *      the same - which @c imagemask stretches to the height of the bars. The row is defined,
+ *      RunLength-encoded, with a procedure drawing the label, and each label is a call of that
+ *      procedure.
+ *
+ *      Pages are drawn in device pixels at the given resolution, so bars and labels are snapped
+ *      to whole pixels.
+ */
+
+#ifndef RASTER_H
+#define RASTER_H
+
+#include "backend.h"
+#include "barcode.h"
+
+/**
+ *      @defgroup RasterProperties Rasterised PostScript properties
+ */
+/*@{*/
+// clang-format off
+// The page, in points (A4)
+#define BK_RASTER_PAGE_WIDTH        595.28
+#define BK_RASTER_PAGE_HEIGHT       841.89
+#define BK_RASTER_FONT              "Courier"
+// Barcodes whose definitions are kept on the printer - beyond this they are undefined
+#define BK_RASTER_MAX_SYMBOLS       1024
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Generates rasterised PostScript from a stream of barcodes, one page at a time
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties to be used when generating the PostScript
+ *      @param layout The arrangement of rows and columns of a single page
+ *      @param dpi The resolution of the printer
+ *      @param sink The destination for the generated PostScript
+ *      @param stats Destination for a summary of the generated output, or NULL
+ *      @return SUCCESS, ERR_INVALID_LAYOUT, ERR_ARGUMENT, ERR_DATA_LENGTH, ERR_CHAR_INVALID, or any
+ *              error returned by @c source or @c sink
+ */
+// clang-format off
+int bk_generate_raster(
+    BKSource *, PSProperties *, Layout *, int, BKSink *, BKGenerateStats *);
+// clang-format on
+
+#endif
@@ -0,0 +1,512 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file ring.c
+ *      @brief Shared memory job ring implementations as defined in ring.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "ring.h"
+
+#include "backend.h"
+#include "error.h"
+#include "metrics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_ALIGNED(n) (((n) + BK_RING_ALIGN - 1) & ~(uint64_t)(BK_RING_ALIGN - 1))
+
+static volatile sig_atomic_t ring_stop;
+
+static void ring_signal(int sig) {
+    (void) sig;
+    ring_stop = 1;
+}
+
+/*      @brief Sleep while @c *word is @c expected, or until interrupted by a signal */
+static void ring_futex_wait(uint32_t * word, uint32_t expected) {
+    syscall(SYS_futex, word, FUTEX_WAIT, expected, NULL, NULL, 0);
+}
+
+static void ring_futex_wake(uint32_t * word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/*      @brief Pause briefly between polls of the other side's count */
+static inline void ring_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static int ring_map(BKRing * ring, int fd, size_t len) {
+    void * map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (MAP_FAILED == map) {
+        fprintf(stderr, "ERROR: could not map ring %s: %s\n", ring->name, strerror(errno));
+        return ERR_RING;
+    }
+
+    ring->header  = map;
+    ring->data    = (char *) map + BK_RING_HEADER_SIZE;
+    ring->map_len = len;
+
+    return SUCCESS;
+}
+
+int bk_ring_create(BKRing * ring, const char * name, size_t capacity) {
+    memset(ring, 0, sizeof *ring);
+    strncpy(ring->name, name, sizeof ring->name - 1);
+
+    if (capacity < BK_RING_HEADER_SIZE || 0 != (capacity & (capacity - 1))) {
+        fprintf(stderr, "ERROR: ring size must be a power of two of at least %d\n",
+                BK_RING_HEADER_SIZE);
+        return ERR_RING;
+    }
+
+    shm_unlink(name);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (-1 == fd) {
+        fprintf(stderr, "ERROR: could not create ring %s: %s\n", name, strerror(errno));
+        return ERR_RING;
+    }
+
+    size_t len = BK_RING_HEADER_SIZE + capacity;
+    if (-1 == ftruncate(fd, len)) {
+        close(fd);
+        shm_unlink(name);
+        return ERR_RING;
+    }
+
+    int status = ring_map(ring, fd, len);
+    if (SUCCESS != status) {
+        shm_unlink(name);
+        return status;
+    }
+    ring->owner = true;
+
+    // The new object is zero-filled, so only the identifying fields need setting
+    ring->header->version  = BK_RING_VERSION;
+    ring->header->capacity = capacity;
+    // Written last, so that a producer attaching early does not see a partial header
+    __atomic_store_n(&ring->header->magic, BK_RING_MAGIC, __ATOMIC_RELEASE);
+
+    return SUCCESS;
+}
+
+int bk_ring_attach(BKRing * ring, const char * name) {
+    struct stat st;
+
+    memset(ring, 0, sizeof *ring);
+    strncpy(ring->name, name, sizeof ring->name - 1);
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (-1 == fd) {
+        fprintf(stderr, "ERROR: could not open ring %s: %s\n", name, strerror(errno));
+        return ERR_RING;
+    }
+
+    if (-1 == fstat(fd, &st) || (size_t) st.st_size < BK_RING_HEADER_SIZE) {
+        close(fd);
+        return ERR_RING;
+    }
+
+    int status = ring_map(ring, fd, st.st_size);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    if (BK_RING_MAGIC != __atomic_load_n(&ring->header->magic, __ATOMIC_ACQUIRE)
+        || BK_RING_VERSION != ring->header->version
+        || ring->header->capacity + BK_RING_HEADER_SIZE != ring->map_len) {
+        fprintf(stderr, "ERROR: %s is not a compatible ring\n", name);
+        bk_ring_close(ring);
+        return ERR_RING;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ *      @details Reserves @c len contiguous bytes at the head, writing a BK_RING_PAD record first if
+ *              the record would otherwise wrap. Returns the offset of the reserved space, and the
+ *              total bytes to publish (including any padding) in @c total.
+ */
+static int ring_reserve(BKRing * ring, uint64_t len, uint64_t * offset, uint64_t * total) {
+    BKRingHeader * header   = ring->header;
+    uint64_t       capacity = header->capacity;
+    uint64_t       head     = header->head;
+    uint64_t       pos      = head & (capacity - 1);
+    uint64_t       pad      = capacity - pos < len ? capacity - pos : 0;
+
+    if (pad + len > capacity) {
+        return ERR_RING;
+    }
+
+    /* Backpressure: wait for the consumer to free enough space. The tail last read is at most
+       the current one, so while it leaves room the consumer's cache line need not be read. */
+    for (int spins = 0; capacity - (head - ring->peer) < pad + len; spins++) {
+        ring->peer = __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE);
+        if (capacity - (head - ring->peer) >= pad + len) {
+            break;
+        } else if (spins < BK_RING_SPIN) {
+            ring_relax();
+            continue;
+        }
+
+        uint32_t seq = __atomic_load_n(&header->space_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&header->producer_waiting, 1, __ATOMIC_SEQ_CST);
+        ring->peer = __atomic_load_n(&header->tail, __ATOMIC_SEQ_CST);
+        if (capacity - (head - ring->peer) < pad + len) {
+            ring_futex_wait(&header->space_seq, seq);
+        }
+        __atomic_store_n(&header->producer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    if (pad > 0) {
+        BKRingRecord record = { BK_RING_PAD, 0, 0 };
+        memcpy(ring->data + pos, &record, sizeof record);
+    }
+
+    *offset = (pos + pad) & (capacity - 1);
+    *total  = pad + len;
+
+    return SUCCESS;
+}
+
+static void ring_publish(BKRing * ring, uint64_t total) {
+    BKRingHeader * header = ring->header;
+
+    __atomic_store_n(&header->head, header->head + total, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->data_seq, 1, __ATOMIC_SEQ_CST);
+    // Clearing the flag means only the first record published while the consumer sleeps wakes it
+    if (__atomic_exchange_n(&header->consumer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        ring_futex_wake(&header->data_seq);
+    }
+}
+
+int bk_ring_push(BKRing * ring, const char * barcode, size_t len, int quantity) {
+    uint64_t offset, total;
+
+    if (len > BK_RING_MAX_CODE || quantity <= 0) {
+        return ERR_RING;
+    }
+
+    int status = ring_reserve(ring, RING_ALIGNED(sizeof(BKRingRecord) + len + 1), &offset, &total);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    BKRingRecord record = { BK_RING_LABEL, (uint16_t) len, quantity };
+    char *       dest   = ring->data + offset;
+    memcpy(dest, &record, sizeof record);
+    memcpy(dest + sizeof record, barcode, len);
+    dest[sizeof record + len] = '\0';
+
+    ring_publish(ring, total);
+
+    return SUCCESS;
+}
+
+int bk_ring_end_job(BKRing * ring) {
+    uint64_t offset, total;
+
+    int status = ring_reserve(ring, sizeof(BKRingRecord), &offset, &total);
+    if (SUCCESS != status) {
+        return status;
+    }
+
+    BKRingRecord record = { BK_RING_JOB_END, 0, 0 };
+    memcpy(ring->data + offset, &record, sizeof record);
+
+    ring_publish(ring, total);
+
+    return SUCCESS;
+}
+
+/*      @brief Free the record last returned by bk_ring_next(), along with @c extra further bytes */
+static void ring_release(BKRing * ring, uint64_t extra) {
+    BKRingHeader * header = ring->header;
+    uint64_t       len    = ring->held + extra;
+
+    if (0 == len) {
+        return;
+    }
+    ring->held = 0;
+
+    __atomic_store_n(&header->tail, header->tail + len, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&header->space_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_exchange_n(&header->producer_waiting, 0, __ATOMIC_SEQ_CST)) {
+        ring_futex_wake(&header->space_seq);
+    }
+}
+
+/**
+ *      @details Records up to the head last read are known to have been published, so the
+ *              producer's count is only read once they have all been consumed. It is then polled
+ *              up to BK_RING_SPIN times, after which the consumer sleeps until the producer
+ *              publishes a record or a signal arrives, so an idle ring costs no CPU.
+ */
+int bk_ring_wait(BKRing * ring) {
+    BKRingHeader * header = ring->header;
+
+    for (int spins = 0; ring->peer == header->tail; spins++) {
+        ring->peer = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE);
+        if (ring->peer != header->tail) {
+            break;
+        } else if (NULL != ring->stop && *ring->stop) {
+            return ERR_RING;
+        } else if (spins < BK_RING_SPIN) {
+            ring_relax();
+            continue;
+        }
+
+        uint32_t seq = __atomic_load_n(&header->data_seq, __ATOMIC_ACQUIRE);
+        __atomic_store_n(&header->consumer_waiting, 1, __ATOMIC_SEQ_CST);
+        ring->peer = __atomic_load_n(&header->head, __ATOMIC_SEQ_CST);
+        if (ring->peer == header->tail) {
+            ring_futex_wait(&header->data_seq, seq);
+        }
+        __atomic_store_n(&header->consumer_waiting, 0, __ATOMIC_RELAXED);
+    }
+
+    return SUCCESS;
+}
+
+int bk_ring_next(void * ctx, const char ** barcode, int * quantity) {
+    BKRing * ring     = ctx;
+    uint64_t capacity = ring->header->capacity;
+
+    ring_release(ring, 0);
+
+    for (;;) {
+        if (SUCCESS != bk_ring_wait(ring)) {
+            return ERR_RING;
+        }
+
+        uint64_t     pos       = ring->header->tail & (capacity - 1);
+        uint64_t     published = ring->peer - ring->header->tail;
+        uint64_t     extent;
+        BKRingRecord record;
+        memcpy(&record, ring->data + pos, sizeof record);
+
+        // The producer is not trusted: each record must lie within what it has published
+        switch (record.type) {
+            case BK_RING_PAD:
+                if (capacity - pos > published) {
+                    break;
+                }
+                ring_release(ring, capacity - pos);
+                continue;
+            case BK_RING_JOB_END:
+                ring_release(ring, sizeof record);
+                ring->job_ended = true;
+                return BK_SOURCE_END;
+            case BK_RING_LABEL:
+                extent = RING_ALIGNED(sizeof record + record.length + 1);
+                if (record.length > BK_RING_MAX_CODE || record.quantity <= 0
+                    || pos + extent > capacity || extent > published
+                    || '\0' != ring->data[pos + sizeof record + record.length]) {
+                    break;
+                }
+                *barcode   = ring->data + pos + sizeof record;
+                *quantity  = record.quantity;
+                ring->held = extent;
+                return SUCCESS;
+        }
+
+        fprintf(stderr, "ERROR: invalid record in ring %s\n", ring->name);
+        return ERR_RING;
+    }
+}
+
+int bk_ring_skip_job(BKRing * ring) {
+    const char * barcode;
+    int          quantity;
+    int          status;
+
+    if (ring->job_ended) {
+        return SUCCESS;
+    }
+    while (SUCCESS == (status = bk_ring_next(ring, &barcode, &quantity))) {
+    }
+
+    return BK_SOURCE_END == status ? SUCCESS : status;
+}
+
+void bk_ring_close(BKRing * ring) {
+    if (NULL != ring->header) {
+        munmap(ring->header, ring->map_len);
+    }
+    if (ring->owner) {
+        shm_unlink(ring->name);
+    }
+    memset(ring, 0, sizeof *ring);
+}
+
+/**
+ *      @details Each job is generated as its records arrive, so generation overlaps the producer
+ *              writing the rest of the job, and the ring need only hold part of a job at once.
+ *              Jobs use the default properties and layout.
+ */
+int bk_ring_serve(const BKRingOptions * options) {
+    BKRing            ring;
+    BKGenerateContext context;
+    PSProperties      props = PS_DEFAULT_PROPS;
+    Layout            layout;
+    FILE *            ps_file;
+    char              ps_path[BK_TEMPFILE_TEMPLATE_SIZE];
+    int               status;
+
+    layout.cols = BK_DEFAULT_COLS;
+    layout.rows = BK_DEFAULT_ROWS;
+
+    size_t size = options->size ? options->size : BK_RING_DEFAULT_SIZE;
+    status      = bk_ring_create(&ring, options->name, size);
+    if (SUCCESS != status) {
+        return status;
+    }
+    ring.stop = &ring_stop;
+
+    status = bk_tempfile_open(ps_path, &ps_file);
+    if (SUCCESS != status) {
+        bk_ring_close(&ring);
+        return ERR_RING;
+    }
+
+    // Without SA_RESTART, so that a futex wait is interrupted
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = ring_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    bk_context_init(&context);
+
+    printf("Reading jobs from ring %s\n", options->name);
+    fflush(stdout);
+
+    while (SUCCESS == bk_ring_wait(&ring)) {
+        BKGenerateStats stats                 = { 0, 0, 0 };
+        char            job_id[BK_JOB_ID_LEN] = "-";
+        BKSource        source                = { bk_ring_next, &ring };
+        BKSink          sink                  = { bk_file_write, NULL };
+        uint64_t        start                 = bk_clock_ns();
+
+        ring.job_ended = false;
+        if (NULL == freopen(ps_path, "w", ps_file)) {
+            status = ERR_FILE_RESET_FAILED;
+            break;
+        }
+        sink.ctx = ps_file;
+
+        status = bk_generate_context(&source, &props, &layout, &sink, &context, &stats);
+        if (ERR_RING == status) {
+            break;
+        } else if (SUCCESS != status) {
+            // The job's remaining records must still be consumed
+            if (SUCCESS != bk_ring_skip_job(&ring)) {
+                break;
+            }
+        } else if (0 != fflush(ps_file)) {
+            status = ERR_FLUSH;
+        }
+
+        if (SUCCESS == status && NULL != options->printer && stats.labels > 0) {
+            status = bk_print_sync(ps_path, (char *) options->printer, job_id, BK_JOB_ID_LEN);
+        }
+
+        if (SUCCESS == status) {
+            printf("Printed %ld labels on %ld pages (job %s) in %.1f ms\n",
+                   stats.labels,
+                   stats.pages,
+                   job_id[0] ? job_id : "-",
+                   (bk_clock_ns() - start) / 1e6);
+        } else {
+            fprintf(stderr, "ERROR: could not print job from ring: error %d\n", status);
+        }
+        fflush(stdout);
+
+        bk_metrics_gauge_set(BK_METRIC_RING_BACKLOG,
+                             __atomic_load_n(&ring.header->head, __ATOMIC_ACQUIRE)
+                                 - ring.header->tail);
+
+        status = SUCCESS;
+    }
+
+    bk_context_free(&context);
+    fclose(ps_file);
+    remove(ps_path);
+    bk_ring_close(&ring);
+
+    // Being stopped while waiting for a job is the normal way out
+    return ring_stop && ERR_RING == status ? SUCCESS : status;
+}
+
+#else
+
+int bk_ring_create(BKRing * ring, const char * name, size_t capacity) {
+    (void) ring, (void) name, (void) capacity;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_attach(BKRing * ring, const char * name) {
+    (void) ring, (void) name;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_push(BKRing * ring, const char * barcode, size_t len, int quantity) {
+    (void) ring, (void) barcode, (void) len, (void) quantity;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_end_job(BKRing * ring) {
+    (void) ring;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_wait(BKRing * ring) {
+    (void) ring;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_next(void * ctx, const char ** barcode, int * quantity) {
+    (void) ctx, (void) barcode, (void) quantity;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_ring_skip_job(BKRing * ring) {
+    (void) ring;
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+void bk_ring_close(BKRing * ring) {
+    (void) ring;
+}
+
+int bk_ring_serve(const BKRingOptions * options) {
+    (void) options;
+    fprintf(stderr, "ERROR: shared memory rings are only supported on Linux\n");
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+#endif
@@ -0,0 +1,184 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file ring.h
+ *      @brief Shared memory job ring declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      A ring is a POSIX shared memory object holding a BKRingHeader in its first
+ *      BK_RING_HEADER_SIZE bytes, followed by @c capacity bytes of records. Exactly one producer
+ *      process appends records and exactly one consumer reads them.
+ *
+ *      Every record starts with a BKRingRecord and is padded to a multiple of BK_RING_ALIGN bytes:
+ *
+ *          BK_RING_LABEL   @c length bytes of barcode text, then a null terminator. @c quantity
+ *                          copies of the barcode are printed.
+ *          BK_RING_JOB_END Ends the current job; @c length and @c quantity are 0.
+ *          BK_RING_PAD     Fills the rest of the buffer, so that no record wraps around its end.
+ *                          The next record starts at offset 0.
+ *
+ *      @c head and @c tail are byte counts which only ever increase; a position in the buffer is
+ *      the count modulo @c capacity. The producer publishes records by advancing @c head, and the
+ *      consumer frees them by advancing @c tail. A producer finding too little free space, or a
+ *      consumer finding no records, first polls the other side's count up to BK_RING_SPIN times,
+ *      then sleeps on a futex (@c space_seq or @c data_seq respectively) after setting its waiting
+ *      flag, and is woken by the other side advancing its count. Each side keeps the other's count
+ *      as it last read it, and only reads it again once that shows no room or no records, so that
+ *      a busy ring does not pass the counts' cache lines back and forth for every record.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ *      @defgroup RingProperties Shared memory ring properties
+ */
+/*@{*/
+// clang-format off
+#define BK_RING_MAGIC           0x474E5242  // "BRNG"
+#define BK_RING_VERSION         1
+#define BK_RING_HEADER_SIZE     4096
+#define BK_RING_DEFAULT_SIZE    (4 * 1024 * 1024)
+#define BK_RING_ALIGN           8
+// Longest barcode text accepted in a record
+#define BK_RING_MAX_CODE        4096
+// Polls of the other side's count before sleeping, so that a side which has only caught up
+// briefly is not put to sleep and woken for every record
+#define BK_RING_SPIN            4000
+
+#define BK_RING_LABEL           1
+#define BK_RING_JOB_END         2
+#define BK_RING_PAD             3
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief The header of a ring's shared memory
+ *      @details Producer and consumer fields are kept on separate cache lines.
+ */
+typedef struct BKRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+
+    _Alignas(64) uint64_t head;
+    uint32_t data_seq;
+    uint32_t consumer_waiting;
+
+    _Alignas(64) uint64_t tail;
+    uint32_t space_seq;
+    uint32_t producer_waiting;
+} BKRingHeader;
+
+/*      @brief The header of a record */
+typedef struct BKRingRecord {
+    uint16_t type;
+    uint16_t length;
+    int32_t  quantity;
+} BKRingRecord;
+
+/**
+ *      @brief One side's mapping of a ring
+ *      @details @c stop may point to a flag set by a signal handler; a consumer waiting for
+ *              records returns ERR_RING once it is set. @c peer is the other side's count as this
+ *              side last read it: @c tail for the producer, @c head for the consumer. @c job_ended
+ *              is set once the consumer has read the end of the current job.
+ */
+typedef struct BKRing {
+    BKRingHeader *                 header;
+    char *                         data;
+    size_t                         map_len;
+    uint64_t                       held;
+    uint64_t                       peer;
+    bool                           owner;
+    bool                           job_ended;
+    char                           name[256];
+    const volatile sig_atomic_t * stop;
+} BKRing;
+
+/**
+ *      @brief Options for consuming jobs from a ring
+ *      @details @c printer may be NULL, in which case jobs are generated but not printed. @c size
+ *               of 0 selects BK_RING_DEFAULT_SIZE.
+ */
+typedef struct BKRingOptions {
+    const char * name;
+    const char * printer;
+    size_t       size;
+} BKRingOptions;
+
+/**
+ *      @brief Create a ring as its consumer, replacing any ring of the same name
+ *      @param ring The ring to initialise
+ *      @param name Name of the shared memory object, beginning with '/'
+ *      @param capacity Size of the record buffer - a power of two
+ *      @return SUCCESS, ERR_RING, ERR_UNSUPPORTED_PLATFORM
+ */
+int bk_ring_create(BKRing *, const char *, size_t);
+
+/**
+ *      @brief Attach to a ring created by its consumer, as its producer
+ *      @return SUCCESS, ERR_RING, ERR_UNSUPPORTED_PLATFORM
+ */
+int bk_ring_attach(BKRing *, const char *);
+
+/**
+ *      @brief Append a label to the current job, waiting while the ring is full
+ *      @param ring An attached ring
+ *      @param barcode The barcode text - need not be null-terminated
+ *      @param len Length of @c barcode, at most BK_RING_MAX_CODE
+ *      @param quantity Number of copies to print - at least 1
+ *      @return SUCCESS, ERR_RING
+ */
+int bk_ring_push(BKRing *, const char *, size_t, int);
+
+/**
+ *      @brief End the current job, waiting while the ring is full
+ *      @return SUCCESS, ERR_RING
+ */
+int bk_ring_end_job(BKRing *);
+
+/**
+ *      @brief Wait until a record is available to the consumer
+ *      @return SUCCESS, or ERR_RING if stopped while waiting
+ */
+int bk_ring_wait(BKRing *);
+
+/**
+ *      @brief BKSource callback reading the labels of one job from a ring, as its consumer
+ *      @details Barcodes are returned in place in shared memory, and each record is freed when the
+ *               next is read. Returns BK_SOURCE_END at the end of the job, and waits for further
+ *               records until then.
+ */
+int bk_ring_next(void *, const char **, int *);
+
+/**
+ *      @brief Discard the remaining records of the current job, as its consumer
+ *      @details Does nothing if the end of the job has already been read.
+ *      @return SUCCESS, ERR_RING
+ */
+int bk_ring_skip_job(BKRing *);
+
+/**
+ *      @brief Unmap a ring, and remove it if this side created it
+ */
+void bk_ring_close(BKRing *);
+
+/**
+ *      @brief Create a ring and generate (and print) each job written to it, until interrupted
+ *      @param options The ring name, printer and size
+ *      @return SUCCESS, ERR_RING, ERR_UNSUPPORTED_PLATFORM
+ */
+int bk_ring_serve(const BKRingOptions *);
+
+#endif
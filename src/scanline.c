@@ -0,0 +1,313 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file scanline.c
+ *      @brief Barcode scanline rasterisation implementations as defined in scanline.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "scanline.h"
+
+#include "error.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BK_SCANLINE_HAVE_SSE2
+#endif
+
+// AVX2 is compiled for its own functions only, and used once the processor is known to have it
+#if defined(BK_SCANLINE_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))                   \
+    && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define BK_SCANLINE_HAVE_AVX2
+#define SCANLINE_AVX2 __attribute__((target("avx2")))
+#endif
+
+#ifdef _MSC_VER
+#define SCANLINE_LOAD(ptr) InterlockedCompareExchange((volatile LONG *) (ptr), 0, 0)
+#define SCANLINE_STORE(ptr, value) InterlockedExchange((volatile LONG *) (ptr), (value))
+#else
+#define SCANLINE_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define SCANLINE_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#endif
+
+// The instruction set in use, or -1 until first used
+static long scanline_isa = -1;
+
+/*      @brief Fill a scanline with its bars and spaces, returning its length in pixels */
+typedef int (*ScanlineExpand)(
+    const BKModules *, int, unsigned char, unsigned char, unsigned char *);
+/*      @brief Pack a scanline of BK_SCANLINE_INK and BK_SCANLINE_PAPER bytes to bits, in place */
+typedef void (*ScanlinePack)(unsigned char *, int);
+
+// clang-format off
+static int expand_scalar(
+    const BKModules * modules,
+    int module,
+    unsigned char ink,
+    unsigned char paper,
+    unsigned char * row
+) {
+    // clang-format on
+    int x = 0;
+
+    for (int e = 0; e < modules->num_elements; e++) {
+        int element = modules->widths[e] * module;
+        // Elements alternate between bars and spaces
+        memset(row + x, 0 == e % 2 ? ink : paper, element);
+        x += element;
+    }
+    // Pixels packed into the last byte
+    memset(row + x, paper, 7);
+
+    return x;
+}
+
+static void pack_scalar(unsigned char * row, int pixels) {
+    for (int i = 0; i < pixels; i += 8) {
+        unsigned char byte = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            byte = (byte << 1) | (row[i + bit] >> 7);
+        }
+        row[i / 8] = byte;
+    }
+}
+
+#ifdef BK_SCANLINE_HAVE_SSE2
+// clang-format off
+static int expand_sse2(
+    const BKModules * modules,
+    int module,
+    unsigned char ink,
+    unsigned char paper,
+    unsigned char * row
+) {
+    // clang-format on
+    const __m128i v_ink   = _mm_set1_epi8((char) ink);
+    const __m128i v_paper = _mm_set1_epi8((char) paper);
+    int           x       = 0;
+
+    for (int e = 0; e < modules->num_elements; e++) {
+        int     element = modules->widths[e] * module;
+        __m128i value   = 0 == e % 2 ? v_ink : v_paper;
+        // The last store may run past the element, into the next
+        for (int i = 0; i < element; i += 16) {
+            _mm_storeu_si128((__m128i *) (row + x + i), value);
+        }
+        x += element;
+    }
+    _mm_storeu_si128((__m128i *) (row + x), v_paper);
+
+    return x;
+}
+
+static void pack_sse2(unsigned char * row, int pixels) {
+    for (int i = 0; i < pixels; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *) (row + i));
+        // Reverse each group of 8 bytes, so that the first pixel is the most significant bit
+        chunk = _mm_or_si128(_mm_slli_epi16(chunk, 8), _mm_srli_epi16(chunk, 8));
+        chunk = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chunk, 0x1B), 0x1B);
+
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(chunk);
+        row[i / 8]        = mask & 0xFF;
+        row[i / 8 + 1]    = mask >> 8;
+    }
+}
+#endif
+
+#ifdef BK_SCANLINE_HAVE_AVX2
+// clang-format off
+SCANLINE_AVX2 static int expand_avx2(
+    const BKModules * modules,
+    int module,
+    unsigned char ink,
+    unsigned char paper,
+    unsigned char * row
+) {
+    // clang-format on
+    const __m256i v_ink   = _mm256_set1_epi8((char) ink);
+    const __m256i v_paper = _mm256_set1_epi8((char) paper);
+    int           x       = 0;
+
+    for (int e = 0; e < modules->num_elements; e++) {
+        int     element = modules->widths[e] * module;
+        __m256i value   = 0 == e % 2 ? v_ink : v_paper;
+        // The last store may run past the element, into the next
+        for (int i = 0; i < element; i += 32) {
+            _mm256_storeu_si256((__m256i *) (row + x + i), value);
+        }
+        x += element;
+    }
+    _mm256_storeu_si256((__m256i *) (row + x), v_paper);
+
+    return x;
+}
+
+SCANLINE_AVX2 static void pack_avx2(unsigned char * row, int pixels) {
+    // Reverses each group of 8 bytes, so that the first pixel is the most significant bit
+    const __m256i reverse = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                             7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+    for (int i = 0; i < pixels; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (row + i));
+        unsigned int mask =
+            (unsigned int) _mm256_movemask_epi8(_mm256_shuffle_epi8(chunk, reverse));
+        row[i / 8]     = mask & 0xFF;
+        row[i / 8 + 1] = (mask >> 8) & 0xFF;
+        row[i / 8 + 2] = (mask >> 16) & 0xFF;
+        row[i / 8 + 3] = mask >> 24;
+    }
+}
+#endif
+
+static const ScanlineExpand scanline_expand[] = {
+    expand_scalar,
+#ifdef BK_SCANLINE_HAVE_SSE2
+    expand_sse2,
+#else
+    NULL,
+#endif
+#ifdef BK_SCANLINE_HAVE_AVX2
+    expand_avx2,
+#else
+    NULL,
+#endif
+};
+
+static const ScanlinePack scanline_pack[] = {
+    pack_scalar,
+#ifdef BK_SCANLINE_HAVE_SSE2
+    pack_sse2,
+#else
+    NULL,
+#endif
+#ifdef BK_SCANLINE_HAVE_AVX2
+    pack_avx2,
+#else
+    NULL,
+#endif
+};
+
+static bool scanline_supported(BKScanlineIsa isa) {
+    switch (isa) {
+    case BK_SCANLINE_SCALAR:
+        return true;
+    case BK_SCANLINE_SSE2:
+        return NULL != scanline_expand[BK_SCANLINE_SSE2];
+    case BK_SCANLINE_AVX2:
+#ifdef BK_SCANLINE_HAVE_AVX2
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+/*      @brief Get the instruction set in use, choosing the best supported when first called */
+static BKScanlineIsa scanline_current(void) {
+    long isa = SCANLINE_LOAD(&scanline_isa);
+
+    // Every thread choosing at once chooses the same
+    if (isa < 0) {
+        isa = bk_scanline_best();
+        SCANLINE_STORE(&scanline_isa, isa);
+    }
+
+    return (BKScanlineIsa) isa;
+}
+
+BKScanlineIsa bk_scanline_best(void) {
+    if (scanline_supported(BK_SCANLINE_AVX2)) {
+        return BK_SCANLINE_AVX2;
+    } else if (scanline_supported(BK_SCANLINE_SSE2)) {
+        return BK_SCANLINE_SSE2;
+    }
+    return BK_SCANLINE_SCALAR;
+}
+
+int bk_scanline_use(BKScanlineIsa isa) {
+    if (!scanline_supported(isa)) {
+        return ERR_UNSUPPORTED_PLATFORM;
+    }
+    SCANLINE_STORE(&scanline_isa, (long) isa);
+    return SUCCESS;
+}
+
+const char * bk_scanline_name(BKScanlineIsa isa) {
+    switch (isa) {
+    case BK_SCANLINE_SSE2:
+        return "sse2";
+    case BK_SCANLINE_AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+// clang-format off
+int bk_scanline_8bpp(
+    const BKModules * modules,
+    int module,
+    unsigned char ink,
+    unsigned char paper,
+    unsigned char * row
+) {
+    // clang-format on
+    return scanline_expand[scanline_current()](modules, module, ink, paper, row);
+}
+
+/**
+ *      @details Packing reads eight pixels for every byte it writes, front to back, so the
+ *              scanline is packed in place.
+ */
+int bk_scanline_1bpp(const BKModules * modules, int module, unsigned char * row) {
+    BKScanlineIsa isa    = scanline_current();
+    int           pixels = scanline_expand[isa](
+        modules, module, BK_SCANLINE_INK, BK_SCANLINE_PAPER, row);
+
+    scanline_pack[isa](row, pixels);
+
+    return (pixels + 7) / 8;
+}
+
+int bk_scanline_pack(unsigned char * row, int pixels) {
+    scanline_pack[scanline_current()](row, pixels);
+    return (pixels + 7) / 8;
+}
+
+/**
+ *      @details Contiguous rows are copied in doubling blocks, so a tall image takes only a few
+ *              copies.
+ */
+void bk_scanline_replicate(unsigned char * image, size_t stride, size_t len, int rows) {
+    if (rows <= 1) {
+        return;
+    }
+
+    if (stride == len) {
+        size_t total = len * rows;
+        for (size_t done = len; done < total;) {
+            size_t copy = done < total - done ? done : total - done;
+            memcpy(image + done, image, copy);
+            done += copy;
+        }
+    } else {
+        for (int y = 1; y < rows; y++) {
+            memcpy(image + y * stride, image, len);
+        }
+    }
+}
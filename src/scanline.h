@@ -0,0 +1,116 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file scanline.h
+ *      @brief Barcode scanline rasterisation declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Every row of a barcode's bars is the same, so backends drawing barcodes as bitmaps draw a
+ *      single scanline from its module widths (see modules.h) and repeat it over the height of
+ *      the bars. Scanlines are drawn one byte per pixel by filling each bar and space with wide
+ *      stores - which may run up to BK_SCANLINE_PADDING bytes past its end, to be overwritten by
+ *      the next - and packed to one bit per pixel from those bytes.
+ *
+ *      The kernels use AVX2 or SSE2 where the processor supports them, chosen when first used,
+ *      and are otherwise plain C.
+ */
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#include "modules.h"
+
+#include <stddef.h>
+
+/**
+ *      @defgroup ScanlineProperties Scanline properties
+ */
+/*@{*/
+// clang-format off
+// Bytes a scanline may be written beyond its last pixel
+#define BK_SCANLINE_PADDING         32
+// Bytes of a scanline buffer holding a given number of pixels, at either depth
+#define BK_SCANLINE_SIZE(pixels)    ((size_t) (pixels) + BK_SCANLINE_PADDING)
+// 8-bit pixel values of bars and spaces in 1-bit scanlines, before packing
+#define BK_SCANLINE_INK             0xFF
+#define BK_SCANLINE_PAPER           0x00
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Instruction sets the kernels are written for
+ */
+typedef enum BKScanlineIsa {
+    BK_SCANLINE_SCALAR = 0,
+    BK_SCANLINE_SSE2,
+    BK_SCANLINE_AVX2,
+} BKScanlineIsa;
+
+/**
+ *      @brief Get the best instruction set the processor supports
+ */
+BKScanlineIsa bk_scanline_best(void);
+
+/**
+ *      @brief Use the kernels of an instruction set, rather than the best supported
+ *      @param isa The instruction set, applying to every thread
+ *      @return SUCCESS, ERR_UNSUPPORTED_PLATFORM if the processor does not support @c isa
+ */
+int bk_scanline_use(BKScanlineIsa);
+
+/**
+ *      @brief Get the name of an instruction set, e.g. "avx2"
+ */
+const char * bk_scanline_name(BKScanlineIsa);
+
+/**
+ *      @brief Draw a barcode's scanline, one byte per pixel
+ *      @param modules The barcode's bars and spaces
+ *      @param module The width of a module in pixels
+ *      @param ink The value of bar pixels
+ *      @param paper The value of space pixels
+ *      @param row Destination for the scanline, of at least BK_SCANLINE_SIZE(pixels) bytes
+ *      @return The number of pixels drawn, @c module for each of the barcode's modules
+ */
+// clang-format off
+int bk_scanline_8bpp(
+    const BKModules *, int, unsigned char, unsigned char, unsigned char *);
+// clang-format on
+
+/**
+ *      @brief Draw a barcode's scanline, one bit per pixel - the most significant bit of each byte
+ *             first, bars set - padded with clear bits to a whole byte
+ *      @param modules The barcode's bars and spaces
+ *      @param module The width of a module in pixels
+ *      @param row Destination for the scanline, of at least BK_SCANLINE_SIZE(pixels) bytes as it
+ *                 is drawn a byte per pixel before being packed
+ *      @return The number of bytes in the scanline
+ */
+int bk_scanline_1bpp(const BKModules *, int, unsigned char *);
+
+/**
+ *      @brief Pack a scanline drawn one byte per pixel to one bit per pixel, in place - the most
+ *             significant bit of each byte first, set for bytes of 0x80 or more
+ *      @details The BK_SCANLINE_PADDING bytes after the last pixel are read, and those up to a
+ *               whole byte are packed into the last, so they must be written first.
+ *      @param row The scanline, of at least BK_SCANLINE_SIZE(pixels) bytes
+ *      @param pixels The number of pixels in the scanline
+ *      @return The number of bytes in the packed scanline
+ */
+int bk_scanline_pack(unsigned char *, int);
+
+/**
+ *      @brief Copy the first row of an image over the rows following it
+ *      @param image The image, its first row drawn
+ *      @param stride The distance between the start of each row, in bytes
+ *      @param len The length of a row, in bytes
+ *      @param rows The number of rows in the image
+ */
+void bk_scanline_replicate(unsigned char *, size_t, size_t, int);
+
+#endif
@@ -0,0 +1,932 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file sheet.c
+ *      @brief Spreadsheet job file import implementations as defined in sheet.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "sheet.h"
+
+#include "backend.h"
+#include "error.h"
+#include "zlib.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define strncasecmp _strnicmp
+#else
+#include <strings.h>
+#endif
+
+/**
+ *      @defgroup ZipFormat Zip archive record signatures and lengths (APPNOTE.TXT)
+ */
+/*@{*/
+// clang-format off
+#define ZIP_EOCD_SIG        0x06054b50
+#define ZIP_CDIR_SIG        0x02014b50
+#define ZIP_LOCAL_SIG       0x04034b50
+#define ZIP_EOCD_LEN        22
+#define ZIP_CDIR_LEN        46
+#define ZIP_LOCAL_LEN       30
+#define ZIP_MAX_COMMENT     65535
+#define ZIP_STORED          0
+#define ZIP_DEFLATED        8
+#define ZIP_SIZE_ZIP64      0xffffffff
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief The location of a single member of a memory-mapped zip archive
+ */
+typedef struct ZipEntry {
+    const unsigned char * data;
+    size_t                compressed_len;
+    int                   method;
+} ZipEntry;
+
+/**
+ *      @brief Callbacks for the streaming XML tokenizer
+ *      @details Element names are passed without their namespace prefix. Empty elements produce
+ *              both a @c start and an @c end call. Text is passed raw (entities are not decoded),
+ *              and may be split into any number of @c text calls.
+ */
+typedef struct XMLHandler {
+    void (*start)(void *, const char *, size_t, const char *, size_t);
+    void (*end)(void *, const char *, size_t);
+    void (*text)(void *, const char *, size_t);
+    void * ctx;
+    bool   stop;
+} XMLHandler;
+
+/**
+ *      @brief Parser state shared by the xlsx and ods importers
+ */
+typedef struct SheetParser {
+    XMLHandler * handler;
+    BKJob *      job;
+    BKJob *      strings;
+    int          code_column;
+    int          quantity_column;
+    int          header;
+    int          status;
+    long         row;
+    long         rows_repeated;
+    int          column;
+    int          columns_repeated;
+    bool         in_cell;
+    bool         in_table;
+    bool         in_phonetic;
+    bool         capture;
+    bool         shared;
+    char         cell[BK_SHEET_CELL_LEN];
+    size_t       cell_len;
+    char         value[BK_SHEET_CELL_LEN];
+    size_t       value_len;
+    char         code[BK_SHEET_CELL_LEN];
+    size_t       code_len;
+    char         quantity[BK_SHEET_CELL_LEN];
+    size_t       quantity_len;
+} SheetParser;
+
+static uint32_t le16(const unsigned char * p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const unsigned char * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+ *      @details Locates the end of central directory record by scanning backwards past any archive
+ *              comment, then walks the central directory for a member named @c name (or, if
+ *              @c prefix is set, beginning with @c name). Sizes are taken from the central
+ *              directory since local headers may defer them to a data descriptor.
+ */
+static int zip_find(const BKMappedFile * zip, const char * name, bool prefix, ZipEntry * entry) {
+    const unsigned char * base = (const unsigned char *) zip->data;
+    const unsigned char * eocd = NULL;
+    size_t                name_len = strlen(name);
+
+    if (zip->len < ZIP_EOCD_LEN) {
+        return ERR_ARCHIVE;
+    }
+
+    for (size_t back = 0; back <= ZIP_MAX_COMMENT && back + ZIP_EOCD_LEN <= zip->len; back++) {
+        const unsigned char * p = base + zip->len - ZIP_EOCD_LEN - back;
+        if (ZIP_EOCD_SIG == le32(p)) {
+            eocd = p;
+            break;
+        }
+    }
+    if (NULL == eocd) {
+        return ERR_ARCHIVE;
+    }
+
+    uint32_t entries    = le16(eocd + 10);
+    uint32_t cdir_len   = le32(eocd + 12);
+    uint32_t cdir_start = le32(eocd + 16);
+    if ((size_t) cdir_start + cdir_len > zip->len) {
+        return ERR_ARCHIVE;
+    }
+
+    const unsigned char * p   = base + cdir_start;
+    const unsigned char * end = p + cdir_len;
+    for (uint32_t i = 0; i < entries; i++) {
+        if (p + ZIP_CDIR_LEN > end || ZIP_CDIR_SIG != le32(p)) {
+            return ERR_ARCHIVE;
+        }
+
+        uint32_t    method     = le16(p + 10);
+        uint32_t    compressed = le32(p + 20);
+        uint32_t    entry_len  = le16(p + 28);
+        uint32_t    extra_len  = le16(p + 30);
+        uint32_t    comment    = le16(p + 32);
+        uint32_t    local      = le32(p + 42);
+        const char * entry_name = (const char *) p + ZIP_CDIR_LEN;
+
+        if (p + ZIP_CDIR_LEN + entry_len > end) {
+            return ERR_ARCHIVE;
+        }
+
+        if ((prefix ? entry_len >= name_len : entry_len == name_len)
+            && 0 == memcmp(entry_name, name, name_len)) {
+            if (ZIP_SIZE_ZIP64 == compressed || (size_t) local + ZIP_LOCAL_LEN > zip->len) {
+                return ERR_ARCHIVE;
+            }
+
+            const unsigned char * header = base + local;
+            if (ZIP_LOCAL_SIG != le32(header)) {
+                return ERR_ARCHIVE;
+            }
+
+            size_t offset = (size_t) local + ZIP_LOCAL_LEN + le16(header + 26) + le16(header + 28);
+            if (offset + compressed > zip->len) {
+                return ERR_ARCHIVE;
+            }
+
+            entry->data           = base + offset;
+            entry->compressed_len = compressed;
+            entry->method         = method;
+            return SUCCESS;
+        }
+
+        p += ZIP_CDIR_LEN + entry_len + extra_len + comment;
+    }
+
+    return ERR_FILE_OPEN_FAILED;
+}
+
+/**
+ *      @details Tokenizes as much of @c buf as possible and returns the number of bytes consumed.
+ *              An incomplete tag at the end of the buffer is left unconsumed unless @c final is
+ *              set, in which case it is discarded. Declarations, processing instructions and
+ *              comments are skipped; character data sections are passed as text.
+ */
+static size_t xml_parse(const char * buf, size_t len, bool final, XMLHandler * h) {
+    size_t pos = 0;
+
+    while (pos < len && !h->stop) {
+        if ('<' != buf[pos]) {
+            const char * lt  = memchr(buf + pos, '<', len - pos);
+            size_t       end = lt ? (size_t)(lt - buf) : len;
+            h->text(h->ctx, buf + pos, end - pos);
+            pos = end;
+            continue;
+        }
+
+        const char * tag = buf + pos + 1;
+        size_t       rem = len - pos - 1;
+
+        if (rem >= 3 && 0 == memcmp(tag, "!--", 3)) {
+            // Comment: ends at the first "-->"
+            const char * p = tag + 3;
+            while ((p = memchr(p, '>', buf + len - p))
+                   && (p - tag < 5 || '-' != p[-1] || '-' != p[-2])) {
+                p++;
+            }
+            if (NULL == p) {
+                return final ? len : pos;
+            }
+            pos = p - buf + 1;
+            continue;
+        }
+
+        if (rem >= 8 && 0 == memcmp(tag, "![CDATA[", 8)) {
+            const char * p = tag + 8;
+            while ((p = memchr(p, '>', buf + len - p)) && (']' != p[-1] || ']' != p[-2])) {
+                p++;
+            }
+            if (NULL == p) {
+                return final ? len : pos;
+            }
+            h->text(h->ctx, tag + 8, p - 2 - (tag + 8));
+            pos = p - buf + 1;
+            continue;
+        }
+
+        const char * gt = memchr(tag, '>', rem);
+        if (NULL == gt) {
+            return final ? len : pos;
+        }
+        pos = gt - buf + 1;
+
+        if ('?' == *tag || '!' == *tag) {
+            continue;
+        }
+
+        bool closing = '/' == *tag;
+        bool empty   = !closing && gt > tag && '/' == gt[-1];
+        const char * name     = tag + closing;
+        const char * name_end = name;
+        while (name_end < gt && !isspace((unsigned char) *name_end) && '/' != *name_end) {
+            name_end++;
+        }
+
+        // Strip the namespace prefix
+        const char * colon = memchr(name, ':', name_end - name);
+        if (NULL != colon) {
+            name = colon + 1;
+        }
+
+        if (closing) {
+            h->end(h->ctx, name, name_end - name);
+        } else {
+            const char * attrs_end = empty ? gt - 1 : gt;
+            h->start(h->ctx, name, name_end - name, name_end, attrs_end - name_end);
+            if (empty && !h->stop) {
+                h->end(h->ctx, name, name_end - name);
+            }
+        }
+    }
+
+    return h->stop ? len : pos;
+}
+
+/**
+ *      @details Finds an attribute by local name (ignoring any namespace prefix) within the raw
+ *              attribute text of a tag. The value is returned undecoded.
+ */
+// clang-format off
+static bool xml_attr(
+    const char * attrs,
+    size_t len,
+    const char * name,
+    const char ** value,
+    size_t * value_len
+) {
+    // clang-format on
+
+    const char * p        = attrs;
+    const char * end      = attrs + len;
+    size_t       name_len = strlen(name);
+
+    while (p < end) {
+        while (p < end && isspace((unsigned char) *p)) {
+            p++;
+        }
+
+        const char * key = p;
+        while (p < end && '=' != *p && !isspace((unsigned char) *p)) {
+            p++;
+        }
+        const char * key_end = p;
+
+        while (p < end && ('=' == *p || isspace((unsigned char) *p))) {
+            p++;
+        }
+        if (p >= end || ('"' != *p && '\'' != *p)) {
+            return false;
+        }
+
+        char         quote = *p++;
+        const char * val   = p;
+        while (p < end && quote != *p) {
+            p++;
+        }
+
+        const char * colon = memchr(key, ':', key_end - key);
+        if (NULL != colon) {
+            key = colon + 1;
+        }
+        if ((size_t)(key_end - key) == name_len && 0 == memcmp(key, name, name_len)) {
+            *value     = val;
+            *value_len = p - val;
+            return true;
+        }
+        p++;
+    }
+
+    return false;
+}
+
+static long xml_attr_long(const char * attrs, size_t len, const char * name, long fallback) {
+    const char * value;
+    size_t       value_len;
+    long         result = 0;
+
+    if (!xml_attr(attrs, len, name, &value, &value_len) || 0 == value_len) {
+        return fallback;
+    }
+    for (size_t i = 0; i < value_len; i++) {
+        if (!isdigit((unsigned char) value[i]) || result > INT_MAX / 10) {
+            return fallback;
+        }
+        result = result * 10 + (value[i] - '0');
+    }
+    return result;
+}
+
+/**
+ *      @details Decodes the predefined XML entities and ASCII character references in place,
+ *              returning the new length. Characters outside ASCII cannot be encoded in Code-128 and
+ *              are replaced with '?', which the encoder will reject.
+ */
+static size_t xml_decode(char * s, size_t len) {
+    size_t out = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if ('&' != s[i]) {
+            s[out++] = s[i];
+            continue;
+        }
+
+        const char * semi = memchr(s + i, ';', len - i);
+        if (NULL == semi) {
+            s[out++] = s[i];
+            continue;
+        }
+
+        const char * ent     = s + i + 1;
+        size_t       ent_len = semi - ent;
+        char         c       = '?';
+
+        if (2 == ent_len && 0 == memcmp(ent, "lt", 2)) {
+            c = '<';
+        } else if (2 == ent_len && 0 == memcmp(ent, "gt", 2)) {
+            c = '>';
+        } else if (3 == ent_len && 0 == memcmp(ent, "amp", 3)) {
+            c = '&';
+        } else if (4 == ent_len && 0 == memcmp(ent, "quot", 4)) {
+            c = '"';
+        } else if (4 == ent_len && 0 == memcmp(ent, "apos", 4)) {
+            c = '\'';
+        } else if (ent_len > 1 && '#' == ent[0]) {
+            long code = 'x' == ent[1] ? strtol(ent + 2, NULL, 16) : strtol(ent + 1, NULL, 10);
+            c         = code > 0 && code < 128 ? (char) code : '?';
+        }
+
+        s[out++] = c;
+        i        = semi - s;
+    }
+
+    return out;
+}
+
+static bool name_is(const char * name, size_t len, const char * literal) {
+    return strlen(literal) == len && 0 == memcmp(name, literal, len);
+}
+
+/**
+ *      @details Cell text beyond BK_SHEET_CELL_LEN is dropped; such a cell holds neither a valid
+ *              barcode nor a quantity, and is still rejected once truncated as it remains longer
+ *              than BK_BARCODE_LENGTH.
+ */
+static void cell_append(SheetParser * p, const char * text, size_t len) {
+    if (p->cell_len + len > BK_SHEET_CELL_LEN) {
+        len = BK_SHEET_CELL_LEN - p->cell_len;
+    }
+    memcpy(p->cell + p->cell_len, text, len);
+    p->cell_len += len;
+}
+
+static bool match_header(const char * text, size_t len, const char * names[]) {
+    for (int i = 0; names[i] != NULL; i++) {
+        if (strlen(names[i]) == len && 0 == strncasecmp(text, names[i], len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ *      @details Parses a quantity cell. Spreadsheets store whole numbers as floating point, so
+ *              "3" and "3.0" are both accepted. An empty cell is a quantity of 1.
+ */
+static bool parse_quantity(const char * text, size_t len, int * dest) {
+    char   buf[BK_SHEET_CELL_LEN + 1];
+    char * end;
+
+    while (len > 0 && isspace((unsigned char) *text)) {
+        text++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char) text[len - 1])) {
+        len--;
+    }
+    if (0 == len) {
+        *dest = 1;
+        return true;
+    }
+
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+
+    double value = strtod(buf, &end);
+    if (end != buf + len || value < 0 || value > INT_MAX || value != (int) value) {
+        return false;
+    }
+
+    *dest = (int) value;
+    return true;
+}
+
+/**
+ *      @details Called once a cell's text is complete. The cell is assigned to the code and
+ *              quantity slots of the current row if it spans either column. While the first row
+ *              is being read, cells naming a known column select that column.
+ */
+static void sheet_cell(SheetParser * p, const char * text, size_t len, int repeated) {
+    const char * code_names[]     = BK_IMPORT_CODE_NAMES;
+    const char * quantity_names[] = BK_IMPORT_QUANTITY_NAMES;
+
+    if (0 == p->row && BK_IMPORT_HEADER_NO != p->header) {
+        if (match_header(text, len, code_names)) {
+            p->code_column = p->column;
+            p->header      = BK_IMPORT_HEADER_YES;
+        } else if (match_header(text, len, quantity_names)) {
+            p->quantity_column = p->column;
+            p->header          = BK_IMPORT_HEADER_YES;
+        }
+    }
+
+    if (p->code_column >= p->column && p->code_column < p->column + repeated) {
+        memcpy(p->code, text, len);
+        p->code_len = len;
+    }
+
+    if (p->quantity_column >= p->column && p->quantity_column < p->column + repeated) {
+        // A numeric value attribute (ods) takes precedence over the displayed text
+        if (p->value_len > 0) {
+            memcpy(p->quantity, p->value, p->value_len);
+            p->quantity_len = p->value_len;
+        } else {
+            memcpy(p->quantity, text, len);
+            p->quantity_len = len;
+        }
+    }
+}
+
+/**
+ *      @details Called at the end of each row. Mirrors the header handling of delimited text
+ *              imports: the first row is skipped if it named a column or if its quantity is not a
+ *              number.
+ */
+static void sheet_row(SheetParser * p) {
+    const char * code     = p->code;
+    size_t       code_len = p->code_len;
+    int          qty      = 1;
+
+    p->row++;
+
+    while (code_len > 0 && isspace((unsigned char) *code)) {
+        code++;
+        code_len--;
+    }
+    while (code_len > 0 && isspace((unsigned char) code[code_len - 1])) {
+        code_len--;
+    }
+
+    if (1 == p->row && BK_IMPORT_HEADER_NO != p->header) {
+        if (BK_IMPORT_HEADER_YES == p->header || !parse_quantity(p->quantity, p->quantity_len, &qty)) {
+            code_len = 0;
+        }
+    }
+
+    if (code_len > 0) {
+        if (!parse_quantity(p->quantity, p->quantity_len, &qty)) {
+            fprintf(stderr, "ERROR: invalid quantity on row %ld\n", p->row);
+            p->status       = ERR_IMPORT_ROW;
+            p->handler->stop = true;
+        } else if (code_len >= BK_BARCODE_LENGTH) {
+            fprintf(stderr,
+                    "ERROR: barcode on row %ld exceeds %d characters\n",
+                    p->row,
+                    BK_BARCODE_LENGTH - 1);
+            p->status        = ERR_IMPORT_ROW;
+            p->handler->stop = true;
+        } else {
+            bk_job_add(p->job, code, code_len, qty);
+        }
+    }
+
+    p->code_len     = 0;
+    p->quantity_len = 0;
+}
+
+/* -- Office Open XML (xlsx) -- */
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void strings_start(void * ctx, const char * name, size_t len, const char * attrs, size_t alen) {
+    SheetParser * p = ctx;
+
+    if (name_is(name, len, "si")) {
+        p->in_cell  = true;
+        p->cell_len = 0;
+    } else if (name_is(name, len, "rPh")) {
+        // Phonetic runs hold a reading of the string, not its text
+        p->in_phonetic = true;
+    } else if (name_is(name, len, "t") && p->in_cell && !p->in_phonetic) {
+        p->capture = true;
+    }
+}
+
+static void strings_end(void * ctx, const char * name, size_t len) {
+    SheetParser * p = ctx;
+
+    if (name_is(name, len, "t")) {
+        p->capture = false;
+    } else if (name_is(name, len, "rPh")) {
+        p->in_phonetic = false;
+    } else if (name_is(name, len, "si")) {
+        p->cell_len = xml_decode(p->cell, p->cell_len);
+        bk_job_add(p->strings, p->cell, p->cell_len, 0);
+        p->in_cell = false;
+    }
+}
+
+static void sheet_text(void * ctx, const char * text, size_t len) {
+    SheetParser * p = ctx;
+
+    if (p->capture) {
+        cell_append(p, text, len);
+    }
+}
+
+/**
+ *      @details Converts the column letters of an A1-style cell reference to a zero-indexed column.
+ */
+static int xlsx_column(const char * ref, size_t len) {
+    int column = 0;
+    for (size_t i = 0; i < len && isalpha((unsigned char) ref[i]); i++) {
+        column = column * 26 + (toupper((unsigned char) ref[i]) - 'A' + 1);
+    }
+    return column - 1;
+}
+
+static void xlsx_start(void * ctx, const char * name, size_t len, const char * attrs, size_t alen) {
+    SheetParser * p = ctx;
+    const char *  value;
+    size_t        value_len;
+
+    if (name_is(name, len, "row")) {
+        p->column = -1;
+    } else if (name_is(name, len, "c")) {
+        p->column   = xml_attr(attrs, alen, "r", &value, &value_len) ? xlsx_column(value, value_len)
+                                                                     : p->column + 1;
+        p->shared   = xml_attr(attrs, alen, "t", &value, &value_len) && 1 == value_len && 's' == *value;
+        p->in_cell  = true;
+        p->cell_len = 0;
+    } else if (name_is(name, len, "rPh")) {
+        p->in_phonetic = true;
+    } else if ((name_is(name, len, "v") || name_is(name, len, "t")) && p->in_cell
+               && !p->in_phonetic) {
+        p->capture = true;
+    }
+}
+
+static void xlsx_end(void * ctx, const char * name, size_t len) {
+    SheetParser * p = ctx;
+
+    if (name_is(name, len, "v") || name_is(name, len, "t")) {
+        p->capture = false;
+    } else if (name_is(name, len, "rPh")) {
+        p->in_phonetic = false;
+    } else if (name_is(name, len, "c")) {
+        p->cell_len = xml_decode(p->cell, p->cell_len);
+        if (p->shared) {
+            char buf[BK_SHEET_CELL_LEN + 1];
+            memcpy(buf, p->cell, p->cell_len);
+            buf[p->cell_len] = '\0';
+
+            long idx = strtol(buf, NULL, 10);
+            if (idx >= 0 && idx < p->strings->num_barcodes) {
+                const char * text = bk_job_barcode(p->strings, idx);
+                size_t       text_len = strlen(text);
+                sheet_cell(p, text, text_len, 1);
+            }
+        } else {
+            sheet_cell(p, p->cell, p->cell_len, 1);
+        }
+        p->in_cell = false;
+    } else if (name_is(name, len, "row")) {
+        sheet_row(p);
+    } else if (name_is(name, len, "sheetData")) {
+        p->handler->stop = true;
+    }
+}
+
+/* -- OpenDocument (ods) -- */
+
+static void ods_start(void * ctx, const char * name, size_t len, const char * attrs, size_t alen) {
+    SheetParser * p = ctx;
+    const char *  value;
+    size_t        value_len;
+
+    if (name_is(name, len, "table")) {
+        p->in_table = true;
+    } else if (!p->in_table) {
+        return;
+    } else if (name_is(name, len, "table-row")) {
+        p->column        = 0;
+        p->rows_repeated = xml_attr_long(attrs, alen, "number-rows-repeated", 1);
+    } else if (name_is(name, len, "table-cell") || name_is(name, len, "covered-table-cell")) {
+        p->columns_repeated = xml_attr_long(attrs, alen, "number-columns-repeated", 1);
+        p->in_cell          = true;
+        p->cell_len         = 0;
+        p->value_len        = 0;
+        if (xml_attr(attrs, alen, "value", &value, &value_len) && value_len < BK_SHEET_CELL_LEN) {
+            memcpy(p->value, value, value_len);
+            p->value_len = value_len;
+        }
+    } else if (name_is(name, len, "p") && p->in_cell) {
+        p->capture = true;
+    }
+}
+
+static void ods_end(void * ctx, const char * name, size_t len) {
+    SheetParser * p = ctx;
+
+    if (!p->in_table) {
+        return;
+    } else if (name_is(name, len, "p")) {
+        p->capture = false;
+    } else if (name_is(name, len, "table-cell") || name_is(name, len, "covered-table-cell")) {
+        p->cell_len = xml_decode(p->cell, p->cell_len);
+        sheet_cell(p, p->cell, p->cell_len, p->columns_repeated);
+        p->column += p->columns_repeated;
+        p->in_cell = false;
+    } else if (name_is(name, len, "table-row")) {
+        if (0 == p->code_len) {
+            // Blank rows are commonly repeated to the end of the sheet, so are skipped in one step
+            p->row += p->rows_repeated;
+            p->quantity_len = 0;
+        } else {
+            char   code[BK_SHEET_CELL_LEN], quantity[BK_SHEET_CELL_LEN];
+            size_t code_len = p->code_len, quantity_len = p->quantity_len;
+            memcpy(code, p->code, code_len);
+            memcpy(quantity, p->quantity, quantity_len);
+
+            for (long i = 0; i < p->rows_repeated && SUCCESS == p->status; i++) {
+                memcpy(p->code, code, code_len);
+                memcpy(p->quantity, quantity, quantity_len);
+                p->code_len     = code_len;
+                p->quantity_len = quantity_len;
+                sheet_row(p);
+            }
+        }
+    } else if (name_is(name, len, "table")) {
+        // Only the first table is imported
+        p->handler->stop = true;
+    }
+}
+
+#pragma GCC diagnostic pop
+
+/**
+ *      @details Streams a single archive member through the XML tokenizer. Deflated members are
+ *              inflated into a fixed buffer; whatever the tokenizer leaves unconsumed (an
+ *              incomplete tag) is moved to the front of the buffer and the next block inflated
+ *              after it.
+ */
+static int zip_stream(const ZipEntry * entry, XMLHandler * handler) {
+    int      status = SUCCESS;
+    z_stream zs;
+    char *   buf;
+    size_t   have = 0;
+
+    if (ZIP_STORED == entry->method) {
+        xml_parse((const char *) entry->data, entry->compressed_len, true, handler);
+        return SUCCESS;
+    } else if (ZIP_DEFLATED != entry->method) {
+        return ERR_ARCHIVE;
+    }
+
+    buf = malloc(BK_SHEET_BUFSIZE);
+    VERIFY_NULL_BC(buf, BK_SHEET_BUFSIZE);
+
+    memset(&zs, 0, sizeof zs);
+    if (Z_OK != inflateInit2(&zs, -MAX_WBITS)) {
+        free(buf);
+        return ERR_ARCHIVE;
+    }
+    zs.next_in  = (Bytef *) entry->data;
+    zs.avail_in = (uInt) entry->compressed_len;
+
+    for (;;) {
+        zs.next_out  = (Bytef *) buf + have;
+        zs.avail_out = (uInt)(BK_SHEET_BUFSIZE - have);
+
+        int  result = inflate(&zs, Z_NO_FLUSH);
+        bool final  = Z_STREAM_END == result;
+        if (Z_OK != result && !final) {
+            status = ERR_ARCHIVE;
+            break;
+        }
+
+        size_t len  = BK_SHEET_BUFSIZE - zs.avail_out;
+        size_t used = xml_parse(buf, len, final, handler);
+        have        = len - used;
+        memmove(buf, buf + used, have);
+
+        if (final || handler->stop) {
+            break;
+        } else if (have > BK_SHEET_MAX_TAG) {
+            fprintf(stderr, "ERROR: XML tag exceeds %d bytes\n", BK_SHEET_MAX_TAG);
+            status = ERR_ARCHIVE;
+            break;
+        }
+    }
+
+    inflateEnd(&zs);
+    free(buf);
+
+    return status;
+}
+
+// clang-format off
+static void sheet_parser_init(
+    SheetParser * p,
+    XMLHandler * handler,
+    const BKImportOptions * options,
+    BKJob * job
+) {
+    // clang-format on
+
+    BKImportOptions defaults = BK_IMPORT_DEFAULT_OPTIONS;
+
+    if (NULL == options) {
+        options = &defaults;
+    }
+
+    memset(p, 0, sizeof *p);
+    p->handler         = handler;
+    p->job             = job;
+    p->code_column     = options->code_column;
+    p->quantity_column = options->quantity_column;
+    p->header          = options->header;
+    p->status          = SUCCESS;
+    p->column          = -1;
+    p->rows_repeated   = 1;
+
+    handler->text = sheet_text;
+    handler->ctx  = p;
+    handler->stop = false;
+}
+
+// clang-format off
+static void sheet_stats(
+    BKJob * job,
+    long first_row,
+    long first_labels,
+    size_t bytes,
+    uint64_t start,
+    BKImportStats * stats
+) {
+    // clang-format on
+
+    if (NULL != stats) {
+        stats->rows       = bk_job_rows(job) - first_row;
+        stats->labels     = bk_job_labels(job) - first_labels;
+        stats->bytes      = bytes;
+        stats->elapsed_ms = (bk_clock_ns() - start) / 1e6;
+    }
+}
+
+// clang-format off
+int bk_import_xlsx(
+    const char * path,
+    const BKImportOptions * options,
+    BKJob * job,
+    BKImportStats * stats
+) {
+    // clang-format on
+
+    uint64_t     start        = bk_clock_ns();
+    long         first_row    = bk_job_rows(job);
+    long         first_labels = bk_job_labels(job);
+    BKMappedFile zip;
+    ZipEntry     entry;
+    SheetParser  parser;
+    XMLHandler   handler;
+    BKJob        strings;
+    int          status;
+
+    if (SUCCESS != (status = bk_file_map(path, &zip))) {
+        return status;
+    }
+
+    bk_job_init(&strings);
+    sheet_parser_init(&parser, &handler, options, job);
+    parser.strings = &strings;
+
+    // The shared string table is optional - a sheet of numbers or inline strings has none
+    status = zip_find(&zip, BK_XLSX_SHARED_STRINGS, false, &entry);
+    if (SUCCESS == status) {
+        handler.start = strings_start;
+        handler.end   = strings_end;
+        status        = zip_stream(&entry, &handler);
+    } else if (ERR_FILE_OPEN_FAILED == status) {
+        status = SUCCESS;
+    }
+
+    if (SUCCESS == status) {
+        status = zip_find(&zip, BK_XLSX_FIRST_SHEET, false, &entry);
+        if (ERR_FILE_OPEN_FAILED == status) {
+            status = zip_find(&zip, BK_XLSX_SHEET_PREFIX, true, &entry);
+        }
+    }
+
+    if (SUCCESS == status) {
+        parser.in_cell     = false;
+        parser.capture     = false;
+        parser.in_phonetic = false;
+        handler.start      = xlsx_start;
+        handler.end        = xlsx_end;
+        handler.stop       = false;
+        status             = zip_stream(&entry, &handler);
+    }
+
+    if (SUCCESS == status) {
+        status = parser.status;
+    } else if (ERR_FILE_OPEN_FAILED == status) {
+        // Opened, but not a workbook
+        status = ERR_ARCHIVE;
+    }
+
+    sheet_stats(job, first_row, first_labels, zip.len, start, stats);
+
+    bk_job_free(&strings);
+    bk_file_unmap(&zip);
+
+    return status;
+}
+
+// clang-format off
+int bk_import_ods(
+    const char * path,
+    const BKImportOptions * options,
+    BKJob * job,
+    BKImportStats * stats
+) {
+    // clang-format on
+
+    uint64_t     start        = bk_clock_ns();
+    long         first_row    = bk_job_rows(job);
+    long         first_labels = bk_job_labels(job);
+    BKMappedFile zip;
+    ZipEntry     entry;
+    SheetParser  parser;
+    XMLHandler   handler;
+    int          status;
+
+    if (SUCCESS != (status = bk_file_map(path, &zip))) {
+        return status;
+    }
+
+    sheet_parser_init(&parser, &handler, options, job);
+    handler.start = ods_start;
+    handler.end   = ods_end;
+
+    status = zip_find(&zip, BK_ODS_CONTENT, false, &entry);
+    if (SUCCESS == status) {
+        status = zip_stream(&entry, &handler);
+    }
+
+    if (SUCCESS == status) {
+        status = parser.status;
+    } else if (ERR_FILE_OPEN_FAILED == status) {
+        status = ERR_ARCHIVE;
+    }
+
+    sheet_stats(job, first_row, first_labels, zip.len, start, stats);
+
+    bk_file_unmap(&zip);
+
+    return status;
+}
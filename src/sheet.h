@@ -0,0 +1,65 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file sheet.h
+ *      @brief Spreadsheet (xlsx and ods) job file import declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef SHEET_H
+#define SHEET_H
+
+#include "import.h"
+#include "job.h"
+
+/**
+ *      @defgroup SheetProperties Spreadsheet import properties
+ */
+/*@{*/
+// clang-format off
+// Size of the buffer which decompressed XML is streamed through
+#define BK_SHEET_BUFSIZE            65536
+// Longest single XML tag which can be parsed (the remainder of the buffer holds text)
+#define BK_SHEET_MAX_TAG            16384
+// Longest cell text retained - longer cells cannot hold a barcode or quantity
+#define BK_SHEET_CELL_LEN           128
+#define BK_XLSX_SHARED_STRINGS      "xl/sharedStrings.xml"
+#define BK_XLSX_FIRST_SHEET         "xl/worksheets/sheet1.xml"
+#define BK_XLSX_SHEET_PREFIX        "xl/worksheets/sheet"
+#define BK_ODS_CONTENT              "content.xml"
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Import the first worksheet of an Office Open XML workbook
+ *      @details The archive is memory-mapped and the worksheet inflated and parsed as a stream, so
+ *              memory use does not depend on the size of the sheet. Shared strings are the
+ *              exception: the shared string table is held in memory, as any cell may refer to any
+ *              string.
+ *      @param path Path of the workbook
+ *      @param options Column mapping, or NULL for BK_IMPORT_DEFAULT_OPTIONS (@c delimiter is
+ *                     ignored)
+ *      @param job Destination job
+ *      @param stats Destination for an import summary, or NULL
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_MMAP, ERR_ARCHIVE, ERR_IMPORT_ROW
+ */
+int bk_import_xlsx(const char *, const BKImportOptions *, BKJob *, BKImportStats *);
+
+/**
+ *      @brief Import the first table of an OpenDocument spreadsheet
+ *      @details As bk_import_xlsx(), without the exception - OpenDocument stores cell text inline.
+ *      @param path Path of the spreadsheet
+ *      @param options Column mapping, or NULL for BK_IMPORT_DEFAULT_OPTIONS (@c delimiter is
+ *                     ignored)
+ *      @param job Destination job
+ *      @param stats Destination for an import summary, or NULL
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_MMAP, ERR_ARCHIVE, ERR_IMPORT_ROW
+ */
+int bk_import_ods(const char *, const BKImportOptions *, BKJob *, BKImportStats *);
+
+#endif
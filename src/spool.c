@@ -0,0 +1,473 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file spool.c
+ *      @brief Hot folder printing implementations as defined in spool.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "spool.h"
+
+#include "backend.h"
+#include "error.h"
+#include "import.h"
+#include "job.h"
+#include "metrics.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ *      @brief A claimed job file waiting in the queue
+ */
+typedef struct SpoolJob {
+    char              name[BK_SPOOL_NAME_LEN];
+    off_t             size;
+    struct SpoolJob * next;
+} SpoolJob;
+
+/**
+ *      @brief Spool state shared between the watcher and worker threads
+ */
+typedef struct Spool {
+    const BKSpoolOptions * options;
+    pthread_mutex_t        lock;
+    pthread_cond_t         ready;
+    SpoolJob *             head;
+    SpoolJob *             tail;
+    bool                   stopping;
+    unsigned long          batches;
+} Spool;
+
+static volatile int queue_depth;
+static volatile sig_atomic_t spool_stop;
+
+static void spool_signal(int sig) {
+    (void) sig;
+    spool_stop = 1;
+}
+
+static void spool_path(char * dest, const Spool * spool, const char * sub, const char * name) {
+    if (NULL == sub) {
+        snprintf(dest, PATH_MAX, "%s/%s", spool->options->dir, name);
+    } else {
+        snprintf(dest, PATH_MAX, "%s/%s/%s", spool->options->dir, sub, name);
+    }
+}
+
+static void spool_push(Spool * spool, const char * name, off_t size) {
+    size_t     job_size = sizeof(SpoolJob);
+    SpoolJob * job      = calloc(1, job_size);
+    VERIFY_NULL_BC(job, job_size);
+
+    strncpy(job->name, name, BK_SPOOL_NAME_LEN - 1);
+    job->size = size;
+
+    pthread_mutex_lock(&spool->lock);
+    if (NULL == spool->tail) {
+        spool->head = job;
+    } else {
+        spool->tail->next = job;
+    }
+    spool->tail = job;
+    __atomic_add_fetch(&queue_depth, 1, __ATOMIC_RELAXED);
+    bk_metrics_gauge_add(BK_METRIC_SPOOL_QUEUE, 1);
+    pthread_cond_signal(&spool->ready);
+    pthread_mutex_unlock(&spool->lock);
+}
+
+/*      @details Must be called with @c spool->lock held and the queue non-empty */
+static SpoolJob * spool_pop(Spool * spool) {
+    SpoolJob * job = spool->head;
+
+    spool->head = job->next;
+    if (NULL == spool->head) {
+        spool->tail = NULL;
+    }
+    __atomic_sub_fetch(&queue_depth, 1, __ATOMIC_RELAXED);
+    bk_metrics_gauge_add(BK_METRIC_SPOOL_QUEUE, -1);
+
+    return job;
+}
+
+/**
+ *      @details Claims a job file by renaming it from the spool directory into the work directory.
+ *              rename() is atomic, so if several watchers race for a file exactly one succeeds.
+ *              Hidden files are ignored, so that producers may write to a dotfile and rename it
+ *              into place once complete.
+ */
+static void spool_claim(Spool * spool, const char * name) {
+    char        from[PATH_MAX], to[PATH_MAX];
+    struct stat st;
+
+    if ('.' == name[0] || strlen(name) >= BK_SPOOL_NAME_LEN) {
+        return;
+    }
+
+    spool_path(from, spool, NULL, name);
+    if (-1 == stat(from, &st) || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    spool_path(to, spool, BK_SPOOL_WORK_DIR, name);
+    if (-1 == rename(from, to)) {
+        // Claimed by another watcher
+        return;
+    }
+
+    spool_push(spool, name, st.st_size);
+}
+
+/**
+ *      @details Jobs already in the work directory were claimed by a previous run which did not
+ *              finish them, and are queued first. Then any jobs dropped while no watcher was
+ *              running are claimed.
+ */
+static void spool_scan(Spool * spool) {
+    char            path[PATH_MAX];
+    DIR *           dir;
+    struct dirent * entry;
+    struct stat     st;
+
+    spool_path(path, spool, NULL, BK_SPOOL_WORK_DIR);
+    if (NULL != (dir = opendir(path))) {
+        while (NULL != (entry = readdir(dir))) {
+            char job_path[PATH_MAX];
+            spool_path(job_path, spool, BK_SPOOL_WORK_DIR, entry->d_name);
+            if ('.' != entry->d_name[0] && strlen(entry->d_name) < BK_SPOOL_NAME_LEN
+                && !strstr(entry->d_name, BK_SPOOL_OUT_EXT) && 0 == stat(job_path, &st)
+                && S_ISREG(st.st_mode)) {
+                spool_push(spool, entry->d_name, st.st_size);
+            }
+        }
+        closedir(dir);
+    }
+
+    if (NULL != (dir = opendir(spool->options->dir))) {
+        while (NULL != (entry = readdir(dir))) {
+            spool_claim(spool, entry->d_name);
+        }
+        closedir(dir);
+    }
+}
+
+/**
+ *      @details Waits for a job, then - if it is small - waits up to BK_SPOOL_COALESCE_MS for
+ *              further small jobs to print with it. Returns the number of jobs taken, which is
+ *              0 only once the spool is stopping and the queue is empty.
+ */
+static int spool_take(Spool * spool, SpoolJob ** batch) {
+    int             num_jobs = 0;
+    off_t           size     = 0;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&spool->lock);
+
+    while (NULL == spool->head && !spool->stopping) {
+        pthread_cond_wait(&spool->ready, &spool->lock);
+    }
+
+    if (NULL != spool->head) {
+        batch[num_jobs] = spool_pop(spool);
+        size += batch[num_jobs]->size;
+        num_jobs++;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += BK_SPOOL_COALESCE_MS * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+
+        while (num_jobs < BK_SPOOL_BATCH_MAX && size < BK_SPOOL_SMALL_JOB) {
+            if (NULL == spool->head) {
+                if (spool->stopping
+                    || ETIMEDOUT == pthread_cond_timedwait(&spool->ready, &spool->lock, &deadline)) {
+                    break;
+                }
+            } else if (size + spool->head->size > BK_SPOOL_SMALL_JOB) {
+                break;
+            } else {
+                batch[num_jobs] = spool_pop(spool);
+                size += batch[num_jobs]->size;
+                num_jobs++;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&spool->lock);
+
+    return num_jobs;
+}
+
+static void spool_fail(Spool * spool, SpoolJob * job, int status, const char * reason) {
+    char from[PATH_MAX], to[PATH_MAX], err_name[BK_SPOOL_NAME_LEN + sizeof BK_SPOOL_ERR_EXT];
+
+    spool_path(from, spool, BK_SPOOL_WORK_DIR, job->name);
+    spool_path(to, spool, BK_SPOOL_FAILED_DIR, job->name);
+    rename(from, to);
+
+    snprintf(err_name, sizeof err_name, "%s" BK_SPOOL_ERR_EXT, job->name);
+    spool_path(to, spool, BK_SPOOL_FAILED_DIR, err_name);
+
+    FILE * err = fopen(to, "w");
+    if (NULL != err) {
+        fprintf(err, "%s (error %d)\n", reason, status);
+        fclose(err);
+    }
+
+    fprintf(stderr, "ERROR: %s: %s (error %d)\n", job->name, reason, status);
+}
+
+/**
+ *      @details Imports every job of a batch, then generates them all into a single PostScript
+ *              file which is printed with one call to BK_PRINT_CMD. A job which cannot be
+ *              imported fails alone; a failure to generate or print fails the whole batch.
+ */
+static void spool_process(Spool * spool, SpoolJob ** batch, int num_jobs) {
+    BKJob           jobs[BK_SPOOL_BATCH_MAX];
+    BKJobReader     readers[BK_SPOOL_BATCH_MAX];
+    BKSource        sources[BK_SPOOL_BATCH_MAX];
+    SpoolJob *      imported[BK_SPOOL_BATCH_MAX];
+    int             num_imported = 0;
+    PSProperties    props        = PS_DEFAULT_PROPS;
+    Layout          layout;
+    BKGenerateStats stats;
+    char            job_id[BK_JOB_ID_LEN] = "";
+    char            out_name[BK_SPOOL_NAME_LEN + sizeof BK_SPOOL_OUT_EXT];
+    char            path[PATH_MAX], out_path[PATH_MAX];
+    uint64_t        start = bk_clock_ns();
+    int             status;
+
+    layout.cols = BK_DEFAULT_COLS;
+    layout.rows = BK_DEFAULT_ROWS;
+
+    for (int i = 0; i < num_jobs; i++) {
+        BKJob * job = &jobs[num_imported];
+
+        bk_job_init(job);
+        bk_job_set_budget(job, spool->options->memory_budget);
+        spool_path(path, spool, BK_SPOOL_WORK_DIR, batch[i]->name);
+        status = bk_import_file(path, NULL, job, NULL);
+        if (SUCCESS != status) {
+            spool_fail(spool, batch[i], status, "could not import job file");
+            bk_job_free(job);
+            continue;
+        }
+
+        bk_job_read(job, &readers[num_imported]);
+        sources[num_imported].next = bk_job_next;
+        sources[num_imported].ctx  = &readers[num_imported];
+        imported[num_imported]     = batch[i];
+        num_imported++;
+    }
+
+    if (num_imported > 0) {
+        BKChainSource chain  = { sources, num_imported, 0 };
+        BKSource      source = { bk_chain_next, &chain };
+
+        // The batch's output is named after its first job
+        snprintf(out_name, sizeof out_name, "%s" BK_SPOOL_OUT_EXT, imported[0]->name);
+        spool_path(out_path, spool, BK_SPOOL_WORK_DIR, out_name);
+
+        FILE * out = fopen(out_path, "w");
+        if (NULL == out) {
+            status = ERR_FILE_OPEN_FAILED;
+        } else {
+            BKSink sink = { bk_file_write, out };
+            status      = bk_generate_stream(&source, &props, &layout, &sink, &stats);
+            if (EOF == fclose(out) && SUCCESS == status) {
+                status = ERR_FILE_CLOSE_FAILED;
+            }
+        }
+
+        if (SUCCESS == status && stats.labels > 0) {
+            status = bk_print_sync(out_path, (char *) spool->options->printer, job_id, BK_JOB_ID_LEN);
+        }
+
+        if (SUCCESS == status) {
+            char to[PATH_MAX];
+            spool_path(to, spool, BK_SPOOL_DONE_DIR, out_name);
+            rename(out_path, to);
+
+            for (int i = 0; i < num_imported; i++) {
+                spool_path(path, spool, BK_SPOOL_WORK_DIR, imported[i]->name);
+                spool_path(to, spool, BK_SPOOL_DONE_DIR, imported[i]->name);
+                rename(path, to);
+            }
+
+            printf("%s: printed %d job%s, %ld labels on %ld pages (job %s) in %.1f ms, %d queued\n",
+                   imported[0]->name,
+                   num_imported,
+                   1 == num_imported ? "" : "s",
+                   stats.labels,
+                   stats.pages,
+                   job_id[0] ? job_id : "-",
+                   (bk_clock_ns() - start) / 1e6,
+                   bk_spool_queue_depth());
+            fflush(stdout);
+        } else {
+            remove(out_path);
+            for (int i = 0; i < num_imported; i++) {
+                spool_fail(spool, imported[i], status, "could not generate or print job");
+            }
+        }
+    }
+
+    for (int i = 0; i < num_imported; i++) {
+        bk_job_reader_free(&readers[i]);
+        bk_job_free(&jobs[i]);
+    }
+    for (int i = 0; i < num_jobs; i++) {
+        free(batch[i]);
+    }
+}
+
+static void * spool_worker(void * arg) {
+    Spool *    spool = arg;
+    SpoolJob * batch[BK_SPOOL_BATCH_MAX];
+    int        num_jobs;
+
+    bk_trace_thread_name("spool worker");
+
+    while ((num_jobs = spool_take(spool, batch)) > 0) {
+        spool_process(spool, batch, num_jobs);
+    }
+
+    return NULL;
+}
+
+int bk_spool_run(const BKSpoolOptions * options) {
+    const char * subdirs[] = { BK_SPOOL_WORK_DIR, BK_SPOOL_DONE_DIR, BK_SPOOL_FAILED_DIR };
+    Spool        spool;
+    char         path[PATH_MAX];
+    int          num_workers = options->workers > 0 ? options->workers : BK_SPOOL_DEFAULT_WORKERS;
+    pthread_t *  workers;
+    int          status = SUCCESS;
+
+    memset(&spool, 0, sizeof spool);
+    spool.options = options;
+
+    for (int i = 0; i < 3; i++) {
+        spool_path(path, &spool, NULL, subdirs[i]);
+        if (-1 == mkdir(path, 0755) && EEXIST != errno) {
+            fprintf(stderr, "ERROR: could not create %s: %s\n", path, strerror(errno));
+            return ERR_SPOOL;
+        }
+    }
+
+    // Watch before scanning so that nothing dropped in between is missed
+    int watch_fd = inotify_init1(IN_CLOEXEC);
+    if (-1 == watch_fd
+        || -1 == inotify_add_watch(watch_fd, options->dir, IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        fprintf(stderr, "ERROR: could not watch %s: %s\n", options->dir, strerror(errno));
+        if (-1 != watch_fd) {
+            close(watch_fd);
+        }
+        return ERR_SPOOL;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = spool_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    pthread_mutex_init(&spool.lock, NULL);
+    pthread_cond_init(&spool.ready, NULL);
+
+    size_t workers_size = sizeof *workers * num_workers;
+    workers             = calloc(1, workers_size);
+    VERIFY_NULL_BC(workers, workers_size);
+    for (int i = 0; i < num_workers; i++) {
+        pthread_create(&workers[i], NULL, spool_worker, &spool);
+    }
+
+    spool_scan(&spool);
+
+    printf("Watching %s with %d workers\n", options->dir, num_workers);
+    fflush(stdout);
+
+    // Events are read into an aligned buffer, as struct inotify_event requires
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { watch_fd, POLLIN, 0 };
+
+    while (!spool_stop) {
+        if (poll(&pfd, 1, BK_SPOOL_POLL_MS) <= 0) {
+            continue;
+        }
+
+        ssize_t len = read(watch_fd, events, sizeof events);
+        if (len <= 0) {
+            if (len < 0 && EINTR != errno && EAGAIN != errno) {
+                status = ERR_SPOOL;
+                break;
+            }
+            continue;
+        }
+
+        for (char * p = events; p < events + len;) {
+            struct inotify_event * event = (struct inotify_event *) p;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Events were lost, so look for anything left unclaimed
+                spool_scan(&spool);
+            } else if (event->len > 0) {
+                spool_claim(&spool, event->name);
+            }
+            p += sizeof *event + event->len;
+        }
+    }
+
+    // Let the workers finish what has been claimed, then stop
+    pthread_mutex_lock(&spool.lock);
+    spool.stopping = true;
+    pthread_cond_broadcast(&spool.ready);
+    pthread_mutex_unlock(&spool.lock);
+
+    for (int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    free(workers);
+    close(watch_fd);
+    pthread_cond_destroy(&spool.ready);
+    pthread_mutex_destroy(&spool.lock);
+
+    return status;
+}
+
+int bk_spool_queue_depth(void) {
+    return __atomic_load_n(&queue_depth, __ATOMIC_RELAXED);
+}
+
+#else
+
+int bk_spool_run(const BKSpoolOptions * options) {
+    (void) options;
+    fprintf(stderr, "ERROR: spool directories are only supported on Linux\n");
+    return ERR_UNSUPPORTED_PLATFORM;
+}
+
+int bk_spool_queue_depth(void) {
+    return 0;
+}
+
+#endif
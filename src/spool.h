@@ -0,0 +1,70 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file spool.h
+ *      @brief Hot folder (spool directory) printing declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#ifndef SPOOL_H
+#define SPOOL_H
+
+#include <stddef.h>
+
+/**
+ *      @defgroup SpoolProperties Spool directory properties
+ */
+/*@{*/
+// clang-format off
+#define BK_SPOOL_WORK_DIR       "work"
+#define BK_SPOOL_DONE_DIR       "done"
+#define BK_SPOOL_FAILED_DIR     "failed"
+#define BK_SPOOL_ERR_EXT        ".err"
+#define BK_SPOOL_OUT_EXT        ".ps"
+#define BK_SPOOL_NAME_LEN       256
+#define BK_SPOOL_DEFAULT_WORKERS    4
+// Time to wait for further jobs to batch with a small one
+#define BK_SPOOL_COALESCE_MS    50
+// Most jobs, and largest total job file size, printed as one batch
+#define BK_SPOOL_BATCH_MAX      32
+#define BK_SPOOL_SMALL_JOB      (64 * 1024)
+// Interval at which the main loop checks for shutdown
+#define BK_SPOOL_POLL_MS        500
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Options for watching a spool directory
+ *      @details @c workers of 0 selects BK_SPOOL_DEFAULT_WORKERS. @c memory_budget limits the
+ *               memory each job may hold (see bk_job_set_budget()), or is 0 for no limit.
+ */
+typedef struct BKSpoolOptions {
+    const char * dir;
+    const char * printer;
+    int          workers;
+    size_t       memory_budget;
+} BKSpoolOptions;
+
+/**
+ *      @brief Watch a spool directory and print job files dropped into it until interrupted
+ *      @details Job files are claimed by renaming them into the @c work subdirectory, so several
+ *               watchers may share a spool directory. Once processed, each job file is moved to
+ *               @c done alongside the PostScript it was printed in, or to @c failed alongside an
+ *               error file. Small jobs arriving together are generated and printed as one batch.
+ *               Returns on SIGINT or SIGTERM, once jobs in progress are complete.
+ *      @param options The spool directory, printer and number of worker threads
+ *      @return SUCCESS, ERR_SPOOL, ERR_UNSUPPORTED_PLATFORM
+ */
+int bk_spool_run(const BKSpoolOptions *);
+
+/**
+ *      @brief Number of claimed jobs waiting for a worker
+ */
+int bk_spool_queue_depth(void);
+
+#endif
@@ -0,0 +1,68 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file str.c
+ *      @brief String utility definitions as defined in str.h
+ *      @author Elijah Schutz
+ *      @date 23/3/19
+ */
+
+#include "str.h"
+
+#include "error.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ *      @details Simple lexical analysis to verify if the input represents a decimal literal
+ * matching
+ *              @c /[0-9](.[0-9])?/
+ */
+bool isfloat(char * str) {
+    bool decimal = false;
+    int  i       = 0;
+    while (str[i] != '\0') {
+        if (str[i] == '.') {
+            if (decimal) {
+                return false;
+            } else {
+                decimal = true;
+            }
+        } else if (!isdigit(str[i])) {
+            return false;
+        }
+        i++;
+    };
+    return true;
+}
+
+/**
+ *      @details The stripped text is copied to the start of a new buffer, so the return value is
+ *              the pointer to free().
+ */
+char * strstrip(char * str) {
+    size_t len = strlen(str) + 1;
+
+    char * result = calloc(1, len);
+    VERIFY_NULL_BC(result, len);
+
+    while (isspace((unsigned char) *str)) {
+        str++;
+    }
+
+    len = strlen(str);
+    while (len > 0 && isspace((unsigned char) str[len - 1])) {
+        len--;
+    }
+    memcpy(result, str, len);
+
+    return result;
+}
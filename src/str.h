@@ -0,0 +1,35 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file str.h
+ *      @brief String utility declarations
+ *      @author Elijah Schutz
+ *      @date 23/3/19
+ */
+
+#ifndef STR_H
+#define STR_H
+
+#include <stdbool.h>
+
+/**
+ *      @brief Checks if a string represents a float
+ *      @param str A string to be tested on
+ *      @return true or false
+ */
+bool isfloat(char *);
+
+/**
+ *      @brief Strips the whitespace from the beginning and end of a string
+ *      @param str A string to strip
+ *      @return A stripped string
+ *      @warning Memory is allocated to the return value in this function, so make sure you
+ *               free() the return value once you're done.
+ */
+char * strstrip(char *);
+
+#endif
@@ -0,0 +1,364 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file thermal.c
+ *      @brief Thermal label printer command language implementations as defined in thermal.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "thermal.h"
+
+#include "error.h"
+#include "metrics.h"
+#include "modules.h"
+#include "scanline.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ *      @defgroup ThermalLimits Thermal generation limits
+ */
+/*@{*/
+// clang-format off
+// Every element is at most 4 modules wide
+#define THERMAL_MAX_ROW_PIXELS  (BK_MODULES_MAX_ELEMENTS * 4 * BK_THERMAL_MAX_MODULE_DOTS)
+#define THERMAL_MAX_ROW_BYTES   ((THERMAL_MAX_ROW_PIXELS + 7) / 8)
+#define THERMAL_LINE_LEN        256
+// ZPL's field hex indicator, escaping characters which would otherwise start commands
+#define THERMAL_ZPL_HEX         '_'
+// Height and width of EPL's fonts 1 to 5 at 203 dpi, in dots
+#define THERMAL_EPL_FONTS       { { 12, 8 }, { 16, 10 }, { 20, 12 }, { 24, 14 }, { 48, 32 } }
+#define THERMAL_EPL_FONT_DPI    203
+// clang-format on
+/*@}*/
+
+/*      @brief Label geometry, in printer dots */
+typedef struct ThermalGeometry {
+    int lmargin, tmargin, padding;
+    int module, bar_height, fontsize;
+} ThermalGeometry;
+
+/*      @brief Output written so far, and the first error writing it */
+typedef struct ThermalWriter {
+    BKSink * sink;
+    size_t   bytes;
+    int      status;
+} ThermalWriter;
+
+static void thermal_write(ThermalWriter * writer, const char * data, size_t len) {
+    if (SUCCESS == writer->status) {
+        writer->status = writer->sink->write(writer->sink->ctx, data, len);
+        writer->bytes += len;
+    }
+}
+
+static void thermal_printf(ThermalWriter * writer, const char * format, ...) {
+    char    line[THERMAL_LINE_LEN];
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof line, format, args);
+    va_end(args);
+
+    if (len > 0) {
+        thermal_write(writer, line, len < (int) sizeof line ? (size_t) len : sizeof line - 1);
+    }
+}
+
+/*      @brief Write a barcode as field data, in ZPL after @c ^FH or between quotes in EPL */
+static void write_data(ThermalWriter * writer, BKThermalLanguage language, const char * barcode) {
+    static const char hex[] = "0123456789ABCDEF";
+    char              escaped[3 * C128_MAX_STRING_LEN + 1];
+    size_t            len = 0;
+
+    for (; '\0' != *barcode && len + 3 < sizeof escaped; barcode++) {
+        unsigned char c = *barcode;
+        if (BK_THERMAL_ZPL == language && ('^' == c || '~' == c || THERMAL_ZPL_HEX == c)) {
+            escaped[len++] = THERMAL_ZPL_HEX;
+            escaped[len++] = hex[c >> 4];
+            escaped[len++] = hex[c & 0xF];
+        } else if (BK_THERMAL_EPL == language && ('"' == c || '\\' == c)) {
+            escaped[len++] = '\\';
+            escaped[len++] = c;
+        } else {
+            escaped[len++] = c;
+        }
+    }
+
+    thermal_write(writer, escaped, len);
+}
+
+/*      @brief Write one ZPL format, printed @c quantity times */
+// clang-format off
+static void write_zpl(
+    ThermalWriter * writer,
+    const ThermalGeometry * geometry,
+    bool graphic,
+    const char * barcode,
+    const BKModules * modules,
+    int quantity
+) {
+    // clang-format on
+
+    thermal_printf(writer, "^XA^LH%d,%d", geometry->lmargin, geometry->tmargin);
+
+    if (!graphic) {
+        if (geometry->fontsize > 0) {
+            thermal_printf(writer, "^CF0,%d", geometry->fontsize);
+        }
+        thermal_printf(writer,
+                       "^FO%d,%d^BY%d^BCN,%d,%c,N,N,A^FH%c^FD",
+                       geometry->padding,
+                       geometry->padding,
+                       geometry->module,
+                       geometry->bar_height,
+                       geometry->fontsize > 0 ? 'Y' : 'N',
+                       THERMAL_ZPL_HEX);
+        write_data(writer, BK_THERMAL_ZPL, barcode);
+        thermal_write(writer, "^FS", 3);
+    } else {
+        static const char hex[] = "0123456789ABCDEF";
+        unsigned char     row[BK_SCANLINE_SIZE(THERMAL_MAX_ROW_PIXELS)];
+        char              line[2 * THERMAL_MAX_ROW_BYTES];
+        int               bytes = bk_scanline_1bpp(modules, geometry->module, row);
+        int               total = bytes * geometry->bar_height;
+
+        thermal_printf(writer,
+                       "^FO%d,%d^GFA,%d,%d,%d,",
+                       geometry->padding,
+                       geometry->padding,
+                       total,
+                       total,
+                       bytes);
+        for (int i = 0; i < bytes; i++) {
+            line[2 * i]     = hex[row[i] >> 4];
+            line[2 * i + 1] = hex[row[i] & 0xF];
+        }
+        thermal_write(writer, line, 2 * bytes);
+        // A colon repeats the previous row
+        memset(line, ':', sizeof line);
+        for (int left = geometry->bar_height - 1; left > 0; left -= sizeof line) {
+            thermal_write(writer, line, left < (int) sizeof line ? left : (int) sizeof line);
+        }
+        thermal_write(writer, "^FS", 3);
+
+        if (geometry->fontsize > 0) {
+            thermal_printf(writer,
+                           "^FO%d,%d^A0N,%d^FB%d,1,0,C^FH%c^FD",
+                           geometry->padding,
+                           geometry->padding + geometry->bar_height,
+                           geometry->fontsize,
+                           modules->num_modules * geometry->module,
+                           THERMAL_ZPL_HEX);
+            write_data(writer, BK_THERMAL_ZPL, barcode);
+            thermal_write(writer, "^FS", 3);
+        }
+    }
+
+    thermal_printf(writer, "^PQ%d^XZ\n", quantity);
+}
+
+/*      @brief Write one EPL form, printed @c quantity times */
+// clang-format off
+static void write_epl(
+    ThermalWriter * writer,
+    const ThermalGeometry * geometry,
+    int dpi,
+    bool graphic,
+    const char * barcode,
+    const BKModules * modules,
+    int quantity
+) {
+    // clang-format on
+
+    thermal_printf(writer, "\nN\nR%d,%d\n", geometry->lmargin, geometry->tmargin);
+
+    if (!graphic) {
+        thermal_printf(writer,
+                       "B%d,%d,0,1,%d,%d,%d,%c,\"",
+                       geometry->padding,
+                       geometry->padding,
+                       geometry->module,
+                       geometry->module,
+                       geometry->bar_height,
+                       geometry->fontsize > 0 ? 'B' : 'N');
+        write_data(writer, BK_THERMAL_EPL, barcode);
+        thermal_write(writer, "\"\n", 2);
+    } else {
+        unsigned char row[BK_SCANLINE_SIZE(THERMAL_MAX_ROW_PIXELS)];
+        int           bytes = bk_scanline_1bpp(modules, geometry->module, row);
+
+        // Clear bits are printed in EPL
+        for (int i = 0; i < bytes; i++) {
+            row[i] = ~row[i];
+        }
+        thermal_printf(writer,
+                       "GW%d,%d,%d,%d,",
+                       geometry->padding,
+                       geometry->padding,
+                       bytes,
+                       geometry->bar_height);
+        for (int y = 0; y < geometry->bar_height; y++) {
+            thermal_write(writer, (const char *) row, bytes);
+        }
+        thermal_write(writer, "\n", 1);
+
+        if (geometry->fontsize > 0) {
+            static const int fonts[][2] = THERMAL_EPL_FONTS;
+            int              font       = 0;
+
+            // The largest font no taller than the text
+            while (font + 1 < (int) (sizeof fonts / sizeof fonts[0])
+                   && fonts[font + 1][0] * dpi / THERMAL_EPL_FONT_DPI <= geometry->fontsize) {
+                font++;
+            }
+            int text_width = strlen(barcode) * fonts[font][1] * dpi / THERMAL_EPL_FONT_DPI;
+            int bars_width = modules->num_modules * geometry->module;
+
+            thermal_printf(writer,
+                           "A%d,%d,0,%d,1,1,N,\"",
+                           geometry->padding + (bars_width - text_width) / 2,
+                           geometry->padding + geometry->bar_height,
+                           font + 1);
+            write_data(writer, BK_THERMAL_EPL, barcode);
+            thermal_write(writer, "\"\n", 2);
+        }
+    }
+
+    thermal_printf(writer, "P%d\n", quantity);
+}
+
+int bk_thermal_parse(const char * name, BKThermalOptions * options) {
+    static const struct {
+        const char *      name;
+        BKThermalLanguage language;
+    } languages[] = {
+        { "ps", BK_THERMAL_NONE },
+        { "zpl", BK_THERMAL_ZPL },
+        { "epl", BK_THERMAL_EPL },
+    };
+    size_t len = strcspn(name, "-");
+
+    for (size_t i = 0; i < sizeof languages / sizeof languages[0]; i++) {
+        if (strlen(languages[i].name) != len || 0 != strncmp(name, languages[i].name, len)) {
+            continue;
+        }
+        if ('\0' == name[len]) {
+            options->language = languages[i].language;
+            options->graphic  = false;
+            return SUCCESS;
+        } else if (BK_THERMAL_NONE != languages[i].language
+                   && 0 == strcmp(name + len, BK_THERMAL_GRAPHIC_SUFFIX)) {
+            options->language = languages[i].language;
+            options->graphic  = true;
+            return SUCCESS;
+        }
+    }
+
+    return ERR_INVALID_STRING;
+}
+
+/**
+ *      @details Every row is encoded, even when the printer draws the barcode itself, so that
+ *              barcodes it could not encode fail the job as they would in PostScript.
+ */
+// clang-format off
+int bk_generate_thermal(
+    BKSource * source,
+    PSProperties * props,
+    const BKThermalOptions * options,
+    BKSink * sink,
+    BKGenerateStats * stats
+) {
+    // clang-format on
+
+    ThermalWriter   writer = { sink, 0, SUCCESS };
+    ThermalGeometry geometry;
+    int             dpi    = options->dpi > 0 ? options->dpi : BK_THERMAL_DEFAULT_DPI;
+    long            labels = 0;
+    int             status = SUCCESS;
+    double          dots;
+
+    if (BK_THERMAL_ZPL != options->language && BK_THERMAL_EPL != options->language) {
+        return ERR_ARGUMENT;
+    }
+
+    // Dots per unit of the properties
+    if (0 == strcmp(props->units, "mm")) {
+        dots = dpi / 25.4;
+    } else if (0 == strcmp(props->units, "cm")) {
+        dots = dpi / 2.54;
+    } else if (0 == strcmp(props->units, "in")) {
+        dots = dpi;
+    } else {
+        dots = dpi / 72.0;
+    }
+    geometry.lmargin    = lround(props->lmargin * dots);
+    geometry.tmargin    = lround(props->tmargin * dots);
+    geometry.padding    = lround(props->padding * dots);
+    geometry.module     = lround(props->bar_width * dots);
+    geometry.bar_height = lround(props->bar_height * dots);
+    geometry.fontsize   = lround(props->fontsize * dots);
+    if (geometry.module < 1) {
+        geometry.module = 1;
+    } else if (geometry.module > BK_THERMAL_MAX_MODULE_DOTS) {
+        geometry.module = BK_THERMAL_MAX_MODULE_DOTS;
+    }
+
+    uint64_t job_start = bk_trace_begin();
+
+    while (SUCCESS == status) {
+        const char * barcode;
+        int          quantity;
+        BKModules    modules;
+
+        status = source->next(source->ctx, &barcode, &quantity);
+        if (BK_SOURCE_END == status) {
+            status = SUCCESS;
+            break;
+        } else if (SUCCESS != status) {
+            break;
+        } else if (quantity <= 0) {
+            continue;
+        }
+
+        status = bk_modules_encode(barcode, strlen(barcode), &modules);
+
+        for (int left = quantity; left > 0 && SUCCESS == status; left -= BK_THERMAL_MAX_QUANTITY) {
+            int copies = left < BK_THERMAL_MAX_QUANTITY ? left : BK_THERMAL_MAX_QUANTITY;
+
+            if (BK_THERMAL_ZPL == options->language) {
+                write_zpl(&writer, &geometry, options->graphic, barcode, &modules, copies);
+            } else {
+                write_epl(&writer, &geometry, dpi, options->graphic, barcode, &modules, copies);
+            }
+            status = writer.status;
+        }
+        if (SUCCESS == status) {
+            labels += quantity;
+        }
+    }
+
+    if (NULL != stats) {
+        stats->labels = labels;
+        stats->pages  = labels;
+        stats->bytes  = writer.bytes;
+    }
+
+    bk_metrics_observe(BK_METRIC_JOB_SECONDS, bk_trace_end(BK_TRACE_THERMAL, job_start));
+    bk_metrics_add(SUCCESS == status ? BK_METRIC_JOBS : BK_METRIC_JOB_FAILURES, 1);
+    bk_metrics_add(BK_METRIC_LABELS, labels);
+    bk_metrics_add(BK_METRIC_PAGES, labels);
+    bk_metrics_add(BK_METRIC_BYTES, writer.bytes);
+
+    return status;
+}
@@ -0,0 +1,94 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file thermal.h
+ *      @brief Thermal label printer command language declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Thermal label printers are sent their own command language - ZPL or EPL - rather than
+ *      PostScript, which they would otherwise have to rasterise slowly or have rasterised on the
+ *      host. Each row of a job becomes a single label format printed as many times as its
+ *      quantity, so a job's size depends on its rows rather than its labels.
+ *
+ *      Units of PSProperties are converted to printer dots at the printer's resolution. Barcodes
+ *      are either drawn by the printer's own Code 128 command (@c ^BC in ZPL, @c B in EPL), which
+ *      chooses its own code sets and rounds the module width to whole dots, or sent as a bitmap
+ *      drawn from the module widths of modules.h (@c ^GF in ZPL, @c GW in EPL) where the geometry
+ *      must match the other backends exactly. Each label is a printer label, so layouts of rows
+ *      and columns do not apply.
+ */
+
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include "backend.h"
+#include "barcode.h"
+
+#include <stdbool.h>
+
+/**
+ *      @defgroup ThermalProperties Thermal printer properties
+ */
+/*@{*/
+// clang-format off
+#define BK_THERMAL_DEFAULT_DPI      203
+// Widest module ^BY and B accept, in dots
+#define BK_THERMAL_MAX_MODULE_DOTS  10
+// Most copies ^PQ and P accept - larger quantities are split over several formats
+#define BK_THERMAL_MAX_QUANTITY     99999999
+// Suffix of a language name selecting bitmap barcodes, e.g. "zpl-graphic"
+#define BK_THERMAL_GRAPHIC_SUFFIX   "-graphic"
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Printer command languages
+ *      @details BK_THERMAL_NONE generates PostScript as usual.
+ */
+typedef enum BKThermalLanguage {
+    BK_THERMAL_NONE = 0,
+    BK_THERMAL_ZPL,
+    BK_THERMAL_EPL,
+} BKThermalLanguage;
+
+/**
+ *      @brief How labels are generated for a thermal printer
+ *      @details @c dpi of 0 selects BK_THERMAL_DEFAULT_DPI.
+ */
+typedef struct BKThermalOptions {
+    BKThermalLanguage language;
+    int               dpi;
+    bool              graphic;
+} BKThermalOptions;
+
+/**
+ *      @brief Parse a language name - "ps", "zpl" or "epl", optionally followed by
+ *             BK_THERMAL_GRAPHIC_SUFFIX for bitmap barcodes
+ *      @param name The name to parse
+ *      @param options Destination for the language and whether barcodes are bitmaps
+ *      @return SUCCESS, ERR_INVALID_STRING
+ */
+int bk_thermal_parse(const char *, BKThermalOptions *);
+
+/**
+ *      @brief Generates printer commands from a stream of barcodes, one label format per row
+ *      @param source The barcodes and quantities to generate
+ *      @param props The PostScript properties, giving the margins and size of each label
+ *      @param options The language and resolution of the printer
+ *      @param sink The destination for the generated commands
+ *      @param stats Destination for a summary of the generated output, or NULL - each label is
+ *                   counted as a page
+ *      @return SUCCESS, ERR_ARGUMENT, ERR_DATA_LENGTH, ERR_CHAR_INVALID, or any error returned by
+ *              @c source or @c sink
+ */
+// clang-format off
+int bk_generate_thermal(
+    BKSource *, PSProperties *, const BKThermalOptions *, BKSink *, BKGenerateStats *);
+// clang-format on
+
+#endif
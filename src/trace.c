@@ -0,0 +1,289 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file trace.c
+ *      @brief Span tracer implementations as defined in trace.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "trace.h"
+
+#include "error.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+// Volatile accesses are acquire loads and release stores under MSVC
+#define TRACE_LOAD_COUNT(ptr) (*(volatile size_t *) (ptr))
+#define TRACE_STORE_COUNT(ptr, value) (*(volatile size_t *) (ptr) = (value))
+#define TRACE_LOAD_BUFFERS(head)                                                                   \
+    ((TraceBuffer *) InterlockedCompareExchangePointer((PVOID volatile *) (head), NULL, NULL))
+#define TRACE_PUSH(head, buffer)                                                                   \
+    do {                                                                                           \
+        (buffer)->next = TRACE_LOAD_BUFFERS(head);                                                 \
+    } while (InterlockedCompareExchangePointer((PVOID volatile *) (head), (buffer), (buffer)->next) \
+             != (buffer)->next)
+#define TRACE_NEXT_ID(ptr) ((int) InterlockedIncrement((volatile LONG *) (ptr)))
+#define TRACE_TRY_LOCK(ptr) (0 == InterlockedExchange((volatile LONG *) (ptr), 1))
+#define TRACE_UNLOCK(ptr) InterlockedExchange((volatile LONG *) (ptr), 0)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#define TRACE_LOAD_COUNT(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define TRACE_STORE_COUNT(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define TRACE_LOAD_BUFFERS(head) __atomic_load_n((head), __ATOMIC_ACQUIRE)
+#define TRACE_PUSH(head, buffer)                                                                   \
+    do {                                                                                           \
+        (buffer)->next = __atomic_load_n((head), __ATOMIC_RELAXED);                                \
+    } while (!__atomic_compare_exchange_n(                                                         \
+        (head), &(buffer)->next, (buffer), false, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+#define TRACE_NEXT_ID(ptr) ((int) __atomic_add_fetch((ptr), 1, __ATOMIC_RELAXED))
+#define TRACE_TRY_LOCK(ptr) (0 == __atomic_exchange_n((ptr), 1, __ATOMIC_ACQUIRE))
+#define TRACE_UNLOCK(ptr) __atomic_store_n((ptr), 0, __ATOMIC_RELEASE)
+#endif
+
+typedef struct TraceEvent {
+    const char * name;
+    uint64_t     start;
+    uint64_t     duration;
+} TraceEvent;
+
+/*
+ *      Each thread's spans, written only by that thread. count is published with release ordering
+ *      after the event it covers has been written, so bk_trace_dump() may read the buffer while the
+ *      thread carries on. Buffers are never freed, as a dump may be reading them.
+ */
+typedef struct TraceBuffer {
+    struct TraceBuffer * next;
+    int                  tid;
+    char                 name[BK_TRACE_NAME_LEN];
+    size_t               count;
+    size_t               dropped;
+    TraceEvent           events[BK_TRACE_EVENTS];
+} TraceBuffer;
+
+bool bk_trace_enabled = false;
+
+static char *                          trace_path;
+static uint64_t                        trace_epoch;
+static TraceBuffer *                   trace_buffers;
+static long                            trace_threads;
+static long                            trace_dumping;
+static TRACE_THREAD_LOCAL TraceBuffer *trace_buffer;
+
+/*      @brief The calling thread's buffer, registered on first use (NULL if it cannot be allocated) */
+static TraceBuffer * trace_thread_buffer(void) {
+    if (NULL == trace_buffer) {
+        TraceBuffer * buffer = calloc(1, sizeof *buffer);
+        if (NULL == buffer) {
+            return NULL;
+        }
+        buffer->tid = TRACE_NEXT_ID(&trace_threads);
+        TRACE_PUSH(&trace_buffers, buffer);
+        trace_buffer = buffer;
+    }
+    return trace_buffer;
+}
+
+void bk_trace_time_spans(void) {
+    bk_trace_enabled = true;
+}
+
+uint64_t bk_trace_end(const char * name, uint64_t start) {
+    if (0 == start) {
+        return 0;
+    }
+
+    uint64_t duration = bk_clock_ns() - start;
+    if (NULL == trace_path) {
+        return duration;
+    }
+
+    TraceBuffer * buffer = trace_thread_buffer();
+    if (NULL == buffer) {
+        return duration;
+    }
+
+    size_t count = buffer->count;
+    if (count == BK_TRACE_EVENTS) {
+        buffer->dropped++;
+        return duration;
+    }
+
+    buffer->events[count].name     = name;
+    buffer->events[count].start    = start;
+    buffer->events[count].duration = duration;
+    TRACE_STORE_COUNT(&buffer->count, count + 1);
+
+    return duration;
+}
+
+void bk_trace_thread_name(const char * name) {
+    if (NULL == trace_path) {
+        return;
+    }
+
+    TraceBuffer * buffer = trace_thread_buffer();
+    if (NULL != buffer) {
+        strncpy(buffer->name, name, BK_TRACE_NAME_LEN - 1);
+    }
+}
+
+/**
+ *      @details Spans are written as complete ("X") events, timed in microseconds from
+ *              bk_trace_init(), and each thread as a metadata event naming it. The trace is written
+ *              to a temporary file which then replaces the trace file, so that a trace being read
+ *              is never half-written. Only one dump runs at a time; another dump requested in the
+ *              meantime is skipped.
+ */
+int bk_trace_dump(void) {
+    if (NULL == trace_path || !TRACE_TRY_LOCK(&trace_dumping)) {
+        return SUCCESS;
+    }
+
+#ifdef _WIN32
+    long pid = GetCurrentProcessId();
+#else
+    long pid = getpid();
+#endif
+
+    size_t pathlen  = strlen(trace_path) + sizeof ".tmp";
+    char * tmp_path = malloc(pathlen);
+    FILE * trace    = NULL;
+    int    status   = SUCCESS;
+
+    if (NULL != tmp_path) {
+        snprintf(tmp_path, pathlen, "%s.tmp", trace_path);
+        trace = fopen(tmp_path, "w");
+    }
+
+    if (NULL == trace) {
+        status = ERR_FILE_OPEN_FAILED;
+    } else {
+        const char * sep = "";
+
+        fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", trace);
+
+        for (TraceBuffer * buffer = TRACE_LOAD_BUFFERS(&trace_buffers); NULL != buffer;
+             buffer               = buffer->next) {
+            size_t count = TRACE_LOAD_COUNT(&buffer->count);
+
+            // clang-format off
+            fprintf(trace,
+                    "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\",\"dropped\":%zu}}",
+                    sep, pid, buffer->tid,
+                    '\0' != buffer->name[0] ? buffer->name : "thread",
+                    buffer->dropped);
+            // clang-format on
+            sep = ",";
+
+            for (size_t i = 0; i < count; i++) {
+                TraceEvent * event = &buffer->events[i];
+                fprintf(trace,
+                        ",\n{\"name\":\"%s\",\"cat\":\"" BK_TRACE_CATEGORY "\",\"ph\":\"X\","
+                        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%d}",
+                        event->name,
+                        (event->start - trace_epoch) / 1e3,
+                        event->duration / 1e3,
+                        pid,
+                        buffer->tid);
+            }
+        }
+
+        fputs("\n]}\n", trace);
+
+        if (ferror(trace)) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+        if (0 != fclose(trace) && SUCCESS == status) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+#ifdef _WIN32
+        // rename() does not replace an existing file on Windows
+        remove(trace_path);
+#endif
+        if (SUCCESS == status && 0 != rename(tmp_path, trace_path)) {
+            status = ERR_FILE_WRITE_FAILED;
+        }
+    }
+
+    free(tmp_path);
+    TRACE_UNLOCK(&trace_dumping);
+
+    return status;
+}
+
+static void trace_atexit(void) {
+    bk_trace_dump();
+}
+
+#ifndef _WIN32
+/*      @brief Write the trace each time BK_TRACE_SIGNAL is received, which is blocked elsewhere */
+static void * trace_signal_thread(void * arg) {
+    sigset_t * signals = arg;
+    int        signal;
+
+    bk_trace_thread_name("tracer");
+
+    while (0 == sigwait(signals, &signal)) {
+        if (SUCCESS != bk_trace_dump()) {
+            fprintf(stderr, "Warning: could not write trace to %s\n", trace_path);
+        }
+    }
+
+    return NULL;
+}
+#endif
+
+/**
+ *      @details On Unix-compatible systems BK_TRACE_SIGNAL is blocked in the calling thread, and so
+ *              in every thread it goes on to start, then waited for by a detached thread of the
+ *              tracer's own.
+ */
+int bk_trace_init(void) {
+    const char * path = getenv(BK_TRACE_ENV);
+
+    if (NULL != trace_path || NULL == path || '\0' == path[0]) {
+        return SUCCESS;
+    }
+
+    trace_path = strdup(path);
+    VERIFY_NULL_BC(trace_path, strlen(path) + 1);
+
+    trace_epoch      = bk_clock_ns();
+    bk_trace_enabled = true;
+    atexit(trace_atexit);
+    bk_trace_thread_name("main");
+
+#ifndef _WIN32
+    static sigset_t signals;
+    pthread_t       thread;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, BK_TRACE_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (0 != pthread_create(&thread, NULL, trace_signal_thread, &signals)) {
+        return ERR_GENERIC;
+    }
+    pthread_detach(thread);
+#endif
+
+    return SUCCESS;
+}
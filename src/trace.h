@@ -0,0 +1,118 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file trace.h
+ *      @brief Span tracer declarations, exporting Chrome trace event JSON
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      Tracing is enabled by setting BK_TRACE_ENV to the path of the trace file before
+ *      bk_trace_init() is called. Spans are then recorded by every thread into a buffer of its own,
+ *      without locking, and written to the file on exit - and on Unix-compatible systems whenever
+ *      the process receives BK_TRACE_SIGNAL. The file can be opened in chrome://tracing or
+ *      https://ui.perfetto.dev. When tracing is disabled a span costs one branch.
+ *
+ *          uint64_t start = bk_trace_begin();
+ *          ...
+ *          bk_trace_end(BK_TRACE_LAYOUT, start);
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "backend.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ *      @defgroup TraceProperties Tracer properties
+ */
+/*@{*/
+// clang-format off
+#define BK_TRACE_ENV            "BARCODE_TRACE"
+#define BK_TRACE_SIGNAL         SIGUSR1
+// Spans kept per thread - later spans are counted, but dropped
+#define BK_TRACE_EVENTS         (128 * 1024)
+#define BK_TRACE_CATEGORY       "barcode"
+#define BK_TRACE_NAME_LEN       32
+// clang-format on
+/*@}*/
+
+/**
+ *      @defgroup TraceSpans Span names
+ */
+/*@{*/
+// clang-format off
+#define BK_TRACE_JOB            "job"
+// Reading and encoding the labels of one page
+#define BK_TRACE_ENCODE         "encode"
+#define BK_TRACE_LAYOUT         "layout page"
+#define BK_TRACE_WRITE          "write"
+#define BK_TRACE_FLUSH          "flush"
+#define BK_TRACE_SPAWN_LP       "spawn lp"
+#define BK_TRACE_WAIT_LP        "wait lp"
+#define BK_TRACE_PRINTERS       "printer discovery"
+#define BK_TRACE_REFRESH        "ui regeneration"
+#define BK_TRACE_SPECULATE      "ui background generation"
+#define BK_TRACE_PDF            "pdf job"
+#define BK_TRACE_THERMAL        "thermal job"
+#define BK_TRACE_RASTER         "raster job"
+#define BK_TRACE_IMAGES         "image export"
+// Reading a source held up by a sink's full queue (see fanout.h)
+#define BK_TRACE_FANOUT_WAIT    "fanout wait"
+// clang-format on
+/*@}*/
+
+/*      @brief Whether spans are being timed, for the trace or metrics - read through bk_trace_begin() */
+extern bool bk_trace_enabled;
+
+/**
+ *      @brief Enable tracing if BK_TRACE_ENV is set
+ *      @details Must be called before any other threads are started, so that they inherit the
+ *               blocked BK_TRACE_SIGNAL and it is only received by the tracer's own thread.
+ *      @return SUCCESS, or ERR_GENERIC if the signal thread could not be started
+ */
+int bk_trace_init(void);
+
+/**
+ *      @brief Time spans without recording them, so that their durations are returned by
+ *             bk_trace_end() - as the metrics do
+ */
+void bk_trace_time_spans(void);
+
+/**
+ *      @brief Start a span
+ *      @return The span's start time, or 0 if spans are not being timed
+ */
+static inline uint64_t bk_trace_begin(void) {
+    return bk_trace_enabled ? bk_clock_ns() : 0;
+}
+
+/**
+ *      @brief End a span started by bk_trace_begin(), recording it on the calling thread if tracing
+ *      @param name Name of the span, which must remain valid until the trace is written - in
+ *                  practice, one of the BK_TRACE_ span names
+ *      @param start The value returned by bk_trace_begin()
+ *      @return The span's duration in nanoseconds, or 0 if it was not timed
+ */
+uint64_t bk_trace_end(const char *, uint64_t);
+
+/**
+ *      @brief Name the calling thread in the trace
+ */
+void bk_trace_thread_name(const char *);
+
+/**
+ *      @brief Write every span recorded so far to the trace file
+ *      @details May be called while other threads are recording; spans they complete during the
+ *               write may be left out.
+ *      @return SUCCESS, ERR_FILE_OPEN_FAILED, ERR_FILE_WRITE_FAILED
+ */
+int bk_trace_dump(void);
+
+#endif
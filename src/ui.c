@@ -13,11 +13,19 @@
 
 #include "ui.h"
 
+#include "arena.h"
 #include "backend.h"
 #include "barcode.h"
+#include "batch.h"
+#include "dbsource.h"
 #include "error.h"
 #include "gtk/gtk.h"
+#include "import.h"
+#include "job.h"
+#include "preview.h"
+#include "trace.h"
 #include "util.h"
+#include "watchdog.h"
 #include "win.h"
 
 #include <ctype.h>
@@ -82,6 +90,271 @@ static int barcode_quantities[MAX_BARCODES];
  */
 static int barcode_entry_id = 0;
 
+/**
+ *      @brief Global job imported from files opened with the application
+ *      @details Imported barcodes are printed ahead of those entered via the UI. They are kept out
+ *              of the barcode entry widgets, as job files routinely hold far more rows than
+ *              MAX_BARCODES.
+ */
+static BKJob imported_job;
+
+/*      @brief Global path of an SQLite job source opened with the application, or NULL */
+static char * db_path;
+
+/*      @brief Global SQLite query and mark statement (NULL for the defaults) */
+static char *db_query, *db_mark;
+
+/**
+ *      @brief Global SQLite job source
+ *      @details Opened by refresh_postscript() when @c db_path is set, and kept open until the
+ *              print completes so that the rows read can be marked printed.
+ */
+static BKDBSource db_source;
+static bool       db_source_open = false;
+
+/*      @brief Global storage for the barcode list assembled by refresh_postscript() */
+static BKArena refresh_arena;
+
+/*      @brief Update the preview of the barcode entered in entry @c id */
+static void preview_entry(int id) {
+    preview_set_item(imported_job.num_barcodes + id, barcodes[id], barcode_quantities[id]);
+}
+
+/**
+ *      @brief Update the preview of every barcode, imported ones first as refresh_postscript()
+ *             orders them
+ *      @details Barcodes which have not changed are not redrawn, and the imported barcodes and the
+ *               entries are each set in one run, so that loading a job relabels it only once.
+ */
+static void preview_all(void) {
+    char * entries[MAX_BARCODES];
+
+    preview_set_num_items(imported_job.num_barcodes + barcode_entry_id);
+    bk_job_index(&imported_job);
+    preview_set_items(0, imported_job.num_barcodes, imported_job.barcodes, imported_job.quantities);
+    for (int i = 0; i < barcode_entry_id; i++) {
+        entries[i] = barcodes[i];
+    }
+    preview_set_items(imported_job.num_barcodes, barcode_entry_id, entries, barcode_quantities);
+}
+
+/**
+ *      @brief Output being generated in the background for the inputs as they were when it started
+ *      @details Entered barcodes are copied, as they change as each character is typed, but
+ *              imported barcodes are read in place from @c imported_job's string pool - so
+ *              @c imported_job may only be added to or freed after speculate_stop().
+ */
+typedef struct SpeculateTask {
+    PSProperties   props;
+    Layout         layout;
+    BKArraySource  array;
+    char *         entries;
+    GCancellable * cancellable;
+    char           path[BK_TEMPFILE_TEMPLATE_SIZE];
+    int            status;
+} SpeculateTask;
+
+/*      @brief The pending SPECULATE_IDLE_MS timeout, or 0 */
+static guint speculate_timeout;
+/*      @brief Cancels the generation in progress, if any */
+static GCancellable * speculate_cancellable;
+/*      @brief Held by a worker while it generates, and so reads @c imported_job */
+static GMutex speculate_lock;
+/*      @brief Storage reused by each generation in the background, under @c speculate_lock */
+static BKGenerateContext speculate_context;
+
+/*      @brief Whether output has been prepared for the current inputs */
+static bool prepared = false;
+/*      @brief The status of generating the prepared output, as refresh_postscript() would return */
+static int prepared_status;
+/*      @brief Path of the prepared output, or empty if it could not be generated */
+static char prepared_path[BK_TEMPFILE_TEMPLATE_SIZE];
+
+static void speculate_task_free(gpointer data) {
+    SpeculateTask * task = data;
+
+    free(task->array.barcodes);
+    free(task->array.quantities);
+    free(task->entries);
+    g_object_unref(task->cancellable);
+    free(task);
+}
+
+/*      @brief Discard any prepared output, cancelling generation in progress or scheduled */
+static void speculate_cancel(void) {
+    if (0 != speculate_timeout) {
+        g_source_remove(speculate_timeout);
+        speculate_timeout = 0;
+    }
+    if (NULL != speculate_cancellable) {
+        g_cancellable_cancel(speculate_cancellable);
+        g_clear_object(&speculate_cancellable);
+    }
+
+    if ('\0' != prepared_path[0]) {
+        remove(prepared_path);
+        prepared_path[0] = '\0';
+    }
+    prepared = false;
+}
+
+/**
+ *      @brief As speculate_cancel(), also waiting until no worker is reading @c imported_job
+ *      @details Workers check for cancellation before each row they read, so stop soon after.
+ */
+static void speculate_stop(void) {
+    speculate_cancel();
+    g_mutex_lock(&speculate_lock);
+    g_mutex_unlock(&speculate_lock);
+}
+
+/*      @brief BKSource callback reading a SpeculateTask's barcodes until it is cancelled */
+static int speculate_next(void * ctx, const char ** barcode, int * quantity) {
+    SpeculateTask * task = ctx;
+
+    if (g_cancellable_is_cancelled(task->cancellable)) {
+        return ERR_CANCELLED;
+    }
+
+    return bk_array_next(&task->array, barcode, quantity);
+}
+
+/**
+ *      @details Runs on a worker thread, generating into a temporary file of its own so that the
+ *              backend's is left to refresh_postscript().
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+// clang-format off
+static void speculate_thread(
+    GTask * gtask,
+    gpointer source,
+    gpointer data,
+    GCancellable * cancellable
+) {
+    // clang-format on
+
+    SpeculateTask * task = data;
+    FILE *          file;
+    uint64_t        span = bk_trace_begin();
+
+    g_mutex_lock(&speculate_lock);
+
+    task->status = bk_tempfile_open(task->path, &file);
+    if (SUCCESS == task->status) {
+        BKSource rows = { speculate_next, task };
+        BKSink   sink = { bk_file_write, file };
+
+        task->status = bk_generate_context(
+            &rows, &task->props, &task->layout, &sink, &speculate_context, NULL);
+        if (EOF == fclose(file) && SUCCESS == task->status) {
+            task->status = ERR_FILE_CLOSE_FAILED;
+        }
+    } else {
+        task->path[0] = '\0';
+    }
+
+    g_mutex_unlock(&speculate_lock);
+    bk_trace_end(BK_TRACE_SPECULATE, span);
+
+    g_task_return_boolean(gtask, TRUE);
+}
+
+/**
+ *      @details Called on the main thread once speculate_thread() has finished. The output is only
+ *              kept if the inputs have not changed since it was started.
+ */
+static void speculate_done(GObject * source, GAsyncResult * result, gpointer user_data) {
+    SpeculateTask * task      = g_task_get_task_data(G_TASK(result));
+    bool            cancelled = g_cancellable_is_cancelled(task->cancellable);
+    const char *    previous  = watchdog_enter(__func__);
+
+    if ((cancelled || SUCCESS != task->status) && '\0' != task->path[0]) {
+        remove(task->path);
+    } else if (!cancelled) {
+        strncpy(prepared_path, task->path, sizeof prepared_path);
+    }
+
+    if (!cancelled) {
+        prepared        = true;
+        prepared_status = task->status;
+        g_clear_object(&speculate_cancellable);
+    }
+
+    watchdog_leave(previous);
+    g_application_release(G_APPLICATION(source));
+}
+
+/**
+ *      @details The inputs are snapshotted as refresh_postscript() would read them. SQLite job
+ *              sources are not generated in advance, as their rows may change before printing and
+ *              are marked printed as they are read.
+ */
+static gboolean speculate_start(gpointer data) {
+    GApplication * app = g_application_get_default();
+
+    speculate_timeout = 0;
+    if (NULL != db_path || NULL == app) {
+        return G_SOURCE_REMOVE;
+    }
+
+    size_t          task_size = sizeof(SpeculateTask);
+    SpeculateTask * task      = calloc(1, task_size);
+    VERIFY_NULL_BC(task, task_size);
+
+    task->props  = ps_properties;
+    task->layout = *page_layout;
+
+    int    max_barcodes  = imported_job.num_barcodes + barcode_entry_id;
+    size_t barcodes_size = sizeof(char *) * max_barcodes;
+    task->array.barcodes = malloc(barcodes_size);
+    VERIFY_NULL_BC(task->array.barcodes, barcodes_size);
+    size_t quantities_size = sizeof(int) * max_barcodes;
+    task->array.quantities = malloc(quantities_size);
+    VERIFY_NULL_BC(task->array.quantities, quantities_size);
+    size_t entries_size = (size_t) BK_BARCODE_LENGTH * barcode_entry_id;
+    task->entries       = malloc(entries_size);
+    VERIFY_NULL_BC(task->entries, entries_size);
+
+    bk_job_index(&imported_job);
+    for (int i = 0; i < imported_job.num_barcodes; i++) {
+        task->array.barcodes[i]   = imported_job.barcodes[i];
+        task->array.quantities[i] = imported_job.quantities[i];
+    }
+    task->array.num_barcodes = imported_job.num_barcodes;
+    for (int i = 0; i < barcode_entry_id; i++) {
+        if (strlen(barcodes[i]) > 0) {
+            char * entry = task->entries + (size_t) BK_BARCODE_LENGTH * i;
+            memcpy(entry, barcodes[i], BK_BARCODE_LENGTH);
+            task->array.barcodes[task->array.num_barcodes]   = entry;
+            task->array.quantities[task->array.num_barcodes] = barcode_quantities[i];
+            task->array.num_barcodes++;
+        }
+    }
+
+    task->cancellable     = g_cancellable_new();
+    speculate_cancellable = g_object_ref(task->cancellable);
+
+    GTask * gtask = g_task_new(app, NULL, speculate_done, NULL);
+    g_task_set_task_data(gtask, task, speculate_task_free);
+    g_application_hold(app);
+    g_task_run_in_thread(gtask, speculate_thread);
+    g_object_unref(gtask);
+
+    return G_SOURCE_REMOVE;
+}
+#pragma GCC diagnostic pop
+
+/**
+ *      @brief Regenerate the output in the background once the inputs are left unchanged
+ *      @details Called whenever a barcode, quantity or property changes. Output prepared or being
+ *              prepared for the previous inputs is discarded.
+ */
+static void speculate_schedule(void) {
+    speculate_cancel();
+    speculate_timeout = g_timeout_add(SPECULATE_IDLE_MS, speculate_start, NULL);
+}
+
 /**
  *      @details @c barcode_app_init is used for initialising the PostScript properties, page
  * layout, and barcode quantities to their respective default values.
@@ -105,6 +378,9 @@ static void barcode_app_init(BarcodeApp * app) {
 
     page_layout->cols = DEFAULT_COLS;
     page_layout->rows = DEFAULT_ROWS;
+
+    bk_job_init(&imported_job);
+    bk_context_init(&speculate_context);
 }
 
 #pragma GCC diagnostic pop
@@ -117,11 +393,14 @@ static void barcode_app_init(BarcodeApp * app) {
  */
 static void barcode_app_activate(GApplication * app) {
 
+    const char * previous = watchdog_enter(__func__);
+
     /* GTK does not allow settings default combo box values (for the 'units' property), so these are
        used as intermediate storage in looking up the units box. Flow boxes are created with
        indexed children, so nested flow boxes need to be looked up by name, then extracted via an
        index, then children objects looked up by name again etc. */
-    GtkWidget *combo_box, *page_layout_box, *units_box;
+    GtkWidget *combo_box, *page_layout_box, *units_box, *preview_area, *thumbnail_area;
+    GList *    children;
 
     win = barcode_window_new(BARCODE_APP(app));
 
@@ -131,17 +410,26 @@ static void barcode_app_activate(GApplication * app) {
     settings_label = GTK_LABEL(gtk_frame_get_label_widget(GTK_FRAME(settings_frame)));
 
     WIDGET_LOOKUP(win, ui_hint_view_path, UI_HINT_VIEW_PATH_LENGTH, ui_hint_view);
-    ui_hint_text_buffer = gtk_text_buffer_new(gtk_text_tag_table_new());
+    // The view holds its own reference to the buffer, which creates its own tag table
+    g_clear_object(&ui_hint_text_buffer);
+    ui_hint_text_buffer = gtk_text_buffer_new(NULL);
     gtk_text_view_set_buffer(GTK_TEXT_VIEW(ui_hint_view), ui_hint_text_buffer);
 
     WIDGET_LOOKUP(win, settings_box_path, SETTINGS_BOX_PATH_LENGTH, settings_box);
 
     WIDGET_LOOKUP(win, printer_combo_box_path, PRINTER_COMBO_BOX_PATH_LENGTH, printer_combo_box);
 
+    WIDGET_LOOKUP(win, preview_area_path, PREVIEW_AREA_PATH_LENGTH, preview_area);
+    WIDGET_LOOKUP(win, thumbnail_area_path, THUMBNAIL_AREA_PATH_LENGTH, thumbnail_area);
+    preview_init(preview_area, thumbnail_area);
+    preview_set_layout(&ps_properties, page_layout);
+
     // Populate printer combo box
     char ** printers;
     int     num_printers, max_printer_len = 0;
-    int     status = bk_get_printers(&printers, &num_printers);
+    const char * caller = watchdog_enter("bk_get_printers");
+    int          status = bk_get_printers(&printers, &num_printers);
+    watchdog_leave(caller);
     if (status == SUCCESS) {
         for (int i = 0; i < num_printers; i++) {
             int printer_len = strlen(printers[i]);
@@ -152,6 +440,8 @@ static void barcode_app_activate(GApplication * app) {
                 GTK_COMBO_BOX_TEXT(printer_combo_box), i, printers[i], printers[i]);
         }
         max_printer_len++; // null-terminator
+        // Each activation opens a new window, which looks the printers up again
+        free(selected_printer);
         selected_printer_length = max_printer_len;
         selected_printer        = calloc(1, selected_printer_length);
         VERIFY_NULL_BC(selected_printer, selected_printer_length);
@@ -168,21 +458,27 @@ static void barcode_app_activate(GApplication * app) {
     gtk_combo_box_set_active(GTK_COMBO_BOX(printer_combo_box), 0);
 
     new_barcode_btn_clicked(NULL, NULL);
+    preview_all();
+    speculate_schedule();
 
     // Extract the outer settings_box flow box...
     WIDGET_LOOKUP(settings_box, page_layout_box_path, PAGE_LAYOUT_BOX_PATH_LENGTH, page_layout_box);
     // ...look up the units flow box via index...
 
     // clang-format off
-    units_box = gtk_container_get_children(
+    children = gtk_container_get_children(
         GTK_CONTAINER(gtk_flow_box_get_child_at_index(GTK_FLOW_BOX(page_layout_box),
         UNITS_BOX_IDX))
-    )->data;
+    );
+    units_box = children->data;
+    g_list_free(children);
     // ...extract the units combo box from the units flow box, again by index
-    combo_box = gtk_container_get_children(
+    children = gtk_container_get_children(
         GTK_CONTAINER(gtk_flow_box_get_child_at_index(GTK_FLOW_BOX(units_box),
         UNITS_COMBO_IDX))
-    )->data;
+    );
+    combo_box = children->data;
+    g_list_free(children);
     // clang-format on
 
     if (NULL == combo_box) {
@@ -193,20 +489,354 @@ static void barcode_app_activate(GApplication * app) {
     gtk_combo_box_set_active_id(GTK_COMBO_BOX(combo_box), DEFAULT_UNIT);
 
     gtk_window_present(GTK_WINDOW(win));
+
+    watchdog_leave(previous);
 }
 
+/**
+ *      @brief A set of job files being imported on a worker thread
+ *      @details Files are imported in order into a private job, which is merged into
+ *              @c imported_job on the main thread once every file has been read.
+ */
+typedef struct ImportTask {
+    char **       paths;
+    int           num_paths;
+    int           failed_path;
+    BKJob         job;
+    BKImportStats stats;
+    int           status;
+} ImportTask;
+
+static void import_task_free(gpointer data) {
+    ImportTask * task = data;
+
+    for (int i = 0; i < task->num_paths; i++) {
+        g_free(task->paths[i]);
+    }
+    free(task->paths);
+    bk_job_free(&task->job);
+    free(task);
+}
+
+/**
+ *      @details Runs on a worker thread, so touches nothing but the task itself.
+ */
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
+// clang-format off
+static void import_thread(
+    GTask * gtask,
+    gpointer source,
+    gpointer data,
+    GCancellable * cancellable
+) {
+    // clang-format on
+
+    ImportTask * task = data;
+
+    memset(&task->stats, 0, sizeof task->stats);
+    task->status = SUCCESS;
+
+    for (int i = 0; i < task->num_paths && SUCCESS == task->status; i++) {
+        BKImportStats stats;
+
+        if (NULL == task->paths[i]) {
+            task->status = ERR_FILE_OPEN_FAILED;
+        } else {
+            task->status = bk_import_file(task->paths[i], NULL, &task->job, &stats);
+        }
+
+        if (SUCCESS == task->status) {
+            task->stats.rows += stats.rows;
+            task->stats.labels += stats.labels;
+            task->stats.bytes += stats.bytes;
+            task->stats.elapsed_ms += stats.elapsed_ms;
+        } else {
+            task->failed_path = i;
+        }
+    }
+
+    g_task_return_boolean(gtask, TRUE);
+}
+
+/**
+ *      @details Called on the main thread once import_thread() has finished. Rows are only merged
+ *              into @c imported_job if every file was imported successfully.
+ */
+static void import_done(GObject * source, GAsyncResult * result, gpointer user_data) {
+    ImportTask * task     = g_task_get_task_data(G_TASK(result));
+    const char * previous = watchdog_enter(__func__);
+
+    if (SUCCESS == task->status) {
+        speculate_stop();
+        if (0 == imported_job.num_barcodes) {
+            // Nothing to merge with, so take the imported storage as-is
+            bk_job_free(&imported_job);
+            imported_job = task->job;
+            bk_job_init(&task->job);
+        } else {
+            for (int i = 0; i < task->job.num_barcodes; i++) {
+                const char * barcode = bk_job_barcode(&task->job, i);
+                bk_job_add(&imported_job, barcode, strlen(barcode), task->job.quantities[i]);
+            }
+        }
+        preview_all();
+        speculate_schedule();
+
+        char message[UI_HINT_MAX_LEN];
+        snprintf(message,
+                 UI_HINT_MAX_LEN,
+                 "Imported %ld barcodes (%ld labels) from %d file%s in %.1f ms\n",
+                 task->stats.rows,
+                 task->stats.labels,
+                 task->num_paths,
+                 task->num_paths == 1 ? "" : "s",
+                 task->stats.elapsed_ms);
+        gtk_text_buffer_set_text(GTK_TEXT_BUFFER(ui_hint_text_buffer), message, -1);
+    } else {
+        fprintf(stderr,
+                "ERROR: could not import \"%s\"\n",
+                task->paths[task->failed_path] ? task->paths[task->failed_path] : "(unknown)");
+        ui_hint(task->status);
+    }
+
+    watchdog_leave(previous);
+    g_application_release(G_APPLICATION(source));
+}
+
+/**
+ *      @details Files are imported on a worker thread so that the window stays responsive while
+ *              large job files load. The application is held until the import completes.
+ */
 static void barcode_app_open(GApplication * app, GFile ** files, gint n_files, const gchar * hint) {
 
     barcode_app_activate(app);
+
+    // SQLite databases are read when printing rather than imported
+    int num_imports = 0;
+    for (int i = 0; i < n_files; i++) {
+        char * path = g_file_get_path(files[i]);
+        if (NULL != path && BK_FORMAT_SQLITE == bk_import_format(path)) {
+            char message[UI_HINT_MAX_LEN];
+            snprintf(message, UI_HINT_MAX_LEN, "Labels will be printed from %s\n", path);
+            gtk_text_buffer_set_text(GTK_TEXT_BUFFER(ui_hint_text_buffer), message, -1);
+
+            g_free(db_path);
+            db_path = path;
+            speculate_cancel();
+        } else {
+            num_imports++;
+            g_free(path);
+        }
+    }
+
+    if (num_imports < 1) {
+        return;
+    }
+
+    size_t       task_size = sizeof(ImportTask);
+    ImportTask * task      = calloc(1, task_size);
+    VERIFY_NULL_BC(task, task_size);
+
+    size_t paths_size = sizeof *task->paths * n_files;
+    task->paths       = calloc(1, paths_size);
+    VERIFY_NULL_BC(task->paths, paths_size);
+
+    for (int i = 0; i < n_files; i++) {
+        char * path = g_file_get_path(files[i]);
+        if (NULL != path && BK_FORMAT_SQLITE == bk_import_format(path)) {
+            g_free(path);
+        } else {
+            task->paths[task->num_paths++] = path;
+        }
+    }
+    bk_job_init(&task->job);
+
+    gtk_text_buffer_set_text(GTK_TEXT_BUFFER(ui_hint_text_buffer), "Importing job files…\n", -1);
+
+    GTask * gtask = g_task_new(app, NULL, import_done, NULL);
+    g_task_set_task_data(gtask, task, import_task_free);
+    g_application_hold(app);
+    g_task_run_in_thread(gtask, import_thread);
+    g_object_unref(gtask);
+}
+#pragma GCC diagnostic pop
+
+/**
+ *      @brief A print job passed on the command line, printed on a worker thread
+ *      @details The option strings are owned by the task, as the command line they came from is
+ *              freed once barcode_app_command_line() returns.
+ */
+typedef struct BatchTask {
+    BKBatchOptions            options;
+    BKBatchResult             result;
+    int                       status;
+    GApplicationCommandLine * cmdline;
+} BatchTask;
+
+static void batch_task_free(gpointer data) {
+    BatchTask * task = data;
+
+    g_free((char *) task->options.path);
+    g_free((char *) task->options.printer);
+    g_free((char *) task->options.query);
+    g_free((char *) task->options.mark);
+    g_free((char *) task->options.archive);
+    g_free((char *) task->options.images.dir);
+    g_object_unref(task->cmdline);
+    free(task);
+}
+
+/*      @brief Resolve a path given on a command line against its working directory, or NULL */
+static char * batch_task_path(GApplicationCommandLine * cmdline, const char * arg) {
+    if (NULL == arg) {
+        return NULL;
+    }
+
+    GFile * file = g_application_command_line_create_file_for_arg(cmdline, arg);
+    char *  path = g_file_get_path(file);
+    g_object_unref(file);
+
+    return path;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+// clang-format off
+static void batch_thread(
+    GTask * gtask,
+    gpointer source,
+    gpointer data,
+    GCancellable * cancellable
+) {
+    // clang-format on
+
+    BatchTask * task = data;
+
+    task->status = bk_batch_run(&task->options, &task->result);
+    g_task_return_boolean(gtask, TRUE);
+}
+
+/**
+ *      @details Reports the job to the process whose command line it came from, which exits once
+ *              the task releases its command line object.
+ */
+static void batch_done(GObject * source, GAsyncResult * result, gpointer user_data) {
+    BatchTask * task = g_task_get_task_data(G_TASK(result));
+    char        summary[BK_EXEC_BUFSIZE];
+
+    bk_batch_report(&task->options, task->status, &task->result, summary, sizeof summary);
+
+    if (SUCCESS == task->status) {
+        g_application_command_line_print(task->cmdline, "%s", summary);
+    } else {
+        g_application_command_line_printerr(task->cmdline, "%s", summary);
+    }
+    g_application_command_line_set_exit_status(
+        task->cmdline, SUCCESS == task->status ? EXIT_SUCCESS : EXIT_FAILURE);
+
+    g_application_release(G_APPLICATION(source));
+}
+
+/**
+ *      @details Runs in the primary instance, for its own command line and for those of later
+ *              invocations. A print job is printed on a worker thread without touching the window,
+ *              so that a script printing through a running instance does not pay for starting one.
+ *              Paths are resolved against the working directory of the invoking process.
+ */
+static int barcode_app_command_line(GApplication * app, GApplicationCommandLine * cmdline) {
+    CmdLineOptions options;
+    gint           argc;
+    gchar **       argv = g_application_command_line_get_arguments(cmdline, &argc);
+
+    if (SUCCESS != cmd_line_parse(argc, argv, &options)) {
+        g_strfreev(argv);
+        return EXIT_FAILURE;
+    }
+
+    if (NULL != options.batch.path) {
+        size_t      task_size = sizeof(BatchTask);
+        BatchTask * task      = calloc(1, task_size);
+        VERIFY_NULL_BC(task, task_size);
+
+        GFile * file =
+            g_application_command_line_create_file_for_arg(cmdline, options.batch.path);
+        task->options.path    = g_file_get_path(file);
+        task->options.printer = g_strdup(options.batch.printer);
+        task->options.query   = g_strdup(options.batch.query);
+        task->options.mark    = g_strdup(options.batch.mark);
+        task->options.thermal    = options.batch.thermal;
+        task->options.raster_dpi = options.batch.raster_dpi;
+        task->options.archive    = batch_task_path(cmdline, options.batch.archive);
+        // Only the directory and format of the images are used, and the directory is owned
+        task->options.images       = options.batch.images;
+        task->options.images.path  = NULL;
+        task->options.images.query = NULL;
+        task->options.images.dir   = batch_task_path(cmdline, options.batch.images.dir);
+        task->cmdline            = g_object_ref(cmdline);
+        g_object_unref(file);
+
+        GTask * gtask = g_task_new(app, NULL, batch_done, NULL);
+        g_task_set_task_data(gtask, task, batch_task_free);
+        g_application_hold(app);
+        g_task_run_in_thread(gtask, batch_thread);
+        g_object_unref(gtask);
+
+        g_strfreev(argv);
+        return EXIT_SUCCESS;
+    }
+
+    if (NULL != options.batch.query || NULL != options.batch.mark) {
+        ui_set_db_query(options.batch.query, options.batch.mark);
+    }
+
+    int num_files = argc - options.first_file;
+    if (num_files > 0) {
+        size_t   files_size = sizeof(GFile *) * num_files;
+        GFile ** files      = calloc(1, files_size);
+        VERIFY_NULL_BC(files, files_size);
+
+        for (int i = 0; i < num_files; i++) {
+            files[i] = g_application_command_line_create_file_for_arg(
+                cmdline, argv[options.first_file + i]);
+        }
+        g_application_open(app, files, num_files, "");
+
+        for (int i = 0; i < num_files; i++) {
+            g_object_unref(files[i]);
+        }
+        free(files);
+    } else {
+        g_application_activate(app);
+    }
+
+    g_strfreev(argv);
+    return EXIT_SUCCESS;
 }
 #pragma GCC diagnostic pop
 
+/**
+ *      @details Runs only in the primary instance, before the first activation, so that the
+ *              watchdog covers activating as well as everything after it.
+ */
+static void barcode_app_startup(GApplication * app) {
+    G_APPLICATION_CLASS(barcode_app_parent_class)->startup(app);
+    watchdog_start();
+}
+
+/*      @details The main loop stops iterating once shut down, which must not be reported */
+static void barcode_app_shutdown(GApplication * app) {
+    watchdog_stop();
+    G_APPLICATION_CLASS(barcode_app_parent_class)->shutdown(app);
+}
+
 static void barcode_app_class_init(BarcodeAppClass * class) {
 
-    G_APPLICATION_CLASS(class)->activate = barcode_app_activate;
-    G_APPLICATION_CLASS(class)->open     = barcode_app_open;
+    G_APPLICATION_CLASS(class)->startup      = barcode_app_startup;
+    G_APPLICATION_CLASS(class)->shutdown     = barcode_app_shutdown;
+    G_APPLICATION_CLASS(class)->activate     = barcode_app_activate;
+    G_APPLICATION_CLASS(class)->open         = barcode_app_open;
+    G_APPLICATION_CLASS(class)->command_line = barcode_app_command_line;
 }
 
 BarcodeApp * barcode_app_new(void) {
@@ -215,12 +845,50 @@ BarcodeApp * barcode_app_new(void) {
     return g_object_new(
         BARCODE_TYPE_APP,
         "application-id",
-        "org.eschutz.barcode",
+        BARCODE_APP_ID,
         "flags",
-        G_APPLICATION_HANDLES_OPEN,
+        G_APPLICATION_HANDLES_OPEN | G_APPLICATION_HANDLES_COMMAND_LINE,
+        NULL
+    );
+    // clang-format on
+}
+
+/**
+ *      @details Asks the session bus directly rather than registering the application, as
+ *              registering would make this process the primary instance if none were running,
+ *              which would start GTK.
+ */
+bool ui_primary_running(void) {
+    gboolean          owned = FALSE;
+    GDBusConnection * bus   = g_bus_get_sync(G_BUS_TYPE_SESSION, NULL, NULL);
+
+    if (NULL == bus) {
+        return false;
+    }
+
+    // clang-format off
+    GVariant * reply = g_dbus_connection_call_sync(
+        bus,
+        "org.freedesktop.DBus",
+        "/org/freedesktop/DBus",
+        "org.freedesktop.DBus",
+        "NameHasOwner",
+        g_variant_new("(s)", BARCODE_APP_ID),
+        G_VARIANT_TYPE("(b)"),
+        G_DBUS_CALL_FLAGS_NONE,
+        -1,
+        NULL,
         NULL
     );
     // clang-format on
+
+    if (NULL != reply) {
+        g_variant_get(reply, "(b)", &owned);
+        g_variant_unref(reply);
+    }
+    g_object_unref(bus);
+
+    return owned;
 }
 
 /**
@@ -229,52 +897,68 @@ BarcodeApp * barcode_app_new(void) {
  */
 int refresh_postscript(char ** print_file_dest) {
 
-// barcode_entry_id here represents the number of barcode entry dialogues on screen
-#ifdef _WIN32
-    size_t  new_barcodes_size = sizeof(char *) * barcode_entry_id;
-    char ** new_barcodes      = calloc(1, new_barcodes_size);
+    uint64_t     span     = bk_trace_begin();
+    const char * previous = watchdog_enter(__func__);
+
+    // The list only lives until the PostScript is generated, so its storage is reused by the next
+    // refresh rather than freed
+    bk_arena_reset(&refresh_arena);
+
+    // Imported barcodes come first, followed by those entered via the UI
+    int     max_barcodes      = imported_job.num_barcodes + barcode_entry_id;
+    size_t  new_barcodes_size = sizeof(char *) * max_barcodes;
+    char ** new_barcodes      = bk_arena_alloc(&refresh_arena, new_barcodes_size);
     VERIFY_NULL_BC(new_barcodes, new_barcodes_size);
-    size_t elem_size = sizeof(new_barcodes[0]) * BK_BARCODE_LENGTH;
-    for (int i = 0; i < barcode_entry_id; i++) {
-        new_barcodes[i] = calloc(1, elem_size);
-        VERIFY_NULL_BC(new_barcodes[i], elem_size);
-    }
-    size_t quantities_size        = sizeof(int) * barcode_entry_id;
-    int *  new_barcode_quantities = calloc(1, quantities_size);
+    size_t quantities_size        = sizeof(int) * max_barcodes;
+    int *  new_barcode_quantities = bk_arena_alloc(&refresh_arena, quantities_size);
     VERIFY_NULL_BC(new_barcode_quantities, quantities_size);
-#else
-    char new_barcodes[barcode_entry_id][BK_BARCODE_LENGTH];
-    int  new_barcode_quantities[barcode_entry_id];
-#endif
+
+    bk_job_index(&imported_job);
+    for (int i = 0; i < imported_job.num_barcodes; i++) {
+        new_barcodes[i]           = imported_job.barcodes[i];
+        new_barcode_quantities[i] = imported_job.quantities[i];
+    }
 
     // Filter out empty barcode entries
-    int new_barcodes_num = 0;
+    // barcode_entry_id here represents the number of barcode entry dialogues on screen
+    int new_barcodes_num = imported_job.num_barcodes;
     for (int i = 0; i < barcode_entry_id; i++) {
         if (strlen(barcodes[i]) > 0) {
             /* new_barcodes_num is the number of non-empty barcodes so far, so is the index of the
                next non-empty barcode */
-            strncpy(new_barcodes[new_barcodes_num], barcodes[i], BK_BARCODE_LENGTH);
+            new_barcodes[new_barcodes_num]           = barcodes[i];
             new_barcode_quantities[new_barcodes_num] = barcode_quantities[i];
             new_barcodes_num++;
         }
     }
 
-    // bk_generate_png generates the print preview and fills print_file_name with its file path as a
-    // string
-    int result = bk_generate(new_barcodes,
-                             new_barcode_quantities,
-                             new_barcodes_num,
-                             &ps_properties,
-                             page_layout,
-                             print_file_dest);
+    // The SQLite job source, if any, is read after the barcodes above
+    BKArraySource array      = { new_barcodes, new_barcode_quantities, new_barcodes_num, 0 };
+    BKSource      sources[2] = { { bk_array_next, &array } };
+    BKChainSource chain      = { sources, 1, 0 };
+    BKSource      source     = { bk_chain_next, &chain };
+    int           result     = SUCCESS;
 
-#ifdef _WIN32
-    for (int i = 0; i < barcode_entry_id; i++) {
-        free(new_barcodes[i]);
+    if (NULL != db_path) {
+        if (db_source_open) {
+            bk_db_close(&db_source);
+        }
+        result         = bk_db_open(&db_source, db_path, db_query);
+        db_source_open = SUCCESS == result;
+        sources[1]     = bk_db_source(&db_source);
+        chain.num_sources++;
+    }
+
+    // bk_generate_source generates the PostScript and fills print_file_dest with its file path as
+    // a string
+    if (SUCCESS == result) {
+        result =
+            bk_generate_source(&source, &ps_properties, page_layout, print_file_dest, NULL);
     }
-    free(new_barcodes);
-    free(new_barcode_quantities);
-#endif
+
+    bk_trace_end(BK_TRACE_REFRESH, span);
+    watchdog_leave(previous);
+
     return result;
 }
 
@@ -340,6 +1024,35 @@ int ui_hint(int err) {
                      "ERROR: Could not get list of printers - check the output of %s\n",
                      BK_GET_PRINTER_CMD);
             break;
+        case ERR_FILE_OPEN_FAILED:
+            strncpy(message, "ERROR: Could not open job file\n", UI_HINT_MAX_LEN);
+            break;
+        case ERR_MMAP:
+            strncpy(message, "ERROR: Could not read job file into memory\n", UI_HINT_MAX_LEN);
+            break;
+        case ERR_UNSUPPORTED_FORMAT:
+            strncpy(message, "ERROR: Unsupported job file format\n", UI_HINT_MAX_LEN);
+            break;
+        case ERR_ARCHIVE:
+            strncpy(message, "ERROR: Job file is not a valid spreadsheet\n", UI_HINT_MAX_LEN);
+            break;
+        case ERR_PRINT_FAILED:
+            snprintf(message,
+                     UI_HINT_MAX_LEN,
+                     "ERROR: Printing failed - check the output of %s\n",
+                     BK_PRINT_CMD);
+            break;
+        case ERR_SQLITE:
+            strncpy(message,
+                    "ERROR: Could not read labels from the database – see the console for "
+                    "details\n",
+                    UI_HINT_MAX_LEN);
+            break;
+        case ERR_IMPORT_ROW:
+            strncpy(message,
+                    "ERROR: Job file contains an invalid row – see the console for details\n",
+                    UI_HINT_MAX_LEN);
+            break;
         default:
             snprintf(
                 message, UI_HINT_MAX_LEN, "UNKNOWN ERROR: Received unknown error code: %d\n", err);
@@ -351,18 +1064,29 @@ int ui_hint(int err) {
     return status;
 }
 
-int do_print(char * filename) {
-    int    status = SUCCESS;
-    char * active_text =
-        gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(printer_combo_box)); // freed by GTK
+int do_print(char * filename, bool is_prepared) {
+    int          status   = SUCCESS;
+    const char * previous = watchdog_enter(__func__);
+    char *       active_text =
+        gtk_combo_box_text_get_active_text(GTK_COMBO_BOX_TEXT(printer_combo_box));
 
-    if (active_text != NULL) {
+    // Without any printers, the only entry is a message and nothing was allocated to select
+    if (active_text != NULL && selected_printer != NULL) {
         strncpy(selected_printer, active_text, selected_printer_length);
-        status = bk_print(filename, selected_printer);
+        // Rows from an SQLite source may only be marked printed once the print is accepted, and
+        // the prepared output is removed by the next edit, so lp must have read it by then
+        if (db_source_open || is_prepared) {
+            status = bk_print_sync(filename, selected_printer, NULL, 0);
+        } else {
+            status = bk_print(filename, selected_printer);
+        }
     } else {
         status = ERR_GENERIC;
     }
 
+    g_free(active_text);
+    watchdog_leave(previous);
+
     return status;
 }
 
@@ -372,21 +1096,45 @@ int do_print(char * filename) {
 #pragma GCC diagnostic ignored "-Wunused-parameter"
 
 /**
- *      @details print_button_clicked() regenerates the PostScript output and calls do_print()
+ *      @details print_button_clicked() calls do_print() with the output prepared in the background
+ *              if it is ready, or otherwise regenerates the PostScript output first. The prepared
+ *              output is kept, so printing again without changes is also immediate. It is printed
+ *              with bk_print_sync(), as speculate_cancel() removes it as soon as anything changes.
  *      @see do_print()
  */
 void print_button_clicked(GtkButton * button, gpointer user_data) {
-    int    ps_status, ui_status, print_status;
-    char * print_file_dest = NULL;
-    ps_status              = refresh_postscript(&print_file_dest);
+    int          ps_status, ui_status, print_status;
+    char *       print_file_dest = NULL;
+    char *       print_file;
+    bool         print_prepared = prepared && NULL == db_path;
+    const char * previous       = watchdog_enter(__func__);
+
+    if (print_prepared) {
+        ps_status  = prepared_status;
+        print_file = prepared_path;
+    } else {
+        ps_status  = refresh_postscript(&print_file_dest);
+        print_file = print_file_dest;
+    }
 
     // Update UI hints based on output value
     ui_status = ui_hint(ps_status);
     if (SUCCESS == ps_status && SUCCESS == ui_status) {
-        print_status = do_print(print_file_dest);
+        print_status = do_print(print_file, print_prepared);
+        if (SUCCESS == print_status && db_source_open) {
+            ui_hint(bk_db_mark_printed(&db_source, db_mark));
+        } else if (SUCCESS != print_status) {
+            ui_hint(print_status);
+        }
+    }
+
+    if (db_source_open) {
+        bk_db_close(&db_source);
+        db_source_open = false;
     }
 
     free(print_file_dest);
+    watchdog_leave(previous);
 }
 
 /**
@@ -399,6 +1147,8 @@ void rows_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         page_layout->rows = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -412,6 +1162,8 @@ void cols_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         page_layout->cols = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -421,7 +1173,13 @@ void cols_changed(GtkEntry * entry, gpointer data) {
  *              barcodes and barcode quantities).
  */
 void units_changed(GtkComboBoxText * combo_box, gpointer data) {
-    strncpy(ps_properties.units, gtk_combo_box_text_get_active_text(combo_box), UNIT_ID_LEN);
+    char * units = gtk_combo_box_text_get_active_text(combo_box);
+    if (NULL != units) {
+        strncpy(ps_properties.units, units, UNIT_ID_LEN);
+        g_free(units);
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
+    }
 }
 
 /**
@@ -434,6 +1192,8 @@ void lmargin_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.lmargin = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -447,6 +1207,8 @@ void rmargin_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.rmargin = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -460,6 +1222,8 @@ void bmargin_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.bmargin = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -473,6 +1237,8 @@ void tmargin_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.tmargin = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -486,6 +1252,8 @@ void bar_width_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.bar_width = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -499,6 +1267,8 @@ void bar_height_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.bar_height = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -512,6 +1282,8 @@ void padding_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.padding = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -525,6 +1297,8 @@ void col_width_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.column_width = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
@@ -538,9 +1312,19 @@ void fsize_changed(GtkEntry * entry, gpointer data) {
     int    status = gtk_entry_get_text_as_double(entry, &value);
     if (status == SUCCESS) {
         ps_properties.fontsize = value;
+        preview_set_layout(&ps_properties, page_layout);
+        speculate_schedule();
     }
 }
 
+/**
+ *      @details The function is called when the 'value-changed' event is emitted. The scale is in
+ *              percent, of 72 pixels per inch.
+ */
+void preview_zoom_changed(GtkRange * range, gpointer data) {
+    preview_set_zoom(gtk_range_get_value(range) / 100);
+}
+
 /**
  *      @details The function is called when the 'value-changed' event is emitted. The spin button
  *              content needs to be polled and the barcode quantity updated.
@@ -554,12 +1338,14 @@ void spin_button_value_changed(GtkSpinButton * button, int * id) {
 
     // status in this case is the number of variables filled by sscanf()
     int status = sscanf(btn_name, BARCODE_SPIN_NAME, &_id);
-    if (status == 0) {
+    if (status != 1) {
         fprintf(stderr, "ERROR: sscanf failed on \"%s\"\n", btn_name);
-        return;
+    } else {
+        barcode_quantities[_id] = gtk_spin_button_get_value_as_int(button);
+        preview_entry(_id);
+        speculate_schedule();
     }
 
-    barcode_quantities[_id] = gtk_spin_button_get_value_as_int(button);
     free(btn_name);
 }
 
@@ -580,15 +1366,38 @@ int barcode_entry_focus_out(GtkEntry * entry, GdkEvent event, int * id) {
 
     // status in this case is the number of variables filled by sscanf()
     int status = sscanf(entry_name, BARCODE_ENTRY_NAME, &_id);
-    if (status == 0) {
+    if (status != 1) {
         fprintf(stderr, "sscanf failed on \"%s\"\n", entry_name);
+    } else {
+        strncpy(barcodes[_id], gtk_entry_get_text(entry), BK_BARCODE_LENGTH);
+        preview_entry(_id);
+        speculate_schedule();
     }
-    strncpy(barcodes[_id], gtk_entry_get_text(entry), BK_BARCODE_LENGTH);
 
     free(entry_name);
     return GDK_EVENT_PROPAGATE;
 }
 
+/**
+ *      @details barcode_entry_changed() is called on emission of the 'changed' event, so as each
+ *              character is typed. The barcode is read from the entry and its preview updated,
+ *              which redraws only that barcode's labels.
+ */
+void barcode_entry_changed(GtkEditable * editable, gpointer user_data) {
+    int          _id;
+    const char * entry_name = gtk_widget_get_name(GTK_WIDGET(editable));
+
+    // status in this case is the number of variables filled by sscanf()
+    int status = sscanf(entry_name, BARCODE_ENTRY_NAME, &_id);
+    if (status != 1) {
+        fprintf(stderr, "sscanf failed on \"%s\"\n", entry_name);
+    } else {
+        strncpy(barcodes[_id], gtk_entry_get_text(GTK_ENTRY(editable)), BK_BARCODE_LENGTH);
+        preview_entry(_id);
+        speculate_schedule();
+    }
+}
+
 /**
  *      @details new_barcode_btn_clicked() is responsible for creating a new barcode entry box and
  *              updating the UI and environment to reflect the new state.
@@ -601,6 +1410,7 @@ void new_barcode_btn_clicked(GtkButton * button, gpointer user_data) {
     }
 
     GtkWidget *barcode_box, *new_entry, *spin_btn;
+    const char * previous = watchdog_enter(__func__);
 
     // Adjustment settings for the spin button
     GtkAdjustment * adjustment;
@@ -627,6 +1437,7 @@ void new_barcode_btn_clicked(GtkButton * button, gpointer user_data) {
     gtk_entry_set_max_length(GTK_ENTRY(new_entry), BARCODE_ENTRY_MAX_LENGTH);
     // Connect event callbacks
     g_signal_connect(new_entry, "activate", G_CALLBACK(new_barcode_btn_clicked), NULL);
+    g_signal_connect(new_entry, "changed", G_CALLBACK(barcode_entry_changed), NULL);
     // clang-format off
     g_signal_connect(
         new_entry,
@@ -694,11 +1505,36 @@ void new_barcode_btn_clicked(GtkButton * button, gpointer user_data) {
     barcode_quantities[barcode_entry_id] = 1;
 
     barcode_entry_id++;
+    preview_set_num_items(imported_job.num_barcodes + barcode_entry_id);
+
+    watchdog_leave(previous);
 }
 
 #pragma GCC diagnostic pop
 
+/**
+ *      @details The statements are copied, as they may come from a command line passed from
+ *              another process.
+ */
+void ui_set_db_query(const char * query, const char * mark) {
+    g_free(db_query);
+    g_free(db_mark);
+    db_query = g_strdup(query);
+    db_mark  = g_strdup(mark);
+}
+
 void ui_cleanup(void) {
+    speculate_stop();
+    bk_context_free(&speculate_context);
     free(page_layout);
     free(selected_printer);
+    bk_job_free(&imported_job);
+    bk_arena_free(&refresh_arena);
+    preview_cleanup();
+    if (db_source_open) {
+        bk_db_close(&db_source);
+    }
+    g_free(db_path);
+    g_free(db_query);
+    g_free(db_mark);
 }
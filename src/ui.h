@@ -16,6 +16,8 @@
 
 #include "gtk/gtk.h"
 
+#include <stdbool.h>
+
 /*      @brief Index of the units flow box within the settings flow box */
 #define UNITS_BOX_IDX 0
 /*      @brief Index of the units combo box within the units flow box */
@@ -27,6 +29,12 @@
 /*      @brief Maximum length of a UI hint message */
 #define UI_HINT_MAX_LEN 256
 
+/*      @brief Time the inputs must be unchanged for before output is generated in the background */
+#define SPECULATE_IDLE_MS 400
+
+/*      @brief Application ID, under which the primary instance is registered on the session bus */
+#define BARCODE_APP_ID "org.eschutz.barcode"
+
 /*      @brief (Required by GTK) BarcodeApp type macro */
 #define BARCODE_TYPE_APP barcode_app_get_type()
 
@@ -48,12 +56,22 @@ static void barcode_app_activate(GApplication *);
 /*      @brief (Required by GTK) Open a BarcodeApp */
 static void barcode_app_open(GApplication *, GFile **, gint, const gchar *);
 
+/*      @brief (Required by GTK) Handle a command line, passed from this or another process */
+static int barcode_app_command_line(GApplication *, GApplicationCommandLine *);
+
 /*      @brief (Required by GTK) BarcodeApp class initialisation */
 static void barcode_app_class_init(BarcodeAppClass *);
 
 /*      @brief (Required by GTK) Create a new BarcodeApp */
 BarcodeApp * barcode_app_new(void);
 
+/**
+ *      @brief Check whether a primary instance of the application is running
+ *      @details A command line run while one is, is handled by that instance.
+ *      @return true if BARCODE_APP_ID is owned on the session bus
+ */
+bool ui_primary_running(void);
+
 /**
  *      @brief Refreshes the barcode PostScript with the latest data
  *      @param print_file_dest Double pointer to print file name buffer
@@ -79,9 +97,11 @@ int ui_hint(int);
 /**
  *      @brief Print a PostScript file
  *      @param ps_filename Pointer to the name of a PostScript file
+ *      @param is_prepared Whether the file is the output prepared in the background, which the
+ *              next edit removes, so that it is printed synchronously
  *      @return SUCCESS, TODO: fill out other return values
  */
-int do_print(char *);
+int do_print(char *, bool);
 
 /**
  *      @defgroup UICallbacks Event handlers (callbacks) corresponding to certain events on specific
@@ -217,6 +237,15 @@ void fsize_changed(GtkEntry *, gpointer);
  */
 void new_barcode_btn_clicked(GtkButton *, gpointer);
 
+/**
+ *      @brief Callback when the 'preview_zoom' scale is changed
+ *      @param range The GtkScale object corresponding to the 'preview_zoom' scale
+ *      @param data Supplemental data (unused)
+ *      @warning This function is called automatically by GTK, so should not be called directly. Use
+ *               g_signal_emit() instead.
+ */
+void preview_zoom_changed(GtkRange *, gpointer);
+
 /**
  *      @brief Callback when a spin button value is changed
  *      @param button The specific GtkSpinButton object
@@ -237,6 +266,15 @@ void spin_button_value_changed(GtkSpinButton *, int *);
  */
 int barcode_entry_focus_out(GtkEntry *, GdkEvent, int *);
 
+/**
+ *      @brief Callback when the text of a barcode entry is changed
+ *      @param editable The specific GtkEntry object
+ *      @param user_data Supplemental data (unused)
+ *      @warning This function is called automatically by GTK, so should not be called directly. Use
+ *               g_signal_emit() instead.
+ */
+void barcode_entry_changed(GtkEditable *, gpointer);
+
 /**
  *      @brief Callback when the print button is clicked
  *      @param button The print button object
@@ -247,6 +285,13 @@ int barcode_entry_focus_out(GtkEntry *, GdkEvent, int *);
 void print_button_clicked(GtkButton *, gpointer);
 /*@}*/
 
+/**
+ *      @brief Set the query and mark statement used for SQLite job sources opened in the UI
+ *      @param query Query yielding rows, or NULL for BK_DB_DEFAULT_QUERY
+ *      @param mark Statement marking a row printed, or NULL for BK_DB_DEFAULT_MARK
+ */
+void ui_set_db_query(const char *, const char *);
+
 /*      @brief Clean up any mess left from the UI */
 void ui_cleanup(void);
 
@@ -18,6 +18,7 @@
 
 #include <ctype.h>
 #include <stdbool.h>
+#include <string.h>
 
 // clang-format off
 const char barcode_entry_path[BARCODE_ENTRY_PATH_LENGTH][WIDGET_ID_MAXLEN]
@@ -37,6 +38,14 @@ const char page_layout_box_path[PAGE_LAYOUT_BOX_PATH_LENGTH][WIDGET_ID_MAXLEN]
 
 const char printer_combo_box_path[PRINTER_COMBO_BOX_PATH_LENGTH][WIDGET_ID_MAXLEN]
 = {"content_box", "right_box", "printer_box", "printer_combo_box"};
+
+const char preview_area_path[PREVIEW_AREA_PATH_LENGTH][WIDGET_ID_MAXLEN]
+    = {"content_box", "preview_box", "preview_pane", "preview_window", "preview_viewport",
+       "preview_area"};
+
+const char thumbnail_area_path[THUMBNAIL_AREA_PATH_LENGTH][WIDGET_ID_MAXLEN]
+    = {"content_box", "preview_box", "preview_pane", "thumbnail_window", "thumbnail_viewport",
+       "thumbnail_area"};
 // clang-format on
 
 /**
@@ -78,25 +87,25 @@ int gtk_widget_lookup_path(
 /**
  *      @details Linear search (a small number of children is expected) through the children of a
  *              GTK container. This is a linked list (GList): children->data contains the child
- *              widget, children->data contains the next child.
+ *              widget, children->next contains the next child.
  */
 int gtk_widget_query_name(GtkContainer * container, char * name, GtkWidget ** dest) {
+    // The list is newly allocated, though the widgets in it are not
     GList * children = gtk_container_get_children(container);
+    int     status   = ERR_WIDGET_NOT_FOUND;
 
-    do {
-        if (NULL == children) {
-            return ERR_WIDGET_NOT_FOUND;
-        }
-
-        GtkWidget * widget = children->data;
+    for (GList * child = children; NULL != child; child = child->next) {
+        GtkWidget * widget = child->data;
         if (strcmp(gtk_widget_get_name(widget), name) == 0) {
-            *dest = widget;
-            return SUCCESS;
-        } else {
-            children = children->next;
+            *dest  = widget;
+            status = SUCCESS;
+            break;
         }
+    }
 
-    } while (true);
+    g_list_free(children);
+
+    return status;
 }
 
 /**
@@ -119,48 +128,134 @@ int gtk_entry_get_text_as_double(GtkEntry * entry, double * dest) {
     return status;
 }
 
-/**
- *      @details Simple lexical analysis to verify if the input represents a decimal literal
- * matching
- *              @c /[0-9](.[0-9])?/
- */
-bool isfloat(char * str) {
-    bool decimal = false;
-    int  i       = 0;
-    while (str[i] != '\0') {
-        if (str[i] == '.') {
-            if (decimal) {
-                return false;
-            } else {
-                decimal = true;
+int cmd_line_parse(int argc, char ** argv, CmdLineOptions * options) {
+    memset(options, 0, sizeof *options);
+    options->first_file = 1;
+
+    if (argc > 1 && strcmp(argv[1], CMD_LINE_QUIET) == 0) {
+        options->quiet      = true;
+        options->first_file = 2;
+    }
+
+    while (options->first_file < argc && strncmp(argv[options->first_file], "--", 2) == 0) {
+        const char * opt   = argv[options->first_file];
+        const char * value = options->first_file + 1 < argc ? argv[options->first_file + 1] : NULL;
+
+        if (NULL == value) {
+            fprintf(stderr, "Error: %s requires a value\n", opt);
+            return ERR_INVALID_STRING;
+        } else if (strcmp(opt, CMD_LINE_PRINT_JOB) == 0) {
+            options->batch.path = value;
+        } else if (strcmp(opt, CMD_LINE_PRINTER) == 0) {
+            options->batch.printer = value;
+            options->spool.printer = value;
+            options->ring.printer  = value;
+        } else if (strcmp(opt, CMD_LINE_QUERY) == 0) {
+            options->batch.query  = value;
+            options->export.query = value;
+            options->images.query = value;
+        } else if (strcmp(opt, CMD_LINE_MARK) == 0) {
+            options->batch.mark = value;
+        } else if (strcmp(opt, CMD_LINE_WATCH) == 0) {
+            options->spool.dir = value;
+        } else if (strcmp(opt, CMD_LINE_JOBS) == 0) {
+            options->spool.workers         = atoi(value);
+            options->server.workers        = options->spool.workers;
+            options->export.workers        = options->spool.workers;
+            options->images.workers        = options->spool.workers;
+            options->server.render.workers = options->spool.workers;
+        } else if (strcmp(opt, CMD_LINE_DAEMON) == 0) {
+            options->server.socket_path = value;
+        } else if (strcmp(opt, CMD_LINE_RING) == 0) {
+            options->ring.name = value;
+        } else if (strcmp(opt, CMD_LINE_MEMORY_BUDGET) == 0) {
+            // Given in megabytes
+            options->batch.memory_budget = (size_t) atol(value) * 1024 * 1024;
+            options->spool.memory_budget = options->batch.memory_budget;
+        } else if (strcmp(opt, CMD_LINE_METRICS) == 0) {
+            options->metrics_path = value;
+        } else if (strcmp(opt, CMD_LINE_EXPORT) == 0) {
+            options->export.path = value;
+            options->images.path = value;
+        } else if (strcmp(opt, CMD_LINE_OUTPUT) == 0) {
+            options->export.output            = value;
+            options->server.render.output_dir = value;
+        } else if (strcmp(opt, CMD_LINE_DEVICE) == 0) {
+            options->export.device        = value;
+            options->server.render.device = value;
+        } else if (strcmp(opt, CMD_LINE_RESOLUTION) == 0) {
+            options->export.resolution        = atoi(value);
+            options->batch.thermal.dpi        = options->export.resolution;
+            options->images.resolution        = options->export.resolution;
+            options->server.render.resolution = options->export.resolution;
+        } else if (strcmp(opt, CMD_LINE_LANGUAGE) == 0) {
+            if (SUCCESS != bk_thermal_parse(value, &options->batch.thermal)) {
+                fprintf(stderr, "Error: unknown printer language \"%s\"\n", value);
+                return ERR_INVALID_STRING;
+            }
+        } else if (strcmp(opt, CMD_LINE_RASTER) == 0) {
+            options->batch.raster_dpi = atoi(value);
+        } else if (strcmp(opt, CMD_LINE_IMAGES) == 0) {
+            options->images.dir = value;
+        } else if (strcmp(opt, CMD_LINE_FORMAT) == 0) {
+            if (SUCCESS != bk_image_formats(value, &options->images.formats)) {
+                fprintf(stderr, "Error: unknown image format in \"%s\"\n", value);
+                return ERR_INVALID_STRING;
             }
-        } else if (!isdigit(str[i])) {
-            return false;
+        } else if (strcmp(opt, CMD_LINE_ARCHIVE) == 0) {
+            options->batch.archive = value;
+        } else {
+            fprintf(stderr, "Error: invalid command line option\n");
+            return ERR_INVALID_STRING;
         }
-        i++;
-    };
-    return true;
-}
+        options->first_file += 2;
+    }
 
-char * strstrip(char * str) {
-    size_t len = strlen(str) + 1;
-    
-    char * result = calloc(1, len);
-    VERIFY_NULL_BC(result, len);
-    strncpy(result, str, len);
-
-    int i = 0;
-    while (isspace(result[i++])); // Code golf!
-    result += i - 1;
-    
-    // Set the trailing chars to null while the end is whitespace
-    // The length must be adjusted as result has been shifted forward
-    // Note --i decrements, then returns, i
-    i = len - i;
-    while (isspace(result[--i])) {
-        result[i] = '\0';
+    if (NULL != options->batch.path && NULL == options->batch.printer) {
+        fprintf(stderr, "Error: %s requires %s\n", CMD_LINE_PRINT_JOB, CMD_LINE_PRINTER);
+        return ERR_INVALID_STRING;
     }
 
-    return result;
-}
+    if (NULL != options->batch.archive && NULL == options->batch.path) {
+        fprintf(stderr, "Error: %s requires %s\n", CMD_LINE_ARCHIVE, CMD_LINE_PRINT_JOB);
+        return ERR_INVALID_STRING;
+    }
+
+    if (NULL != options->images.dir && NULL == options->images.path
+        && NULL == options->batch.path) {
+        fprintf(stderr,
+                "Error: %s requires %s or %s\n",
+                CMD_LINE_IMAGES,
+                CMD_LINE_EXPORT,
+                CMD_LINE_PRINT_JOB);
+        return ERR_INVALID_STRING;
+    }
+
+    // Images of a printed job are exported from the same read of it
+    if (NULL != options->batch.path) {
+        options->batch.images = options->images;
+    }
 
+    if (NULL != options->export.path && NULL == options->export.output
+        && NULL == options->images.dir) {
+        fprintf(stderr, "Error: %s requires %s\n", CMD_LINE_EXPORT, CMD_LINE_OUTPUT);
+        return ERR_INVALID_STRING;
+    }
+
+    if (NULL != options->server.socket_path && NULL != options->server.render.device
+        && NULL == options->server.render.output_dir) {
+        fprintf(stderr,
+                "Error: %s with %s requires %s\n",
+                CMD_LINE_DEVICE,
+                CMD_LINE_DAEMON,
+                CMD_LINE_OUTPUT);
+        return ERR_INVALID_STRING;
+    }
+
+    if (NULL != options->spool.dir && NULL == options->spool.printer) {
+        fprintf(stderr, "Error: %s requires %s\n", CMD_LINE_WATCH, CMD_LINE_PRINTER);
+        return ERR_INVALID_STRING;
+    }
+
+    return SUCCESS;
+}
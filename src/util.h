@@ -14,8 +14,15 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include "batch.h"
+#include "daemon.h"
 #include "error.h"
+#include "gspool.h"
 #include "gtk/gtk.h"
+#include "images.h"
+#include "ring.h"
+#include "spool.h"
+#include "str.h"
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -38,6 +45,8 @@
 // Child of settings_box
 #define PAGE_LAYOUT_BOX_PATH_LENGTH 1
 #define PRINTER_COMBO_BOX_PATH_LENGTH 4
+#define PREVIEW_AREA_PATH_LENGTH    6
+#define THUMBNAIL_AREA_PATH_LENGTH  6
 /*@}*/
 
 /*      @brief Platform-dependent file separator */
@@ -52,6 +61,29 @@
 #define NUM_CMD_LINE_OPTS 3
 #define CMD_LINE_OPTS_LENGTH 16
 
+#define CMD_LINE_QUIET "--quiet"
+
+/*      @brief Command line options taking a value */
+#define CMD_LINE_PRINT_JOB "--print-job"
+#define CMD_LINE_PRINTER "--printer"
+#define CMD_LINE_QUERY "--query"
+#define CMD_LINE_MARK "--mark"
+#define CMD_LINE_WATCH "--watch"
+#define CMD_LINE_JOBS "--jobs"
+#define CMD_LINE_DAEMON "--daemon"
+#define CMD_LINE_RING "--ring"
+#define CMD_LINE_MEMORY_BUDGET "--memory-budget"
+#define CMD_LINE_METRICS "--metrics"
+#define CMD_LINE_EXPORT "--export"
+#define CMD_LINE_OUTPUT "--output"
+#define CMD_LINE_DEVICE "--device"
+#define CMD_LINE_RESOLUTION "--resolution"
+#define CMD_LINE_LANGUAGE "--language"
+#define CMD_LINE_RASTER "--raster"
+#define CMD_LINE_IMAGES "--images"
+#define CMD_LINE_FORMAT "--format"
+#define CMD_LINE_ARCHIVE "--archive"
+
 /*      @brief Utility macro for compile-time string length calculations (w/null terminator) */
 #define STRLEN(str) sizeof(str) / sizeof(char)
 
@@ -84,6 +116,22 @@
     } while (0);
 // clang-format on
 
+/**
+ *      @brief Options parsed from the command line by cmd_line_parse()
+ *      @details Arguments from @c first_file onwards are job files.
+ */
+typedef struct CmdLineOptions {
+    BKBatchOptions    batch;
+    BKSpoolOptions    spool;
+    BKDaemonOptions   server;
+    BKRingOptions     ring;
+    BKGsExportOptions export;
+    BKImageOptions    images;
+    const char *      metrics_path;
+    bool              quiet;
+    int               first_file;
+} CmdLineOptions;
+
 /**
  *      @defgroup UIPaths Constant paths used for looking up static widgets
  */
@@ -94,6 +142,8 @@ extern const char settings_box_path[SETTINGS_BOX_PATH_LENGTH][WIDGET_ID_MAXLEN];
 extern const char page_layout_box_path[PAGE_LAYOUT_BOX_PATH_LENGTH][WIDGET_ID_MAXLEN];
 extern const char ui_hint_view_path[UI_HINT_VIEW_PATH_LENGTH][WIDGET_ID_MAXLEN];
 extern const char printer_combo_box_path[PRINTER_COMBO_BOX_PATH_LENGTH][WIDGET_ID_MAXLEN];
+extern const char preview_area_path[PREVIEW_AREA_PATH_LENGTH][WIDGET_ID_MAXLEN];
+extern const char thumbnail_area_path[THUMBNAIL_AREA_PATH_LENGTH][WIDGET_ID_MAXLEN];
 /*@}*/
 
 /**
@@ -127,19 +177,14 @@ int gtk_widget_query_name(GtkContainer *, char *, GtkWidget **);
 int gtk_entry_get_text_as_double(GtkEntry *, double *);
 
 /**
- *      @brief Checks if a string represents a float
- *      @param str A string to be tested on
- *      @return true or false
- */
-bool isfloat(char *);
-
-/**
- *      @brief Strips the whitespace from the beginning and end of a string
- *      @param str A string to strip
- *      @return A stripped string
- *      @warning Memory is allocated to the return value in this function, so make sure you
- *               free() the return value once you're done.
+ *      @brief Parses --quiet and the command line options taking a value
+ *      @details Options which print a message and exit (--help etc.) are not handled here. Option
+ *               values point into @c argv.
+ *      @param argc Number of arguments
+ *      @param argv Arguments, the first being the program name
+ *      @param options Destination for the parsed options
+ *      @return ERR_INVALID_STRING (after printing the reason), SUCCESS
  */
-char * strstrip(char *);
+int cmd_line_parse(int, char **, CmdLineOptions *);
 
 #endif
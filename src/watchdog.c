@@ -0,0 +1,196 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file watchdog.c
+ *      @brief Main loop stall watchdog implementations as defined in watchdog.h
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ */
+
+#include "watchdog.h"
+
+#include "trace.h"
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Backtraces of another thread are taken by signalling it, so need execinfo.h and pthreads
+#if defined(__GLIBC__) || defined(__APPLE__)
+#define WATCHDOG_BACKTRACE 1
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*      @brief Iterations of the main loop, counted by the heartbeat */
+static gint beats;
+/*      @brief Name of the callback the main thread is running, or NULL */
+static gpointer current_callback;
+static gint     running;
+static guint    heartbeat;
+static GThread *watchdog_thread;
+static gint64   threshold_us;
+
+#ifdef WATCHDOG_BACKTRACE
+static pthread_t main_thread;
+static void *    frames[WATCHDOG_MAX_FRAMES];
+/*      @brief Frames captured by watchdog_signal(), or -1 while a capture is outstanding */
+static gint num_frames;
+
+/*      @brief Capture a backtrace of the thread receiving WATCHDOG_SIGNAL - the main thread */
+static void watchdog_signal(int sig) {
+    (void) sig;
+    g_atomic_int_set(&num_frames, backtrace(frames, WATCHDOG_MAX_FRAMES));
+}
+#endif
+
+static gboolean watchdog_beat(gpointer data) {
+    (void) data;
+    g_atomic_int_inc(&beats);
+    return G_SOURCE_CONTINUE;
+}
+
+/*      @brief Ask the main thread for its backtrace, without waiting for it */
+static void watchdog_capture(void) {
+#ifdef WATCHDOG_BACKTRACE
+    g_atomic_int_set(&num_frames, -1);
+    pthread_kill(main_thread, WATCHDOG_SIGNAL);
+#endif
+}
+
+/**
+ *      @param ongoing Whether the main loop is still stalled
+ *      @param with_backtrace Whether to print the backtrace captured when the stall was detected
+ */
+// clang-format off
+static void watchdog_report(
+    gint64 stall_us,
+    const char * callback,
+    bool ongoing,
+    bool with_backtrace
+) {
+    // clang-format on
+
+    fprintf(stderr,
+            "WARNING: main loop %s for %lld ms in %s\n",
+            ongoing ? "has been stalled" : "stalled",
+            (long long) (stall_us / 1000),
+            NULL != callback ? callback : "(no marked callback)");
+
+#ifdef WATCHDOG_BACKTRACE
+    int captured = g_atomic_int_get(&num_frames);
+    if (with_backtrace && captured > 0) {
+        fprintf(stderr, "Main thread backtrace once stalled:\n");
+        fflush(stderr);
+        backtrace_symbols_fd(frames, captured, STDERR_FILENO);
+    }
+#else
+    (void) with_backtrace;
+#endif
+}
+
+/**
+ *      @details The heartbeat is expected every threshold / WATCHDOG_RESOLUTION, and checked for as
+ *              often, so a loop iterating normally never appears stalled. A stall is timed from
+ *              when the heartbeat was last seen to when it is next seen, so is accurate to within
+ *              two checks.
+ */
+static gpointer watchdog_run(gpointer data) {
+    (void) data;
+
+    gint         last_beat   = g_atomic_int_get(&beats);
+    gint64       last_change = g_get_monotonic_time();
+    const char * callback    = NULL;
+    bool         stalled = false, reported = false;
+
+    bk_trace_thread_name("watchdog");
+
+    while (g_atomic_int_get(&running)) {
+        g_usleep(threshold_us / WATCHDOG_RESOLUTION);
+
+        gint   beat = g_atomic_int_get(&beats);
+        gint64 now  = g_get_monotonic_time();
+
+        if (beat != last_beat) {
+            if (stalled) {
+                watchdog_report(now - last_change, callback, false, !reported);
+            }
+            last_beat   = beat;
+            last_change = now;
+            stalled     = false;
+            reported    = false;
+        } else if (!stalled && now - last_change > threshold_us) {
+            stalled  = true;
+            callback = g_atomic_pointer_get(&current_callback);
+            watchdog_capture();
+        } else if (stalled && !reported && now - last_change > WATCHDOG_HANG_MS * 1000) {
+            watchdog_report(now - last_change, callback, true, true);
+            reported = true;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *      @details The heartbeat has a high priority, so that it is dispatched as soon as the main
+ *              loop next iterates rather than after other pending sources.
+ */
+void watchdog_start(void) {
+    const char * env       = getenv(WATCHDOG_ENV);
+    long         threshold = NULL != env ? atol(env) : WATCHDOG_DEFAULT_THRESHOLD;
+
+    if (threshold <= 0 || NULL != watchdog_thread) {
+        return;
+    }
+    threshold_us = threshold * 1000;
+
+#ifdef WATCHDOG_BACKTRACE
+    struct sigaction action;
+    void *           warmup[1];
+
+    main_thread = pthread_self();
+    // The first backtrace() loads the unwinder, which is not safe in a signal handler
+    backtrace(warmup, 1);
+
+    /* Interrupted reads and writes restart, but sleeps and polls return early with EINTR - which
+       GLib's own poll() already retries */
+    sigemptyset(&action.sa_mask);
+    action.sa_flags   = SA_RESTART;
+    action.sa_handler = watchdog_signal;
+    sigaction(WATCHDOG_SIGNAL, &action, NULL);
+#endif
+
+    g_atomic_int_set(&running, 1);
+    heartbeat = g_timeout_add_full(
+        G_PRIORITY_HIGH, threshold / WATCHDOG_RESOLUTION, watchdog_beat, NULL, NULL);
+    watchdog_thread = g_thread_new("watchdog", watchdog_run, NULL);
+}
+
+void watchdog_stop(void) {
+    if (NULL == watchdog_thread) {
+        return;
+    }
+
+    g_atomic_int_set(&running, 0);
+    g_source_remove(heartbeat);
+    g_thread_join(watchdog_thread);
+    watchdog_thread = NULL;
+}
+
+/*      @details Only the main thread sets the callback, so it need not be exchanged atomically */
+const char * watchdog_enter(const char * name) {
+    const char * previous = g_atomic_pointer_get(&current_callback);
+    g_atomic_pointer_set(&current_callback, (gpointer) name);
+    return previous;
+}
+
+void watchdog_leave(const char * previous) {
+    g_atomic_pointer_set(&current_callback, (gpointer) previous);
+}
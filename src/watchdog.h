@@ -0,0 +1,59 @@
+/* Copyright © 2019 Elijah Schutz */
+
+/* This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at https://mozilla.org/MPL/2.0/. */
+
+/*
+ *      @file watchdog.h
+ *      @brief Main loop stall watchdog declarations
+ *      @author Elijah Schutz
+ *      @date 18/10/26
+ *
+ *      A heartbeat source on the main loop counts its iterations, and a watchdog thread reports on
+ *      standard error whenever the count stops for longer than the threshold: how long the main
+ *      loop stalled, the user interface callback it was in (as marked by watchdog_enter()), and
+ *      where possible a backtrace of the main thread taken while it was stalled.
+ */
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "gtk/gtk.h"
+
+/**
+ *      @defgroup WatchdogProperties Watchdog properties
+ */
+/*@{*/
+// clang-format off
+// Stall threshold in milliseconds, overriding the default; 0 disables the watchdog
+#define WATCHDOG_ENV                "BARCODE_WATCHDOG_MS"
+#define WATCHDOG_DEFAULT_THRESHOLD  100
+// Heartbeats and checks per threshold
+#define WATCHDOG_RESOLUTION         4
+// Stalls are also reported while still in progress once this long
+#define WATCHDOG_HANG_MS            5000
+#define WATCHDOG_MAX_FRAMES         64
+#define WATCHDOG_SIGNAL             SIGUSR2
+// clang-format on
+/*@}*/
+
+/**
+ *      @brief Start watching the default main context
+ *      @details Must be called on the main thread.
+ */
+void watchdog_start(void);
+
+/*      @brief Stop watching, before the main loop stops running */
+void watchdog_stop(void);
+
+/**
+ *      @brief Mark the main thread as running a named callback, until watchdog_leave()
+ *      @param name Name of the callback, which must remain valid - a string constant or __func__
+ *      @return The callback previously being run, to pass to watchdog_leave()
+ */
+const char * watchdog_enter(const char *);
+
+void watchdog_leave(const char *);
+
+#endif
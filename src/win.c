@@ -65,6 +65,8 @@ static void barcode_window_class_init(BarcodeWindowClass * class) {
         GTK_WIDGET_CLASS(class), "barcode_entry_focus_out", G_CALLBACK(barcode_entry_focus_out));
     gtk_widget_class_bind_template_callback_full(
         GTK_WIDGET_CLASS(class), "print_button_clicked", G_CALLBACK(print_button_clicked));
+    gtk_widget_class_bind_template_callback_full(
+        GTK_WIDGET_CLASS(class), "preview_zoom_changed", G_CALLBACK(preview_zoom_changed));
 }
 
 BarcodeWindow * barcode_window_new(BarcodeApp * app) {
@@ -13,6 +13,7 @@
 #ifndef WIN_H
 #define WIN_H
 
+#include "backend.h"
 #include "gtk/gtk.h"
 #include "ui.h"
 
@@ -62,10 +63,10 @@
  *      @defgroup Defaults Default values for filling the UI
  */
 /*@{*/
-#define DEFAULT_WINSIZE_W   700
+#define DEFAULT_WINSIZE_W   1100
 #define DEFAULT_WINSIZE_H   480
-#define DEFAULT_COLS        2
-#define DEFAULT_ROWS        1
+#define DEFAULT_COLS        BK_DEFAULT_COLS
+#define DEFAULT_ROWS        BK_DEFAULT_ROWS
 #define DEFAULT_UNIT        UNIT_ID_MM
 /*@}*/
 // clang-format on
@@ -9,7 +9,7 @@ SET SDIR=src
 SET UIDIR=ui
 SET ODIR=build
 SET EXE_DIR=bin\%TARGET%
-SET SRC_FILES=ui win util backend resources main
+SET SRC_FILES=ui win util watchdog preview str alloc arena core backend job import sheet dbsource batch spool cache daemon ring gspool trace metrics probes modules pdf thermal raster scanline images fanout resources main
 
 SET INCLUDES_STR=/wd4068 /Iinclude /Iinclude\win
 